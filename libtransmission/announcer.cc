@@ -16,6 +16,7 @@
 #include <set>
 #include <string>
 #include <string_view>
+#include <tuple>
 #include <vector>
 
 #include <fmt/core.h>
@@ -106,6 +107,8 @@ struct StopsCompare
 
 // ---
 
+struct tr_tier;
+
 struct tr_scrape_info
 {
     int multiscrape_max;
@@ -162,6 +165,16 @@ public:
     void onAnnounceDone(int tier_id, tr_announce_event event, bool is_running_on_success, tr_announce_response const& response);
     void onScrapeDone(tr_scrape_response const& response);
 
+    // Tiers are kept in deadline order by their next announce and scrape
+    // times so that upkeep only needs to look at the ones that are due.
+    // Call these whenever a tier's `announceAt` or `scrapeAt` changes.
+    void scheduleAnnounce(tr_tier const& tier);
+    void scheduleScrape(tr_tier const& tier);
+
+    // Remove and return the tiers whose announce or scrape time has come.
+    [[nodiscard]] std::vector<tr_tier*> popDueAnnounces(time_t now);
+    [[nodiscard]] std::vector<tr_tier*> popDueScrapes(time_t now);
+
     [[nodiscard]] tr_scrape_info* scrape_info(tr_interned_string url)
     {
         if (std::empty(url))
@@ -239,12 +252,32 @@ private:
         stops_.clear();
     }
 
+    struct TierDeadline
+    {
+        time_t at;
+        tr_torrent_id_t tor_id;
+        int tier_id;
+
+        [[nodiscard]] constexpr bool operator<(TierDeadline const& that) const noexcept
+        {
+            return std::tie(at, tor_id, tier_id) < std::tie(that.at, that.tor_id, that.tier_id);
+        }
+    };
+
+    using Deadlines = std::set<TierDeadline>;
+
+    template<typename GetDeadline>
+    [[nodiscard]] std::vector<tr_tier*> popDue(Deadlines& deadlines, time_t now, GetDeadline get_deadline);
+
     static auto constexpr UpkeepInterval = 500ms;
 
     tr_announcer_udp& announcer_udp_;
 
     std::map<tr_interned_string, tr_scrape_info> scrape_info_;
 
+    Deadlines announce_deadlines_;
+    Deadlines scrape_deadlines_;
+
     std::unique_ptr<libtransmission::Timer> const upkeep_timer_;
 
     std::set<tr_announce_request, StopsCompare> stops_;
@@ -338,13 +371,17 @@ tr_interned_string tr_announcerGetKey(tr_url_parsed_t const& parsed)
 /** @brief A group of trackers in a single tier, as per the multitracker spec */
 struct tr_tier
 {
-    tr_tier(tr_announcer_impl* announcer, tr_torrent* tor_in, std::vector<tr_announce_list::tracker_info const*> const& infos)
-        : tor{ tor_in }
+    tr_tier(
+        tr_announcer_impl* announcer_in,
+        tr_torrent* tor_in,
+        std::vector<tr_announce_list::tracker_info const*> const& infos)
+        : announcer{ announcer_in }
+        , tor{ tor_in }
     {
         trackers.reserve(std::size(infos));
         for (auto const* info : infos)
         {
-            trackers.emplace_back(announcer, *info);
+            trackers.emplace_back(announcer_in, *info);
         }
         useNextTracker();
         scrapeSoon();
@@ -416,6 +453,9 @@ struct tr_tier
         lastAnnounceStartTime = 0;
         lastScrapeStartTime = 0;
 
+        // the new tracker may be scrapable even if the old one wasn't
+        announcer->scheduleScrape(*this);
+
         return currentTracker();
     }
 
@@ -465,6 +505,7 @@ struct tr_tier
     void scheduleNextScrape(time_t interval_secs)
     {
         this->scrapeAt = getNextScrapeTime(tor->session, this, interval_secs);
+        announcer->scheduleScrape(*this);
     }
 
     std::deque<tr_announce_event> announce_events;
@@ -480,6 +521,7 @@ struct tr_tier
 
     std::optional<size_t> current_tracker_index_;
 
+    tr_announcer_impl* const announcer;
     tr_torrent* const tor;
 
     time_t scrapeAt = 0;
@@ -639,6 +681,67 @@ private:
     }
 };
 
+// ---
+
+void tr_announcer_impl::scheduleAnnounce(tr_tier const& tier)
+{
+    tier.tor->markRpcChanged(); // for `trackerStats`
+
+    if (tier.announceAt != 0)
+    {
+        announce_deadlines_.insert(TierDeadline{ tier.announceAt, tier.tor->id(), tier.id });
+    }
+}
+
+void tr_announcer_impl::scheduleScrape(tr_tier const& tier)
+{
+    tier.tor->markRpcChanged(); // for `trackerStats`
+
+    if (tier.scrapeAt != 0)
+    {
+        scrape_deadlines_.insert(TierDeadline{ tier.scrapeAt, tier.tor->id(), tier.id });
+    }
+}
+
+// Entries are never updated in place. A tier that gets rescheduled just
+// gets a new entry, and the old one is dropped here when it comes due
+// and no longer matches the tier's deadline. The same goes for entries
+// whose torrent was removed or whose tiers were rebuilt.
+template<typename GetDeadline>
+std::vector<tr_tier*> tr_announcer_impl::popDue(Deadlines& deadlines, time_t now, GetDeadline get_deadline)
+{
+    auto due = std::vector<tr_tier*>{};
+
+    auto const begin = std::begin(deadlines);
+    auto const end = deadlines.upper_bound(TierDeadline{ now, INT_MAX, INT_MAX });
+    for (auto it = begin; it != end; ++it)
+    {
+        auto* const tor = session->torrents().get(it->tor_id);
+        if (tor == nullptr || tor->torrent_announcer == nullptr)
+        {
+            continue;
+        }
+
+        if (auto* const tier = tor->torrent_announcer->getTier(it->tier_id); tier != nullptr && get_deadline(*tier) == it->at)
+        {
+            due.push_back(tier);
+        }
+    }
+
+    deadlines.erase(begin, end);
+    return due;
+}
+
+std::vector<tr_tier*> tr_announcer_impl::popDueAnnounces(time_t now)
+{
+    return popDue(announce_deadlines_, now, [](tr_tier const& tier) { return tier.announceAt; });
+}
+
+std::vector<tr_tier*> tr_announcer_impl::popDueScrapes(time_t now)
+{
+    return popDue(scrape_deadlines_, now, [](tr_tier const& tier) { return tier.scrapeAt; });
+}
+
 // --- PUBLISH
 
 namespace
@@ -830,6 +933,7 @@ void tier_announce_event_push(tr_tier* tier, tr_announce_event e, time_t announc
     events.push_back(e);
     tier->announceAt = announce_at;
     tier_update_announce_priority(tier);
+    tier->announcer->scheduleAnnounce(*tier);
 
     tr_logAddTrace_tier_announce_queue(tier);
     tr_logAddTraceTier(tier, fmt::format("announcing in {} seconds", difftime(announce_at, tr_time())));
@@ -1002,6 +1106,7 @@ void tr_announcer_impl::onAnnounceDone(
     tier->lastAnnounceTimedOut = response.did_timeout;
     tier->lastAnnounceSucceeded = false;
     tier->isAnnouncing = false;
+    tier->tor->markRpcChanged();
     tier->manualAnnounceAllowedAt = now + tier->announceMinIntervalSec;
 
     if (response.external_ip)
@@ -1339,6 +1444,7 @@ void tr_announcer_impl::onScrapeDone(tr_scrape_response const& response)
         tier->lastScrapeTime = now;
         tier->lastScrapeSucceeded = false;
         tier->lastScrapeTimedOut = response.did_timeout;
+        tier->tor->markRpcChanged();
 
         if (!response.did_connect)
         {
@@ -1436,6 +1542,7 @@ void multiscrape(tr_announcer_impl* announcer, std::vector<tr_tier*> const& tier
             ++req->info_hash_count;
             tier->isScraping = true;
             tier->lastScrapeStartTime = now;
+            tier->tor->markRpcChanged();
             found = true;
         }
 
@@ -1450,6 +1557,7 @@ void multiscrape(tr_announcer_impl* announcer, std::vector<tr_tier*> const& tier
             ++req->info_hash_count;
             tier->isScraping = true;
             tier->lastScrapeStartTime = now;
+            tier->tor->markRpcChanged();
 
             ++request_count;
         }
@@ -1527,6 +1635,13 @@ void tierAnnounce(tr_announcer_impl* announcer, tr_tier* tier)
 
     tier->isAnnouncing = true;
     tier->lastAnnounceStartTime = now;
+    tor->markRpcChanged();
+
+    // if more events are queued, send them as soon as this one is done
+    if (!std::empty(tier->announce_events))
+    {
+        announcer->scheduleAnnounce(*tier);
+    }
 
     auto tier_id = tier->id;
     auto is_running_on_success = tor->isRunning;
@@ -1546,22 +1661,33 @@ void scrapeAndAnnounceMore(tr_announcer_impl* announcer)
 {
     auto const now = tr_time();
 
-    /* build a list of tiers that need to be announced */
-    auto announce_me = std::vector<tr_tier*>{};
+    /* build a list of tiers that need to be scraped. Tiers that are due
+     * but busy with a scrape or announce are put back in the queue so
+     * that we can look at them again in the next upkeep. */
     auto scrape_me = std::vector<tr_tier*>{};
-    for (auto* const tor : announcer->session->torrents())
+    for (auto* const tier : announcer->popDueScrapes(now))
     {
-        for (auto& tier : tor->torrent_announcer->tiers)
+        if (tier->needsToScrape(now))
         {
-            if (tier.needsToAnnounce(now))
-            {
-                announce_me.push_back(&tier);
-            }
+            scrape_me.push_back(tier);
+        }
+        else if (tier->isScraping)
+        {
+            announcer->scheduleScrape(*tier);
+        }
+    }
 
-            if (tier.needsToScrape(now))
-            {
-                scrape_me.push_back(&tier);
-            }
+    /* build a list of tiers that need to be announced */
+    auto announce_me = std::vector<tr_tier*>{};
+    for (auto* const tier : announcer->popDueAnnounces(now))
+    {
+        if (tier->needsToAnnounce(now))
+        {
+            announce_me.push_back(tier);
+        }
+        else if (!std::empty(tier->announce_events))
+        {
+            announcer->scheduleAnnounce(*tier);
         }
     }
 
@@ -1571,6 +1697,15 @@ void scrapeAndAnnounceMore(tr_announcer_impl* announcer)
      * us which swarms are interesting and should be announced next. */
     multiscrape(announcer, scrape_me);
 
+    // requeue any that didn't fit in this upkeep's requests
+    for (auto* const tier : scrape_me)
+    {
+        if (!tier->isScraping)
+        {
+            announcer->scheduleScrape(*tier);
+        }
+    }
+
     /* Second, announce what we can. If there aren't enough slots
      * available, use compareAnnounceTiers to prioritize. */
     if (announce_me.size() > MaxAnnouncesPerUpkeep)
@@ -1580,6 +1715,12 @@ void scrapeAndAnnounceMore(tr_announcer_impl* announcer)
             std::begin(announce_me) + MaxAnnouncesPerUpkeep,
             std::end(announce_me),
             [](auto const* a, auto const* b) { return compareAnnounceTiers(a, b) < 0; });
+
+        // the rest stay due until there's room for them
+        std::for_each(
+            std::begin(announce_me) + MaxAnnouncesPerUpkeep,
+            std::end(announce_me),
+            [announcer](auto const* tier) { announcer->scheduleAnnounce(*tier); });
         announce_me.resize(MaxAnnouncesPerUpkeep);
     }
 
@@ -1596,6 +1737,7 @@ void tr_announcer_impl::upkeep()
 {
     using namespace upkeep_helpers;
 
+    auto const timer = session->perfStats().time("announcer.upkeep"sv);
     auto const lock = session->unique_lock();
 
     // maybe send out some "stopped" messages for closed torrents
@@ -4,15 +4,15 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
-#include <utility> // for std::swap()
+#include <limits>
+#include <utility> // for std::move()
 #include <vector>
 
-#include <fmt/core.h>
+#include <fmt/format.h>
 
 #include "transmission.h"
 
 #include "bandwidth.h"
-#include "crypto-utils.h"
 #include "log.h"
 #include "peer-io.h"
 #include "tr-assert.h"
@@ -133,12 +133,34 @@ void tr_bandwidth::setParent(tr_bandwidth* new_parent)
 
 // ---
 
+namespace
+{
+namespace scheduler_helpers
+{
+// Value of 3000 bytes chosen so that when using µTP we'll send a full-size
+// frame right away and leave enough buffered data for the next frame to go
+// out in a timely manner.
+auto constexpr MinQuantum = size_t{ 3000U };
+
+// When nothing above a node is limited, fairness doesn't matter much because
+// the peers are only limited by their sockets. Use bigger slices to keep the
+// number of rounds down.
+auto constexpr UnlimitedQuantum = size_t{ 16U } * MinQuantum;
+
+auto constexpr Unlimited = std::numeric_limits<size_t>::max();
+} // namespace scheduler_helpers
+} // namespace
+
+// Gathers the peers in this subtree into `peer_pool` and resets each node's
+// round robin state. Subtrees that ignore their parent's limits are scheduled
+// on their own, so they're added to `roots` instead of to their parent's queue.
 void tr_bandwidth::allocateBandwidth(
     tr_priority_t parent_priority,
     unsigned int period_msec,
-    std::vector<std::shared_ptr<tr_peerIo>>& peer_pool)
+    std::vector<std::shared_ptr<tr_peerIo>>& peer_pool,
+    std::array<std::vector<tr_bandwidth*>, 2>& roots)
 {
-    auto const priority = std::max(parent_priority, this->priority_);
+    effective_priority_ = std::max(parent_priority, this->priority_);
 
     // set the available bandwidth
     for (auto const dir : { TR_UP, TR_DOWN })
@@ -150,100 +172,218 @@ void tr_bandwidth::allocateBandwidth(
         }
     }
 
+    for (auto& sched : sched_)
+    {
+        sched.active.clear();
+        sched.active_weight = 0U;
+        sched.deficit = 0U;
+        sched.peer_deficit = 0U;
+        sched.peer_active = false;
+        sched.stats = {};
+    }
+
     // add this bandwidth's peer, if any, to the peer pool
+    pulse_peer_ = nullptr;
     if (auto shared = this->peer_.lock(); shared)
     {
-        shared->set_priority(priority);
+        shared->set_priority(effective_priority_);
+        pulse_peer_ = shared.get();
         peer_pool.push_back(std::move(shared));
     }
 
+    if (pulse_peer_ != nullptr)
+    {
+        for (auto& sched : sched_)
+        {
+            sched.active.push_back(this);
+            sched.active_weight += weight();
+            sched.peer_active = true;
+        }
+    }
+
     // traverse & repeat for the subtree
     for (auto* child : this->children_)
     {
-        child->allocateBandwidth(priority, period_msec, peer_pool);
+        child->allocateBandwidth(effective_priority_, period_msec, peer_pool, roots);
+
+        for (auto const dir : { TR_UP, TR_DOWN })
+        {
+            if (std::empty(child->sched_[dir].active))
+            {
+                continue;
+            }
+
+            if (child->band_[dir].honor_parent_limits_)
+            {
+                sched_[dir].active.push_back(child);
+                sched_[dir].active_weight += child->weight();
+            }
+            else
+            {
+                roots[dir].push_back(child);
+            }
+        }
+    }
+
+    for (auto& sched : sched_)
+    {
+        sched.stats.queued = std::size(sched.active);
+    }
+}
+
+size_t tr_bandwidth::weight() const noexcept
+{
+    // High-priority peers used to get three passes per pulse,
+    // normal-priority ones two, and low-priority ones one.
+    switch (effective_priority_)
+    {
+    case TR_PRI_HIGH:
+        return 3U;
+
+    case TR_PRI_NORMAL:
+        return 2U;
+
+    default:
+        return 1U;
+    }
+}
+
+bool tr_bandwidth::hasWork(tr_direction dir) const noexcept
+{
+    auto const& band = band_[dir];
+    return !std::empty(sched_[dir].active) && (!band.is_limited_ || band.bytes_left_ > 0U);
+}
+
+size_t tr_bandwidth::servePeer(tr_direction dir, size_t budget)
+{
+    TR_ASSERT(pulse_peer_ != nullptr);
+
+    auto const used = pulse_peer_->flush(dir, budget);
+    tr_logAddTrace(fmt::format("peer {} used {} of {} bytes", fmt::ptr(pulse_peer_), used, budget));
+
+    // if it didn't use all of it, it's done for this pulse
+    if (used < budget)
+    {
+        sched_[dir].peer_active = false;
     }
+
+    return used;
 }
 
-void tr_bandwidth::phaseOne(std::vector<tr_peerIo*>& peers, tr_direction dir)
+// Lets this subtree do up to `budget` bytes of I/O, taking turns among
+// the children (and own peer) that still have I/O to do.
+// @return the number of bytes used
+size_t tr_bandwidth::serve(tr_direction dir, size_t budget)
 {
-    // First phase of IO. Tries to distribute bandwidth fairly to keep faster
-    // peers from starving the others.
-    tr_logAddTrace(fmt::format("{} peers to go round-robin for {}", peers.size(), dir == TR_UP ? "upload" : "download"));
+    using namespace scheduler_helpers;
 
-    // Shuffle the peers so they all have equal chance to be first in line.
-    thread_local auto urbg = tr_urbg<size_t>{};
-    std::shuffle(std::begin(peers), std::end(peers), urbg);
+    auto& sched = sched_[dir];
+    auto& active = sched.active;
 
-    // Give each peer `Increment` bandwidth bytes to use. Repeat this
-    // process until we run out of bandwidth and/or peers that can use it.
-    for (size_t n_unfinished = std::size(peers); n_unfinished > 0U;)
+    if (auto const& band = band_[dir]; band.is_limited_)
     {
-        for (size_t i = 0; i < n_unfinished;)
+        budget = std::min(budget, band.bytes_left_);
+    }
+
+    auto const is_unlimited = budget == Unlimited;
+    auto used = size_t{};
+    auto quantum = size_t{};
+    auto turns_left_in_round = size_t{};
+    while (used < budget && !std::empty(active))
+    {
+        auto const remaining = budget - used;
+
+        if (turns_left_in_round == 0U)
         {
-            // Value of 3000 bytes chosen so that when using µTP we'll send a full-size
-            // frame right away and leave enough buffered data for the next frame to go
-            // out in a timely manner.
-            static auto constexpr Increment = size_t{ 3000 };
+            // Size this round's slices so that what's left of the budget
+            // gets shared out among the active entries in about one round,
+            // by weight. Keep the size fixed for the whole round so that
+            // entries later in the round don't get smaller slices.
+            quantum = is_unlimited ? UnlimitedQuantum : std::max(MinQuantum, remaining / sched.active_weight);
+            turns_left_in_round = std::size(active);
+        }
 
-            auto const bytes_used = peers[i]->flush(dir, Increment);
-            tr_logAddTrace(fmt::format("peer #{} of {} used {} bytes in this pass", i, n_unfinished, bytes_used));
+        sched.cursor %= std::size(active);
+        auto* const entry = active[sched.cursor];
+        auto const is_own_peer = entry == this;
+        auto& deficit = is_own_peer ? sched.peer_deficit : entry->sched_[dir].deficit;
 
-            if (bytes_used != Increment)
-            {
-                // peer is done writing for now; move it to the end of the list
-                std::swap(peers[i], peers[n_unfinished - 1]);
-                --n_unfinished;
-            }
-            else
-            {
-                ++i;
-            }
+        // a new turn gets a new quantum of credit
+        if (deficit == 0U)
+        {
+            deficit = quantum * entry->weight();
+            ++sched.stats.turns;
+        }
+
+        auto const want = std::min(deficit, remaining);
+        auto const got = is_own_peer ? servePeer(dir, want) : entry->serve(dir, want);
+        deficit -= std::min(deficit, got);
+        used += got;
+
+        if (is_own_peer ? !sched.peer_active : !entry->hasWork(dir))
+        {
+            // it's done for this pulse. Swap-remove it; the order of the
+            // remaining entries changes, but deterministically.
+            sched.active_weight -= entry->weight();
+            active[sched.cursor] = active.back();
+            active.pop_back();
+            deficit = 0U;
+            --turns_left_in_round;
+        }
+        else if (deficit == 0U || got < want)
+        {
+            // it's used up its credit for this turn; move on to the next one
+            deficit = 0U;
+            ++sched.cursor;
+            --turns_left_in_round;
+        }
+        else
+        {
+            // we ran out of budget partway through its turn;
+            // it'll pick up where it left off next time
+            break;
         }
     }
+
+    sched.stats.bytes_served += used;
+    return used;
 }
 
 void tr_bandwidth::allocate(unsigned int period_msec)
 {
+    using namespace scheduler_helpers;
+
     // keep these peers alive for the scope of this function
     auto refs = std::vector<std::shared_ptr<tr_peerIo>>{};
 
-    auto peer_arrays = std::array<std::vector<tr_peerIo*>, 3>{};
-    auto& high = peer_arrays[0];
-    auto& normal = peer_arrays[1];
-    auto& low = peer_arrays[2];
-
     // allocateBandwidth () is a helper function with two purposes:
     // 1. allocate bandwidth to b and its subtree
     // 2. accumulate an array of all the peerIos from b and its subtree.
-    this->allocateBandwidth(TR_PRI_LOW, period_msec, refs);
+    auto roots = std::array<std::vector<tr_bandwidth*>, 2>{};
+    this->allocateBandwidth(TR_PRI_LOW, period_msec, refs, roots);
 
     for (auto const& io : refs)
     {
         io->flush_outgoing_protocol_msgs();
+    }
 
-        switch (io->priority())
+    // First phase of IO. Hand out the bandwidth a slice at a time, taking
+    // turns so that faster peers can't starve the others. Keep going until
+    // we run out of bandwidth and/or peers that can use it.
+    for (auto const dir : { TR_UP, TR_DOWN })
+    {
+        roots[dir].push_back(this);
+        for (auto* const root : roots[dir])
         {
-        case TR_PRI_HIGH:
-            high.push_back(io.get());
-            [[fallthrough]];
-
-        case TR_PRI_NORMAL:
-            normal.push_back(io.get());
-            [[fallthrough]];
-
-        default:
-            low.push_back(io.get());
+            root->serve(dir, Unlimited);
         }
-    }
 
-    // First phase of IO. Tries to distribute bandwidth fairly to keep faster
-    // peers from starving the others. Loop through the peers, giving each a
-    // small chunk of bandwidth. Keep looping until we run out of bandwidth
-    // and/or peers that can use it
-    for (auto& peers : peer_arrays)
-    {
-        phaseOne(peers, TR_UP);
-        phaseOne(peers, TR_DOWN);
+        tr_logAddTrace(fmt::format(
+            "{} peers took {} turns to {} {} bytes",
+            std::size(refs),
+            sched_[dir].stats.turns,
+            dir == TR_UP ? "upload" : "download",
+            sched_[dir].stats.bytes_served));
     }
 
     // Second phase of IO. To help us scale in high bandwidth situations,
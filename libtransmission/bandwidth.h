@@ -73,6 +73,18 @@ struct tr_bandwidth_limits
  *   The peer-ios all have a pointer to their associated `tr_bandwidth` object,
  *   and call `tr_bandwidth::clamp()` before performing I/O to see how much
  *   bandwidth they can safely use.
+ *
+ * SCHEDULING
+ *
+ *   Within each `allocate()` pulse, bandwidth is handed out by deficit round
+ *   robin at every level of the tree: each node takes turns among its children
+ *   (and its own peer, if any) that still have I/O to do, giving each a slice
+ *   proportional to its priority: 3 for high, 2 for normal, and 1 for low.
+ *   So siblings share by weight instead of higher priorities going first, and
+ *   a torrent's share doesn't depend on how many peers it has. A node with a
+ *   speed limit sizes the slices so that its budget is shared out in about one
+ *   round. The turn order carries over from one pulse to the next, so every
+ *   peer gets to go first in turn.
  */
 struct tr_bandwidth
 {
@@ -231,6 +243,29 @@ public:
 
     void setLimits(tr_bandwidth_limits const* limits);
 
+    // How the last `allocate()` pulse went for this node.
+    struct SchedulerStats
+    {
+        // number of children (and own peer) that had I/O to do at the start of the pulse
+        size_t queued = 0;
+
+        // bytes of I/O done by this subtree during the pulse
+        size_t bytes_served = 0;
+
+        // number of turns handed out to children (and own peer)
+        size_t turns = 0;
+
+        // unspent credit this node had left in its parent's round at the end of the pulse
+        size_t credit = 0;
+    };
+
+    [[nodiscard]] constexpr auto schedulerStats(tr_direction dir) const noexcept
+    {
+        auto stats = sched_[dir].stats;
+        stats.credit = sched_[dir].deficit;
+        return stats;
+    }
+
 private:
     struct RateControl
     {
@@ -264,18 +299,52 @@ private:
 
     [[nodiscard]] size_t clamp(uint64_t now, tr_direction dir, size_t byte_count) const;
 
-    static void phaseOne(std::vector<tr_peerIo*>& peers, tr_direction dir);
+    // deficit round robin state for one direction
+    struct Scheduler
+    {
+        // children with I/O to do. May also hold `this`, standing in for this node's own peer
+        std::vector<tr_bandwidth*> active;
+
+        // whose turn it is in `active`
+        size_t cursor = 0;
+
+        // how much this node may still use in its parent's current round
+        size_t deficit = 0;
+
+        // how much this node's own peer may still use in this node's current round
+        size_t peer_deficit = 0;
+
+        // sum of `active`'s weights
+        size_t active_weight = 0;
+
+        // true if this node's own peer is in `active`
+        bool peer_active = false;
+
+        SchedulerStats stats;
+    };
 
     void allocateBandwidth(
         tr_priority_t parent_priority,
         unsigned int period_msec,
-        std::vector<std::shared_ptr<tr_peerIo>>& peer_pool);
+        std::vector<std::shared_ptr<tr_peerIo>>& peer_pool,
+        std::array<std::vector<tr_bandwidth*>, 2>& roots);
+
+    [[nodiscard]] size_t weight() const noexcept;
+
+    [[nodiscard]] bool hasWork(tr_direction dir) const noexcept;
+
+    size_t serve(tr_direction dir, size_t budget);
+
+    size_t servePeer(tr_direction dir, size_t budget);
 
     mutable std::array<Band, 2> band_ = {};
+    std::array<Scheduler, 2> sched_ = {};
     std::vector<tr_bandwidth*> children_;
     tr_bandwidth* parent_ = nullptr;
     std::weak_ptr<tr_peerIo> peer_;
+    tr_peerIo* pulse_peer_ = nullptr; // `peer_`, kept alive by `allocate()` for the duration of the pulse
     tr_priority_t priority_ = 0;
+    tr_priority_t effective_priority_ = 0; // the higher of this node's priority and its parent's
 };
 
 /* @} */
@@ -5,8 +5,13 @@
 
 #include <algorithm>
 #include <array>
+#include <cstdint>
+#include <ctime>
 #include <fstream>
+#include <memory>
+#include <optional>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 #include <fmt/core.h>
@@ -210,43 +215,12 @@ std::optional<address_range_t> parseLine(std::string_view line)
 }
 } // namespace ParseHelpers
 
-auto parseFile(std::string_view filename)
+// Sorts `ranges` by start address and merges overlapping ranges.
+void sortAndMerge(std::vector<address_range_t>& ranges)
 {
-    using namespace ParseHelpers;
-
-    auto ranges = std::vector<address_range_t>{};
-
-    auto in = std::ifstream{ tr_pathbuf{ filename } };
-    if (!in.is_open())
-    {
-        tr_logAddWarn(fmt::format(
-            _("Couldn't read '{path}': {error} ({error_code})"),
-            fmt::arg("path", filename),
-            fmt::arg("error", tr_strerror(errno)),
-            fmt::arg("error_code", errno)));
-        return ranges;
-    }
-
-    auto line = std::string{};
-    auto line_number = size_t{ 0U };
-    while (std::getline(in, line))
-    {
-        ++line_number;
-        if (auto range = parseLine(line); range && (range->first.type == range->second.type))
-        {
-            ranges.push_back(*range);
-        }
-        else
-        {
-            // don't try to display the actual lines - it causes issues
-            tr_logAddWarn(fmt::format(_("Couldn't parse line: '{line}'"), fmt::arg("line", line_number)));
-        }
-    }
-    in.close();
-
     if (std::empty(ranges))
     {
-        return ranges;
+        return;
     }
 
     // safeguard against some joker swapping the begin & end ranges
@@ -288,7 +262,43 @@ auto parseFile(std::string_view filename)
         TR_ASSERT(ranges[i - 1].second < ranges[i].first);
     }
 #endif
+}
 
+auto parseFile(std::string_view filename)
+{
+    using namespace ParseHelpers;
+
+    auto ranges = std::vector<address_range_t>{};
+
+    auto in = std::ifstream{ tr_pathbuf{ filename } };
+    if (!in.is_open())
+    {
+        tr_logAddWarn(fmt::format(
+            _("Couldn't read '{path}': {error} ({error_code})"),
+            fmt::arg("path", filename),
+            fmt::arg("error", tr_strerror(errno)),
+            fmt::arg("error_code", errno)));
+        return ranges;
+    }
+
+    auto line = std::string{};
+    auto line_number = size_t{ 0U };
+    while (std::getline(in, line))
+    {
+        ++line_number;
+        if (auto range = parseLine(line); range && (range->first.type == range->second.type))
+        {
+            ranges.push_back(*range);
+        }
+        else
+        {
+            // don't try to display the actual lines - it causes issues
+            tr_logAddWarn(fmt::format(_("Couldn't parse line: '{line}'"), fmt::arg("line", line_number)));
+        }
+    }
+    in.close();
+
+    sortAndMerge(ranges);
     return ranges;
 }
 
@@ -316,42 +326,38 @@ auto getFilenamesInDir(std::string_view folder)
     return files;
 }
 
-} // namespace
-
-void Blocklist::ensureLoaded() const
+// Reads a .bin file's rules, rebuilding it from its source file if it's unusable.
+std::vector<address_range_t> readBinFile(std::string_view bin_file)
 {
-    if (!std::empty(rules_))
-    {
-        return;
-    }
+    auto ranges = std::vector<address_range_t>{};
 
     // get the file's size
     tr_error* error = nullptr;
-    auto const file_info = tr_sys_path_get_info(bin_file_, 0, &error);
+    auto const file_info = tr_sys_path_get_info(bin_file, 0, &error);
     if (error != nullptr)
     {
         tr_logAddWarn(fmt::format(
             _("Couldn't read '{path}': {error} ({error_code})"),
-            fmt::arg("path", bin_file_),
+            fmt::arg("path", bin_file),
             fmt::arg("error", error->message),
             fmt::arg("error_code", error->code)));
         tr_error_clear(&error);
     }
     if (!file_info)
     {
-        return;
+        return ranges;
     }
 
     // open the file
-    auto in = std::ifstream{ bin_file_, std::ios_base::in | std::ios_base::binary };
+    auto in = std::ifstream{ tr_pathbuf{ bin_file }, std::ios_base::in | std::ios_base::binary };
     if (!in)
     {
         tr_logAddWarn(fmt::format(
             _("Couldn't read '{path}': {error} ({error_code})"),
-            fmt::arg("path", bin_file_),
+            fmt::arg("path", bin_file),
             fmt::arg("error", tr_strerror(errno)),
             fmt::arg("error_code", errno)));
-        return;
+        return ranges;
     }
 
     // check to see if the file is usable
@@ -375,114 +381,356 @@ void Blocklist::ensureLoaded() const
     {
         // bad binary file; try to rebuild it
         in.close();
-        if (auto const sz_src_file = std::string{ std::data(bin_file_), std::size(bin_file_) - std::size(BinFileSuffix) };
+        if (auto const sz_src_file = std::string{ std::data(bin_file), std::size(bin_file) - std::size(BinFileSuffix) };
             tr_sys_path_exists(sz_src_file))
         {
-            rules_ = parseFile(sz_src_file);
-            if (!std::empty(rules_))
+            ranges = parseFile(sz_src_file);
+            if (!std::empty(ranges))
             {
                 tr_logAddInfo(_("Rewriting old blocklist file format to new format"));
-                tr_sys_path_remove(bin_file_);
-                save(bin_file_, std::data(rules_), std::size(rules_));
+                tr_sys_path_remove(tr_pathbuf{ bin_file });
+                save(bin_file, std::data(ranges), std::size(ranges));
             }
         }
-        return;
+        return ranges;
     }
 
-    auto range = address_range_t{};
-    rules_.reserve(file_info->size - std::size(BinContentsPrefix) / sizeof(address_range_t));
-    while (in.read(reinterpret_cast<char*>(&range), sizeof(range)))
-    {
-        rules_.emplace_back(range);
-    }
+    ranges.resize((file_info->size - std::size(BinContentsPrefix)) / sizeof(address_range_t));
+    in.read(reinterpret_cast<char*>(std::data(ranges)), std::size(ranges) * sizeof(address_range_t));
+    ranges.resize(in.gcount() / sizeof(address_range_t));
 
     tr_logAddInfo(fmt::format(
-        tr_ngettext("Blocklist '{path}' has {count} entry", "Blocklist '{path}' has {count} entries", std::size(rules_)),
-        fmt::arg("path", tr_sys_path_basename(bin_file_)),
-        fmt::arg("count", std::size(rules_))));
+        tr_ngettext("Blocklist '{path}' has {count} entry", "Blocklist '{path}' has {count} entries", std::size(ranges)),
+        fmt::arg("path", tr_sys_path_basename(bin_file)),
+        fmt::arg("count", std::size(ranges))));
+
+    return ranges;
 }
 
-std::vector<Blocklist> Blocklist::loadBlocklists(std::string_view const blocklist_dir, bool const is_enabled)
+// ---
+
+namespace IndexHelpers
 {
-    // check for files that need to be updated
-    for (auto const& src_file : getFilenamesInDir(blocklist_dir))
+// The merged index lives alongside the blocklists. Its name starts with
+// a dot so that loadBlocklists() doesn't mistake it for a blocklist.
+auto constexpr IndexFilename = std::string_view{ ".blocklist-index" };
+
+// A string at the beginning of index files to make sure we don't map incompatible files.
+// It's 24 bytes long so that the header and ranges that follow it are aligned.
+auto constexpr IndexContentsPrefix = std::string_view{ "-tr-blocklist-index-v01-" };
+
+struct IndexHeader
+{
+    uint64_t fingerprint; // of the blocklists that the index was built from
+    uint64_t n_ipv4;
+    uint64_t n_ipv6;
+};
+
+using Ipv4Range = BlocklistIndex::Ipv4Range;
+using Ipv6Range = BlocklistIndex::Ipv6Range;
+
+static_assert(std::size(IndexContentsPrefix) % alignof(IndexHeader) == 0);
+static_assert(sizeof(IndexHeader) % alignof(Ipv4Range) == 0);
+static_assert(sizeof(Ipv4Range) % alignof(Ipv6Range) == 0);
+
+// Identifies the set of blocklists that an index was built from.
+// The .bin files are only ever rewritten wholesale, so names & sizes are enough
+// to notice additions and removals; edits are caught by comparing timestamps.
+uint64_t getFingerprint(std::vector<Blocklist> const& blocklists)
+{
+    auto hash = uint64_t{ 0xcbf29ce484222325ULL }; // 64-bit FNV-1a
+    auto const mix = [&hash](void const* data, size_t len)
     {
-        if (tr_strvEndsWith(src_file, BinFileSuffix))
+        auto const* const bytes = static_cast<unsigned char const*>(data);
+        for (size_t i = 0; i < len; ++i)
         {
-            continue;
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ULL;
         }
+    };
 
-        // ensure this src_file has an up-to-date corresponding bin_file
-        auto const src_info = tr_sys_path_get_info(src_file);
-        auto const bin_file = tr_pathbuf{ src_file, BinFileSuffix };
-        auto const bin_info = tr_sys_path_get_info(bin_file);
-        auto const bin_needs_update = src_info && (!bin_info || bin_info->last_modified_at <= src_info->last_modified_at);
-        if (bin_needs_update)
+    for (auto const& blocklist : blocklists)
+    {
+        auto const name = tr_sys_path_basename(blocklist.binFile());
+        auto const info = tr_sys_path_get_info(blocklist.binFile());
+        auto const size = info ? info->size : uint64_t{};
+        mix(std::data(name), std::size(name));
+        mix(&size, sizeof(size));
+    }
+
+    return hash;
+}
+
+[[nodiscard]] bool isNewerThanIndex(std::vector<Blocklist> const& blocklists, time_t index_mtime)
+{
+    return std::any_of(
+        std::begin(blocklists),
+        std::end(blocklists),
+        [index_mtime](auto const& blocklist)
         {
-            if (auto const ranges = parseFile(src_file); !std::empty(ranges))
-            {
-                save(bin_file, std::data(ranges), std::size(ranges));
-            }
+            auto const info = tr_sys_path_get_info(blocklist.binFile());
+            return !info || info->last_modified_at >= index_mtime;
+        });
+}
+
+// Lays out sorted `ranges` in Eytzinger order: ranges[0] is the root of an
+// implicit binary search tree and the children of the node at 1-based
+// position k are at positions 2k and 2k+1.
+template<typename Range>
+std::vector<Range> toEytzinger(std::vector<Range> const& sorted)
+{
+    auto ranges = std::vector<Range>(std::size(sorted));
+    auto pos = size_t{};
+
+    auto const fill = [&](auto const& self, size_t k) -> void
+    {
+        if (k <= std::size(ranges))
+        {
+            self(self, 2 * k);
+            ranges[k - 1] = sorted[pos++];
+            self(self, 2 * k + 1);
         }
+    };
+    fill(fill, 1);
+
+    return ranges;
+}
+
+// Finds the first range that ends at or after `key` and checks whether it
+// also starts at or before it. Since the ranges don't overlap, no other
+// range can hold `key`.
+template<typename Range, typename Key>
+[[nodiscard]] bool eytzingerContains(Range const* ranges, size_t n_ranges, Key const& key) noexcept
+{
+    auto k = size_t{ 1 };
+    while (k <= n_ranges)
+    {
+        k = 2 * k + (ranges[k - 1].end < key ? 1 : 0);
     }
 
-    auto ret = std::vector<Blocklist>{};
-    for (auto const& bin_file : getFilenamesInDir(blocklist_dir))
+    // walk back up past the right turns. `k` is then the 1-based
+    // position of the lower bound, or 0 if every range ends before `key`
+    while ((k & 1) != 0)
     {
-        if (tr_strvEndsWith(bin_file, BinFileSuffix))
+        k >>= 1;
+    }
+    k >>= 1;
+
+    return k != 0 && !(key < ranges[k - 1].begin);
+}
+
+[[nodiscard]] Ipv4Range toIpv4Range(address_range_t const& range) noexcept
+{
+    return { ntohl(range.first.addr.addr4.s_addr), ntohl(range.second.addr.addr4.s_addr) };
+}
+
+[[nodiscard]] Ipv6Range toIpv6Range(address_range_t const& range) noexcept
+{
+    auto ret = Ipv6Range{};
+    std::copy_n(range.first.addr.addr6.s6_addr, std::size(ret.begin), std::begin(ret.begin));
+    std::copy_n(range.second.addr.addr6.s6_addr, std::size(ret.end), std::begin(ret.end));
+    return ret;
+}
+
+template<typename T>
+void append(std::vector<char>& contents, T const* items, size_t n_items)
+{
+    auto const* const begin = reinterpret_cast<char const*>(items);
+    contents.insert(std::end(contents), begin, begin + n_items * sizeof(T));
+}
+
+// Merges the rules of every blocklist and serializes them in index file format.
+std::vector<char> compileIndex(std::vector<Blocklist> const& blocklists, uint64_t fingerprint)
+{
+    auto all_ranges = std::vector<address_range_t>{};
+    for (auto const& blocklist : blocklists)
+    {
+        auto const ranges = readBinFile(blocklist.binFile());
+        all_ranges.insert(std::end(all_ranges), std::begin(ranges), std::end(ranges));
+    }
+    sortAndMerge(all_ranges);
+
+    auto ipv4 = std::vector<Ipv4Range>{};
+    auto ipv6 = std::vector<Ipv6Range>{};
+    for (auto const& range : all_ranges)
+    {
+        if (range.first.is_ipv4())
         {
-            ret.emplace_back(bin_file, is_enabled);
+            ipv4.emplace_back(toIpv4Range(range));
+        }
+        else
+        {
+            ipv6.emplace_back(toIpv6Range(range));
         }
     }
-    return ret;
+
+    ipv4 = toEytzinger(ipv4);
+    ipv6 = toEytzinger(ipv6);
+
+    auto const header = IndexHeader{ fingerprint, std::size(ipv4), std::size(ipv6) };
+    auto contents = std::vector<char>{};
+    contents.reserve(
+        std::size(IndexContentsPrefix) + sizeof(header) + std::size(ipv4) * sizeof(Ipv4Range) +
+        std::size(ipv6) * sizeof(Ipv6Range));
+    append(contents, std::data(IndexContentsPrefix), std::size(IndexContentsPrefix));
+    append(contents, &header, 1);
+    append(contents, std::data(ipv4), std::size(ipv4));
+    append(contents, std::data(ipv6), std::size(ipv6));
+    return contents;
 }
 
-bool Blocklist::contains(tr_address const& addr) const
+// Writes to a temporary file that's renamed into place
+// so that a half-written index never gets mapped.
+bool saveIndex(std::string_view filename, std::vector<char> const& contents)
 {
-    TR_ASSERT(addr.is_valid());
+    auto const tmp_file = tr_pathbuf{ filename, ".tmp"sv };
+
+    auto out = std::ofstream{ tmp_file, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary };
+    auto saved = out.is_open() && out.write(std::data(contents), std::size(contents));
+    out.close();
+    saved = saved && !out.fail();
+
+    if (!saved)
+    {
+        tr_logAddWarn(fmt::format(
+            _("Couldn't save '{path}': {error} ({error_code})"),
+            fmt::arg("path", filename),
+            fmt::arg("error", tr_strerror(errno)),
+            fmt::arg("error_code", errno)));
+        tr_sys_path_remove(tmp_file);
+        return false;
+    }
 
-    if (!is_enabled_)
+    tr_error* error = nullptr;
+    if (!tr_sys_path_rename(tmp_file, tr_pathbuf{ filename }, &error))
     {
+        tr_logAddWarn(fmt::format(
+            _("Couldn't save '{path}': {error} ({error_code})"),
+            fmt::arg("path", filename),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        tr_error_clear(&error);
+        tr_sys_path_remove(tmp_file);
         return false;
     }
 
-    ensureLoaded();
+    return true;
+}
 
-    struct Compare
+// @return the file's contents mapped into memory, or nullptr
+std::shared_ptr<void const> mapFile(std::string_view filename, size_t* setme_size)
+{
+    auto const info = tr_sys_path_get_info(filename);
+    if (!info || info->size == 0U)
     {
-        [[nodiscard]] static auto compare(tr_address const& a, address_range_t const& b) noexcept // <=>
-        {
-            if (a < b.first)
-            {
-                return -1;
-            }
-            if (b.second < a)
-            {
-                return 1;
-            }
-            return 0;
-        }
+        return {};
+    }
+
+    auto const fd = tr_sys_file_open(tr_pathbuf{ filename }, TR_SYS_FILE_READ, 0);
+    if (fd == TR_BAD_SYS_FILE)
+    {
+        return {};
+    }
+
+    tr_error* error = nullptr;
+    auto const size = info->size;
+    auto* const data = tr_sys_file_map_for_reading(fd, 0, size, &error);
+    tr_sys_file_close(fd);
+    if (data == nullptr)
+    {
+        tr_logAddWarn(fmt::format(
+            _("Couldn't read '{path}': {error} ({error_code})"),
+            fmt::arg("path", filename),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        tr_error_clear(&error);
+        return {};
+    }
+
+    *setme_size = size;
+    return { data, [size](void const* mapped) { tr_sys_file_unmap(mapped, size); } };
+}
+
+[[nodiscard]] std::optional<IndexHeader> getHeader(void const* contents, size_t size)
+{
+    if (contents == nullptr || size < std::size(IndexContentsPrefix) + sizeof(IndexHeader))
+    {
+        return {};
+    }
+
+    auto const* const bytes = static_cast<char const*>(contents);
+    if (std::string_view{ bytes, std::size(IndexContentsPrefix) } != IndexContentsPrefix)
+    {
+        return {};
+    }
+
+    auto header = IndexHeader{};
+    std::copy_n(bytes + std::size(IndexContentsPrefix), sizeof(header), reinterpret_cast<char*>(&header));
+
+    auto const expected_size = std::size(IndexContentsPrefix) + sizeof(header) + header.n_ipv4 * sizeof(Ipv4Range) +
+        header.n_ipv6 * sizeof(Ipv6Range);
+    if (size != expected_size)
+    {
+        return {};
+    }
+
+    return header;
+}
+} // namespace IndexHelpers
+
+} // namespace
+
+// ---
 
-        [[nodiscard]] static auto compare(address_range_t const& a, tr_address const& b) noexcept // <=>
+size_t Blocklist::size() const
+{
+    if (!size_)
+    {
+        auto const info = tr_sys_path_get_info(bin_file_);
+        size_ = info && info->size > std::size(BinContentsPrefix) ?
+            (info->size - std::size(BinContentsPrefix)) / sizeof(address_range_t) :
+            size_t{};
+    }
+
+    return *size_;
+}
+
+std::vector<Blocklist> Blocklist::loadBlocklists(std::string_view const blocklist_dir)
+{
+    // check for files that need to be updated
+    for (auto const& src_file : getFilenamesInDir(blocklist_dir))
+    {
+        if (tr_strvEndsWith(src_file, BinFileSuffix))
         {
-            return -compare(b, a);
+            continue;
         }
 
-        [[nodiscard]] auto operator()(address_range_t const& a, tr_address const& b) const noexcept // <
+        // ensure this src_file has an up-to-date corresponding bin_file
+        auto const src_info = tr_sys_path_get_info(src_file);
+        auto const bin_file = tr_pathbuf{ src_file, BinFileSuffix };
+        auto const bin_info = tr_sys_path_get_info(bin_file);
+        auto const bin_needs_update = src_info && (!bin_info || bin_info->last_modified_at <= src_info->last_modified_at);
+        if (bin_needs_update)
         {
-            return compare(a, b) < 0;
+            if (auto const ranges = parseFile(src_file); !std::empty(ranges))
+            {
+                save(bin_file, std::data(ranges), std::size(ranges));
+            }
         }
+    }
 
-        [[nodiscard]] auto operator()(tr_address const& a, address_range_t const& b) const noexcept // <
+    auto ret = std::vector<Blocklist>{};
+    for (auto const& bin_file : getFilenamesInDir(blocklist_dir))
+    {
+        if (tr_strvEndsWith(bin_file, BinFileSuffix))
         {
-            return compare(a, b) < 0;
+            ret.emplace_back(bin_file);
         }
-    };
-
-    return std::binary_search(std::begin(rules_), std::end(rules_), addr, Compare{});
+    }
+    return ret;
 }
 
-std::optional<Blocklist> Blocklist::saveNew(std::string_view external_file, std::string_view bin_file, bool is_enabled)
+std::optional<Blocklist> Blocklist::saveNew(std::string_view external_file, std::string_view bin_file)
 {
     // if we can't parse the file, do nothing
     auto rules = parseFile(external_file);
@@ -512,10 +760,92 @@ std::optional<Blocklist> Blocklist::saveNew(std::string_view external_file, std:
 
     save(bin_file, std::data(rules), std::size(rules));
 
-    // return a new Blocklist with these rules
-    auto ret = Blocklist{ bin_file, is_enabled };
-    ret.rules_ = std::move(rules);
+    // return a new Blocklist for these rules
+    auto ret = Blocklist{ bin_file };
+    ret.size_ = std::size(rules);
+    return ret;
+}
+
+// ---
+
+BlocklistIndex BlocklistIndex::load(std::string_view blocklist_dir, std::vector<Blocklist> const& blocklists)
+{
+    using namespace IndexHelpers;
+
+    auto const index_file = tr_pathbuf{ blocklist_dir, '/', IndexFilename };
+
+    if (std::empty(blocklists))
+    {
+        tr_sys_path_remove(index_file);
+        return {};
+    }
+
+    // use the existing index if it's up-to-date
+    auto const fingerprint = getFingerprint(blocklists);
+    if (auto const index_info = tr_sys_path_get_info(index_file);
+        index_info && !isNewerThanIndex(blocklists, index_info->last_modified_at))
+    {
+        auto size = size_t{};
+        auto mapping = mapFile(index_file, &size);
+        if (auto const header = getHeader(mapping.get(), size); header && header->fingerprint == fingerprint)
+        {
+            return fromContents(std::move(mapping), size);
+        }
+    }
+
+    // build a new one
+    auto contents = std::make_shared<std::vector<char>>(compileIndex(blocklists, fingerprint));
+    if (saveIndex(index_file, *contents))
+    {
+        auto size = size_t{};
+        if (auto mapping = mapFile(index_file, &size); getHeader(mapping.get(), size))
+        {
+            return fromContents(std::move(mapping), size);
+        }
+    }
+
+    // couldn't map it; fall back to keeping it on the heap
+    auto const size = std::size(*contents);
+    auto const* const data = std::data(*contents);
+    return fromContents(std::shared_ptr<void const>{ std::move(contents), data }, size);
+}
+
+BlocklistIndex BlocklistIndex::fromContents(std::shared_ptr<void const> contents, size_t size)
+{
+    using namespace IndexHelpers;
+
+    auto const header = getHeader(contents.get(), size);
+    if (!header)
+    {
+        return {};
+    }
+
+    auto const* const bytes = static_cast<char const*>(contents.get());
+    auto const* const ranges = bytes + std::size(IndexContentsPrefix) + sizeof(IndexHeader);
+
+    auto ret = BlocklistIndex{};
+    ret.n_ipv4_ = header->n_ipv4;
+    ret.ipv4_ = reinterpret_cast<Ipv4Range const*>(ranges);
+    ret.n_ipv6_ = header->n_ipv6;
+    ret.ipv6_ = reinterpret_cast<Ipv6Range const*>(ranges + ret.n_ipv4_ * sizeof(Ipv4Range));
+    ret.mapping_ = std::move(contents);
     return ret;
 }
 
+bool BlocklistIndex::contains(tr_address const& addr) const noexcept
+{
+    using namespace IndexHelpers;
+
+    TR_ASSERT(addr.is_valid());
+
+    if (addr.is_ipv4())
+    {
+        return eytzingerContains(ipv4_, n_ipv4_, ntohl(addr.addr.addr4.s_addr));
+    }
+
+    auto key = std::array<uint8_t, 16>{};
+    std::copy_n(addr.addr.addr6.s6_addr, std::size(key), std::begin(key));
+    return eytzingerContains(ipv6_, n_ipv6_, key);
+}
+
 } // namespace libtransmission
@@ -9,10 +9,13 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <array>
+#include <cstddef> // for size_t
+#include <cstdint> // for uint8_t, uint32_t
+#include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
-#include <utility> // for std::pair
 #include <vector>
 
 #include "net.h" // for tr_address
@@ -22,52 +25,81 @@ struct tr_address;
 namespace libtransmission
 {
 
+// One blocklist source file, e.g. "level1", and its pre-parsed ".bin" file.
+// Lookups don't go through here; see BlocklistIndex.
 class Blocklist
 {
 public:
-    [[nodiscard]] static std::vector<Blocklist> loadBlocklists(std::string_view const blocklist_dir, bool const is_enabled);
+    [[nodiscard]] static std::vector<Blocklist> loadBlocklists(std::string_view const blocklist_dir);
 
-    static std::optional<Blocklist> saveNew(std::string_view external_file, std::string_view bin_file, bool is_enabled);
+    static std::optional<Blocklist> saveNew(std::string_view external_file, std::string_view bin_file);
 
     Blocklist() = default;
 
-    Blocklist(std::string_view bin_file, bool is_enabled)
+    explicit Blocklist(std::string_view bin_file)
         : bin_file_{ bin_file }
-        , is_enabled_{ is_enabled }
     {
     }
 
-    [[nodiscard]] bool contains(tr_address const& addr) const;
+    // number of rules in the .bin file
+    [[nodiscard]] size_t size() const;
 
-    [[nodiscard]] auto size() const
+    [[nodiscard]] constexpr auto const& binFile() const noexcept
     {
-        ensureLoaded();
-
-        return std::size(rules_);
+        return bin_file_;
     }
 
-    [[nodiscard]] constexpr bool enabled() const noexcept
+private:
+    mutable std::optional<size_t> size_;
+
+    std::string bin_file_;
+};
+
+// All the blocklists' rules merged into one index with separate IPv4 and
+// IPv6 tables. The index is compiled to a file in the blocklist directory
+// and memory-mapped from there, so it costs page cache instead of heap and
+// is only rebuilt when one of the blocklists changes.
+//
+// Each table is a sorted, non-overlapping list of ranges stored in
+// Eytzinger (breadth-first) order, so a lookup is one branch-light descent
+// whose first few levels all sit in the same handful of cache lines.
+class BlocklistIndex
+{
+public:
+    BlocklistIndex() = default;
+
+    [[nodiscard]] static BlocklistIndex load(std::string_view blocklist_dir, std::vector<Blocklist> const& blocklists);
+
+    [[nodiscard]] bool contains(tr_address const& addr) const noexcept;
+
+    // number of merged ranges
+    [[nodiscard]] constexpr auto size() const noexcept
     {
-        return is_enabled_;
+        return n_ipv4_ + n_ipv6_;
     }
 
-    void setEnabled(bool is_enabled) noexcept
+    struct Ipv4Range
     {
-        is_enabled_ = is_enabled;
-    }
+        uint32_t begin; // host byte order
+        uint32_t end;
+    };
 
-    [[nodiscard]] constexpr auto const& binFile() const noexcept
+    struct Ipv6Range
     {
-        return bin_file_;
-    }
+        std::array<uint8_t, 16> begin; // network byte order
+        std::array<uint8_t, 16> end;
+    };
 
 private:
-    void ensureLoaded() const;
+    [[nodiscard]] static BlocklistIndex fromContents(std::shared_ptr<void const> contents, size_t size);
 
-    mutable std::vector<std::pair<tr_address, tr_address>> rules_;
+    std::shared_ptr<void const> mapping_;
 
-    std::string bin_file_;
-    bool is_enabled_ = false;
+    Ipv4Range const* ipv4_ = nullptr;
+    size_t n_ipv4_ = 0;
+
+    Ipv6Range const* ipv6_ = nullptr;
+    size_t n_ipv6_ = 0;
 };
 
 } // namespace libtransmission
@@ -16,104 +16,152 @@
 
 #include "transmission.h"
 #include "cache.h"
+#include "disk-io.h"
 #include "inout.h"
 #include "log.h"
 #include "torrent.h"
 #include "torrents.h"
 #include "tr-assert.h"
-#include "utils.h" // tr_time(), tr_formatter
+#include "utils.h" // tr_formatter
 
 Cache::Key Cache::makeKey(tr_torrent const* torrent, tr_block_info::Location loc) noexcept
 {
     return std::make_pair(torrent->id(), loc.block);
 }
 
-std::pair<Cache::CIter, Cache::CIter> Cache::findContiguous(CIter const begin, CIter const end, CIter const iter) noexcept
+std::pair<Cache::Iter, Cache::Iter> Cache::findContiguous(Iter const begin, Iter const end, Iter const iter) noexcept
 {
     if (iter == end)
     {
         return std::make_pair(end, end);
     }
 
+    // cap the span's length so that joining its blocks doesn't need a huge buffer
+    auto n_blocks = size_t{ 1U };
+
     auto span_begin = iter;
-    for (auto key = iter->key;;)
+    for (auto key = iter->first; span_begin != begin && n_blocks < MaxSpanBlocks; ++n_blocks)
     {
-        if (span_begin == begin)
-        {
-            break;
-        }
-
         --key.second;
         auto const prev = std::prev(span_begin);
-        if (prev->key != key)
+        if (prev->first != key)
         {
             break;
         }
+
+        span_begin = prev;
     }
 
     auto span_end = std::next(iter);
-    for (auto key = iter->key;;)
+    for (auto key = iter->first; span_end != end && n_blocks < MaxSpanBlocks; ++n_blocks)
     {
-        if (span_end == end)
-        {
-            break;
-        }
-
         ++key.second;
-        if (span_end->key != key)
+        if (span_end->first != key)
         {
             break;
         }
+
+        ++span_end;
     }
 
     return std::make_pair(span_begin, span_end);
 }
 
-int Cache::writeContiguous(CIter const begin, CIter const end) const
+bool Cache::writeContiguous(Iter const begin, Iter const end, bool wait)
 {
-    // The most common case without an extra data copy.
-    auto const* towrite = begin->buf.get();
+    auto const [torrent_id, block] = begin->first;
+    auto* const tor = torrents_.get(torrent_id);
+    if (tor == nullptr)
+    {
+        return true; // nowhere to save them
+    }
 
-    // Contiguous area to join more than one block, if any.
-    auto buf = std::vector<uint8_t>{};
+    if (!wait && !disk_io_.hasRoom(torrent_id))
+    {
+        return false;
+    }
+
+    // The most common case without an extra data copy.
+    auto towrite = std::shared_ptr<std::vector<uint8_t>>{};
+    auto const n_blocks = static_cast<tr_block_index_t>(std::distance(begin, end));
 
-    if (end - begin > 1)
+    if (n_blocks > 1)
     {
-        // Yes, there are.
+        // Contiguous area to join more than one block.
         auto const buflen = std::accumulate(
             begin,
             end,
             size_t{},
-            [](size_t sum, auto const& block) { return sum + std::size(*block.buf); });
-        buf.reserve(buflen);
+            [](size_t sum, auto const& entry) { return sum + std::size(*entry.second.buf); });
+        towrite = std::make_shared<std::vector<uint8_t>>();
+        towrite->reserve(buflen);
         for (auto iter = begin; iter != end; ++iter)
         {
-            TR_ASSERT(begin->key.first == iter->key.first);
-            TR_ASSERT(begin->key.second + std::distance(begin, iter) == iter->key.second);
-            buf.insert(std::end(buf), std::begin(*iter->buf), std::end(*iter->buf));
+            TR_ASSERT(begin->first.first == iter->first.first);
+            TR_ASSERT(begin->first.second + std::distance(begin, iter) == iter->first.second);
+            towrite->insert(std::end(*towrite), std::begin(*iter->second.buf), std::end(*iter->second.buf));
+            recycleBuffer(std::move(iter->second.buf));
         }
-        TR_ASSERT(std::size(buf) == buflen);
-        towrite = &buf;
+        TR_ASSERT(std::size(*towrite) == buflen);
+    }
+    else
+    {
+        towrite = std::move(begin->second.buf);
     }
 
-    // save it
-    auto const& [torrent_id, block] = begin->key;
-    auto* const tor = torrents_.get(torrent_id);
-    if (tor == nullptr)
+    ++disk_writes_;
+    disk_write_bytes_ += std::size(*towrite);
+
+    // Keep the data readable until it's on disk.
+    auto const span_id = next_span_id_++;
+    flushing_.push_back({ span_id, torrent_id, block, block + n_blocks, towrite });
+
+    // a copy of these pieces read from disk before now is stale
+    if (!std::empty(read_index_) || !std::empty(loading_))
     {
-        return EINVAL;
+        auto const first_piece = tor->blockLoc(block).piece;
+        auto const last_piece = tor->blockLoc(block + n_blocks - 1U).piece;
+        dropReadPieces({ torrent_id, first_piece }, { torrent_id, last_piece + 1U });
     }
 
-    auto const loc = tor->blockLoc(block);
+    // save it
+    disk_io_.write(
+        tor,
+        tor->blockLoc(block),
+        std::move(towrite),
+        [this, span_id, tor_id = torrent_id](int err, tr_file_index_t failed_file)
+        { onSpanWritten(span_id, tor_id, err, failed_file); });
+    return true;
+}
+
+void Cache::onSpanWritten(uint64_t span_id, tr_torrent_id_t tor_id, int err, tr_file_index_t failed_file)
+{
+    if (auto const span = std::find_if(
+            std::begin(flushing_),
+            std::end(flushing_),
+            [span_id](auto const& candidate) { return candidate.id == span_id; });
+        span != std::end(flushing_))
+    {
+        // reuse single-block buffers for new incoming blocks
+        if (span->end - span->begin == 1U && span->buf.use_count() == 1)
+        {
+            recycleBuffer(std::make_unique<std::vector<uint8_t>>(std::move(*span->buf)));
+        }
+
+        flushing_.erase(span);
+    }
 
-    if (auto const err = tr_ioWrite(tor, loc, std::size(*towrite), std::data(*towrite)); err != 0)
+    if (err != 0)
     {
-        return err;
+        if (auto* const tor = torrents_.get(tor_id); tor != nullptr)
+        {
+            tr_ioWriteFailed(tor, failed_file, err);
+        }
     }
 
-    ++disk_writes_;
-    disk_write_bytes_ += std::size(*towrite);
-    return {};
+    // now that the disk has caught up a little,
+    // write out anything that was left waiting for it
+    cacheTrim();
 }
 
 size_t Cache::getMaxBlocks(int64_t max_bytes) noexcept
@@ -121,18 +169,28 @@ size_t Cache::getMaxBlocks(int64_t max_bytes) noexcept
     return std::lldiv(max_bytes, tr_block_info::BlockSize).quot;
 }
 
-int Cache::setLimit(int64_t new_limit)
+void Cache::setLimit(int64_t new_limit)
 {
     max_bytes_ = new_limit;
     max_blocks_ = getMaxBlocks(new_limit);
 
     tr_logAddDebug(fmt::format("Maximum cache size set to {} ({} blocks)", tr_formatter_mem_B(max_bytes_), max_blocks_));
 
-    return cacheTrim();
+    cacheTrim();
+}
+
+void Cache::setReadLimit(int64_t new_limit)
+{
+    max_read_bytes_ = new_limit;
+
+    tr_logAddDebug(fmt::format("Maximum read cache size set to {}", tr_formatter_mem_B(max_read_bytes_)));
+
+    readCacheTrim();
 }
 
-Cache::Cache(tr_torrents& torrents, int64_t max_bytes)
+Cache::Cache(tr_torrents& torrents, tr_disk_io& disk_io, int64_t max_bytes)
     : torrents_{ torrents }
+    , disk_io_{ disk_io }
     , max_blocks_(getMaxBlocks(max_bytes))
     , max_bytes_(max_bytes)
 {
@@ -140,52 +198,142 @@ Cache::Cache(tr_torrents& torrents, int64_t max_bytes)
 
 // ---
 
-int Cache::writeBlock(tr_torrent_id_t tor_id, tr_block_index_t block, std::unique_ptr<std::vector<uint8_t>>& writeme)
+std::unique_ptr<std::vector<uint8_t>> Cache::makeBlockBuffer()
+{
+    if (std::empty(buffer_pool_))
+    {
+        return std::make_unique<std::vector<uint8_t>>();
+    }
+
+    auto buf = std::move(buffer_pool_.back());
+    buffer_pool_.pop_back();
+    return buf;
+}
+
+void Cache::recycleBuffer(std::unique_ptr<std::vector<uint8_t>> buf)
+{
+    if (buf && buf->capacity() >= tr_block_info::BlockSize && std::size(buffer_pool_) < MaxPooledBuffers)
+    {
+        buf->clear();
+        buffer_pool_.emplace_back(std::move(buf));
+    }
+}
+
+void Cache::writeBlock(tr_torrent_id_t tor_id, tr_block_index_t block, std::unique_ptr<std::vector<uint8_t>>& writeme)
 {
     auto const key = Key{ tor_id, block };
-    auto iter = std::lower_bound(std::begin(blocks_), std::end(blocks_), key, CompareCacheBlockByKey{});
-    if (iter == std::end(blocks_) || iter->key != key)
+    auto [iter, is_new] = blocks_.try_emplace(key);
+    if (is_new)
     {
-        iter = blocks_.emplace(iter);
-        iter->key = key;
+        iter->second.age = blocks_by_age_.insert(std::end(blocks_by_age_), key);
+    }
+    else
+    {
+        // this is now the most recently written block
+        blocks_by_age_.splice(std::end(blocks_by_age_), blocks_by_age_, iter->second.age);
+        recycleBuffer(std::move(iter->second.buf));
     }
 
-    iter->time_added = tr_time();
+    iter->second.buf = std::move(writeme);
 
-    iter->buf = std::move(writeme);
+    // don't let the read cache serve stale data for this piece
+    if (!std::empty(read_index_) || !std::empty(loading_))
+    {
+        if (auto const* const tor = torrents_.get(tor_id); tor != nullptr)
+        {
+            auto const piece = tor->blockLoc(block).piece;
+            dropReadPieces({ tor_id, piece }, { tor_id, piece + 1 });
+        }
+    }
 
     ++cache_writes_;
-    cache_write_bytes_ += std::size(*iter->buf);
+    cache_write_bytes_ += std::size(*iter->second.buf);
+
+    cacheTrim();
+}
 
-    return cacheTrim();
+Cache::Iter Cache::getBlock(tr_torrent const* torrent, tr_block_info::Location loc) noexcept
+{
+    return blocks_.find(makeKey(torrent, loc));
 }
 
-Cache::CIter Cache::getBlock(tr_torrent const* torrent, tr_block_info::Location loc) noexcept
+uint8_t const* Cache::getInMemory(tr_torrent const* torrent, tr_block_info::Location loc, uint32_t len) noexcept
 {
-    if (auto const [begin, end] = std::equal_range(
-            std::begin(blocks_),
-            std::end(blocks_),
-            makeKey(torrent, loc),
-            CompareCacheBlockByKey{});
-        begin < end)
+    if (auto const iter = getBlock(torrent, loc); iter != std::end(blocks_))
+    {
+        return std::data(*iter->second.buf);
+    }
+
+    // newest spans are at the back
+    auto const tor_id = torrent->id();
+    for (auto span = std::rbegin(flushing_), end = std::rend(flushing_); span != end; ++span)
     {
-        return begin;
+        if (span->tor_id != tor_id || loc.block < span->begin || loc.block >= span->end)
+        {
+            continue;
+        }
+
+        auto const offset = size_t{ loc.block - span->begin } * tr_block_info::BlockSize + loc.block_offset;
+        if (offset + len <= std::size(*span->buf))
+        {
+            return std::data(*span->buf) + offset;
+        }
     }
 
-    return std::end(blocks_);
+    return nullptr;
 }
 
 int Cache::readBlock(tr_torrent* torrent, tr_block_info::Location loc, uint32_t len, uint8_t* setme)
 {
-    if (auto const iter = getBlock(torrent, loc); iter != std::end(blocks_))
+    if (auto const* const data = getInMemory(torrent, loc, len); data != nullptr)
+    {
+        std::copy_n(data, len, setme);
+        return {};
+    }
+
+    if (auto const* const data = getReadCached(torrent, loc, len); data != nullptr)
     {
-        std::copy_n(std::begin(*iter->buf), len, setme);
+        ++read_stats_.hits;
+        std::copy_n(data, len, setme);
         return {};
     }
 
     return tr_ioRead(torrent, loc, len, setme);
 }
 
+bool Cache::readBlockAsync(tr_torrent* torrent, tr_block_info::Location loc, uint32_t len, ReadCallback&& on_done)
+{
+    if (auto const* const data = getInMemory(torrent, loc, len); data != nullptr)
+    {
+        on_done(0, std::vector<uint8_t>(data, data + len));
+        return true;
+    }
+
+    if (auto const* const data = getReadCached(torrent, loc, len); data != nullptr)
+    {
+        ++read_stats_.hits;
+        on_done(0, std::vector<uint8_t>(data, data + len));
+        return true;
+    }
+
+    if (isReadCacheable(torrent, loc.piece))
+    {
+        return loadPiece(torrent, loc, len, std::move(on_done));
+    }
+
+    if (!disk_io_.read(torrent, loc, len, std::move(on_done)))
+    {
+        return false;
+    }
+
+    if (max_read_bytes_ != 0U)
+    {
+        ++read_stats_.misses;
+    }
+
+    return true;
+}
+
 int Cache::prefetchBlock(tr_torrent* torrent, tr_block_info::Location loc, uint32_t len)
 {
     if (auto const iter = getBlock(torrent, loc); iter != std::end(blocks_))
@@ -193,82 +341,235 @@ int Cache::prefetchBlock(tr_torrent* torrent, tr_block_info::Location loc, uint3
         return {}; // already have it
     }
 
+    if (auto const key = PieceKey{ torrent->id(), loc.piece }; read_index_.count(key) != 0U || loading_.count(key) != 0U)
+    {
+        return {}; // already have it, or will soon
+    }
+
     return tr_ioPrefetch(torrent, loc, len);
 }
 
 // ---
 
-int Cache::flushSpan(CIter const begin, CIter const end)
+bool Cache::isReadCacheable(tr_torrent const* torrent, tr_piece_index_t piece) const
+{
+    // only cache pieces that we have and know to be good,
+    // since those are the only ones we can upload to peers
+    if (torrent->pieceSize(piece) > max_read_bytes_ || !torrent->hasPiece(piece) || !torrent->isPieceChecked(piece))
+    {
+        return false;
+    }
+
+    // A piece can be complete while some of its blocks haven't reached the disk yet.
+    // Reading it from disk now would cache old bytes for those blocks.
+    auto const tor_id = torrent->id();
+    auto const [block_begin, block_end] = torrent->blockSpanForPiece(piece);
+    if (blocks_.lower_bound({ tor_id, block_begin }) != blocks_.lower_bound({ tor_id, block_end }))
+    {
+        return false;
+    }
+
+    return std::none_of(
+        std::begin(flushing_),
+        std::end(flushing_),
+        [tor_id, block_begin = block_begin, block_end = block_end](auto const& span)
+        { return span.tor_id == tor_id && span.begin < block_end && block_begin < span.end; });
+}
+
+uint8_t const* Cache::getReadCached(tr_torrent const* torrent, tr_block_info::Location loc, uint32_t len)
+{
+    auto const it = read_index_.find({ torrent->id(), loc.piece });
+    if (it == std::end(read_index_))
+    {
+        return nullptr;
+    }
+
+    auto const& buf = *it->second->buf;
+    if (size_t{ loc.piece_offset } + len > std::size(buf))
+    {
+        return nullptr;
+    }
+
+    // mark the piece as most recently used
+    read_pieces_.splice(std::begin(read_pieces_), read_pieces_, it->second);
+
+    return std::data(buf) + loc.piece_offset;
+}
+
+bool Cache::loadPiece(tr_torrent* torrent, tr_block_info::Location loc, uint32_t len, ReadCallback&& on_done)
+{
+    auto const key = PieceKey{ torrent->id(), loc.piece };
+
+    // if another peer already asked for this piece, wait for that read to finish
+    if (auto const it = loading_.find(key); it != std::end(loading_))
+    {
+        ++read_stats_.hits;
+        it->second.waiters.push_back({ loc.piece_offset, len, std::move(on_done) });
+        return true;
+    }
+
+    auto const queued = disk_io_.read(
+        torrent,
+        torrent->pieceLoc(loc.piece),
+        torrent->pieceSize(loc.piece),
+        [this, key](int err, std::vector<uint8_t>&& data) { onPieceLoaded(key, err, std::move(data)); });
+    if (!queued)
+    {
+        return false;
+    }
+
+    ++read_stats_.misses;
+    loading_[key].waiters.push_back({ loc.piece_offset, len, std::move(on_done) });
+    return true;
+}
+
+void Cache::onPieceLoaded(PieceKey key, int err, std::vector<uint8_t>&& data)
 {
-    for (auto walk = begin; walk < end;)
+    auto node = loading_.extract(key);
+    if (node.empty())
+    {
+        return;
+    }
+
+    auto& load = node.mapped();
+    auto const buf = std::make_shared<std::vector<uint8_t> const>(std::move(data));
+
+    // cache the piece before notifying the waiters,
+    // since they're likely to ask for its next block
+    if (err == 0 && load.is_cacheable && std::size(*buf) <= max_read_bytes_ && read_index_.count(key) == 0U)
     {
-        auto const [contig_begin, contig_end] = findContiguous(begin, end, walk);
+        read_pieces_.push_front({ key, buf });
+        read_index_.try_emplace(key, std::begin(read_pieces_));
+        read_bytes_ += std::size(*buf);
+        readCacheTrim();
+    }
 
-        if (auto const err = writeContiguous(contig_begin, contig_end); err != 0)
+    for (auto& waiter : load.waiters)
+    {
+        if (err != 0)
+        {
+            waiter.on_done(err, {});
+        }
+        else if (size_t{ waiter.piece_offset } + waiter.len > std::size(*buf))
+        {
+            waiter.on_done(EIO, {});
+        }
+        else
         {
-            return err;
+            auto const* const begin = std::data(*buf) + waiter.piece_offset;
+            waiter.on_done(0, std::vector<uint8_t>(begin, begin + waiter.len));
         }
+    }
+}
+
+void Cache::dropReadPieces(PieceKey const& begin, PieceKey const& end)
+{
+    for (auto it = read_index_.lower_bound(begin), it_end = read_index_.lower_bound(end); it != it_end;)
+    {
+        read_bytes_ -= std::size(*it->second->buf);
+        read_pieces_.erase(it->second);
+        it = read_index_.erase(it);
+    }
+
+    for (auto it = loading_.lower_bound(begin), it_end = loading_.lower_bound(end); it != it_end; ++it)
+    {
+        it->second.is_cacheable = false;
+    }
+}
+
+void Cache::readCacheTrim()
+{
+    while (read_bytes_ > max_read_bytes_ && !std::empty(read_pieces_))
+    {
+        auto const& oldest = read_pieces_.back();
+        read_bytes_ -= std::size(*oldest.buf);
+        read_index_.erase(oldest.key);
+        read_pieces_.pop_back();
+        ++read_stats_.evictions;
+    }
+}
+
+// ---
 
+void Cache::flushSpan(Iter const begin, Iter const end)
+{
+    for (auto walk = begin; walk != end;)
+    {
+        auto const [contig_begin, contig_end] = findContiguous(walk, end, walk);
+        [[maybe_unused]] auto const written = writeContiguous(contig_begin, contig_end, true);
+        TR_ASSERT(written);
         walk = contig_end;
     }
 
+    eraseBlocks(begin, end);
+}
+
+void Cache::eraseBlocks(Iter const begin, Iter const end)
+{
+    for (auto iter = begin; iter != end; ++iter)
+    {
+        blocks_by_age_.erase(iter->second.age);
+    }
+
     blocks_.erase(begin, end);
-    return {};
 }
 
-int Cache::flushFile(tr_torrent const* torrent, tr_file_index_t file)
+void Cache::flushFile(tr_torrent const* torrent, tr_file_index_t file)
 {
-    auto const compare = CompareCacheBlockByKey{};
     auto const tor_id = torrent->id();
     auto const [block_begin, block_end] = tr_torGetFileBlockSpan(torrent, file);
 
-    return flushSpan(
-        std::lower_bound(std::begin(blocks_), std::end(blocks_), std::make_pair(tor_id, block_begin), compare),
-        std::lower_bound(std::begin(blocks_), std::end(blocks_), std::make_pair(tor_id, block_end), compare));
+    flushSpan(blocks_.lower_bound({ tor_id, block_begin }), blocks_.lower_bound({ tor_id, block_end }));
+
+    // wait for the writes to land so that the file can be closed
+    disk_io_.flushTorrent(tor_id);
 }
 
-int Cache::flushTorrent(tr_torrent const* torrent)
+void Cache::flushTorrent(tr_torrent const* torrent)
 {
-    auto const compare = CompareCacheBlockByKey{};
     auto const tor_id = torrent->id();
 
-    return flushSpan(
-        std::lower_bound(std::begin(blocks_), std::end(blocks_), std::make_pair(tor_id, 0), compare),
-        std::lower_bound(std::begin(blocks_), std::end(blocks_), std::make_pair(tor_id + 1, 0), compare));
+    flushSpan(blocks_.lower_bound({ tor_id, 0 }), blocks_.lower_bound({ tor_id + 1, 0 }));
+
+    // the torrent's files may be about to move or be rechecked
+    dropReadPieces({ tor_id, 0 }, { tor_id + 1, 0 });
+
+    // wait for the writes to land so that the files can be closed
+    disk_io_.flushTorrent(tor_id);
 }
 
-int Cache::flushOldest()
+bool Cache::flushOldest(bool wait)
 {
-    auto const oldest = std::min_element(
-        std::begin(blocks_),
-        std::end(blocks_),
-        [](auto const& a, auto const& b) { return a.time_added < b.time_added; });
-
-    if (oldest == std::end(blocks_)) // nothing to flush
+    if (std::empty(blocks_by_age_)) // nothing to flush
     {
-        return 0;
+        return false;
     }
 
+    auto const oldest = blocks_.find(blocks_by_age_.front());
+    TR_ASSERT(oldest != std::end(blocks_));
+
     auto const [begin, end] = findContiguous(std::begin(blocks_), std::end(blocks_), oldest);
 
-    if (auto const err = writeContiguous(begin, end); err != 0)
+    if (!writeContiguous(begin, end, wait))
     {
-        return err;
+        return false;
     }
 
-    blocks_.erase(begin, end);
-    return 0;
+    eraseBlocks(begin, end);
+    return true;
 }
 
-int Cache::cacheTrim()
+void Cache::cacheTrim()
 {
     while (std::size(blocks_) > max_blocks_)
     {
-        if (auto const err = flushOldest(); err != 0)
+        // Don't make the session thread wait on a busy disk unless
+        // the cache has grown too far past its limit.
+        // onSpanWritten() tries again when a write finishes.
+        auto const wait = std::size(blocks_) > max_blocks_ + MaxOvershootBlocks;
+        if (!flushOldest(wait))
         {
-            return err;
+            break;
         }
     }
-
-    return 0;
 }
@@ -11,8 +11,10 @@
 
 #include <cstdint> // for size_t
 #include <cstdint> // for intX_t, uintX_t
-#include <ctime>
-#include <memory> // for std::unique_ptr
+#include <functional>
+#include <list>
+#include <map>
+#include <memory> // for std::unique_ptr, std::shared_ptr
 #include <utility> // for std::pair
 #include <vector>
 
@@ -20,82 +22,205 @@
 
 #include "block-info.h"
 
+class tr_disk_io;
 class tr_torrents;
 struct tr_torrent;
 
 class Cache
 {
 public:
-    Cache(tr_torrents& torrents, int64_t max_bytes);
+    using ReadCallback = std::function<void(int err, std::vector<uint8_t>&& data)>;
 
-    int setLimit(int64_t new_limit);
+    struct ReadCacheStats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t bytes = 0;
+    };
+
+    Cache(tr_torrents& torrents, tr_disk_io& disk_io, int64_t max_bytes);
+
+    void setLimit(int64_t new_limit);
 
     [[nodiscard]] constexpr auto getLimit() const noexcept
     {
         return max_bytes_;
     }
 
-    // @return any error code from cacheTrim()
-    int writeBlock(tr_torrent_id_t tor, tr_block_index_t block, std::unique_ptr<std::vector<uint8_t>>& writeme);
+    // Set how much memory to use for caching pieces that peers are downloading from us.
+    // This is separate from the write cache; a limit of 0 disables it.
+    void setReadLimit(int64_t new_limit);
+
+    [[nodiscard]] constexpr auto getReadLimit() const noexcept
+    {
+        return max_read_bytes_;
+    }
+
+    [[nodiscard]] ReadCacheStats readCacheStats() const noexcept
+    {
+        auto stats = read_stats_;
+        stats.bytes = read_bytes_;
+        return stats;
+    }
+
+    // @return an empty buffer for an incoming block.
+    // Buffers are recycled once their blocks have been written to disk.
+    [[nodiscard]] std::unique_ptr<std::vector<uint8_t>> makeBlockBuffer();
+
+    // Write errors are reported later, from the session thread,
+    // by stopping the torrent with a local error.
+    void writeBlock(tr_torrent_id_t tor, tr_block_index_t block, std::unique_ptr<std::vector<uint8_t>>& writeme);
 
     int readBlock(tr_torrent* torrent, tr_block_info::Location loc, uint32_t len, uint8_t* setme);
+
+    // Like readBlock(), but never waits on the disk.
+    // `on_done` is called from the session thread when the data is ready;
+    // if the block is already in memory, it's called before this returns.
+    // On a read cache miss, the block's entire piece is loaded so that
+    // requests for the piece's other blocks can be served from memory.
+    // @return false if the disk is too busy to take the request right now
+    [[nodiscard]] bool readBlockAsync(tr_torrent* torrent, tr_block_info::Location loc, uint32_t len, ReadCallback&& on_done);
     int prefetchBlock(tr_torrent* torrent, tr_block_info::Location loc, uint32_t len);
-    int flushTorrent(tr_torrent const* torrent);
-    int flushFile(tr_torrent const* torrent, tr_file_index_t file);
+
+    // @return true if the block at `loc` hasn't been written to disk yet
+    [[nodiscard]] bool isInMemory(tr_torrent const* torrent, tr_block_info::Location loc, uint32_t len) noexcept
+    {
+        return getInMemory(torrent, loc, len) != nullptr;
+    }
+
+    // These wait until the blocks are on disk.
+    void flushTorrent(tr_torrent const* torrent);
+    void flushFile(tr_torrent const* torrent, tr_file_index_t file);
 
 private:
     using Key = std::pair<tr_torrent_id_t, tr_block_index_t>;
 
+    // keys of the cached blocks, least recently written first
+    using BlocksByAge = std::list<Key>;
+
     struct CacheBlock
     {
-        Key key;
         std::unique_ptr<std::vector<uint8_t>> buf;
-        time_t time_added = {};
+        BlocksByAge::iterator age;
     };
 
-    using Blocks = std::vector<CacheBlock>;
-    using CIter = Blocks::const_iterator;
+    // sorted by key so that contiguous blocks can be written together
+    using Blocks = std::map<Key, CacheBlock>;
+    using Iter = Blocks::iterator;
+
+    static auto constexpr MaxPooledBuffers = size_t{ 64U };
+
+    // the most blocks to join into a single disk write
+    static auto constexpr MaxSpanBlocks = size_t{ 64U };
+
+    // When the disk can't keep up, blocks stay in the cache past its limit
+    // instead of making the session thread wait. Past this many extra blocks
+    // the session thread waits anyway, so that memory use stays bounded.
+    static auto constexpr MaxOvershootBlocks = size_t{ 1024U };
 
-    struct CompareCacheBlockByKey
+    // a contiguous run of blocks that has been handed off to
+    // the disk I/O workers but hasn't been written to disk yet
+    struct FlushingSpan
     {
-        [[nodiscard]] constexpr bool operator()(Key const& key, CacheBlock const& block)
-        {
-            return key < block.key;
-        }
-        [[nodiscard]] constexpr bool operator()(CacheBlock const& block, Key const& key)
-        {
-            return block.key < key;
-        }
+        uint64_t id = {};
+        tr_torrent_id_t tor_id = {};
+        tr_block_index_t begin = {};
+        tr_block_index_t end = {};
+        std::shared_ptr<std::vector<uint8_t>> buf;
     };
 
     [[nodiscard]] static Key makeKey(tr_torrent const* torrent, tr_block_info::Location loc) noexcept;
 
-    [[nodiscard]] static std::pair<CIter, CIter> findContiguous(CIter const begin, CIter const end, CIter const iter) noexcept;
+    [[nodiscard]] static std::pair<Iter, Iter> findContiguous(Iter const begin, Iter const end, Iter const iter) noexcept;
 
-    // @return any error code from tr_ioWrite()
-    [[nodiscard]] int writeContiguous(CIter const begin, CIter const end) const;
+    // Hands the blocks off to the disk I/O workers to be saved,
+    // or drops them if their torrent is gone.
+    // @return false if the disk is busy and `wait` is false;
+    // in that case, the blocks are left alone.
+    [[nodiscard]] bool writeContiguous(Iter const begin, Iter const end, bool wait);
 
-    // @return any error code from writeContiguous()
-    [[nodiscard]] int flushSpan(CIter const begin, CIter const end);
+    void onSpanWritten(uint64_t span_id, tr_torrent_id_t tor_id, int err, tr_file_index_t failed_file);
 
-    // @return any error code from writeContiguous()
-    [[nodiscard]] int flushOldest();
+    void flushSpan(Iter const begin, Iter const end);
 
-    // @return any error code from writeContiguous()
-    [[nodiscard]] int cacheTrim();
+    void eraseBlocks(Iter const begin, Iter const end);
+
+    void recycleBuffer(std::unique_ptr<std::vector<uint8_t>> buf);
+
+    // @return false if the disk is busy and `wait` is false
+    [[nodiscard]] bool flushOldest(bool wait);
+
+    void cacheTrim();
 
     [[nodiscard]] static size_t getMaxBlocks(int64_t max_bytes) noexcept;
 
-    [[nodiscard]] CIter getBlock(tr_torrent const* torrent, tr_block_info::Location loc) noexcept;
+    [[nodiscard]] Iter getBlock(tr_torrent const* torrent, tr_block_info::Location loc) noexcept;
+
+    // @return a pointer to `len` bytes of the block at `loc` if it's
+    // still in memory, either in the cache or on its way to disk
+    [[nodiscard]] uint8_t const* getInMemory(tr_torrent const* torrent, tr_block_info::Location loc, uint32_t len) noexcept;
+
+    // --- read cache
+
+    using PieceKey = std::pair<tr_torrent_id_t, tr_piece_index_t>;
+
+    struct ReadPiece
+    {
+        PieceKey key;
+        std::shared_ptr<std::vector<uint8_t> const> buf;
+    };
+
+    using ReadPieces = std::list<ReadPiece>;
+
+    // a block request that's waiting for its piece to be loaded
+    struct PendingRead
+    {
+        uint32_t piece_offset = {};
+        uint32_t len = {};
+        ReadCallback on_done;
+    };
+
+    struct PieceLoad
+    {
+        std::vector<PendingRead> waiters;
+
+        // false if the piece changed while it was being loaded
+        bool is_cacheable = true;
+    };
+
+    [[nodiscard]] bool isReadCacheable(tr_torrent const* torrent, tr_piece_index_t piece) const;
+
+    // @return a pointer to `len` bytes of the block at `loc` if its piece is in the read cache
+    [[nodiscard]] uint8_t const* getReadCached(tr_torrent const* torrent, tr_block_info::Location loc, uint32_t len);
+
+    [[nodiscard]] bool loadPiece(tr_torrent* torrent, tr_block_info::Location loc, uint32_t len, ReadCallback&& on_done);
+    void onPieceLoaded(PieceKey key, int err, std::vector<uint8_t>&& data);
+
+    void dropReadPieces(PieceKey const& begin, PieceKey const& end);
+    void readCacheTrim();
 
     tr_torrents& torrents_;
+    tr_disk_io& disk_io_;
 
     Blocks blocks_ = {};
+    BlocksByAge blocks_by_age_ = {};
+    std::vector<std::unique_ptr<std::vector<uint8_t>>> buffer_pool_ = {};
+    std::vector<FlushingSpan> flushing_ = {};
+    uint64_t next_span_id_ = {};
     size_t max_blocks_ = 0;
     size_t max_bytes_ = 0;
 
-    mutable size_t disk_writes_ = 0;
-    mutable size_t disk_write_bytes_ = 0;
-    mutable size_t cache_writes_ = 0;
-    mutable size_t cache_write_bytes_ = 0;
+    size_t disk_writes_ = 0;
+    size_t disk_write_bytes_ = 0;
+    size_t cache_writes_ = 0;
+    size_t cache_write_bytes_ = 0;
+
+    // most recently used pieces are at the front
+    ReadPieces read_pieces_ = {};
+    std::map<PieceKey, ReadPieces::iterator> read_index_ = {};
+    std::map<PieceKey, PieceLoad> loading_ = {};
+    size_t read_bytes_ = 0;
+    size_t max_read_bytes_ = 0;
+    ReadCacheStats read_stats_ = {};
 };
@@ -0,0 +1,258 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "transmission.h"
+
+#include "disk-io.h"
+#include "inout.h"
+#include "perf-stats.h"
+#include "session-thread.h"
+#include "torrent.h"
+#include "tr-assert.h"
+
+using namespace std::literals;
+
+void tr_disk_io::Job::run()
+{
+    if (err != 0) // couldn't make a plan
+    {
+        return;
+    }
+
+    auto& open_files = session->openFiles();
+
+    if (write_buf)
+    {
+        err = tr_ioWritePlanned(open_files, plan, std::data(*write_buf), &failed_file, &n_files_created);
+    }
+    else
+    {
+        read_buf.resize(len);
+        err = tr_ioReadPlanned(open_files, plan, std::data(read_buf));
+    }
+}
+
+void tr_disk_io::Job::finish()
+{
+    for (size_t i = 0; i < n_files_created; ++i)
+    {
+        session->addFileCreated();
+    }
+
+    if (write_buf)
+    {
+        // let go of the buffer first so that the callback can reuse it
+        write_buf.reset();
+
+        if (on_write)
+        {
+            on_write(err, failed_file);
+        }
+    }
+    else if (on_read)
+    {
+        on_read(err, std::move(read_buf));
+    }
+}
+
+void tr_disk_io::Completed::drain()
+{
+    auto lock = std::unique_lock(mutex);
+    auto done = std::vector<Job>{};
+    std::swap(done, jobs);
+    drain_posted = false;
+    lock.unlock();
+
+    for (auto& job : done)
+    {
+        job.finish();
+    }
+}
+
+// ---
+
+tr_disk_io::tr_disk_io(tr_session_thread& session_thread, size_t n_workers)
+    : session_thread_{ session_thread }
+{
+    n_workers = std::max(n_workers, size_t{ 1U });
+    workers_.reserve(n_workers);
+    for (size_t i = 0; i < n_workers; ++i)
+    {
+        auto& worker = *workers_.emplace_back(std::make_unique<Worker>());
+        worker.thread = std::thread(&tr_disk_io::workerThreadFunc, this, std::ref(worker));
+    }
+}
+
+tr_disk_io::~tr_disk_io()
+{
+    // finish any queued writes before exiting, but don't bother
+    // invoking their callbacks since the session is shutting down
+    {
+        auto const lock = std::lock_guard(mutex_);
+        stopping_ = true;
+        for (auto& worker : workers_)
+        {
+            worker->work_cv.notify_one();
+        }
+    }
+
+    for (auto& worker : workers_)
+    {
+        worker->thread.join();
+    }
+}
+
+tr_disk_io::Worker& tr_disk_io::workerFor(tr_torrent_id_t tor_id) const noexcept
+{
+    return *workers_[static_cast<size_t>(tor_id) % std::size(workers_)];
+}
+
+bool tr_disk_io::enqueue(Job&& job, bool wait_for_room)
+{
+    auto lock = std::unique_lock(mutex_);
+
+    auto& worker = workerFor(job.tor_id);
+    if (wait_for_room)
+    {
+        idle_cv_.wait(lock, [this, &worker]() { return stopping_ || std::size(worker.todo) < MaxJobsPerWorker; });
+    }
+
+    if (stopping_ || std::size(worker.todo) >= MaxJobsPerWorker)
+    {
+        return false;
+    }
+
+    worker.todo.emplace_back(std::move(job));
+    worker.work_cv.notify_one();
+    return true;
+}
+
+bool tr_disk_io::read(tr_torrent* tor, tr_block_info::Location loc, uint32_t len, ReadCallback&& on_done)
+{
+    TR_ASSERT(session_thread_.amInSessionThread());
+
+    auto job = Job{};
+    job.session = tor->session;
+    job.tor_id = tor->id();
+    job.len = len;
+    job.err = tr_ioMakePlan(tor, loc, len, false, job.plan);
+    job.on_read = std::move(on_done);
+    return enqueue(std::move(job), false);
+}
+
+void tr_disk_io::write(
+    tr_torrent* tor,
+    tr_block_info::Location loc,
+    std::shared_ptr<std::vector<uint8_t> const> data,
+    WriteCallback&& on_done)
+{
+    TR_ASSERT(session_thread_.amInSessionThread());
+    TR_ASSERT(data);
+
+    auto job = Job{};
+    job.session = tor->session;
+    job.tor_id = tor->id();
+    job.len = static_cast<uint32_t>(std::size(*data));
+    job.err = tr_ioMakePlan(tor, loc, job.len, true, job.plan);
+    job.write_buf = std::move(data);
+    job.on_write = std::move(on_done);
+    [[maybe_unused]] auto const queued = enqueue(std::move(job), true);
+    TR_ASSERT(queued);
+}
+
+void tr_disk_io::flushTorrent(tr_torrent_id_t tor_id)
+{
+    TR_ASSERT(session_thread_.amInSessionThread());
+
+    auto lock = std::unique_lock(mutex_);
+    auto& worker = workerFor(tor_id);
+    idle_cv_.wait(
+        lock,
+        [&worker, tor_id]()
+        {
+            return worker.busy_with != tor_id &&
+                std::none_of(
+                       std::begin(worker.todo),
+                       std::end(worker.todo),
+                       [tor_id](auto const& job) { return job.tor_id == tor_id; });
+        });
+    lock.unlock();
+
+    completed_->drain();
+}
+
+bool tr_disk_io::hasRoom(tr_torrent_id_t tor_id) const
+{
+    auto const lock = std::lock_guard(mutex_);
+    return std::size(workerFor(tor_id).todo) < MaxJobsPerWorker;
+}
+
+size_t tr_disk_io::size() const
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    auto n = size_t{};
+    for (auto const& worker : workers_)
+    {
+        n += std::size(worker->todo);
+        n += worker->busy_with ? 1U : 0U;
+    }
+    return n;
+}
+
+void tr_disk_io::workerThreadFunc(Worker& worker)
+{
+    auto lock = std::unique_lock(mutex_);
+
+    for (;;)
+    {
+        worker.work_cv.wait(lock, [this, &worker]() { return stopping_ || !std::empty(worker.todo); });
+        if (std::empty(worker.todo))
+        {
+            return; // stopping
+        }
+
+        auto job = std::move(worker.todo.front());
+        worker.todo.pop_front();
+        worker.busy_with = job.tor_id;
+        lock.unlock();
+
+        {
+            auto const timer = session_thread_.perfStats().time(job.write_buf ? "disk.write"sv : "disk.read"sv);
+            job.run();
+        }
+
+        // hand the job back to the session thread
+        auto post_drain = false;
+        {
+            auto const completed_lock = std::lock_guard(completed_->mutex);
+            completed_->jobs.emplace_back(std::move(job));
+            post_drain = !std::exchange(completed_->drain_posted, true);
+        }
+        if (post_drain)
+        {
+            session_thread_.run(
+                [weak = std::weak_ptr<Completed>{ completed_ }]()
+                {
+                    if (auto const completed = weak.lock(); completed)
+                    {
+                        completed->drain();
+                    }
+                });
+        }
+
+        lock.lock();
+        worker.busy_with.reset();
+        idle_cv_.notify_all();
+    }
+}
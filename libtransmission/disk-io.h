@@ -0,0 +1,138 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <condition_variable>
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t, uint32_t
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "transmission.h"
+
+#include "block-info.h"
+#include "inout.h" // tr_io_plan
+
+struct tr_session;
+class tr_session_thread;
+struct tr_torrent;
+
+// A bounded pool of worker threads that read and write torrent data
+// so that a slow disk never stalls the session thread's event loop.
+//
+// Jobs are sharded by torrent: every job for a given torrent runs on the
+// same worker, in the order it was queued, so writes to a torrent's files
+// are never reordered. Completion callbacks are invoked on the session thread.
+//
+// Workers never look at the torrent itself: read() and write() must be called
+// from the session thread, which resolves everything the job needs up front.
+class tr_disk_io
+{
+public:
+    using ReadCallback = std::function<void(int err, std::vector<uint8_t>&& data)>;
+    using WriteCallback = std::function<void(int err, tr_file_index_t failed_file)>;
+
+    static auto constexpr DefaultWorkerCount = size_t{ 4U };
+    static auto constexpr MaxJobsPerWorker = size_t{ 256U };
+
+    explicit tr_disk_io(tr_session_thread& session_thread, size_t n_workers = DefaultWorkerCount);
+    tr_disk_io(tr_disk_io&&) = delete;
+    tr_disk_io(tr_disk_io const&) = delete;
+    tr_disk_io& operator=(tr_disk_io&&) = delete;
+    tr_disk_io& operator=(tr_disk_io const&) = delete;
+    ~tr_disk_io();
+
+    // Queue a read of `len` bytes at `loc`.
+    // @return false if `tor`'s worker is too busy to accept more jobs.
+    [[nodiscard]] bool read(tr_torrent* tor, tr_block_info::Location loc, uint32_t len, ReadCallback&& on_done);
+
+    // Queue a write of `data` at `loc`.
+    // Writes are never dropped: if `tor`'s worker is too busy to accept
+    // more jobs, this blocks until there is room in its queue.
+    void write(
+        tr_torrent* tor,
+        tr_block_info::Location loc,
+        std::shared_ptr<std::vector<uint8_t> const> data,
+        WriteCallback&& on_done);
+
+    // @return true if `tor_id`'s worker can take another job without
+    // making write() block. Since jobs are only queued from the session
+    // thread, this stays true until the session thread queues another one.
+    [[nodiscard]] bool hasRoom(tr_torrent_id_t tor_id) const;
+
+    // Wait for all of `tor`'s queued jobs to finish and run their callbacks.
+    // This must be called from the session thread before a torrent's files
+    // are closed, moved, or freed.
+    void flushTorrent(tr_torrent_id_t tor_id);
+
+    // @return the number of jobs that are queued or being worked on
+    [[nodiscard]] size_t size() const;
+
+private:
+    struct Job
+    {
+        tr_session* session = nullptr;
+        tr_torrent_id_t tor_id = {};
+        tr_io_plan plan;
+        uint32_t len = {};
+
+        // set for writes; unset for reads
+        std::shared_ptr<std::vector<uint8_t> const> write_buf;
+        WriteCallback on_write;
+
+        std::vector<uint8_t> read_buf;
+        ReadCallback on_read;
+
+        int err = 0;
+        tr_file_index_t failed_file = {};
+        size_t n_files_created = 0;
+
+        void run();
+        void finish();
+    };
+
+    // Finished jobs waiting for their callbacks to be run on the session thread.
+    // This is shared with the lambdas posted to the session thread so that
+    // they can outlive `tr_disk_io` safely during shutdown.
+    struct Completed
+    {
+        std::mutex mutex;
+        std::vector<Job> jobs;
+        bool drain_posted = false;
+
+        void drain();
+    };
+
+    struct Worker
+    {
+        std::thread thread;
+        std::condition_variable work_cv;
+        std::deque<Job> todo;
+        std::optional<tr_torrent_id_t> busy_with;
+    };
+
+    [[nodiscard]] bool enqueue(Job&& job, bool wait_for_room);
+    [[nodiscard]] Worker& workerFor(tr_torrent_id_t tor_id) const noexcept;
+    void workerThreadFunc(Worker& worker);
+
+    tr_session_thread& session_thread_;
+
+    std::shared_ptr<Completed> const completed_ = std::make_shared<Completed>();
+
+    mutable std::mutex mutex_;
+    std::condition_variable idle_cv_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    bool stopping_ = false;
+};
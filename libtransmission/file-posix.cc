@@ -20,6 +20,7 @@
 #include <fcntl.h> /* O_LARGEFILE, posix_fadvise(), [posix_]fallocate(), fcntl() */
 #include <libgen.h> /* basename(), dirname() */
 #include <sys/file.h> /* flock() */
+#include <sys/mman.h> /* mmap(), munmap() */
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h> /* lseek(), write(), ftruncate(), pread(), pwrite(), pathconf(), etc */
@@ -1078,6 +1079,37 @@ bool tr_sys_file_lock([[maybe_unused]] tr_sys_file_t handle, [[maybe_unused]] in
     return ret;
 }
 
+void* tr_sys_file_map_for_reading(tr_sys_file_t handle, uint64_t offset, uint64_t size, tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+    TR_ASSERT(size > 0);
+
+    void* ret = mmap(nullptr, size, PROT_READ, MAP_SHARED, handle, offset);
+
+    if (ret == MAP_FAILED)
+    {
+        tr_error_set_from_errno(error, errno);
+        ret = nullptr;
+    }
+
+    return ret;
+}
+
+bool tr_sys_file_unmap(void const* address, uint64_t size, tr_error** error)
+{
+    TR_ASSERT(address != nullptr);
+    TR_ASSERT(size > 0);
+
+    bool const ret = munmap(const_cast<void*>(address), size) != -1;
+
+    if (!ret)
+    {
+        tr_error_set_from_errno(error, errno);
+    }
+
+    return ret;
+}
+
 std::string tr_sys_dir_get_current(tr_error** error)
 {
     auto buf = std::vector<char>{};
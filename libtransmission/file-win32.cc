@@ -1213,6 +1213,58 @@ bool tr_sys_file_lock(tr_sys_file_t handle, int operation, tr_error** error)
     return ret;
 }
 
+void* tr_sys_file_map_for_reading(tr_sys_file_t handle, uint64_t offset, uint64_t size, tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+    TR_ASSERT(size > 0);
+
+    if (size > MAXSIZE_T)
+    {
+        set_system_error(error, ERROR_INVALID_PARAMETER);
+        return nullptr;
+    }
+
+    void* ret = nullptr;
+
+    if (HANDLE const mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr); mapping != nullptr)
+    {
+        auto native_offset = ULARGE_INTEGER{};
+        native_offset.QuadPart = offset;
+
+        ret = MapViewOfFile(
+            mapping,
+            FILE_MAP_READ,
+            native_offset.u.HighPart,
+            native_offset.u.LowPart,
+            static_cast<SIZE_T>(size));
+
+        // the view keeps its own reference to the mapping
+        CloseHandle(mapping);
+    }
+
+    if (ret == nullptr)
+    {
+        set_system_error(error, GetLastError());
+    }
+
+    return ret;
+}
+
+bool tr_sys_file_unmap(void const* address, [[maybe_unused]] uint64_t size, tr_error** error)
+{
+    TR_ASSERT(address != nullptr);
+    TR_ASSERT(size > 0);
+
+    bool const ret = UnmapViewOfFile(address) != FALSE;
+
+    if (!ret)
+    {
+        set_system_error(error, GetLastError());
+    }
+
+    return ret;
+}
+
 std::string tr_sys_dir_get_current(tr_error** error)
 {
     if (auto const size = GetCurrentDirectoryW(0, nullptr); size != 0)
@@ -506,6 +506,32 @@ bool tr_sys_file_preallocate(tr_sys_file_t handle, uint64_t size, int flags, str
  */
 bool tr_sys_file_lock(tr_sys_file_t handle, int operation, struct tr_error** error = nullptr);
 
+/**
+ * @brief Portability wrapper for `mmap()` for reading.
+ *
+ * @param[in]  handle Valid file descriptor.
+ * @param[in]  offset Offset in file to map from.
+ * @param[in]  size   Number of bytes to map.
+ * @param[out] error  Pointer to error object. Optional, pass `nullptr` if you
+ *                    are not interested in error details.
+ *
+ * @return Pointer to mapped file data on success, `nullptr` otherwise (with
+ *         `error` set accordingly).
+ */
+void* tr_sys_file_map_for_reading(tr_sys_file_t handle, uint64_t offset, uint64_t size, struct tr_error** error = nullptr);
+
+/**
+ * @brief Portability wrapper for `munmap()`.
+ *
+ * @param[in]  address Pointer to mapped file data.
+ * @param[in]  size    Size of mapped data in bytes.
+ * @param[out] error   Pointer to error object. Optional, pass `nullptr` if you
+ *                     are not interested in error details.
+ *
+ * @return `True` on success, `false` otherwise (with `error` set accordingly).
+ */
+bool tr_sys_file_unmap(void const* address, uint64_t size, struct tr_error** error = nullptr);
+
 /* File-related wrappers (utility) */
 
 /**
@@ -7,6 +7,7 @@
 #include <array>
 #include <cerrno>
 #include <optional>
+#include <utility>
 
 #include <fmt/core.h>
 
@@ -72,54 +73,51 @@ enum class IoMode
     Write
 };
 
-bool getFilename(tr_pathbuf& setme, tr_torrent const* tor, tr_file_index_t file_index, IoMode io_mode)
+bool getFilename(tr_pathbuf& setme, tr_io_plan const& plan, tr_io_plan::File const& file)
 {
-    if (auto found = tor->findFile(file_index); found)
+    for (auto const& base : plan.search_dirs)
     {
-        setme.assign(found->filename());
-        return true;
+        if (std::empty(base))
+        {
+            continue;
+        }
+
+        setme.assign(base, '/', file.subpath);
+        if (tr_sys_path_get_info(setme))
+        {
+            return true;
+        }
+
+        setme.assign(base, '/', file.subpath, tr_torrent_files::PartialFileSuffix);
+        if (tr_sys_path_get_info(setme))
+        {
+            return true;
+        }
     }
 
-    if (io_mode != IoMode::Write)
+    if (!plan.is_write)
     {
         return false;
     }
 
     // We didn't find the file that we want to write to.
     // Let's figure out where it goes so that we can create it.
-    auto const base = tor->currentDir();
-    auto const suffix = tor->session->isIncompleteFileNamingEnabled() ? tr_torrent_files::PartialFileSuffix : ""sv;
-    setme.assign(base, '/', tor->fileSubpath(file_index), suffix);
+    auto const suffix = plan.create_partial ? tr_torrent_files::PartialFileSuffix : ""sv;
+    setme.assign(plan.create_dir, '/', file.subpath, suffix);
     return true;
 }
 
 /* returns 0 on success, or an errno on failure */
-int readOrWriteBytes(
-    tr_session* session,
-    tr_torrent* tor,
-    IoMode io_mode,
-    tr_file_index_t file_index,
-    uint64_t file_offset,
-    uint8_t* buf,
-    size_t buflen)
+int openFile(
+    tr_open_files& open_files,
+    tr_io_plan const& plan,
+    tr_io_plan::File const& file,
+    tr_open_files::Handle& setme,
+    size_t* setme_n_files_created)
 {
-    TR_ASSERT(file_index < tor->fileCount());
-
-    bool const do_write = io_mode == IoMode::Write;
-    auto const file_size = tor->fileSize(file_index);
-    TR_ASSERT(file_size == 0 || file_offset < file_size);
-    TR_ASSERT(file_offset + buflen <= file_size);
-
-    if (file_size == 0)
-    {
-        return 0;
-    }
-
-    // --- Find the fd
-
-    auto fd = session->openFiles().get(tor->id(), file_index, do_write);
+    auto fd = open_files.acquire(plan.tor_id, file.index, plan.is_write);
     auto filename = tr_pathbuf{};
-    if (!fd && !getFilename(filename, tor, file_index, io_mode))
+    if (!fd && !getFilename(filename, plan, file))
     {
         return ENOENT;
     }
@@ -127,65 +125,90 @@ int readOrWriteBytes(
     if (!fd) // not in the cache, so open or create it now
     {
         // open (and maybe create) the file
-        auto const prealloc = (!do_write || !tor->fileIsWanted(file_index)) ? TR_PREALLOCATE_NONE :
-                                                                              tor->session->preallocationMode();
-        fd = session->openFiles().get(tor->id(), file_index, do_write, filename, prealloc, file_size);
-        if (fd && do_write)
+        fd = open_files.acquire(plan.tor_id, file.index, plan.is_write, filename, file.prealloc, file.size);
+        if (fd && plan.is_write && setme_n_files_created != nullptr)
         {
             // make a note that we just created a file
-            tor->session->addFileCreated();
+            ++*setme_n_files_created;
         }
     }
 
     if (!fd) // couldn't create/open it either
     {
         int const err = errno;
-        tr_logAddErrorTor(
-            tor,
+        tr_logAddError(
             fmt::format(
                 _("Couldn't get '{path}': {error} ({error_code})"),
                 fmt::arg("path", filename),
                 fmt::arg("error", tr_strerror(err)),
-                fmt::arg("error_code", err)));
+                fmt::arg("error_code", err)),
+            plan.tor_name);
+        return err;
+    }
+
+    setme = std::move(fd);
+    return 0;
+}
+
+/* returns 0 on success, or an errno on failure */
+int readOrWriteBytes(
+    tr_open_files& open_files,
+    tr_io_plan const& plan,
+    IoMode io_mode,
+    tr_io_plan::File const& file,
+    uint8_t* buf,
+    size_t* setme_n_files_created)
+{
+    TR_ASSERT(file.size == 0 || file.offset < file.size);
+    TR_ASSERT(file.offset + file.length <= file.size);
+
+    if (file.size == 0)
+    {
+        return 0;
+    }
+
+    auto fd = tr_open_files::Handle{};
+    if (auto const err = openFile(open_files, plan, file, fd, setme_n_files_created); err != 0)
+    {
         return err;
     }
 
     switch (io_mode)
     {
     case IoMode::Read:
-        if (tr_error* error = nullptr; !readEntireBuf(*fd, file_offset, buf, buflen, &error) && error != nullptr)
+        if (tr_error* error = nullptr; !readEntireBuf(*fd, file.offset, buf, file.length, &error) && error != nullptr)
         {
             auto const err = error->code;
-            tr_logAddErrorTor(
-                tor,
+            tr_logAddError(
                 fmt::format(
                     _("Couldn't read '{path}': {error} ({error_code})"),
-                    fmt::arg("path", tor->fileSubpath(file_index)),
+                    fmt::arg("path", file.subpath),
                     fmt::arg("error", error->message),
-                    fmt::arg("error_code", error->code)));
+                    fmt::arg("error_code", error->code)),
+                plan.tor_name);
             tr_error_free(error);
             return err;
         }
         break;
 
     case IoMode::Write:
-        if (tr_error* error = nullptr; !writeEntireBuf(*fd, file_offset, buf, buflen, &error) && error != nullptr)
+        if (tr_error* error = nullptr; !writeEntireBuf(*fd, file.offset, buf, file.length, &error) && error != nullptr)
         {
             auto const err = error->code;
-            tr_logAddErrorTor(
-                tor,
+            tr_logAddError(
                 fmt::format(
                     _("Couldn't save '{path}': {error} ({error_code})"),
-                    fmt::arg("path", tor->fileSubpath(file_index)),
+                    fmt::arg("path", file.subpath),
                     fmt::arg("error", error->message),
-                    fmt::arg("error_code", error->code)));
+                    fmt::arg("error_code", error->code)),
+                plan.tor_name);
             tr_error_free(error);
             return err;
         }
         break;
 
     case IoMode::Prefetch:
-        tr_sys_file_advise(*fd, file_offset, buflen, TR_SYS_FILE_ADVICE_WILL_NEED);
+        tr_sys_file_advise(*fd, file.offset, file.length, TR_SYS_FILE_ADVICE_WILL_NEED);
         break;
     }
 
@@ -193,37 +216,55 @@ int readOrWriteBytes(
 }
 
 /* returns 0 on success, or an errno on failure */
-int readOrWritePiece(tr_torrent* tor, IoMode io_mode, tr_block_info::Location loc, uint8_t* buf, size_t buflen)
+int readOrWritePlan(
+    tr_open_files& open_files,
+    tr_io_plan const& plan,
+    IoMode io_mode,
+    uint8_t* buf,
+    tr_file_index_t* setme_failed_file = nullptr,
+    size_t* setme_n_files_created = nullptr)
 {
-    int err = 0;
-
-    if (loc.piece >= tor->pieceCount())
+    for (auto const& file : plan.files)
     {
-        return EINVAL;
-    }
-
-    auto [file_index, file_offset] = tor->fileOffset(loc);
+        if (auto const err = readOrWriteBytes(open_files, plan, io_mode, file, buf, setme_n_files_created); err != 0)
+        {
+            if (setme_failed_file != nullptr)
+            {
+                *setme_failed_file = file.index;
+            }
 
-    while (buflen != 0 && err == 0)
-    {
-        uint64_t const bytes_this_pass = std::min(uint64_t{ buflen }, uint64_t{ tor->fileSize(file_index) - file_offset });
+            return err;
+        }
 
-        err = readOrWriteBytes(tor->session, tor, io_mode, file_index, file_offset, buf, bytes_this_pass);
         if (buf != nullptr)
         {
-            buf += bytes_this_pass;
+            buf += file.length;
         }
-        buflen -= bytes_this_pass;
+    }
 
-        if (err != 0 && io_mode == IoMode::Write && tor->error != TR_STAT_LOCAL_ERROR)
-        {
-            auto const path = tr_pathbuf{ tor->downloadDir(), '/', tor->fileSubpath(file_index) };
-            tor->setLocalError(fmt::format(FMT_STRING("{:s} ({:s})"), tr_strerror(err), path));
-            tr_torrentStop(tor);
-        }
+    return 0;
+}
 
-        ++file_index;
-        file_offset = 0;
+/* returns 0 on success, or an errno on failure */
+int readOrWritePiece(
+    tr_torrent* tor,
+    IoMode io_mode,
+    tr_block_info::Location loc,
+    uint8_t* buf,
+    size_t buflen,
+    tr_file_index_t* setme_failed_file = nullptr)
+{
+    auto plan = tr_io_plan{};
+    if (auto const err = tr_ioMakePlan(tor, loc, buflen, io_mode == IoMode::Write, plan); err != 0)
+    {
+        return err;
+    }
+
+    auto n_files_created = size_t{};
+    auto const err = readOrWritePlan(tor->session->openFiles(), plan, io_mode, buf, setme_failed_file, &n_files_created);
+    for (size_t i = 0; i < n_files_created; ++i)
+    {
+        tor->session->addFileCreated();
     }
 
     return err;
@@ -283,9 +324,129 @@ int tr_ioPrefetch(tr_torrent* tor, tr_block_info::Location loc, size_t len)
     return readOrWritePiece(tor, IoMode::Prefetch, loc, nullptr, len);
 }
 
+int tr_ioOpenSpans(tr_torrent* tor, tr_block_info::Location loc, size_t len, std::vector<tr_io_file_span>& setme)
+{
+    setme.clear();
+
+    auto plan = tr_io_plan{};
+    if (auto const err = tr_ioMakePlan(tor, loc, len, false, plan); err != 0)
+    {
+        return err;
+    }
+
+    for (auto const& file : plan.files)
+    {
+        if (file.size == 0)
+        {
+            continue;
+        }
+
+        auto& span = setme.emplace_back();
+        span.offset = file.offset;
+        span.length = file.length;
+        if (auto const err = openFile(tor->session->openFiles(), plan, file, span.fd, nullptr); err != 0)
+        {
+            setme.clear();
+            return err;
+        }
+    }
+
+    return 0;
+}
+
 int tr_ioWrite(tr_torrent* tor, tr_block_info::Location loc, size_t len, uint8_t const* writeme)
 {
-    return readOrWritePiece(tor, IoMode::Write, loc, const_cast<uint8_t*>(writeme), len);
+    auto failed_file = tr_file_index_t{};
+    auto const err = readOrWritePiece(tor, IoMode::Write, loc, const_cast<uint8_t*>(writeme), len, &failed_file);
+    if (err != 0)
+    {
+        tr_ioWriteFailed(tor, failed_file, err);
+    }
+
+    return err;
+}
+
+int tr_ioMakePlan(tr_torrent const* tor, tr_block_info::Location loc, size_t len, bool is_write, tr_io_plan& setme)
+{
+    if (loc.piece >= tor->pieceCount())
+    {
+        return EINVAL;
+    }
+
+    setme.tor_id = tor->id();
+    setme.tor_name = tor->name();
+    setme.search_dirs = { tor->downloadDir(), tor->incompleteDir() };
+    setme.create_dir = tor->currentDir();
+    setme.create_partial = tor->session->isIncompleteFileNamingEnabled();
+    setme.is_write = is_write;
+    setme.files.clear();
+
+    auto [file_index, file_offset] = tor->fileOffset(loc);
+
+    while (len != 0)
+    {
+        auto const file_size = tor->fileSize(file_index);
+        uint64_t const bytes_this_pass = std::min(uint64_t{ len }, uint64_t{ file_size - file_offset });
+
+        auto& file = setme.files.emplace_back();
+        file.index = file_index;
+        file.offset = file_offset;
+        file.length = bytes_this_pass;
+        file.size = file_size;
+        file.subpath = tor->fileSubpath(file_index);
+        file.prealloc = (!is_write || !tor->fileIsWanted(file_index)) ? TR_PREALLOCATE_NONE :
+                                                                        tor->session->preallocationMode();
+
+        len -= bytes_this_pass;
+        ++file_index;
+        file_offset = 0;
+    }
+
+    return 0;
+}
+
+int tr_ioReadPlanned(tr_open_files& open_files, tr_io_plan const& plan, uint8_t* setme)
+{
+    TR_ASSERT(!plan.is_write);
+
+    return readOrWritePlan(open_files, plan, IoMode::Read, setme);
+}
+
+int tr_ioWritePlanned(
+    tr_open_files& open_files,
+    tr_io_plan const& plan,
+    uint8_t const* writeme,
+    tr_file_index_t* setme_failed_file,
+    size_t* setme_n_files_created)
+{
+    TR_ASSERT(plan.is_write);
+
+    return readOrWritePlan(
+        open_files,
+        plan,
+        IoMode::Write,
+        const_cast<uint8_t*>(writeme),
+        setme_failed_file,
+        setme_n_files_created);
+}
+
+void tr_ioWriteFailed(tr_torrent* tor, tr_file_index_t file_index, int err)
+{
+    TR_ASSERT(tor->session->amInSessionThread());
+
+    if (tor->error == TR_STAT_LOCAL_ERROR)
+    {
+        return;
+    }
+
+    auto const path = tr_pathbuf{ tor->downloadDir(), '/', tor->fileSubpath(file_index) };
+    tor->setLocalError(fmt::format(FMT_STRING("{:s} ({:s})"), tr_strerror(err), path));
+
+    // this may be a write that was flushed while the torrent was stopping
+    if (tor->isRunning)
+    {
+        tr_torrentStop(tor);
+    }
 }
 
 bool tr_ioTestPiece(tr_torrent* tor, tr_piece_index_t piece)
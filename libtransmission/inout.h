@@ -9,11 +9,17 @@
 #error only libtransmission should #include this header.
 #endif
 
-#include <cstdint> // uint8_t, uint32_t
+#include <array>
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t, uint32_t, uint64_t
+#include <string>
+#include <vector>
 
 #include "transmission.h"
 
 #include "block-info.h"
+#include "interned-string.h"
+#include "open-files.h"
 
 struct tr_torrent;
 
@@ -30,12 +36,106 @@ struct tr_torrent;
 
 int tr_ioPrefetch(tr_torrent* tor, tr_block_info::Location loc, size_t len);
 
+/**
+ * A range of bytes in one of a torrent's files.
+ * The file stays open for as long as `fd` is held.
+ */
+struct tr_io_file_span
+{
+    tr_open_files::Handle fd;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+};
+
+/**
+ * Opens the files that hold the block specified by the piece index, offset,
+ * and length, so that it can be sent without reading it into memory first.
+ * @return 0 on success, or an errno value on failure.
+ */
+[[nodiscard]] int tr_ioOpenSpans(
+    struct tr_torrent* tor,
+    tr_block_info::Location loc,
+    size_t len,
+    std::vector<tr_io_file_span>& setme);
+
 /**
  * Writes the block specified by the piece index, offset, and length.
+ * If the write fails, the torrent is stopped with a local error.
  * @return 0 on success, or an errno value on failure.
  */
 [[nodiscard]] int tr_ioWrite(struct tr_torrent* tor, tr_block_info::Location loc, size_t len, uint8_t const* writeme);
 
+/**
+ * Everything a disk I/O worker needs to know to read or write a block.
+ *
+ * The session thread can change where a torrent's files are, or what they're
+ * named, at any time. So this is filled in by the session thread when the job
+ * is queued, and the worker uses it instead of looking at the torrent.
+ */
+struct tr_io_plan
+{
+    struct File
+    {
+        tr_file_index_t index = {};
+        uint64_t offset = 0; // where in the file the job starts
+        uint64_t length = 0; // how many bytes of the job are in this file
+        uint64_t size = 0;
+        std::string subpath;
+        tr_preallocation_mode prealloc = TR_PREALLOCATE_NONE;
+    };
+
+    tr_torrent_id_t tor_id = {};
+    std::string tor_name; // for log messages
+
+    // where to look for existing files, in order
+    std::array<tr_interned_string, 2> search_dirs;
+
+    // where to create missing files, if this is a write
+    tr_interned_string create_dir;
+    bool create_partial = false; // whether new files get the partial suffix
+    bool is_write = false;
+
+    std::vector<File> files;
+};
+
+/**
+ * Fills in `setme` for reading or writing the block specified by
+ * the piece index, offset, and length. Call from the session thread.
+ * @return 0 on success, or an errno value on failure.
+ */
+[[nodiscard]] int tr_ioMakePlan(
+    struct tr_torrent const* tor,
+    tr_block_info::Location loc,
+    size_t len,
+    bool is_write,
+    tr_io_plan& setme);
+
+/**
+ * Like tr_ioRead(), but safe to call from a disk I/O worker thread.
+ * @return 0 on success, or an errno value on failure.
+ */
+[[nodiscard]] int tr_ioReadPlanned(tr_open_files& open_files, tr_io_plan const& plan, uint8_t* setme);
+
+/**
+ * Like tr_ioWrite(), but safe to call from a disk I/O worker thread.
+ * It leaves the torrent's state alone on failure; pass the error along
+ * to tr_ioWriteFailed() from the session thread instead.
+ * @param setme_n_files_created incremented for each file that's opened for writing,
+ *        so that the session thread can add it to the session's stats
+ * @return 0 on success, or an errno value on failure.
+ */
+[[nodiscard]] int tr_ioWritePlanned(
+    tr_open_files& open_files,
+    tr_io_plan const& plan,
+    uint8_t const* writeme,
+    tr_file_index_t* setme_failed_file,
+    size_t* setme_n_files_created);
+
+/**
+ * Stops the torrent with a local error after a failed write.
+ */
+void tr_ioWriteFailed(struct tr_torrent* tor, tr_file_index_t file_index, int err);
+
 /**
  * @brief Test to see if the piece matches its metainfo's SHA1 checksum.
  */
@@ -0,0 +1,131 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cctype> // isprint()
+#include <cmath> // fabs()
+#include <iterator> // std::back_inserter
+#include <string_view>
+
+#define UTF_CPP_CPLUSPLUS 201703L
+#include <utf8.h>
+
+#include <fmt/compile.h>
+#include <fmt/format.h>
+
+#include "json-writer.h"
+
+using namespace std::literals;
+
+namespace
+{
+[[nodiscard]] bool needsEscape(char ch) noexcept
+{
+    return ch == '"' || ch == '\\' || isprint(static_cast<unsigned char>(ch)) == 0;
+}
+} // namespace
+
+namespace libtransmission
+{
+
+void JsonWriter::addInt(int64_t value)
+{
+    separate();
+    fmt::format_to(std::back_inserter(out_), FMT_COMPILE("{:d}"), value);
+    need_comma_ = true;
+}
+
+// formatted the same way as tr_variantToStrJson()
+void JsonWriter::addReal(double value)
+{
+    separate();
+    if (fabs(value - static_cast<int>(value)) < 0.00001)
+    {
+        fmt::format_to(std::back_inserter(out_), FMT_COMPILE("{:.0f}"), value);
+    }
+    else
+    {
+        fmt::format_to(std::back_inserter(out_), FMT_COMPILE("{:.4f}"), value);
+    }
+    need_comma_ = true;
+}
+
+// escaped the same way as tr_variantToStrJson()
+void JsonWriter::addStr(std::string_view value)
+{
+    separate();
+    out_ += '"';
+
+    while (!std::empty(value))
+    {
+        // copy the run of characters that don't need escaping in one go
+        auto run = size_t{};
+        while (run < std::size(value) && !needsEscape(value[run]))
+        {
+            ++run;
+        }
+
+        out_.append(std::data(value), run);
+        value.remove_prefix(run);
+
+        if (std::empty(value))
+        {
+            break;
+        }
+
+        switch (value.front())
+        {
+        case '\b':
+            out_ += R"(\b)"sv;
+            break;
+
+        case '\f':
+            out_ += R"(\f)"sv;
+            break;
+
+        case '\n':
+            out_ += R"(\n)"sv;
+            break;
+
+        case '\r':
+            out_ += R"(\r)"sv;
+            break;
+
+        case '\t':
+            out_ += R"(\t)"sv;
+            break;
+
+        case '"':
+            out_ += R"(\")"sv;
+            break;
+
+        case '\\':
+            out_ += R"(\\)"sv;
+            break;
+
+        default:
+            try
+            {
+                auto const* const begin8 = std::data(value);
+                auto const* const end8 = begin8 + std::size(value);
+                auto const* walk8 = begin8;
+                auto const uch32 = utf8::next(walk8, end8);
+                fmt::format_to(std::back_inserter(out_), FMT_COMPILE("\\u{:04x}"), uch32);
+                value.remove_prefix(walk8 - begin8 - 1);
+            }
+            catch (utf8::exception const&)
+            {
+                out_ += '?';
+            }
+            break;
+        }
+
+        value.remove_prefix(1);
+    }
+
+    out_ += '"';
+    need_comma_ = true;
+}
+
+} // namespace libtransmission
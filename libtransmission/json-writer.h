@@ -0,0 +1,125 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstdint> // int64_t
+#include <string>
+#include <string_view>
+
+#include "quark.h"
+
+namespace libtransmission
+{
+
+// Writes compact JSON straight into a string, for large responses where
+// building a tr_variant tree just to serialize it would be wasteful.
+//
+// The writer only takes care of punctuation; it's up to the caller
+// to balance start/end calls and to give each dict value a key().
+class JsonWriter
+{
+public:
+    explicit JsonWriter(std::string& out) noexcept
+        : out_{ out }
+    {
+    }
+
+    void startDict()
+    {
+        separate();
+        out_ += '{';
+        need_comma_ = false;
+    }
+
+    void endDict()
+    {
+        out_ += '}';
+        need_comma_ = true;
+    }
+
+    void startList()
+    {
+        separate();
+        out_ += '[';
+        need_comma_ = false;
+    }
+
+    void endList()
+    {
+        out_ += ']';
+        need_comma_ = true;
+    }
+
+    // quark names never need escaping
+    void key(tr_quark key)
+    {
+        separate();
+        out_ += '"';
+        out_ += tr_quark_get_string_view(key);
+        out_ += "\":";
+        need_comma_ = false;
+    }
+
+    void addBool(bool value)
+    {
+        separate();
+        out_ += value ? "true" : "false";
+        need_comma_ = true;
+    }
+
+    void addInt(int64_t value);
+    void addReal(double value);
+    void addStr(std::string_view value);
+
+    void addQuark(tr_quark value)
+    {
+        addStr(tr_quark_get_string_view(value));
+    }
+
+    // convenience wrappers to add a key and its value to a dict
+
+    void addBool(tr_quark key, bool value)
+    {
+        this->key(key);
+        addBool(value);
+    }
+
+    void addInt(tr_quark key, int64_t value)
+    {
+        this->key(key);
+        addInt(value);
+    }
+
+    void addReal(tr_quark key, double value)
+    {
+        this->key(key);
+        addReal(value);
+    }
+
+    void addStr(tr_quark key, std::string_view value)
+    {
+        this->key(key);
+        addStr(value);
+    }
+
+private:
+    void separate()
+    {
+        if (need_comma_)
+        {
+            out_ += ',';
+        }
+    }
+
+    std::string& out_;
+    bool need_comma_ = false;
+};
+
+} // namespace libtransmission
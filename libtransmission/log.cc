@@ -3,16 +3,27 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cerrno>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint> // uint32_t
 #include <cstdio>
+#include <cstdlib> // std::atexit()
+#include <iterator> // std::back_inserter()
 #include <map>
 #include <mutex>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <utility>
 
+#ifndef _WIN32
+#include <pthread.h> // pthread_atfork()
+#endif
+
 #include <fmt/chrono.h>
 #include <fmt/format.h>
 
@@ -20,6 +31,7 @@
 
 #include "file.h"
 #include "log.h"
+#include "mpsc-queue.h"
 #include "tr-assert.h"
 #include "utils.h"
 
@@ -32,58 +44,408 @@ using namespace std::literals;
 namespace
 {
 
+#ifdef _WIN32
+auto constexpr NativeEol = "\r\n"sv;
+#else
+auto constexpr NativeEol = "\n"sv;
+#endif
+
+void formatTime(char* buf, size_t buflen, std::chrono::system_clock::time_point when)
+{
+    auto const [out, len] = fmt::format_to_n(
+        buf,
+        buflen - 1,
+        "{0:%F %H:%M:}{1:%S}",
+        when,
+        std::chrono::duration_cast<std::chrono::milliseconds>(when.time_since_epoch()));
+    *out = '\0';
+}
+
+// A message that's waiting to be written out or added to the message queue.
+// Most messages are short enough to be stored inline so that logging them
+// doesn't allocate.
+struct LogRecord
+{
+    static auto constexpr InlineSize = size_t{ 160U };
+
+    void setText(std::string_view name, std::string_view msg)
+    {
+        name_len = static_cast<uint32_t>(std::size(name));
+        text_len = static_cast<uint32_t>(std::size(name) + std::size(msg));
+
+        if (text_len <= InlineSize)
+        {
+            std::copy(std::begin(msg), std::end(msg), std::copy(std::begin(name), std::end(name), std::begin(inline_text)));
+        }
+        else
+        {
+            long_text.reserve(text_len);
+            long_text.append(name).append(msg);
+        }
+    }
+
+    [[nodiscard]] std::string_view text() const noexcept
+    {
+        return text_len <= InlineSize ? std::string_view{ std::data(inline_text), text_len } : std::string_view{ long_text };
+    }
+
+    // the torrent or module name, or empty if the caller didn't give one
+    [[nodiscard]] std::string_view name() const noexcept
+    {
+        return text().substr(0, name_len);
+    }
+
+    [[nodiscard]] std::string_view message() const noexcept
+    {
+        return text().substr(name_len);
+    }
+
+    char const* file = nullptr;
+    long line = 0;
+    std::chrono::system_clock::time_point wall_time;
+    time_t when = 0;
+    tr_log_level level = TR_LOG_OFF;
+
+    // whether it goes to the message queue instead of the log file
+    bool queued = false;
+
+    uint32_t name_len = 0;
+    uint32_t text_len = 0;
+    std::array<char, InlineSize> inline_text;
+    std::string long_text;
+};
+
+// Logging used to happen under one process-wide lock, with the caller
+// writing to the log file itself. Now callers just copy their messages
+// into a lock-free ring, and a writer thread writes them out or adds
+// them to the message queue. When the ring is full, the caller either
+// drops the message or writes out the ring itself, as the overflow
+// policy says. tr_logGetQueue() writes out the ring too, so that it
+// returns every message that was logged before it was called.
 class tr_log_state
 {
 public:
-    [[nodiscard]] auto unique_lock()
+    tr_log_state()
     {
-        return std::unique_lock(message_mutex_);
+        if (tr_env_get_int("TR_LOG_DROP", 0) != 0)
+        {
+            overflow_policy = TR_LOG_OVERFLOW_DROP;
+        }
+
+#ifndef _WIN32
+        // A forked child, e.g. a daemon, doesn't have our writer thread.
+        // Make sure that it starts one and that the locks aren't stuck.
+        pthread_atfork(
+            []() { instance().lockAll(); },
+            []() { instance().unlockAll(); },
+            []()
+            {
+                auto& state = instance();
+                state.unlockAll();
+
+                // The parent's writer was waiting on the old condition variable,
+                // so the child's copy of it thinks someone's still waiting.
+                state.wake_ = new WakeState{};
+                state.wake_pending_ = false;
+                state.urgent_ = false;
+                state.writer_started_ = false;
+            });
+#endif
     }
 
-    tr_log_level level = TR_LOG_ERROR;
+    // Leaked on purpose so that the writer thread can't outlive it
+    static tr_log_state& instance()
+    {
+        static auto& state = *new tr_log_state{};
+        return state;
+    }
 
-    bool queue_enabled_ = false;
+    void add(LogRecord&& record)
+    {
+        auto const record_level = record.level;
+        auto const droppable = record_level >= TR_LOG_INFO && overflow_policy == TR_LOG_OVERFLOW_DROP;
 
-    tr_log_message* queue_ = nullptr;
+        while (!ring_.tryPush(std::move(record)))
+        {
+            if (droppable)
+            {
+                ++n_dropped_;
+                return;
+            }
+
+            // Write out the ring ourselves. Waiting for the writer thread
+            // instead could deadlock if the writer is what we're waiting on.
+            auto const lock = std::lock_guard{ consumer_mutex_ };
+            drainLocked();
+        }
 
-    tr_log_message** queue_tail_ = &queue_;
+        // don't sit on anything important, or let the ring fill up
+        wakeWriter(record_level <= TR_LOG_WARN || ring_.sizeApprox() >= RingSize / 2U);
+    }
 
-    int queue_length_ = 0;
+    // @return every message that's been queued since the last call
+    [[nodiscard]] tr_log_message* takeQueue()
+    {
+        auto const lock = std::lock_guard{ consumer_mutex_ };
+        drainLocked();
+
+        auto* const ret = queue_;
+        queue_ = nullptr;
+        queue_tail_ = &queue_;
+        queue_length_ = 0;
+        return ret;
+    }
 
-    std::recursive_mutex message_mutex_;
-};
+    void drain()
+    {
+        auto const lock = std::lock_guard{ consumer_mutex_ };
+        drainLocked();
+    }
+
+    // Don't log the same warning ad infinitum. It's not useful after some point.
+    // @return how many times the message at `file:line` has been logged, including this one
+    [[nodiscard]] size_t countRepeat(char const* file, long line)
+    {
+        auto const lock = std::lock_guard{ repeat_mutex_ };
+        return ++repeat_counts_[std::make_pair(file, line)];
+    }
 
-auto log_state = tr_log_state{};
+    std::atomic<tr_log_level> level = TR_LOG_ERROR;
 
-// ---
+    std::atomic<bool> queue_enabled = false;
 
-tr_sys_file_t tr_logGetFile()
-{
-    static bool initialized = false;
-    static tr_sys_file_t file = TR_BAD_SYS_FILE;
+    std::atomic<tr_log_overflow_policy> overflow_policy = TR_LOG_OVERFLOW_BLOCK;
+
+private:
+    static auto constexpr RingSize = size_t{ 1024U };
+
+    // how long the writer waits for more messages before handling what it has
+    static auto constexpr BatchInterval = std::chrono::milliseconds{ 50 };
 
-    if (!initialized)
+    // write out log lines whenever this many bytes of them are waiting
+    static auto constexpr MaxPendingBytes = size_t{ 64U * 1024U };
+
+    static tr_sys_file_t logFile()
     {
         switch (tr_env_get_int("TR_DEBUG_FD", 0))
         {
         case 1:
-            file = tr_sys_file_get_std(TR_STD_SYS_FILE_OUT);
-            break;
+            return tr_sys_file_get_std(TR_STD_SYS_FILE_OUT);
 
         case 2:
-            file = tr_sys_file_get_std(TR_STD_SYS_FILE_ERR);
-            break;
+            return tr_sys_file_get_std(TR_STD_SYS_FILE_ERR);
 
         default:
-            file = TR_BAD_SYS_FILE;
-            break;
+            return TR_BAD_SYS_FILE;
         }
+    }
 
-        initialized = true;
+    // Writes out the ring too, so that the child doesn't write it out again
+    void lockAll()
+    {
+        consumer_mutex_.lock();
+        repeat_mutex_.lock();
+        drainLocked();
     }
 
-    return file;
-}
+    void unlockAll()
+    {
+        repeat_mutex_.unlock();
+        consumer_mutex_.unlock();
+    }
+
+    void wakeWriter(bool urgent)
+    {
+        if (!writer_started_.exchange(true))
+        {
+            std::thread(&tr_log_state::writerThreadFunc, this).detach();
+
+            // don't lose whatever's still in the ring when the process exits
+            static auto const registered = std::atexit([]() { instance().drain(); });
+            (void)registered;
+        }
+
+        // Only the first message since the writer last looked at the ring
+        // needs to wake it. It's already going to look again for the rest.
+        auto notify = !wake_pending_.exchange(true);
+        if (urgent)
+        {
+            notify |= !urgent_.exchange(true);
+        }
+
+        if (notify)
+        {
+            auto* const wake = wake_;
+            auto const lock = std::lock_guard{ wake->mutex };
+            wake->cv.notify_one();
+        }
+    }
+
+    void writerThreadFunc()
+    {
+        auto* const wake = wake_;
+
+        for (;;)
+        {
+            {
+                auto lock = std::unique_lock{ wake->mutex };
+                wake->cv.wait(lock, [this]() { return wake_pending_.load(); });
+
+                // Give more messages a chance to arrive so that they're
+                // handled as a batch, instead of waking up for each one.
+                wake->cv.wait_for(lock, BatchInterval, [this]() { return urgent_.load(); });
+            }
+
+            // clear these before looking at the ring so that no wakeup is missed
+            urgent_ = false;
+            wake_pending_.exchange(false, std::memory_order_acq_rel);
+            drain();
+        }
+    }
+
+    // Caller must hold consumer_mutex_
+    void drainLocked()
+    {
+        for (auto record = LogRecord{}; ring_.tryPop(record);)
+        {
+            handle(record);
+
+            if (std::size(lines_) >= MaxPendingBytes)
+            {
+                writeLines();
+            }
+        }
+
+        if (auto const n_dropped = n_dropped_.exchange(0U); n_dropped > 0U)
+        {
+            auto record = LogRecord{};
+            record.file = __FILE__;
+            record.line = __LINE__;
+            record.wall_time = std::chrono::system_clock::now();
+            record.when = tr_time();
+            record.level = TR_LOG_WARN;
+            record.queued = queue_enabled;
+            record.setText(
+                {},
+                fmt::format(
+                    tr_ngettext(
+                        "Couldn't keep up with logging, so {count} message was dropped",
+                        "Couldn't keep up with logging, so {count} messages were dropped",
+                        n_dropped),
+                    fmt::arg("count", n_dropped)));
+            handle(record);
+        }
+
+        writeLines();
+    }
+
+    // Caller must hold consumer_mutex_
+    void writeLines()
+    {
+        if (std::size(lines_) == 0U)
+        {
+            return;
+        }
+
+        tr_sys_file_write(file_, std::data(lines_), std::size(lines_), nullptr);
+        tr_sys_file_flush(file_);
+        lines_.clear();
+    }
+
+    // Caller must hold consumer_mutex_
+    void handle(LogRecord const& record)
+    {
+        // formatting this was left for now so that it didn't slow down the caller
+        auto name = std::string{ record.name() };
+        if (std::empty(name))
+        {
+            auto const base = tr_sys_path_basename(record.file);
+            name = fmt::format(FMT_STRING("{}:{}"), !std::empty(base) ? base : "?", record.line);
+        }
+
+        if (record.queued)
+        {
+            auto* const newmsg = new tr_log_message{};
+            newmsg->level = record.level;
+            newmsg->when = record.when;
+            newmsg->message = record.message();
+            newmsg->file = record.file;
+            newmsg->line = record.line;
+            newmsg->name = std::move(name);
+
+            *queue_tail_ = newmsg;
+            queue_tail_ = &newmsg->next;
+            ++queue_length_;
+
+            if (queue_length_ > TR_LOG_MAX_QUEUE_LENGTH)
+            {
+                tr_log_message* old = queue_;
+                queue_ = old->next;
+                old->next = nullptr;
+                tr_logFreeQueue(old);
+                --queue_length_;
+                TR_ASSERT(queue_length_ == TR_LOG_MAX_QUEUE_LENGTH);
+            }
+
+            return;
+        }
+
+        if (file_ == TR_BAD_SYS_FILE)
+        {
+            file_ = logFile();
+
+            if (file_ == TR_BAD_SYS_FILE)
+            {
+                file_ = tr_sys_file_get_std(TR_STD_SYS_FILE_ERR);
+            }
+        }
+
+        auto timestr = std::array<char, 64>{};
+        formatTime(std::data(timestr), std::size(timestr), record.wall_time);
+        fmt::format_to(
+            std::back_inserter(lines_),
+            FMT_STRING("[{:s}] {:s}: {:s}{:s}"),
+            std::data(timestr),
+            name,
+            record.message(),
+            NativeEol);
+    }
+
+    libtransmission::MpscQueue<LogRecord, RingSize> ring_;
+    std::atomic<size_t> n_dropped_ = 0U;
+
+    struct WakeState
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+
+    std::atomic<bool> writer_started_ = false;
+    std::atomic<bool> wake_pending_ = false;
+    std::atomic<bool> urgent_ = false;
+
+    // Only replaced in a forked child, which has no other threads yet
+    WakeState* wake_ = new WakeState{};
+
+    // Only one thread at a time may pop from the ring
+    std::mutex consumer_mutex_;
+
+    // depends-on: consumer_mutex_
+    tr_sys_file_t file_ = TR_BAD_SYS_FILE;
+    fmt::memory_buffer lines_;
+    tr_log_message* queue_ = nullptr;
+    tr_log_message** queue_tail_ = &queue_;
+    int queue_length_ = 0;
+
+    std::mutex repeat_mutex_;
+
+    // depends-on: repeat_mutex_
+    std::map<std::pair<char const*, long>, size_t> repeat_counts_;
+};
+
+auto& log_state = tr_log_state::instance();
+
+// ---
 
 void logAddImpl(
     [[maybe_unused]] char const* file,
@@ -97,8 +459,6 @@ void logAddImpl(
         return;
     }
 
-    auto const lock = log_state.unique_lock();
-
 #if defined(__ANDROID__)
 
     int prio;
@@ -133,47 +493,16 @@ void logAddImpl(
 
 #else
 
-    if (tr_logGetQueueEnabled())
-    {
-        auto* const newmsg = new tr_log_message{};
-        newmsg->level = level;
-        newmsg->when = tr_time();
-        newmsg->message = msg;
-        newmsg->file = file;
-        newmsg->line = line;
-        newmsg->name = name;
-
-        *log_state.queue_tail_ = newmsg;
-        log_state.queue_tail_ = &newmsg->next;
-        ++log_state.queue_length_;
-
-        if (log_state.queue_length_ > TR_LOG_MAX_QUEUE_LENGTH)
-        {
-            tr_log_message* old = log_state.queue_;
-            log_state.queue_ = old->next;
-            old->next = nullptr;
-            tr_logFreeQueue(old);
-            --log_state.queue_length_;
-            TR_ASSERT(log_state.queue_length_ == TR_LOG_MAX_QUEUE_LENGTH);
-        }
-    }
-    else
-    {
-        tr_sys_file_t fp = tr_logGetFile();
-
-        if (fp == TR_BAD_SYS_FILE)
-        {
-            fp = tr_sys_file_get_std(TR_STD_SYS_FILE_ERR);
-        }
+    auto record = LogRecord{};
+    record.file = file;
+    record.line = line;
+    record.wall_time = std::chrono::system_clock::now();
+    record.when = tr_time();
+    record.level = level;
+    record.queued = tr_logGetQueueEnabled();
+    record.setText(name, msg);
+    log_state.add(std::move(record));
 
-        auto timestr = std::array<char, 64>{};
-        tr_logGetTimeStr(std::data(timestr), std::size(timestr));
-        tr_sys_file_write_line(
-            fp,
-            !std::empty(name) ? fmt::format(FMT_STRING("[{:s}] {:s}: {:s}"), std::data(timestr), name, msg) :
-                                fmt::format(FMT_STRING("[{:s}] {:s}"), std::data(timestr), msg));
-        tr_sys_file_flush(fp);
-    }
 #endif
 }
 
@@ -196,24 +525,17 @@ void tr_logSetLevel(tr_log_level level)
 
 void tr_logSetQueueEnabled(bool is_enabled)
 {
-    log_state.queue_enabled_ = is_enabled;
+    log_state.queue_enabled = is_enabled;
 }
 
 bool tr_logGetQueueEnabled()
 {
-    return log_state.queue_enabled_;
+    return log_state.queue_enabled;
 }
 
 tr_log_message* tr_logGetQueue()
 {
-    auto const lock = log_state.unique_lock();
-
-    auto* const ret = log_state.queue_;
-    log_state.queue_ = nullptr;
-    log_state.queue_tail_ = &log_state.queue_;
-    log_state.queue_length_ = 0;
-
-    return ret;
+    return log_state.takeQueue();
 }
 
 void tr_logFreeQueue(tr_log_message* freeme)
@@ -226,18 +548,21 @@ void tr_logFreeQueue(tr_log_message* freeme)
     }
 }
 
+void tr_logSetOverflowPolicy(tr_log_overflow_policy policy)
+{
+    log_state.overflow_policy = policy;
+}
+
+tr_log_overflow_policy tr_logGetOverflowPolicy()
+{
+    return log_state.overflow_policy;
+}
+
 // ---
 
 char* tr_logGetTimeStr(char* buf, size_t buflen)
 {
-    auto const a = std::chrono::system_clock::now();
-    auto const [out, len] = fmt::format_to_n(
-        buf,
-        buflen - 1,
-        "{0:%F %H:%M:}{1:%S}",
-        a,
-        std::chrono::duration_cast<std::chrono::milliseconds>(a.time_since_epoch()));
-    *out = '\0';
+    formatTime(buf, buflen, std::chrono::system_clock::now());
     return buf;
 }
 
@@ -245,14 +570,6 @@ void tr_logAddMessage(char const* file, long line, tr_log_level level, std::stri
 {
     TR_ASSERT(!std::empty(msg));
 
-    auto name_fallback = std::string{};
-    if (std::empty(name))
-    {
-        auto const base = tr_sys_path_basename(file);
-        name_fallback = fmt::format(FMT_STRING("{}:{}"), !std::empty(base) ? base : "?", line);
-        name = name_fallback;
-    }
-
     // message logging shouldn't affect errno
     int const err = errno;
 
@@ -263,18 +580,14 @@ void tr_logAddMessage(char const* file, long line, tr_log_level level, std::stri
         return;
     }
 
-    auto const lock = log_state.unique_lock();
-
     // don't log the same warning ad infinitum.
     // it's not useful after some point.
     bool last_one = false;
     if (level == TR_LOG_CRITICAL || level == TR_LOG_ERROR || level == TR_LOG_WARN)
     {
         static auto constexpr MaxRepeat = size_t{ 30 };
-        static auto counts = new std::map<std::pair<char const*, int>, size_t>{};
 
-        auto& count = (*counts)[std::make_pair(file, line)];
-        ++count;
+        auto const count = log_state.countRepeat(file, line);
         last_one = count == MaxRepeat;
         if (count > MaxRepeat)
         {
@@ -79,6 +79,24 @@ void tr_logFreeQueue(tr_log_message* freeme);
 
 // ---
 
+// What to do with a message when the log's buffer is full because
+// messages are being logged faster than they can be written out.
+enum tr_log_overflow_policy
+{
+    // Wait until there's room. Nothing is lost.
+    TR_LOG_OVERFLOW_BLOCK,
+
+    // Drop info, debug, and trace messages, and note how many were dropped.
+    // More important messages still wait.
+    TR_LOG_OVERFLOW_DROP
+};
+
+void tr_logSetOverflowPolicy(tr_log_overflow_policy policy);
+
+[[nodiscard]] tr_log_overflow_policy tr_logGetOverflowPolicy();
+
+// ---
+
 void tr_logSetLevel(tr_log_level);
 
 [[nodiscard]] tr_log_level tr_logGetLevel();
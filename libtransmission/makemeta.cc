@@ -5,6 +5,10 @@
 
 #include <algorithm>
 #include <cerrno> // for ENOENT
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <string>
@@ -17,12 +21,12 @@
 
 #include "transmission.h"
 
-#include "crypto-utils.h"
 #include "error.h"
 #include "file.h"
 #include "log.h"
 #include "makemeta.h"
 #include "session.h" // TR_NAME
+#include "sha1-batch.h"
 #include "tr-assert.h"
 #include "utils.h" // for _()
 #include "variant.h"
@@ -169,8 +173,118 @@ bool tr_metainfo_builder::setPieceSize(uint32_t piece_size) noexcept
     return true;
 }
 
+namespace
+{
+namespace checksum_helpers
+{
+
+// Pieces that have been read from disk and are waiting to be hashed.
+struct Batch
+{
+    explicit Batch(size_t batch_bytes)
+        : buf{ new char[batch_bytes] } // not zeroed, since it's about to be overwritten
+    {
+    }
+
+    tr_piece_index_t first_piece = 0;
+    std::unique_ptr<char[]> buf;
+    std::vector<std::string_view> pieces;
+};
+
+// Hands batches from the thread that reads pieces to the threads that hash them.
+// There are at most `n_batches` so that reading can't get too far ahead.
+// They're allocated as they're needed, so small jobs don't pay for them all.
+class BatchQueue
+{
+public:
+    BatchQueue(size_t n_batches, size_t batch_bytes)
+        : max_batches_{ n_batches }
+        , batch_bytes_{ batch_bytes }
+    {
+        free_.reserve(n_batches);
+    }
+
+    // @return an empty batch to read pieces into.
+    [[nodiscard]] std::unique_ptr<Batch> takeEmpty()
+    {
+        auto lock = std::unique_lock{ mutex_ };
+        if (std::empty(free_) && n_batches_ < max_batches_)
+        {
+            ++n_batches_;
+            lock.unlock();
+            return std::make_unique<Batch>(batch_bytes_);
+        }
+
+        empty_cv_.wait(lock, [this]() { return !std::empty(free_); });
+        auto batch = std::move(free_.back());
+        free_.pop_back();
+        batch->pieces.clear();
+        return batch;
+    }
+
+    void giveEmpty(std::unique_ptr<Batch> batch)
+    {
+        {
+            auto const lock = std::lock_guard{ mutex_ };
+            free_.emplace_back(std::move(batch));
+        }
+        empty_cv_.notify_one();
+    }
+
+    void push(std::unique_ptr<Batch> batch)
+    {
+        {
+            auto const lock = std::lock_guard{ mutex_ };
+            full_.emplace_back(std::move(batch));
+        }
+        full_cv_.notify_one();
+    }
+
+    // @return the next batch to hash, or nullptr if the queue is closed and drained.
+    [[nodiscard]] std::unique_ptr<Batch> pop()
+    {
+        auto lock = std::unique_lock{ mutex_ };
+        full_cv_.wait(lock, [this]() { return closed_ || !std::empty(full_); });
+        if (std::empty(full_))
+        {
+            return {};
+        }
+
+        auto batch = std::move(full_.front());
+        full_.pop_front();
+        return batch;
+    }
+
+    // No more batches will be pushed.
+    void close()
+    {
+        {
+            auto const lock = std::lock_guard{ mutex_ };
+            closed_ = true;
+        }
+        full_cv_.notify_all();
+    }
+
+private:
+    size_t const max_batches_;
+    size_t const batch_bytes_;
+    size_t n_batches_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable empty_cv_;
+    std::condition_variable full_cv_;
+    std::vector<std::unique_ptr<Batch>> free_;
+    std::deque<std::unique_ptr<Batch>> full_;
+    bool closed_ = false;
+};
+
+} // namespace checksum_helpers
+} // namespace
+
 bool tr_metainfo_builder::blockingMakeChecksums(tr_error** error)
 {
+    using namespace checksum_helpers;
+
     checksum_piece_ = 0;
     cancel_ = false;
 
@@ -181,86 +295,143 @@ bool tr_metainfo_builder::blockingMakeChecksums(tr_error** error)
     }
 
     auto hashes = std::vector<std::byte>(std::size(tr_sha1_digest_t{}) * pieceCount());
-    auto* walk = std::data(hashes);
-    auto sha = tr_sha1::create();
-
-    auto file_index = tr_file_index_t{ 0U };
-    auto piece_index = tr_piece_index_t{ 0U };
-    auto total_remain = totalSize();
-    auto off = uint64_t{ 0U };
-
-    auto buf = std::vector<char>(pieceSize());
-
-    auto const parent = tr_sys_path_dirname(top_);
-    auto fd = tr_sys_file_open(
-        tr_pathbuf{ parent, '/', path(file_index) },
-        TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL,
-        0,
-        error);
-    if (fd == TR_BAD_SYS_FILE)
-    {
-        return false;
-    }
 
-    while (!cancel_ && (total_remain > 0U))
+    // This thread reads batches of pieces while the worker threads hash them.
+    // Batches let multi-buffer SHA-1 be used, and since each batch knows
+    // where its pieces start, the hashes land in order no matter which
+    // worker finishes first.
+    //
+    // MaxBufferedBytes is a hard cap on memory use. When it doesn't leave
+    // room for a batch per thread plus one being read, use fewer threads;
+    // a thread with no batch to hash would just sit there anyway.
+    static auto constexpr MaxBatchBytes = uint64_t{ 1024U * 1024U * 32U };
+    static auto constexpr MaxBufferedBytes = uint64_t{ 1024U * 1024U * 256U };
+    auto const engine = tr_sha1_best_engine();
+    auto const wanted_workers = checksum_threads_ != 0U ?
+        checksum_threads_ :
+        std::max(size_t{ std::thread::hardware_concurrency() }, size_t{ 1U });
+    auto const batch_size = std::clamp(MaxBatchBytes / pieceSize(), uint64_t{ 1U }, uint64_t{ tr_sha1_batch_size(engine) });
+    auto const batch_bytes = batch_size * pieceSize();
+    auto const n_batches = std::clamp(MaxBufferedBytes / batch_bytes, uint64_t{ 1U }, uint64_t{ wanted_workers * 2U });
+    auto const n_workers = std::clamp(size_t(n_batches - 1U), size_t{ 1U }, wanted_workers);
+    auto queue = BatchQueue{ static_cast<size_t>(n_batches), static_cast<size_t>(batch_bytes) };
+
+    auto workers = std::vector<std::thread>{};
+    workers.reserve(n_workers);
+    for (size_t i = 0; i < n_workers; ++i)
     {
-        checksum_piece_ = piece_index;
+        workers.emplace_back(
+            [this, &queue, &hashes, engine]()
+            {
+                while (auto batch = queue.pop())
+                {
+                    if (!cancel_)
+                    {
+                        auto* walk = std::data(hashes) + size_t{ batch->first_piece } * std::size(tr_sha1_digest_t{});
+                        for (auto const& digest : tr_sha1_digest_many(batch->pieces, engine))
+                        {
+                            walk = std::copy(std::begin(digest), std::end(digest), walk);
+                        }
 
-        TR_ASSERT(piece_index < pieceCount());
+                        checksum_piece_ += static_cast<tr_piece_index_t>(std::size(batch->pieces));
+                    }
 
-        uint32_t const piece_size = block_info_.pieceSize(piece_index);
-        buf.resize(piece_size);
-        auto* bufptr = std::data(buf);
+                    queue.giveEmpty(std::move(batch));
+                }
+            });
+    }
 
-        auto left_in_piece = piece_size;
-        while (left_in_piece > 0U)
+    auto const read_pieces = [this, &queue, batch_size, error]()
+    {
+        auto file_index = tr_file_index_t{ 0U };
+        auto off = uint64_t{ 0U };
+
+        auto const parent = tr_sys_path_dirname(top_);
+        auto fd = tr_sys_file_open(
+            tr_pathbuf{ parent, '/', path(file_index) },
+            TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL,
+            0,
+            error);
+        if (fd == TR_BAD_SYS_FILE)
         {
-            auto const n_this_pass = std::min(fileSize(file_index) - off, uint64_t{ left_in_piece });
-            auto n_read = uint64_t{};
+            return false;
+        }
 
-            (void)tr_sys_file_read(fd, bufptr, n_this_pass, &n_read, error);
-            bufptr += n_read;
-            off += n_read;
-            left_in_piece -= n_read;
+        auto batch = std::unique_ptr<Batch>{};
+        for (auto piece_index = tr_piece_index_t{ 0U }; !cancel_ && piece_index < pieceCount(); ++piece_index)
+        {
+            if (!batch)
+            {
+                batch = queue.takeEmpty();
+                batch->first_piece = piece_index;
+            }
 
-            if (off == fileSize(file_index))
+            uint32_t const piece_size = block_info_.pieceSize(piece_index);
+            auto* const slot = batch->buf.get() + std::size(batch->pieces) * pieceSize();
+            auto* bufptr = slot;
+
+            auto left_in_piece = piece_size;
+            while (left_in_piece > 0U)
             {
-                off = 0;
-                tr_sys_file_close(fd);
-                fd = TR_BAD_SYS_FILE;
+                auto const n_this_pass = std::min(fileSize(file_index) - off, uint64_t{ left_in_piece });
+                auto n_read = uint64_t{};
+
+                (void)tr_sys_file_read(fd, bufptr, n_this_pass, &n_read, error);
+                bufptr += n_read;
+                off += n_read;
+                left_in_piece -= n_read;
 
-                if (++file_index < fileCount())
+                if (off == fileSize(file_index))
                 {
-                    fd = tr_sys_file_open(
-                        tr_pathbuf{ parent, '/', path(file_index) },
-                        TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL,
-                        0,
-                        error);
-                    if (fd == TR_BAD_SYS_FILE)
+                    off = 0;
+                    tr_sys_file_close(fd);
+                    fd = TR_BAD_SYS_FILE;
+
+                    if (++file_index < fileCount())
                     {
-                        return false;
+                        fd = tr_sys_file_open(
+                            tr_pathbuf{ parent, '/', path(file_index) },
+                            TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL,
+                            0,
+                            error);
+                        if (fd == TR_BAD_SYS_FILE)
+                        {
+                            return false;
+                        }
                     }
                 }
             }
+
+            TR_ASSERT(bufptr - slot == (int)piece_size);
+            TR_ASSERT(left_in_piece == 0);
+            batch->pieces.emplace_back(slot, piece_size);
+
+            if (std::size(batch->pieces) == batch_size || piece_index + 1U == pieceCount())
+            {
+                queue.push(std::move(batch));
+                batch.reset();
+            }
         }
 
-        TR_ASSERT(bufptr - std::data(buf) == (int)piece_size);
-        TR_ASSERT(left_in_piece == 0);
-        sha->add(std::data(buf), std::size(buf));
-        auto const digest = sha->finish();
-        walk = std::copy(std::begin(digest), std::end(digest), walk);
-        sha->clear();
+        if (fd != TR_BAD_SYS_FILE)
+        {
+            tr_sys_file_close(fd);
+        }
 
-        total_remain -= piece_size;
-        ++piece_index;
-    }
+        return true;
+    };
 
-    TR_ASSERT(cancel_ || size_t(walk - std::data(hashes)) == std::size(hashes));
-    TR_ASSERT(cancel_ || total_remain == 0U);
+    auto const ok = read_pieces();
 
-    if (fd != TR_BAD_SYS_FILE)
+    queue.close();
+    for (auto& worker : workers)
     {
-        tr_sys_file_close(fd);
+        worker.join();
+    }
+
+    if (!ok)
+    {
+        return false;
     }
 
     if (cancel_)
@@ -269,6 +440,8 @@ bool tr_metainfo_builder::blockingMakeChecksums(tr_error** error)
         return false;
     }
 
+    TR_ASSERT(checksum_piece_ == pieceCount());
+
     piece_hashes_ = std::move(hashes);
     return true;
 }
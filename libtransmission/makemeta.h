@@ -6,6 +6,7 @@
 #pragma once
 
 #include <algorithm> // std::move
+#include <atomic>
 #include <cstddef> // std::byte
 #include <cstdint>
 #include <future>
@@ -50,14 +51,14 @@ public:
     }
 
     // Returns the status of a `makeChecksums()` call:
-    // The current piece being tested and the total number of pieces in the torrent.
-    [[nodiscard]] constexpr std::pair<tr_piece_index_t, tr_piece_index_t> checksumStatus() const noexcept
+    // The number of pieces hashed so far and the total number of pieces in the torrent.
+    [[nodiscard]] std::pair<tr_piece_index_t, tr_piece_index_t> checksumStatus() const noexcept
     {
-        return std::make_pair(checksum_piece_, block_info_.pieceCount());
+        return std::make_pair(checksum_piece_.load(), block_info_.pieceCount());
     }
 
     // Tell the `makeChecksums()` worker thread to cleanly exit ASAP.
-    constexpr void cancelChecksums() noexcept
+    void cancelChecksums() noexcept
     {
         cancel_ = true;
     }
@@ -91,6 +92,13 @@ public:
 
     bool setPieceSize(uint32_t piece_size) noexcept;
 
+    // How many threads `makeChecksums()` hashes pieces with while
+    // its worker thread reads them. 0 means one per CPU core.
+    constexpr void setChecksumThreads(size_t n_threads) noexcept
+    {
+        checksum_threads_ = n_threads;
+    }
+
     constexpr void setPrivate(bool is_private) noexcept
     {
         is_private_ = is_private;
@@ -123,6 +131,11 @@ public:
         return comment_;
     }
 
+    [[nodiscard]] constexpr auto checksumThreads() const noexcept
+    {
+        return checksum_threads_;
+    }
+
     [[nodiscard]] TR_CONSTEXPR20 auto fileCount() const noexcept
     {
         return files_.fileCount();
@@ -235,9 +248,11 @@ private:
     std::string comment_;
     std::string source_;
 
-    tr_piece_index_t checksum_piece_ = 0;
+    size_t checksum_threads_ = 1U;
+
+    std::atomic<tr_piece_index_t> checksum_piece_ = 0;
 
     bool is_private_ = false;
     bool anonymize_ = false;
-    bool cancel_ = false;
+    std::atomic<bool> cancel_ = false;
 };
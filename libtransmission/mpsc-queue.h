@@ -0,0 +1,136 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <array>
+#include <atomic>
+#include <cstddef> // size_t, ptrdiff_t
+#include <utility>
+
+namespace libtransmission
+{
+
+// A bounded, lock-free, multi-producer single-consumer FIFO queue.
+//
+// Any thread may tryPush(), but only one thread at a time may tryPop().
+// Each slot has a sequence number that tells producers and the consumer
+// whose turn it is, so a push is one CAS on the write position plus two
+// stores, and a pop is lock-free. This is Dmitry Vyukov's bounded queue
+// with the consumer side simplified for a single consumer.
+template<typename T, size_t Capacity>
+class MpscQueue
+{
+public:
+    static_assert(Capacity >= 2U && (Capacity & (Capacity - 1U)) == 0U, "Capacity must be a power of two");
+
+    MpscQueue() noexcept
+    {
+        for (size_t i = 0; i < Capacity; ++i)
+        {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscQueue(MpscQueue&&) = delete;
+    MpscQueue(MpscQueue const&) = delete;
+    MpscQueue& operator=(MpscQueue&&) = delete;
+    MpscQueue& operator=(MpscQueue const&) = delete;
+
+    ~MpscQueue() = default;
+
+    // @return false if the queue is full, in which case `value` is left alone.
+    [[nodiscard]] bool tryPush(T&& value)
+    {
+        auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            auto& cell = cells_[pos & Mask];
+            auto const seq = cell.sequence.load(std::memory_order_acquire);
+            auto const diff = static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos);
+
+            if (diff == 0)
+            {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1U, std::memory_order_relaxed))
+                {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1U, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // the consumer hasn't caught up yet
+            }
+            else
+            {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Only call this from the consumer thread.
+    // @return false if there's nothing ready to pop. Note that a push
+    // that is still in progress can hide pushes that finished after it.
+    [[nodiscard]] bool tryPop(T& setme)
+    {
+        auto const pos = dequeue_pos_.load(std::memory_order_relaxed);
+        auto& cell = cells_[pos & Mask];
+
+        if (cell.sequence.load(std::memory_order_acquire) != pos + 1U)
+        {
+            return false;
+        }
+
+        setme = std::move(cell.value);
+        cell.value = T{};
+        cell.sequence.store(pos + Capacity, std::memory_order_release);
+        dequeue_pos_.store(pos + 1U, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Only call this from the consumer thread.
+    // @return true if every push that has started has also been popped.
+    [[nodiscard]] bool isDrained() const noexcept
+    {
+        return enqueue_pos_.load(std::memory_order_acquire) == dequeue_pos_.load(std::memory_order_relaxed);
+    }
+
+    // @return roughly how many values are waiting to be popped
+    [[nodiscard]] size_t sizeApprox() const noexcept
+    {
+        auto const dequeue_pos = dequeue_pos_.load(std::memory_order_relaxed);
+        auto const enqueue_pos = enqueue_pos_.load(std::memory_order_relaxed);
+        return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0U;
+    }
+
+    [[nodiscard]] static constexpr size_t capacity() noexcept
+    {
+        return Capacity;
+    }
+
+private:
+    static auto constexpr Mask = Capacity - 1U;
+
+    // Keep the producers' and consumer's hot data on separate cache lines.
+    static auto constexpr CacheLineSize = size_t{ 64U };
+
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::array<Cell, Capacity> cells_;
+    alignas(CacheLineSize) std::atomic<size_t> enqueue_pos_ = 0U;
+    alignas(CacheLineSize) std::atomic<size_t> dequeue_pos_ = 0U;
+};
+
+} // namespace libtransmission
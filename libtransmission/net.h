@@ -11,6 +11,7 @@
 #include <algorithm> // for std::copy_n
 #include <array>
 #include <cstddef> // size_t
+#include <functional> // std::hash
 #include <optional>
 #include <string>
 #include <string_view>
@@ -308,6 +309,19 @@ struct tr_address
     [[nodiscard]] bool is_valid_for_peers(tr_port port) const noexcept;
 };
 
+template<>
+struct std::hash<tr_address>
+{
+    // hashes the same bytes that tr_address::compare() compares
+    std::size_t operator()(tr_address const& addr) const noexcept
+    {
+        auto const bytes = addr.is_ipv4() ?
+            std::string_view{ reinterpret_cast<char const*>(&addr.addr.addr4), sizeof(addr.addr.addr4) } :
+            std::string_view{ reinterpret_cast<char const*>(&addr.addr.addr6.s6_addr), sizeof(addr.addr.addr6.s6_addr) };
+        return std::hash<std::string_view>{}(bytes);
+    }
+};
+
 // --- Sockets
 
 struct tr_session;
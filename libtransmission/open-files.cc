@@ -109,12 +109,28 @@ bool preallocate_file_full(tr_sys_file_t fd, uint64_t length, tr_error** error)
     return false;
 }
 
+[[nodiscard]] tr_open_files::Handle makeHandle(tr_sys_file_t fd)
+{
+    return { new tr_sys_file_t{ fd },
+             [](tr_sys_file_t const* pfd)
+             {
+                 if (isOpen(*pfd))
+                 {
+                     tr_sys_file_close(*pfd);
+                 }
+
+                 delete pfd;
+             } };
+}
+
 } // unnamed namespace
 
 // ---
 
-std::optional<tr_sys_file_t> tr_open_files::get(tr_torrent_id_t tor_id, tr_file_index_t file_num, bool writable)
+tr_open_files::Handle tr_open_files::acquire(tr_torrent_id_t tor_id, tr_file_index_t file_num, bool writable)
 {
+    auto const lock = std::lock_guard(pool_mutex_);
+
     if (auto* const found = pool_.get(makeKey(tor_id, file_num)); found != nullptr)
     {
         if (writable && !found->writable_)
@@ -128,7 +144,7 @@ std::optional<tr_sys_file_t> tr_open_files::get(tr_torrent_id_t tor_id, tr_file_
     return {};
 }
 
-std::optional<tr_sys_file_t> tr_open_files::get(
+tr_open_files::Handle tr_open_files::acquire(
     tr_torrent_id_t tor_id,
     tr_file_index_t file_num,
     bool writable,
@@ -136,6 +152,8 @@ std::optional<tr_sys_file_t> tr_open_files::get(
     tr_preallocation_mode allocation,
     uint64_t file_size)
 {
+    auto const lock = std::lock_guard(pool_mutex_);
+
     // is there already an entry
     auto key = makeKey(tor_id, file_num);
     if (auto* const found = pool_.get(key); found != nullptr)
@@ -241,31 +259,26 @@ std::optional<tr_sys_file_t> tr_open_files::get(
 
     // cache it
     auto& entry = pool_.add(std::move(key));
-    entry.fd_ = fd;
+    entry.fd_ = makeHandle(fd);
     entry.writable_ = writable;
 
-    return fd;
+    return entry.fd_;
 }
 
 void tr_open_files::closeAll()
 {
+    auto const lock = std::lock_guard(pool_mutex_);
     pool_.clear();
 }
 
 void tr_open_files::closeTorrent(tr_torrent_id_t tor_id)
 {
-    return pool_.erase_if([&tor_id](Key const& key, Val const& /*unused*/) { return key.first == tor_id; });
+    auto const lock = std::lock_guard(pool_mutex_);
+    pool_.erase_if([&tor_id](Key const& key, Val const& /*unused*/) { return key.first == tor_id; });
 }
 
 void tr_open_files::closeFile(tr_torrent_id_t tor_id, tr_file_index_t file_num)
 {
+    auto const lock = std::lock_guard(pool_mutex_);
     pool_.erase(makeKey(tor_id, file_num));
 }
-
-tr_open_files::Val::~Val()
-{
-    if (isOpen(fd_))
-    {
-        tr_sys_file_close(fd_);
-    }
-}
@@ -11,7 +11,8 @@
 
 #include <cstddef> // for size_t
 #include <cstdint> // for uintX_t
-#include <optional>
+#include <memory>
+#include <mutex>
 #include <string_view>
 #include <utility>
 
@@ -22,13 +23,18 @@
 
 struct tr_session;
 
-// A pool of open files that are cached while reading / writing torrents' data
+// A pool of open files that are cached while reading / writing torrents' data.
+// It is safe to use from both the session thread and the disk I/O workers.
 class tr_open_files
 {
 public:
-    [[nodiscard]] std::optional<tr_sys_file_t> get(tr_torrent_id_t tor_id, tr_file_index_t file_num, bool writable);
+    // A reference to an open file. The file stays open for as long as
+    // the handle is held, even if the pool evicts or closes it meanwhile.
+    using Handle = std::shared_ptr<tr_sys_file_t const>;
 
-    [[nodiscard]] std::optional<tr_sys_file_t> get(
+    [[nodiscard]] Handle acquire(tr_torrent_id_t tor_id, tr_file_index_t file_num, bool writable);
+
+    [[nodiscard]] Handle acquire(
         tr_torrent_id_t tor_id,
         tr_file_index_t file_num,
         bool writable,
@@ -50,25 +56,11 @@ private:
 
     struct Val
     {
-        Val() noexcept = default;
-        Val(Val const&) = delete;
-        Val& operator=(Val const&) = delete;
-        Val(Val&& that) noexcept
-        {
-            *this = std::move(that);
-        }
-        Val& operator=(Val&& that) noexcept
-        {
-            std::swap(this->fd_, that.fd_);
-            std::swap(this->writable_, that.writable_);
-            return *this;
-        }
-        ~Val();
-
-        tr_sys_file_t fd_ = TR_BAD_SYS_FILE;
+        Handle fd_;
         bool writable_ = false;
     };
 
     static constexpr size_t MaxOpenFiles = 32;
     tr_lru_cache<Key, Val, MaxOpenFiles> pool_;
+    std::mutex pool_mutex_;
 };
@@ -45,6 +45,9 @@ public:
         ClientGotSuggest,
         ClientGotPort,
         ClientGotRej,
+        // Bitfield, HaveAll, and HaveNone are published before the peer's
+        // `has()` is updated so that listeners can see what changed.
+        // Have is published after.
         ClientGotBitfield,
         ClientGotHave,
         ClientGotHaveAll,
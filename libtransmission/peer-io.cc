@@ -9,6 +9,7 @@
 #include <cstdint>
 #include <cstring>
 #include <string>
+#include <string_view>
 
 #include <event2/event.h>
 #include <event2/bufferevent.h>
@@ -27,6 +28,8 @@
 #include "tr-utp.h"
 #include "utils.h" // for _()
 
+using namespace std::literals;
+
 #ifdef _WIN32
 #undef EAGAIN
 #define EAGAIN WSAEWOULDBLOCK
@@ -326,6 +329,8 @@ void tr_peerIo::event_write_cb([[maybe_unused]] evutil_socket_t fd, short /*even
 
     io->pending_events_ &= ~EV_WRITE;
 
+    auto const timer = io->session_->perfStats().time("peer-io.write"sv);
+
     // Write as much as possible. Since the socket is non-blocking,
     // write() will return if it can't write any more without blocking
     io->try_write(SIZE_MAX);
@@ -450,6 +455,8 @@ void tr_peerIo::event_read_cb([[maybe_unused]] evutil_socket_t fd, short /*event
 
     io->pending_events_ &= ~EV_READ;
 
+    auto const timer = io->session_->perfStats().time("peer-io.read"sv);
+
     // if we don't have any bandwidth left, stop reading
     auto const n_used = std::size(io->inbuf_);
     auto const n_left = n_used >= MaxLen ? 0 : MaxLen - n_used;
@@ -575,8 +582,13 @@ size_t tr_peerIo::get_write_buffer_space(uint64_t now) const noexcept
 
 void tr_peerIo::write(libtransmission::Buffer& buf, bool is_piece_data)
 {
-    auto [bytes, len] = buf.pullup();
-    encrypt(len, bytes);
+    // don't pull up unencrypted buffers: they may hold file segments
+    if (is_encrypted())
+    {
+        auto [bytes, len] = buf.pullup();
+        encrypt(len, bytes);
+    }
+
     outbuf_info_.emplace_back(std::size(buf), is_piece_data);
     outbuf_.add(buf);
 }
@@ -256,6 +256,18 @@ public:
         return filter_.is_active();
     }
 
+    // Whether `write()` accepts buffers holding file segments (see
+    // `libtransmission::Buffer::add_file()`). Those bytes are never
+    // copied into memory, so they can only go unencrypted over TCP.
+    [[nodiscard]] constexpr auto supports_file_segments() const noexcept
+    {
+#ifdef _WIN32
+        return false;
+#else
+        return socket_.is_tcp() && !is_encrypted();
+#endif
+    }
+
     void decrypt_init(bool is_incoming, DH const& dh, tr_sha1_digest_t const& info_hash)
     {
         filter_.decryptInit(is_incoming, dh, info_hash);
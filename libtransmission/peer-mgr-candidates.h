@@ -0,0 +1,188 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef LIBTRANSMISSION_PEER_MODULE
+#error only the libtransmission peer module should #include this header.
+#endif
+
+#include <algorithm> // std::make_heap, std::pop_heap, std::push_heap
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <ctime> // time_t
+#include <functional> // std::greater
+#include <unordered_map>
+#include <vector>
+
+/**
+ * The peers that a swarm might want to connect to, best first.
+ *
+ * Each item is either ready, ranked by a key where smaller is better,
+ * or waiting until a given time. Adding an item that's already queued
+ * replaces its old entry. Replaced entries are skipped when they reach
+ * the front instead of being searched for, so every change is O(log n)
+ * and nothing ever needs to look at the whole queue.
+ *
+ * The queue doesn't know what makes an item a good candidate, so the
+ * caller must re-add items when that changes, e.g. when a connection
+ * closes, and should double-check `top()` before using it.
+ */
+template<typename Item>
+class PeerCandidateQueue
+{
+public:
+    using Key = uint64_t;
+
+    // Queues `item` as ready to use, replacing any entry it already has.
+    void push(Item* item, Key key)
+    {
+        ready_.push_back({ key, item, track(item) });
+        std::push_heap(std::begin(ready_), std::end(ready_), std::greater{});
+        maybeCompact();
+    }
+
+    // Queues `item` to wait until `when`, replacing any entry it already has.
+    void schedule(Item* item, time_t when)
+    {
+        waiting_.push_back({ static_cast<Key>(when), item, track(item) });
+        std::push_heap(std::begin(waiting_), std::end(waiting_), std::greater{});
+        maybeCompact();
+    }
+
+    void remove(Item* item)
+    {
+        generations_.erase(item);
+    }
+
+    // Dequeues and returns the items whose wait is over at `now`.
+    // The caller decides whether to push() them or leave them out.
+    [[nodiscard]] std::vector<Item*> popDue(time_t now)
+    {
+        auto due = std::vector<Item*>{};
+
+        while (!std::empty(waiting_) && waiting_.front().key <= static_cast<Key>(now))
+        {
+            std::pop_heap(std::begin(waiting_), std::end(waiting_), std::greater{});
+            auto const entry = waiting_.back();
+            waiting_.pop_back();
+
+            if (isLive(entry))
+            {
+                generations_.erase(entry.item);
+                due.push_back(entry.item);
+            }
+        }
+
+        return due;
+    }
+
+    // @return the best ready item, or nullptr if none are ready
+    [[nodiscard]] Item* top()
+    {
+        skipStale();
+        return std::empty(ready_) ? nullptr : ready_.front().item;
+    }
+
+    // @return the key that top() was queued with
+    [[nodiscard]] Key topKey()
+    {
+        skipStale();
+        return std::empty(ready_) ? Key{} : ready_.front().key;
+    }
+
+    void pop()
+    {
+        skipStale();
+
+        if (!std::empty(ready_))
+        {
+            generations_.erase(ready_.front().item);
+            std::pop_heap(std::begin(ready_), std::end(ready_), std::greater{});
+            ready_.pop_back();
+        }
+    }
+
+    void clear() noexcept
+    {
+        ready_.clear();
+        waiting_.clear();
+        generations_.clear();
+    }
+
+    // @return how many items are queued, ready or waiting
+    [[nodiscard]] size_t size() const noexcept
+    {
+        return std::size(generations_);
+    }
+
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return std::empty(generations_);
+    }
+
+private:
+    struct Entry
+    {
+        Key key;
+        Item* item;
+        uint64_t generation;
+
+        [[nodiscard]] constexpr bool operator>(Entry const& that) const noexcept
+        {
+            // break ties by queueing order
+            return key != that.key ? key > that.key : generation > that.generation;
+        }
+    };
+
+    uint64_t track(Item* item)
+    {
+        auto const generation = ++next_generation_;
+        generations_[item] = generation;
+        return generation;
+    }
+
+    [[nodiscard]] bool isLive(Entry const& entry) const
+    {
+        auto const iter = generations_.find(entry.item);
+        return iter != std::end(generations_) && iter->second == entry.generation;
+    }
+
+    void skipStale()
+    {
+        while (!std::empty(ready_) && !isLive(ready_.front()))
+        {
+            std::pop_heap(std::begin(ready_), std::end(ready_), std::greater{});
+            ready_.pop_back();
+        }
+    }
+
+    // Drop replaced entries once they outnumber the live ones,
+    // so that items that are re-added often can't grow the heaps forever.
+    void maybeCompact()
+    {
+        static auto constexpr MinEntries = size_t{ 64U };
+
+        if (std::size(ready_) + std::size(waiting_) <= std::max(MinEntries, std::size(generations_) * 2U))
+        {
+            return;
+        }
+
+        for (auto* const heap : { &ready_, &waiting_ })
+        {
+            heap->erase(
+                std::remove_if(std::begin(*heap), std::end(*heap), [this](auto const& entry) { return !isLive(entry); }),
+                std::end(*heap));
+            std::make_heap(std::begin(*heap), std::end(*heap), std::greater{});
+        }
+    }
+
+    std::vector<Entry> ready_;
+    std::vector<Entry> waiting_;
+
+    // the generation of each queued item's live entry
+    std::unordered_map<Item*, uint64_t> generations_;
+    uint64_t next_generation_ = 0U;
+};
@@ -5,8 +5,6 @@
 
 #include <algorithm>
 #include <cstddef>
-#include <set>
-#include <utility>
 #include <vector>
 
 #define LIBTRANSMISSION_PEER_MODULE
@@ -20,112 +18,155 @@
 namespace
 {
 
-struct Candidate
+std::vector<tr_block_span_t> makeSpans(tr_block_index_t const* sorted_blocks, size_t n_blocks)
 {
-    tr_piece_index_t piece;
-    size_t n_blocks_missing;
-    tr_priority_t priority;
-    uint8_t salt;
-
-    Candidate(tr_piece_index_t piece_in, size_t missing_in, tr_priority_t priority_in, uint8_t salt_in)
-        : piece{ piece_in }
-        , n_blocks_missing{ missing_in }
-        , priority{ priority_in }
-        , salt{ salt_in }
+    if (n_blocks == 0)
     {
+        return {};
     }
 
-    [[nodiscard]] int compare(Candidate const& that) const // <=>
+    auto spans = std::vector<tr_block_span_t>{};
+    auto cur = tr_block_span_t{ sorted_blocks[0], sorted_blocks[0] + 1 };
+    for (size_t i = 1; i < n_blocks; ++i)
     {
-        // prefer pieces closer to completion
-        if (n_blocks_missing != that.n_blocks_missing)
+        if (cur.end == sorted_blocks[i])
         {
-            return n_blocks_missing < that.n_blocks_missing ? -1 : 1;
+            ++cur.end;
         }
-
-        // prefer higher priority
-        if (priority != that.priority)
+        else
         {
-            return priority > that.priority ? -1 : 1;
+            spans.push_back(cur);
+            cur = tr_block_span_t{ sorted_blocks[i], sorted_blocks[i] + 1 };
         }
+    }
+    spans.push_back(cur);
 
-        if (salt != that.salt)
-        {
-            return salt < that.salt ? -1 : 1;
-        }
+    return spans;
+}
+
+} // namespace
+
+int Wishlist::Candidate::compare(Candidate const& that) const noexcept
+{
+    // prefer pieces closer to completion
+    if (n_blocks_missing != that.n_blocks_missing)
+    {
+        return n_blocks_missing < that.n_blocks_missing ? -1 : 1;
+    }
 
-        return 0;
+    // prefer higher priority
+    if (priority != that.priority)
+    {
+        return priority > that.priority ? -1 : 1;
     }
 
-    bool operator<(Candidate const& that) const // less than
+    // prefer rarer pieces
+    if (replication != that.replication)
     {
-        return compare(that) < 0;
+        return replication < that.replication ? -1 : 1;
     }
-};
 
-std::vector<Candidate> getCandidates(Wishlist::Mediator const& mediator)
+    if (salt != that.salt)
+    {
+        return salt < that.salt ? -1 : 1;
+    }
+
+    // pieces are unique, so this keeps candidates with equal keys distinct
+    if (piece != that.piece)
+    {
+        return piece < that.piece ? -1 : 1;
+    }
+
+    return 0;
+}
+
+void Wishlist::pieceChanged(tr_piece_index_t piece)
 {
-    // count up the pieces that we still want
-    auto wanted_pieces = std::vector<std::pair<tr_piece_index_t, size_t>>{};
-    auto const n_pieces = mediator.countAllPieces();
-    wanted_pieces.reserve(n_pieces);
-    for (tr_piece_index_t i = 0; i < n_pieces; ++i)
+    if (needs_rebuild_ || piece >= std::size(is_dirty_) || is_dirty_[piece])
     {
-        if (!mediator.clientCanRequestPiece(i))
-        {
-            continue;
-        }
+        return;
+    }
 
-        size_t const n_missing = mediator.countMissingBlocks(i);
-        if (n_missing == 0)
-        {
-            continue;
-        }
+    // if most of the pieces changed, it's cheaper to re-sort everything
+    if (std::size(dirty_pieces_) >= std::size(is_dirty_) / 4U)
+    {
+        invalidate();
+        return;
+    }
 
-        wanted_pieces.emplace_back(i, n_missing);
+    is_dirty_[piece] = true;
+    dirty_pieces_.push_back(piece);
+}
+
+void Wishlist::invalidate() noexcept
+{
+    needs_rebuild_ = true;
+}
+
+void Wishlist::update(Mediator const& mediator, tr_piece_index_t piece)
+{
+    auto& iter = piece_to_candidate_[piece];
+
+    if (iter != std::end(candidates_))
+    {
+        candidates_.erase(iter);
+        iter = std::end(candidates_);
+    }
+
+    if (!mediator.clientWantsPiece(piece))
+    {
+        return;
     }
 
-    // transform them into candidates
-    auto salter = tr_salt_shaker{};
-    auto const n = std::size(wanted_pieces);
-    auto candidates = std::vector<Candidate>{};
-    candidates.reserve(n);
-    for (size_t i = 0; i < n; ++i)
+    auto const n_missing = mediator.countMissingBlocks(piece);
+    if (n_missing == 0)
     {
-        auto const [piece, n_missing] = wanted_pieces[i];
-        candidates.emplace_back(piece, n_missing, mediator.priority(piece), salter());
+        return;
     }
 
-    return candidates;
+    auto const replication = mediator.countPeersWithPiece(piece);
+    iter = candidates_.insert(Candidate{ piece, n_missing, mediator.priority(piece), replication, salt_[piece] }).first;
 }
 
-std::vector<tr_block_span_t> makeSpans(tr_block_index_t const* sorted_blocks, size_t n_blocks)
+void Wishlist::rebuild(Mediator const& mediator)
 {
-    if (n_blocks == 0)
+    auto const n_pieces = mediator.countAllPieces();
+
+    if (std::size(salt_) != n_pieces)
     {
-        return {};
+        auto salter = tr_salt_shaker{};
+        salt_.resize(n_pieces);
+        std::generate(std::begin(salt_), std::end(salt_), [&salter]() { return salter(); });
     }
 
-    auto spans = std::vector<tr_block_span_t>{};
-    auto cur = tr_block_span_t{ sorted_blocks[0], sorted_blocks[0] + 1 };
-    for (size_t i = 1; i < n_blocks; ++i)
+    candidates_.clear();
+    piece_to_candidate_.assign(n_pieces, std::end(candidates_));
+    for (tr_piece_index_t piece = 0; piece < n_pieces; ++piece)
     {
-        if (cur.end == sorted_blocks[i])
-        {
-            ++cur.end;
-        }
-        else
-        {
-            spans.push_back(cur);
-            cur = tr_block_span_t{ sorted_blocks[i], sorted_blocks[i] + 1 };
-        }
+        update(mediator, piece);
     }
-    spans.push_back(cur);
 
-    return spans;
+    dirty_pieces_.clear();
+    is_dirty_.assign(n_pieces, false);
+    needs_rebuild_ = false;
 }
 
-} // namespace
+void Wishlist::refresh(Mediator const& mediator)
+{
+    if (needs_rebuild_ || std::size(piece_to_candidate_) != mediator.countAllPieces())
+    {
+        rebuild(mediator);
+        return;
+    }
+
+    for (auto const piece : dirty_pieces_)
+    {
+        is_dirty_[piece] = false;
+        update(mediator, piece);
+    }
+
+    dirty_pieces_.clear();
+}
 
 std::vector<tr_block_span_t> Wishlist::next(Wishlist::Mediator const& mediator, size_t n_wanted_blocks)
 {
@@ -134,15 +175,12 @@ std::vector<tr_block_span_t> Wishlist::next(Wishlist::Mediator const& mediator,
         return {};
     }
 
-    // We usually won't need all the candidates until endgame, so don't
-    // waste cycles sorting all of them here. partial sort is enough.
-    auto candidates = getCandidates(mediator);
-    auto constexpr MaxSortedPieces = size_t{ 30 };
-    auto const middle = std::min(std::size(candidates), MaxSortedPieces);
-    std::partial_sort(std::begin(candidates), std::begin(candidates) + middle, std::end(candidates));
+    refresh(mediator);
 
-    auto blocks = std::set<tr_block_index_t>{};
-    for (auto const& candidate : candidates)
+    auto const max_peers = mediator.isEndgame() ? size_t{ 2U } : size_t{ 1U };
+    auto blocks = std::vector<tr_block_index_t>{};
+    blocks.reserve(n_wanted_blocks);
+    for (auto const& candidate : candidates_)
     {
         // do we have enough?
         if (std::size(blocks) >= n_wanted_blocks)
@@ -150,6 +188,12 @@ std::vector<tr_block_span_t> Wishlist::next(Wishlist::Mediator const& mediator,
             break;
         }
 
+        // can we get this piece from this peer?
+        if (!mediator.clientCanRequestPiece(candidate.piece))
+        {
+            continue;
+        }
+
         // walk the blocks in this piece
         auto const [begin, end] = mediator.blockSpan(candidate.piece);
         for (tr_block_index_t block = begin; block < end && std::size(blocks) < n_wanted_blocks; ++block)
@@ -161,16 +205,16 @@ std::vector<tr_block_span_t> Wishlist::next(Wishlist::Mediator const& mediator,
             }
 
             // don't request from too many peers
-            size_t const n_peers = mediator.countActiveRequests(block);
-            if (size_t const max_peers = mediator.isEndgame() ? 2 : 1; n_peers >= max_peers)
+            if (mediator.countActiveRequests(block) >= max_peers)
             {
                 continue;
             }
 
-            blocks.insert(block);
+            blocks.push_back(block);
         }
     }
 
-    auto const blocks_v = std::vector<tr_block_index_t>{ std::begin(blocks), std::end(blocks) };
-    return makeSpans(std::data(blocks_v), std::size(blocks_v));
+    // candidates are sorted by desirability, not by index
+    std::sort(std::begin(blocks), std::end(blocks));
+    return makeSpans(std::data(blocks), std::size(blocks));
 }
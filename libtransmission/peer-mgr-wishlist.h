@@ -10,6 +10,8 @@
 #endif
 
 #include <cstddef> // size_t
+#include <cstdint> // uint8_t
+#include <set>
 #include <vector>
 
 #include "transmission.h"
@@ -18,6 +20,10 @@
 
 /**
  * Figures out what blocks we want to request next.
+ *
+ * The candidate pieces are kept sorted between calls to `next()`, so
+ * picking requests for a peer doesn't need to rescan the whole torrent.
+ * Instead, the wishlist must be told when a piece's state changes.
  */
 class Wishlist
 {
@@ -26,9 +32,13 @@ public:
     {
         [[nodiscard]] virtual bool clientCanRequestBlock(tr_block_index_t block) const = 0;
         [[nodiscard]] virtual bool clientCanRequestPiece(tr_piece_index_t piece) const = 0;
+        [[nodiscard]] virtual bool clientWantsPiece(tr_piece_index_t piece) const = 0;
         [[nodiscard]] virtual bool isEndgame() const = 0;
         [[nodiscard]] virtual size_t countActiveRequests(tr_block_index_t block) const = 0;
         [[nodiscard]] virtual size_t countMissingBlocks(tr_piece_index_t piece) const = 0;
+        // Only used to rank pieces by rarity, so peers that have every
+        // piece (i.e. seeds) can be left out of this count.
+        [[nodiscard]] virtual size_t countPeersWithPiece(tr_piece_index_t piece) const = 0;
         [[nodiscard]] virtual tr_block_span_t blockSpan(tr_piece_index_t) const = 0;
         [[nodiscard]] virtual tr_piece_index_t countAllPieces() const = 0;
         [[nodiscard]] virtual tr_priority_t priority(tr_piece_index_t) const = 0;
@@ -36,5 +46,49 @@ public:
     };
 
     // get a list of the next blocks that we should request from a peer
-    static std::vector<tr_block_span_t> next(Mediator const& mediator, size_t n_wanted_blocks);
+    [[nodiscard]] std::vector<tr_block_span_t> next(Mediator const& mediator, size_t n_wanted_blocks);
+
+    // Call this when a piece's missing block count or availability changes.
+    // The piece is re-sorted the next time `next()` is called.
+    void pieceChanged(tr_piece_index_t piece);
+
+    // Call this when many pieces change at once, e.g. when file priorities
+    // change or when the torrent is verified. Everything is re-sorted the
+    // next time `next()` is called.
+    void invalidate() noexcept;
+
+private:
+    struct Candidate
+    {
+        tr_piece_index_t piece;
+        size_t n_blocks_missing;
+        tr_priority_t priority;
+        size_t replication;
+        uint8_t salt;
+
+        [[nodiscard]] int compare(Candidate const& that) const noexcept; // <=>
+
+        [[nodiscard]] bool operator<(Candidate const& that) const noexcept // less than
+        {
+            return compare(that) < 0;
+        }
+    };
+
+    using Candidates = std::set<Candidate>;
+
+    void refresh(Mediator const& mediator);
+    void rebuild(Mediator const& mediator);
+    void update(Mediator const& mediator, tr_piece_index_t piece);
+
+    Candidates candidates_;
+
+    // where each piece is in `candidates_`, or `std::end(candidates_)` if it's not a candidate
+    std::vector<Candidates::iterator> piece_to_candidate_;
+
+    // random tiebreakers so that otherwise-equal pieces are picked in random order
+    std::vector<uint8_t> salt_;
+
+    std::vector<tr_piece_index_t> dirty_pieces_;
+    std::vector<bool> is_dirty_;
+    bool needs_rebuild_ = true;
 };
@@ -17,6 +17,7 @@
 #include <memory>
 #include <optional>
 #include <tuple> // std::tie
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -37,6 +38,7 @@
 #include "net.h"
 #include "peer-io.h"
 #include "peer-mgr-active-requests.h"
+#include "peer-mgr-candidates.h"
 #include "peer-mgr-wishlist.h"
 #include "peer-mgr.h"
 #include "peer-msgs.h"
@@ -150,6 +152,7 @@ struct peer_atom
         , fromFirst{ from }
         , fromBest{ from }
         , flags{ flags_in }
+        , salt{ salter_() }
     {
         ++n_atoms;
     }
@@ -291,9 +294,14 @@ struct peer_atom
     bool utp_failed = false; /* We recently failed to connect over µTP */
     bool is_connected = false;
 
+    uint8_t const salt; /* breaks ties between otherwise-equal connection candidates */
+
 private:
     mutable std::optional<bool> blocklisted_;
 
+    // atoms are only created in the session thread
+    static inline tr_salt_shaker<> salter_;
+
     // the minimum we'll wait before attempting to reconnect to a peer
     static auto constexpr MinimumReconnectIntervalSecs = int{ 5 };
 
@@ -319,6 +327,7 @@ public:
         , tor{ tor_in }
     {
         rebuildWebseeds();
+        rebuildAvailability();
     }
 
     tr_swarm(tr_swarm&&) = delete;
@@ -381,6 +390,7 @@ public:
         is_running = false;
         removeAllPeers();
         outgoing_handshakes.clear();
+        candidates.clear();
     }
 
     void removePeer(tr_peer* peer)
@@ -402,7 +412,11 @@ public:
 
         TR_ASSERT(stats.peer_count == peerCount());
 
+        updateAvailability(peer->has(), false);
+
         delete peer;
+
+        queueCandidate(*atom);
     }
 
     void removeAllPeers()
@@ -473,22 +487,44 @@ public:
         pool_is_all_seeds_.reset();
     }
 
+    // --- piece availability
+
+    // @return the number of connected peers that have `piece`
+    [[nodiscard]] size_t countPeersWithPiece(tr_piece_index_t piece) const noexcept
+    {
+        return seed_count_ + countNonSeedsWithPiece(piece);
+    }
+
+    // @return the number of connected peers that have `piece` but aren't seeds.
+    // This is what rarest-first ranks by, since seeds have every piece.
+    [[nodiscard]] size_t countNonSeedsWithPiece(tr_piece_index_t piece) const noexcept
+    {
+        return piece < std::size(piece_replication_) ? piece_replication_[piece] : 0U;
+    }
+
+    void rebuildAvailability()
+    {
+        piece_replication_.assign(tor->pieceCount(), 0U);
+        seed_count_ = 0U;
+
+        for (auto const* const peer : peers)
+        {
+            updateAvailability(peer->has(), true);
+        }
+
+        wishlist.invalidate();
+    }
+
     [[nodiscard]] peer_atom* get_existing_atom(tr_address const& addr) noexcept
     {
-        auto const iter = std::find_if(
-            std::begin(pool),
-            std::end(pool),
-            [&addr](auto const& atom) { return atom.addr == addr; });
-        return iter != std::end(pool) ? &*iter : nullptr;
+        auto const iter = atoms_by_addr_.find(addr);
+        return iter != std::end(atoms_by_addr_) ? iter->second : nullptr;
     }
 
     [[nodiscard]] peer_atom const* get_existing_atom(tr_address const& addr) const noexcept
     {
-        auto const iter = std::find_if(
-            std::begin(pool),
-            std::end(pool),
-            [&addr](auto const& atom) { return atom.addr == addr; });
-        return iter != std::end(pool) ? &*iter : nullptr;
+        auto const iter = atoms_by_addr_.find(addr);
+        return iter != std::end(atoms_by_addr_) ? iter->second : nullptr;
     }
 
     [[nodiscard]] bool peer_is_a_seed(tr_address const& addr) const noexcept
@@ -507,11 +543,14 @@ public:
         if (atom == nullptr)
         {
             atom = &pool.emplace_back(addr, port, flags, from);
+            atoms_by_addr_.try_emplace(addr, atom);
+            queueCandidate(*atom);
         }
-        else
+        else if (from < atom->fromBest || (atom->flags | flags) != atom->flags)
         {
             atom->fromBest = std::min(atom->fromBest, from);
             atom->flags |= flags;
+            queueCandidate(*atom);
         }
 
         markAllSeedsFlagDirty();
@@ -524,8 +563,21 @@ public:
         tr_logAddTraceSwarm(this, fmt::format("marking peer {} as a seed", atom.display_name()));
         atom.flags |= ADDED_F_SEED_FLAG;
         markAllSeedsFlagDirty();
+        queueCandidate(atom);
     }
 
+    // --- outgoing connection candidates
+
+    // Queues `atom` to be considered for an outgoing connection.
+    // Call this whenever something that getAtomCandidateKey() or
+    // the reconnect interval looks at changes.
+    void queueCandidate(peer_atom& atom);
+
+    // Requeues every atom in the pool.
+    // Call this when something that affects the whole swarm changes,
+    // e.g. the torrent starting or the blocklist being edited.
+    void rebuildCandidates();
+
     static void peerCallbackFunc(tr_peer* peer, tr_peer_event const& event, void* vs)
     {
         TR_ASSERT(peer != nullptr);
@@ -572,11 +624,27 @@ public:
             }
 
         case tr_peer_event::Type::ClientGotHave:
+            s->onPeerGotPiece(peer->has(), event.pieceIndex);
+            break;
+
         case tr_peer_event::Type::ClientGotHaveAll:
+            {
+                auto have = tr_bitfield{ 0U };
+                have.setHasAll();
+                s->onPeerHasChanged(peer->has(), have);
+                break;
+            }
+
         case tr_peer_event::Type::ClientGotHaveNone:
+            {
+                auto have = tr_bitfield{ 0U };
+                have.setHasNone();
+                s->onPeerHasChanged(peer->has(), have);
+                break;
+            }
+
         case tr_peer_event::Type::ClientGotBitfield:
-            /* TODO: if we don't need these, should these events be removed? */
-            /* noop */
+            s->onPeerHasChanged(peer->has(), *event.bitfield);
             break;
 
         case tr_peer_event::Type::ClientGotRej:
@@ -606,6 +674,7 @@ public:
                 auto const loc = tor->pieceLoc(event.pieceIndex, event.offset);
                 s->cancelAllRequestsForBlock(loc.block, peer);
                 peer->blocks_sent_to_client.add(tr_time(), 1);
+                s->wishlist.pieceChanged(loc.piece);
                 tr_torrentGotBlock(tor, loc.block);
                 break;
             }
@@ -647,6 +716,8 @@ public:
 
     ActiveRequests active_requests;
 
+    Wishlist wishlist;
+
     // depends-on: active_requests
     std::vector<std::unique_ptr<tr_peer>> webseeds;
 
@@ -655,9 +726,16 @@ public:
 
     // tr_peers hold pointers to the items in this container,
     // so use a deque instead of vector to prevent insertion from
-    // invalidating those pointers
+    // invalidating those pointers.
+    // Only add to this with ensure_atom_exists(), which keeps it indexed.
     std::deque<peer_atom> pool;
 
+    // the atoms in `pool` that we might want to connect to, best first
+    PeerCandidateQueue<peer_atom> candidates;
+
+    // whether the torrent was done the last time `candidates` was rebuilt
+    bool candidates_seeding = false;
+
     tr_peerMsgs* optimistic = nullptr; /* the optimistic peer, or nullptr if none */
 
     time_t lastCancel = 0;
@@ -673,6 +751,72 @@ private:
         }
     }
 
+    // Called when a peer sends a HAVE.
+    // `have` is the peer's bitfield, which already includes `piece`.
+    void onPeerGotPiece(tr_bitfield const& have, tr_piece_index_t piece)
+    {
+        if (piece >= std::size(piece_replication_))
+        {
+            return;
+        }
+
+        ++piece_replication_[piece];
+
+        if (!have.hasAll())
+        {
+            wishlist.pieceChanged(piece);
+            return;
+        }
+
+        // that was the peer's last missing piece, so move it to the seed count
+        for (auto& n : piece_replication_)
+        {
+            TR_ASSERT(n > 0U);
+            --n;
+        }
+        ++seed_count_;
+        wishlist.invalidate();
+    }
+
+    // Called when a peer sends a BITFIELD, HAVE_ALL, or HAVE_NONE.
+    void onPeerHasChanged(tr_bitfield const& old_have, tr_bitfield const& new_have)
+    {
+        updateAvailability(old_have, false);
+        updateAvailability(new_have, true);
+    }
+
+    void updateAvailability(tr_bitfield const& have, bool is_added)
+    {
+        // Seeds are counted separately so that they can come and go without
+        // touching every piece. Seeds don't make any piece rarer than another,
+        // so the wishlist doesn't need to hear about them either.
+        if (have.hasAll())
+        {
+            TR_ASSERT(is_added || seed_count_ > 0U);
+            seed_count_ = is_added ? seed_count_ + 1U : seed_count_ - 1U;
+            return;
+        }
+
+        if (have.hasNone())
+        {
+            return;
+        }
+
+        auto const n_pieces = static_cast<tr_piece_index_t>(std::min(std::size(piece_replication_), std::size(have)));
+        for (tr_piece_index_t piece = 0; piece < n_pieces; ++piece)
+        {
+            if (!have.test(piece))
+            {
+                continue;
+            }
+
+            auto& n = piece_replication_[piece];
+            TR_ASSERT(is_added || n > 0U);
+            n = is_added ? n + 1U : n - 1U;
+            wishlist.pieceChanged(piece);
+        }
+    }
+
     // number of bad pieces a peer is allowed to send before we ban them
     static auto constexpr MaxBadPiecesPerPeer = int{ 5 };
 
@@ -681,6 +825,15 @@ private:
 
     mutable std::optional<bool> pool_is_all_seeds_;
 
+    // depends-on: pool
+    std::unordered_map<tr_address, peer_atom*> atoms_by_addr_;
+
+    // how many connected non-seed peers have each piece
+    std::vector<uint16_t> piece_replication_;
+
+    // how many connected peers have every piece
+    size_t seed_count_ = 0U;
+
     bool is_endgame_ = false;
 };
 
@@ -806,6 +959,8 @@ void tr_peerMgrOnBlocklistChanged(tr_peerMgr* mgr)
         {
             atom.setBlocklistedDirty();
         }
+
+        tor->swarm->rebuildCandidates();
     }
 }
 
@@ -884,6 +1039,11 @@ std::vector<tr_block_span_t> tr_peerMgrGetNextRequests(tr_torrent* torrent, tr_p
             return torrent_->pieceIsWanted(piece) && peer_->hasPiece(piece);
         }
 
+        [[nodiscard]] bool clientWantsPiece(tr_piece_index_t piece) const override
+        {
+            return torrent_->pieceIsWanted(piece);
+        }
+
         [[nodiscard]] bool isEndgame() const override
         {
             return swarm_->isEndgame();
@@ -899,6 +1059,11 @@ std::vector<tr_block_span_t> tr_peerMgrGetNextRequests(tr_torrent* torrent, tr_p
             return torrent_->countMissingBlocksInPiece(piece);
         }
 
+        [[nodiscard]] size_t countPeersWithPiece(tr_piece_index_t piece) const override
+        {
+            return swarm_->countNonSeedsWithPiece(piece);
+        }
+
         [[nodiscard]] tr_block_span_t blockSpan(tr_piece_index_t piece) const override
         {
             return torrent_->blockSpanForPiece(piece);
@@ -920,8 +1085,9 @@ std::vector<tr_block_span_t> tr_peerMgrGetNextRequests(tr_torrent* torrent, tr_p
         tr_peer const* const peer_;
     };
 
-    torrent->swarm->updateEndgame();
-    return Wishlist::next(MediatorImpl(torrent, peer), numwant);
+    auto* const swarm = torrent->swarm;
+    swarm->updateEndgame();
+    return swarm->wishlist.next(MediatorImpl(torrent, peer), numwant);
 }
 
 // --- Piece List Manipulation / Accessors
@@ -938,6 +1104,7 @@ size_t tr_peerMgrCountActiveRequestsToPeer(tr_torrent const* tor, tr_peer const*
 
 void tr_peerMgr::refillUpkeep() const
 {
+    auto const timer = session->perfStats().time("peer-mgr.refill-upkeep"sv);
     auto const lock = unique_lock();
 
     for (auto* const tor : session->torrents())
@@ -950,6 +1117,8 @@ void tr_peerMgrPieceCompleted(tr_torrent* tor, tr_piece_index_t p)
 {
     bool piece_came_from_peers = false;
 
+    tor->swarm->wishlist.pieceChanged(p);
+
     for (auto* const peer : tor->swarm->peers)
     {
         // notify the peer that we now have this piece
@@ -1096,6 +1265,14 @@ void create_bit_torrent_peer(tr_torrent* tor, std::shared_ptr<tr_peerIo> io, str
         }
     }
 
+    if (s != nullptr)
+    {
+        if (auto* const atom = s->get_existing_atom(addr); atom != nullptr)
+        {
+            s->queueCandidate(*atom);
+        }
+    }
+
     return success;
 }
 } // namespace handshake_helpers
@@ -1219,6 +1396,8 @@ void tr_peerMgrGotBadPiece(tr_torrent* tor, tr_piece_index_t piece_index)
     auto* const swarm = tor->swarm;
     auto const byte_count = tor->pieceSize(piece_index);
 
+    swarm->wishlist.pieceChanged(piece_index);
+
     for (auto* const peer : swarm->peers)
     {
         if (peer->blame.test(piece_index))
@@ -1371,6 +1550,8 @@ void tr_peerMgrStartTorrent(tr_torrent* tor)
 
     swarm->is_running = true;
     swarm->max_peers = tor->peerLimit();
+    swarm->wishlist.invalidate();
+    swarm->rebuildCandidates();
 
     swarm->manager->rechokeSoon();
 }
@@ -1420,6 +1601,9 @@ void tr_peerMgrOnTorrentGotMetainfo(tr_torrent* tor)
         }
     }
 
+    /* the peers' bitfields may have been resized, so recount them */
+    swarm->rebuildAvailability();
+
     /* update the bittorrent peers' willingness... */
     for (auto* peer : swarm->peers)
     {
@@ -1428,6 +1612,13 @@ void tr_peerMgrOnTorrentGotMetainfo(tr_torrent* tor)
     }
 }
 
+void tr_peerMgrOnPiecesChanged(tr_torrent* tor)
+{
+    TR_ASSERT(tr_isTorrent(tor));
+
+    tor->swarm->wishlist.invalidate();
+}
+
 int8_t tr_peerMgrPieceAvailability(tr_torrent const* tor, tr_piece_index_t piece)
 {
     if (!tor->hasMetainfo())
@@ -1440,8 +1631,8 @@ int8_t tr_peerMgrPieceAvailability(tr_torrent const* tor, tr_piece_index_t piece
         return -1;
     }
 
-    auto const& peers = tor->swarm->peers;
-    return std::count_if(std::begin(peers), std::end(peers), [piece](auto const* peer) { return peer->hasPiece(piece); });
+    auto const n = tor->swarm->countPeersWithPiece(piece);
+    return static_cast<int8_t>(std::min(n, size_t{ INT8_MAX }));
 }
 
 void tr_peerMgrTorrentAvailability(tr_torrent const* tor, int8_t* tab, unsigned int n_tabs)
@@ -1505,22 +1696,11 @@ uint64_t tr_peerMgrGetDesiredAvailable(tr_torrent const* tor)
         return 0;
     }
 
-    auto available = swarm->peers.front()->has();
-    for (auto const* const peer : swarm->peers)
-    {
-        available |= peer->has();
-    }
-
-    if (available.hasAll())
-    {
-        return tor->leftUntilDone();
-    }
-
     auto desired_available = uint64_t{};
 
     for (tr_piece_index_t i = 0, n = tor->pieceCount(); i < n; ++i)
     {
-        if (tor->pieceIsWanted(i) && available.test(i))
+        if (tor->pieceIsWanted(i) && swarm->countPeersWithPiece(i) > 0U)
         {
             desired_available += tor->countMissingBytesInPiece(i);
         }
@@ -2102,6 +2282,7 @@ void tr_peerMgr::rechokePulse() const
     using namespace rechoke_downloads_helpers;
     using namespace rechoke_uploads_helpers;
 
+    auto const timer = session->perfStats().time("peer-mgr.rechoke"sv);
     auto const lock = unique_lock();
     auto const now = tr_time_msec();
 
@@ -2305,6 +2486,7 @@ void tr_peerMgr::reconnectPulse()
 {
     using namespace disconnect_helpers;
 
+    auto const timer = session->perfStats().time("peer-mgr.reconnect"sv);
     auto const lock = session->unique_lock();
     auto const now_sec = tr_time();
 
@@ -2383,6 +2565,7 @@ void tr_peerMgr::bandwidthPulse()
 {
     using namespace bandwidth_helpers;
 
+    auto const timer = session->perfStats().time("peer-mgr.bandwidth"sv);
     auto const lock = unique_lock();
 
     pumpAllPeers(this);
@@ -2478,20 +2661,52 @@ struct peer_candidate
     return value;
 }
 
+// how long to wait before checking again on a candidate that's in a handshake.
+// Incoming handshakes can finish without us knowing which swarm to tell.
+auto constexpr HandshakeRecheckSecs = int{ 15 };
+
+// The number of bits in getAtomCandidateKey() that
+// rank lower than the torrent in getPeerCandidateScore().
+auto constexpr AtomKeyLowBits = 14;
+
 /* smaller value is better */
-[[nodiscard]] uint64_t getPeerCandidateScore(tr_torrent const* tor, peer_atom const& atom, uint8_t salt)
+[[nodiscard]] uint64_t getAtomCandidateKey(peer_atom const& atom)
 {
     auto i = uint64_t{};
-    auto score = uint64_t{};
+    auto key = uint64_t{};
     bool const failed = atom.lastConnectionAt < atom.lastConnectionAttemptAt;
 
     /* prefer peers we've connected to, or never tried, over peers we failed to connect to. */
     i = failed ? 1 : 0;
-    score = addValToKey(score, 1, i);
+    key = addValToKey(key, 1, i);
 
     /* prefer the one we attempted least recently (to cycle through all peers) */
     i = atom.lastConnectionAttemptAt;
-    score = addValToKey(score, 32, i);
+    key = addValToKey(key, 32, i);
+
+    /* prefer peers that are known to be connectible */
+    i = (atom.flags & ADDED_F_CONNECTABLE) != 0 ? 0 : 1;
+    key = addValToKey(key, 1, i);
+
+    /* prefer peers that we might be able to upload to */
+    i = (atom.flags & ADDED_F_SEED_FLAG) == 0 ? 0 : 1;
+    key = addValToKey(key, 1, i);
+
+    /* Prefer peers that we got from more trusted sources.
+     * lower `fromBest` values indicate more trusted sources */
+    key = addValToKey(key, 4, atom.fromBest);
+
+    /* salt */
+    key = addValToKey(key, 8, atom.salt);
+
+    return key;
+}
+
+/* smaller value is better */
+[[nodiscard]] uint64_t getPeerCandidateScore(tr_torrent const* tor, uint64_t atom_key)
+{
+    auto i = uint64_t{};
+    auto score = atom_key >> AtomKeyLowBits;
 
     /* prefer peers belonging to a torrent of a higher priority */
     switch (tor->getPriority())
@@ -2519,25 +2734,58 @@ struct peer_candidate
     i = tor->isDone() ? 1 : 0;
     score = addValToKey(score, 1, i);
 
-    /* prefer peers that are known to be connectible */
-    i = (atom.flags & ADDED_F_CONNECTABLE) != 0 ? 0 : 1;
-    score = addValToKey(score, 1, i);
+    /* the rest of the atom's key */
+    score = addValToKey(score, AtomKeyLowBits, atom_key & ((uint64_t{ 1 } << AtomKeyLowBits) - 1U));
 
-    /* prefer peers that we might be able to upload to */
-    i = (atom.flags & ADDED_F_SEED_FLAG) == 0 ? 0 : 1;
-    score = addValToKey(score, 1, i);
+    return score;
+}
 
-    /* Prefer peers that we got from more trusted sources.
-     * lower `fromBest` values indicate more trusted sources */
-    score = addValToKey(score, 4, atom.fromBest);
+/**
+ * @return the best atom in the swarm's candidate queue, or nullptr if none.
+ * Atoms that stopped being candidates since they were queued are dropped,
+ * or put back to wait if they'll be candidates again once some time passes.
+ */
+[[nodiscard]] peer_atom* nextCandidate(tr_swarm* swarm, time_t const now)
+{
+    auto& queue = swarm->candidates;
 
-    /* salt */
-    score = addValToKey(score, 8, salt);
+    for (auto* const atom : queue.popDue(now))
+    {
+        swarm->queueCandidate(*atom);
+    }
 
-    return score;
+    while (auto* const atom = queue.top())
+    {
+        if (!isPeerCandidate(swarm->tor, *atom, now))
+        {
+            queue.pop();
+
+            if (!atom->is_connected && swarm->peer_is_in_use(*atom))
+            {
+                queue.schedule(atom, now + HandshakeRecheckSecs);
+            }
+            else if (auto const interval = atom->getReconnectIntervalSecs(now); now - atom->time < interval)
+            {
+                queue.schedule(atom, atom->time + interval);
+            }
+
+            continue;
+        }
+
+        // it changed since it was queued
+        if (auto const key = getAtomCandidateKey(*atom); key != queue.topKey())
+        {
+            queue.push(atom, key);
+            continue;
+        }
+
+        return atom;
+    }
+
+    return nullptr;
 }
 
-/** @return an array of all the atoms we might want to connect to */
+/** @return the best `max` atoms we might want to connect to */
 [[nodiscard]] std::vector<peer_candidate> getPeerCandidates(tr_session* session, size_t max)
 {
     auto const now = tr_time();
@@ -2549,11 +2797,8 @@ struct peer_candidate
         return {};
     }
 
-    auto candidates = std::vector<peer_candidate>{};
-    candidates.reserve(peer_atom::atom_count());
-
-    /* populate the candidate array */
-    auto salter = tr_salt_shaker{};
+    // each swarm's best candidate
+    auto heads = std::vector<peer_candidate>{};
     for (auto* const tor : session->torrents())
     {
         auto* const swarm = tor->swarm;
@@ -2583,24 +2828,40 @@ struct peer_candidate
             continue;
         }
 
-        for (auto& atom : swarm->pool)
+        // seeds were dropped from the queue while we were seeding
+        if (swarm->candidates_seeding != seeding)
         {
-            if (isPeerCandidate(tor, atom, now))
-            {
-                candidates.push_back({ getPeerCandidateScore(tor, atom, salter()), tor, &atom });
-            }
+            swarm->rebuildCandidates();
+        }
+
+        if (auto* const atom = nextCandidate(swarm, now); atom != nullptr)
+        {
+            heads.push_back({ getPeerCandidateScore(tor, getAtomCandidateKey(*atom)), tor, atom });
         }
     }
 
-    // only keep the best `max` candidates
-    if (std::size(candidates) > max)
+    // merge the swarms' queues until we have `max` candidates
+    static auto constexpr Compare = [](auto const& a, auto const& b)
+    {
+        return a.score > b.score;
+    };
+    std::make_heap(std::begin(heads), std::end(heads), Compare);
+
+    auto candidates = std::vector<peer_candidate>{};
+    while (!std::empty(heads) && std::size(candidates) < max)
     {
-        std::partial_sort(
-            std::begin(candidates),
-            std::begin(candidates) + max,
-            std::end(candidates),
-            [](auto const& a, auto const& b) { return a.score < b.score; });
-        candidates.resize(max);
+        std::pop_heap(std::begin(heads), std::end(heads), Compare);
+        auto const& best = candidates.emplace_back(heads.back());
+        heads.pop_back();
+
+        auto* const swarm = best.tor->swarm;
+        swarm->candidates.pop();
+
+        if (auto* const atom = nextCandidate(swarm, now); atom != nullptr)
+        {
+            heads.push_back({ getPeerCandidateScore(best.tor, getAtomCandidateKey(*atom)), best.tor, atom });
+            std::push_heap(std::begin(heads), std::end(heads), Compare);
+        }
     }
 
     return candidates;
@@ -2663,6 +2924,41 @@ void initiateConnection(tr_peerMgr* mgr, tr_swarm* s, peer_atom& atom)
 } // namespace connect_helpers
 } // namespace
 
+void tr_swarm::queueCandidate(peer_atom& atom)
+{
+    using namespace connect_helpers;
+
+    // these are requeued when they stop being true
+    auto const reachable = atom.isReachable();
+    if (atom.is_connected || (atom.flags2 & MyflagBanned) != 0 || (reachable && !*reachable))
+    {
+        candidates.remove(&atom);
+        return;
+    }
+
+    auto const now = tr_time();
+
+    if (auto const interval = atom.getReconnectIntervalSecs(now); now - atom.time < interval)
+    {
+        candidates.schedule(&atom, atom.time + interval);
+    }
+    else
+    {
+        candidates.push(&atom, getAtomCandidateKey(atom));
+    }
+}
+
+void tr_swarm::rebuildCandidates()
+{
+    candidates.clear();
+    candidates_seeding = tor->isDone();
+
+    for (auto& atom : pool)
+    {
+        queueCandidate(atom);
+    }
+}
+
 void tr_peerMgr::makeNewPeerConnections(size_t max)
 {
     using namespace connect_helpers;
@@ -2671,7 +2967,9 @@ void tr_peerMgr::makeNewPeerConnections(size_t max)
 
     for (auto& candidate : getPeerCandidates(session, max))
     {
-        initiateConnection(this, candidate.tor->swarm, *candidate.atom);
+        auto* const swarm = candidate.tor->swarm;
+        initiateConnection(this, swarm, *candidate.atom);
+        swarm->queueCandidate(*candidate.atom);
     }
 }
 
@@ -210,6 +210,9 @@ void tr_peerMgrTorrentAvailability(tr_torrent const* tor, int8_t* tab, unsigned
 
 void tr_peerMgrOnTorrentGotMetainfo(tr_torrent* tor);
 
+// call this when the priority, wanted flag, or completeness of many pieces changes at once
+void tr_peerMgrOnPiecesChanged(tr_torrent* tor);
+
 void tr_peerMgrOnBlocklistChanged(tr_peerMgr* mgr);
 
 [[nodiscard]] struct tr_peer_stat* tr_peerMgrPeerStats(tr_torrent const* tor, size_t* setme_count);
@@ -26,6 +26,7 @@
 #include "completion.h"
 #include "crypto-utils.h"
 #include "file.h"
+#include "inout.h"
 #include "log.h"
 #include "peer-io.h"
 #include "peer-mgr.h"
@@ -297,6 +298,11 @@ public:
         set_active(TR_UP, false);
         set_active(TR_DOWN, false);
 
+        if (pending_block_read_)
+        {
+            pending_block_read_->msgs = nullptr;
+        }
+
         if (this->io)
         {
             this->io->clear();
@@ -674,6 +680,30 @@ public:
 
     std::vector<QueuedPeerRequest> peer_requested_;
 
+    // A block that we're reading from disk to send to the peer.
+    // It's read by the disk I/O workers so that a slow disk
+    // doesn't block the session thread.
+    struct PendingBlockRead
+    {
+        explicit PendingBlockRead(peer_request const& req_in) noexcept
+            : req{ req_in }
+        {
+        }
+
+        peer_request req;
+        std::vector<uint8_t> data;
+        int err = 0;
+        bool done = false;
+
+        // true if the peer was choked while the read was in flight
+        bool cancelled = false;
+
+        // the peer that's waiting for this read, or nullptr if it's gone
+        tr_peerMsgsImpl* msgs = nullptr;
+    };
+
+    std::shared_ptr<PendingBlockRead> pending_block_read_;
+
     std::vector<tr_pex> pex;
     std::vector<tr_pex> pex6;
 
@@ -842,6 +872,11 @@ void cancelAllRequestsToClient(tr_peerMsgsImpl* msgs)
     }
 
     msgs->peer_requested_.clear();
+
+    if (auto& pending = msgs->pending_block_read_; pending)
+    {
+        pending->cancelled = true;
+    }
 }
 
 // ---
@@ -1429,7 +1464,7 @@ ReadState readBtPiece(tr_peerMsgsImpl* msgs, size_t inlen, size_t* setme_piece_b
     auto& block_buf = msgs->incoming.block_buf[block];
     if (!block_buf)
     {
-        block_buf = std::make_unique<std::vector<uint8_t>>();
+        block_buf = msgs->session->cache->makeBlockBuffer();
         block_buf->reserve(block_size);
     }
 
@@ -1570,9 +1605,10 @@ ReadState readBtMessage(tr_peerMsgsImpl* msgs, size_t inlen)
             logtrace(msgs, "got a bitfield");
             auto tmp = std::vector<uint8_t>(msglen);
             msgs->io->read_bytes(std::data(tmp), std::size(tmp));
-            msgs->have_ = tr_bitfield{ msgs->torrent->hasMetainfo() ? msgs->torrent->pieceCount() : std::size(tmp) * 8 };
-            msgs->have_.setRaw(std::data(tmp), std::size(tmp));
-            msgs->publish(tr_peer_event::GotBitfield(&msgs->have_));
+            auto have = tr_bitfield{ msgs->torrent->hasMetainfo() ? msgs->torrent->pieceCount() : std::size(tmp) * 8 };
+            have.setRaw(std::data(tmp), std::size(tmp));
+            msgs->publish(tr_peer_event::GotBitfield(&have));
+            msgs->have_ = std::move(have);
             msgs->invalidatePercentDone();
             break;
         }
@@ -1674,8 +1710,8 @@ ReadState readBtMessage(tr_peerMsgsImpl* msgs, size_t inlen)
 
         if (fext)
         {
-            msgs->have_.setHasAll();
             msgs->publish(tr_peer_event::GotHaveAll());
+            msgs->have_.setHasAll();
             msgs->invalidatePercentDone();
         }
         else
@@ -1691,8 +1727,8 @@ ReadState readBtMessage(tr_peerMsgsImpl* msgs, size_t inlen)
 
         if (fext)
         {
-            msgs->have_.setHasNone();
             msgs->publish(tr_peer_event::GotHaveNone());
+            msgs->have_.setHasNone();
             msgs->invalidatePercentDone();
         }
         else
@@ -1781,12 +1817,8 @@ int clientGotBlock(tr_peerMsgsImpl* msgs, std::unique_ptr<std::vector<uint8_t>>&
         return 0;
     }
 
-    // NB: if writeBlock() fails the torrent may be paused.
-    // If this happens, `msgs` will be a dangling pointer and must no longer be used.
-    if (auto const err = msgs->session->cache->writeBlock(tor->id(), block, block_data); err != 0)
-    {
-        return err;
-    }
+    // NB: write errors are reported later, when the disk I/O job finishes
+    msgs->session->cache->writeBlock(tor->id(), block, block_data);
 
     msgs->blame.set(loc.piece);
     msgs->incoming.block_buf.erase(block);
@@ -1924,6 +1956,83 @@ void updateBlockRequests(tr_peerMsgsImpl* msgs)
     }
 }
 
+void startBlockRead(tr_peerMsgsImpl* msgs, peer_request const& req)
+{
+    auto pending = std::make_shared<tr_peerMsgsImpl::PendingBlockRead>(req);
+    msgs->pending_block_read_ = pending;
+
+    auto const queued = msgs->session->cache->readBlockAsync(
+        msgs->torrent,
+        msgs->torrent->pieceLoc(req.index, req.offset),
+        req.length,
+        [pending](int err, std::vector<uint8_t>&& data)
+        {
+            pending->err = err;
+            pending->data = std::move(data);
+            pending->done = true;
+
+            // resume sending to the peer now that the block is ready
+            if (auto* const waiting_msgs = pending->msgs; waiting_msgs != nullptr)
+            {
+                peerPulse(waiting_msgs);
+            }
+        });
+
+    if (!queued)
+    {
+        // the disk is busy, so put the request back and try again later
+        msgs->pending_block_read_.reset();
+        msgs->peer_requested_.emplace(std::begin(msgs->peer_requested_), req);
+        return;
+    }
+
+    // Set this after readBlockAsync() so that if the block was already
+    // in memory, the callback above doesn't reenter peerPulse().
+    pending->msgs = msgs;
+}
+
+// Send a block straight from the page cache, without reading it into memory.
+// This is only possible for unencrypted TCP peers, and only for blocks that
+// are on disk and don't need to be checked first.
+// @return the number of bytes queued, or 0 if the block needs to be read normally
+size_t sendBlockFromFile(tr_peerMsgsImpl* msgs, peer_request const& req)
+{
+    auto* const tor = msgs->torrent;
+    auto const loc = tor->pieceLoc(req.index, req.offset);
+
+    if (!msgs->io->supports_file_segments() || !tor->isPieceChecked(req.index) ||
+        msgs->session->cache->isInMemory(tor, loc, req.length))
+    {
+        return 0;
+    }
+
+    auto spans = std::vector<tr_io_file_span>{};
+    if (tr_ioOpenSpans(tor, loc, req.length, spans) != 0)
+    {
+        return 0;
+    }
+
+    auto out = libtransmission::Buffer{};
+    out.add_uint32(sizeof(uint8_t) + 2 * sizeof(uint32_t) + req.length);
+    out.add_uint8(BtPeerMsgs::Piece);
+    out.add_uint32(req.index);
+    out.add_uint32(req.offset);
+    for (auto& span : spans)
+    {
+        auto const fd = *span.fd;
+        if (!out.add_file(fd, span.offset, span.length, std::move(span.fd)))
+        {
+            return 0;
+        }
+    }
+
+    logtrace(msgs, fmt::format(FMT_STRING("sending block {:d}:{:d}->{:d} from file"), req.index, req.offset, req.length));
+    auto const n = std::size(out);
+    TR_ASSERT(n == 4 + 1 + 4 + 4 + req.length);
+    msgs->io->write(out, true);
+    return n;
+}
+
 size_t fillOutputBuffer(tr_peerMsgsImpl* msgs, time_t now)
 {
     size_t bytes_written = 0;
@@ -2008,32 +2117,43 @@ size_t fillOutputBuffer(tr_peerMsgsImpl* msgs, time_t now)
 
     // --- Data Blocks
 
-    if (msgs->io->get_write_buffer_space(now) >= tr_block_info::BlockSize && !std::empty(msgs->peer_requested_))
+    if (msgs->io->get_write_buffer_space(now) >= tr_block_info::BlockSize)
     {
-        req = msgs->peer_requested_.front();
-        msgs->peer_requested_.erase(std::begin(msgs->peer_requested_));
-
-        if (msgs->isValidRequest(req) && msgs->torrent->hasPiece(req.index))
+        if (!msgs->pending_block_read_ && !std::empty(msgs->peer_requested_))
         {
-            uint32_t const msglen = 4 + 1 + 4 + 4 + req.length;
+            req = msgs->peer_requested_.front();
+            msgs->peer_requested_.erase(std::begin(msgs->peer_requested_));
 
-            auto out = libtransmission::Buffer{};
-            out.reserve(msglen);
+            if (msgs->isValidRequest(req) && msgs->torrent->hasPiece(req.index))
+            {
+                if (auto const n = sendBlockFromFile(msgs, req); n != 0)
+                {
+                    bytes_written += n;
+                    msgs->clientSentAnythingAt = now;
+                    msgs->blocks_sent_to_peer.add(tr_time(), 1);
+                }
+                else
+                {
+                    startBlockRead(msgs, req);
+                }
+            }
+            else if (fext) /* peer needs a reject message */
+            {
+                protocolSendReject(msgs, &req);
+            }
+
+            prefetchPieces(msgs);
+        }
+
+        if (msgs->pending_block_read_ && msgs->pending_block_read_->done)
+        {
+            auto const pending = std::move(msgs->pending_block_read_);
+            req = pending->req;
 
-            out.add_uint32(sizeof(uint8_t) + 2 * sizeof(uint32_t) + req.length);
-            out.add_uint8(BtPeerMsgs::Piece);
-            out.add_uint32(req.index);
-            out.add_uint32(req.offset);
-            auto buf = std::array<uint8_t, tr_block_info::BlockSize>{};
-            bool err = msgs->session->cache->readBlock(
-                           msgs->torrent,
-                           msgs->torrent->pieceLoc(req.index, req.offset),
-                           req.length,
-                           std::data(buf)) != 0;
-            out.add(std::data(buf), req.length);
+            bool err = pending->err != 0 || std::size(pending->data) != req.length;
 
             /* check the piece if it needs checking... */
-            if (!err)
+            if (!err && !pending->cancelled)
             {
                 err = !msgs->torrent->ensurePieceIsChecked(req.index);
                 if (err)
@@ -2043,7 +2163,7 @@ size_t fillOutputBuffer(tr_peerMsgsImpl* msgs, time_t now)
                 }
             }
 
-            if (err)
+            if (err || pending->cancelled)
             {
                 if (fext)
                 {
@@ -2052,6 +2172,17 @@ size_t fillOutputBuffer(tr_peerMsgsImpl* msgs, time_t now)
             }
             else
             {
+                uint32_t const msglen = 4 + 1 + 4 + 4 + req.length;
+
+                auto out = libtransmission::Buffer{};
+                out.reserve(msglen);
+
+                out.add_uint32(sizeof(uint8_t) + 2 * sizeof(uint32_t) + req.length);
+                out.add_uint8(BtPeerMsgs::Piece);
+                out.add_uint32(req.index);
+                out.add_uint32(req.offset);
+                out.add(std::data(pending->data), req.length);
+
                 logtrace(msgs, fmt::format(FMT_STRING("sending block {:d}:{:d}->{:d}"), req.index, req.offset, req.length));
                 auto const n = std::size(out);
                 TR_ASSERT(n == msglen);
@@ -2067,15 +2198,6 @@ size_t fillOutputBuffer(tr_peerMsgsImpl* msgs, time_t now)
                 msgs = nullptr;
             }
         }
-        else if (fext) /* peer needs a reject message */
-        {
-            protocolSendReject(msgs, &req);
-        }
-
-        if (msgs != nullptr)
-        {
-            prefetchPieces(msgs);
-        }
     }
 
     // --- Keepalive
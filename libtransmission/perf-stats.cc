@@ -0,0 +1,180 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath> // std::ceil
+#include <cstddef>
+#include <cstdint>
+#include <iterator> // std::back_inserter
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include <fmt/format.h>
+
+#include "perf-stats.h"
+
+using namespace std::literals;
+
+void tr_perf_stats::Histogram::add(std::chrono::microseconds elapsed) noexcept
+{
+    auto const usec = static_cast<uint64_t>(std::max(elapsed.count(), decltype(elapsed.count()){}));
+
+    auto bucket = size_t{};
+    while (bucket + 1U < NumBuckets && (uint64_t{ 1U } << bucket) <= usec)
+    {
+        ++bucket;
+    }
+
+    ++buckets_[bucket];
+    ++count_;
+    total_usec_ += usec;
+    max_usec_ = std::max(max_usec_, usec);
+}
+
+uint64_t tr_perf_stats::Histogram::percentileUsec(double pct) const noexcept
+{
+    if (count_ == 0U)
+    {
+        return 0U;
+    }
+
+    auto const target = std::max(uint64_t{ 1U }, static_cast<uint64_t>(std::ceil(pct / 100.0 * count_)));
+    auto seen = uint64_t{};
+    for (size_t bucket = 0; bucket < NumBuckets; ++bucket)
+    {
+        seen += buckets_[bucket];
+        if (seen >= target)
+        {
+            auto const limit = bucketLimitUsec(bucket);
+            return limit == 0U ? max_usec_ : std::min(limit, max_usec_);
+        }
+    }
+
+    return max_usec_;
+}
+
+// ---
+
+void tr_perf_stats::addTask(std::string_view task, Clock::duration elapsed)
+{
+    auto const usec = std::chrono::duration_cast<std::chrono::microseconds>(elapsed);
+    auto const lock = std::lock_guard{ mutex_ };
+
+    if (auto it = tasks_.find(task); it != std::end(tasks_))
+    {
+        it->second.add(usec);
+    }
+    else
+    {
+        tasks_[std::string{ task }].add(usec);
+    }
+}
+
+void tr_perf_stats::addLoopLag(Clock::duration lag)
+{
+    auto const lock = std::lock_guard{ mutex_ };
+    loop_lag_.add(std::chrono::duration_cast<std::chrono::microseconds>(lag));
+}
+
+void tr_perf_stats::addQueueWait(Clock::duration wait)
+{
+    auto const lock = std::lock_guard{ mutex_ };
+    queue_wait_.add(std::chrono::duration_cast<std::chrono::microseconds>(wait));
+}
+
+void tr_perf_stats::setQueueDepth(size_t depth) noexcept
+{
+    queue_depth_ = depth;
+
+    auto peak = peak_queue_depth_.load();
+    while (peak < depth && !peak_queue_depth_.compare_exchange_weak(peak, depth))
+    {
+    }
+}
+
+tr_perf_stats::Snapshot tr_perf_stats::snapshot() const
+{
+    auto snapshot = Snapshot{};
+    snapshot.queue_depth = queue_depth_;
+    snapshot.peak_queue_depth = peak_queue_depth_;
+
+    auto const lock = std::lock_guard{ mutex_ };
+    snapshot.loop_lag = loop_lag_;
+    snapshot.queue_wait = queue_wait_;
+    snapshot.tasks = tasks_;
+    return snapshot;
+}
+
+std::string tr_perf_stats::toPrometheus() const
+{
+    auto const snapshot = this->snapshot();
+    auto out = fmt::memory_buffer{};
+
+    auto const add_histogram = [&out](std::string_view name, std::string_view labels, Histogram const& histogram)
+    {
+        auto const sep = std::empty(labels) ? ""sv : ","sv;
+        auto cumulative = uint64_t{};
+        for (size_t bucket = 0; bucket + 1U < Histogram::NumBuckets; ++bucket)
+        {
+            cumulative += histogram.buckets()[bucket];
+            fmt::format_to(
+                std::back_inserter(out),
+                "{:s}_bucket{{{:s}{:s}le=\"{:g}\"}} {:d}\n",
+                name,
+                labels,
+                sep,
+                static_cast<double>(Histogram::bucketLimitUsec(bucket)) / 1e6,
+                cumulative);
+        }
+        fmt::format_to(
+            std::back_inserter(out),
+            "{:s}_bucket{{{:s}{:s}le=\"+Inf\"}} {:d}\n",
+            name,
+            labels,
+            sep,
+            histogram.count());
+
+        auto const braced = std::empty(labels) ? std::string{} : fmt::format("{{{:s}}}", labels);
+        fmt::format_to(
+            std::back_inserter(out),
+            "{:s}_sum{:s} {:g}\n",
+            name,
+            braced,
+            static_cast<double>(histogram.totalUsec()) / 1e6);
+        fmt::format_to(std::back_inserter(out), "{:s}_count{:s} {:d}\n", name, braced, histogram.count());
+    };
+
+    auto const add_header = [&out](std::string_view name, std::string_view type, std::string_view help)
+    {
+        fmt::format_to(std::back_inserter(out), "# HELP {:s} {:s}\n# TYPE {:s} {:s}\n", name, help, name, type);
+    };
+
+    static auto constexpr LoopLag = "transmission_session_thread_loop_lag_seconds"sv;
+    add_header(LoopLag, "histogram"sv, "How late the session thread's event loop woke up."sv);
+    add_histogram(LoopLag, ""sv, snapshot.loop_lag);
+
+    static auto constexpr QueueWait = "transmission_session_thread_queue_wait_seconds"sv;
+    add_header(QueueWait, "histogram"sv, "How long work posted to the session thread waited to run."sv);
+    add_histogram(QueueWait, ""sv, snapshot.queue_wait);
+
+    static auto constexpr QueueDepth = "transmission_session_thread_queue_depth"sv;
+    add_header(QueueDepth, "gauge"sv, "Work waiting to run in the session thread."sv);
+    fmt::format_to(std::back_inserter(out), "{:s} {:d}\n", QueueDepth, snapshot.queue_depth);
+
+    static auto constexpr PeakQueueDepth = "transmission_session_thread_peak_queue_depth"sv;
+    add_header(PeakQueueDepth, "gauge"sv, "The most work that has been waiting to run in the session thread."sv);
+    fmt::format_to(std::back_inserter(out), "{:s} {:d}\n", PeakQueueDepth, snapshot.peak_queue_depth);
+
+    static auto constexpr Task = "transmission_task_duration_seconds"sv;
+    add_header(Task, "histogram"sv, "How long each kind of task took to run."sv);
+    for (auto const& [name, histogram] : snapshot.tasks)
+    {
+        add_histogram(Task, fmt::format("task=\"{:s}\"", name), histogram);
+    }
+
+    return fmt::to_string(out);
+}
@@ -0,0 +1,142 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <functional> // std::less
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+// Execution-time histograms for the work done in the session thread
+// and its helper threads, so that we can tell where a sluggish session's
+// time is going. Recording is cheap enough to always leave on.
+class tr_perf_stats
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Log2-spaced buckets of microseconds: bucket `i` counts samples that
+    // took less than 2^i usec. The last bucket counts everything else.
+    class Histogram
+    {
+    public:
+        static auto constexpr NumBuckets = size_t{ 24U };
+
+        void add(std::chrono::microseconds elapsed) noexcept;
+
+        [[nodiscard]] constexpr auto count() const noexcept
+        {
+            return count_;
+        }
+
+        [[nodiscard]] constexpr auto totalUsec() const noexcept
+        {
+            return total_usec_;
+        }
+
+        [[nodiscard]] constexpr auto maxUsec() const noexcept
+        {
+            return max_usec_;
+        }
+
+        [[nodiscard]] constexpr auto const& buckets() const noexcept
+        {
+            return buckets_;
+        }
+
+        // @return the upper bound of `bucket`, or 0 for the unbounded last bucket
+        [[nodiscard]] static constexpr uint64_t bucketLimitUsec(size_t bucket) noexcept
+        {
+            return bucket + 1U < NumBuckets ? uint64_t{ 1U } << bucket : 0U;
+        }
+
+        // @return an estimate of the `pct`th percentile, e.g. 99.0
+        [[nodiscard]] uint64_t percentileUsec(double pct) const noexcept;
+
+    private:
+        std::array<uint64_t, NumBuckets> buckets_ = {};
+        uint64_t count_ = 0U;
+        uint64_t total_usec_ = 0U;
+        uint64_t max_usec_ = 0U;
+    };
+
+    struct Snapshot
+    {
+        // how late the session thread's event loop was to wake up
+        Histogram loop_lag;
+
+        // how long work posted to the session thread waited to run
+        Histogram queue_wait;
+        size_t queue_depth = 0U;
+        size_t peak_queue_depth = 0U;
+
+        // how long each named task took to run
+        std::map<std::string, Histogram, std::less<>> tasks;
+    };
+
+    // Times a task from construction to destruction.
+    class ScopedTimer
+    {
+    public:
+        ScopedTimer(tr_perf_stats& stats, std::string_view task) noexcept
+            : stats_{ stats }
+            , task_{ task }
+            , started_at_{ Clock::now() }
+        {
+        }
+
+        ScopedTimer(ScopedTimer&&) = delete;
+        ScopedTimer(ScopedTimer const&) = delete;
+        ScopedTimer& operator=(ScopedTimer&&) = delete;
+        ScopedTimer& operator=(ScopedTimer const&) = delete;
+
+        ~ScopedTimer()
+        {
+            stats_.addTask(task_, Clock::now() - started_at_);
+        }
+
+    private:
+        tr_perf_stats& stats_;
+        std::string_view const task_;
+        Clock::time_point const started_at_;
+    };
+
+    // `task` is not copied, so it needs to outlive the timer.
+    // A string literal such as "peer-mgr.rechoke" is typical.
+    [[nodiscard]] ScopedTimer time(std::string_view task) noexcept
+    {
+        return ScopedTimer{ *this, task };
+    }
+
+    void addTask(std::string_view task, Clock::duration elapsed);
+    void addLoopLag(Clock::duration lag);
+    void addQueueWait(Clock::duration wait);
+    void setQueueDepth(size_t depth) noexcept;
+
+    [[nodiscard]] Snapshot snapshot() const;
+
+    // @return the stats in Prometheus' text exposition format
+    [[nodiscard]] std::string toPrometheus() const;
+
+private:
+    mutable std::mutex mutex_;
+    Histogram loop_lag_;
+    Histogram queue_wait_;
+    std::map<std::string, Histogram, std::less<>> tasks_;
+
+    std::atomic<size_t> queue_depth_ = 0U;
+    std::atomic<size_t> peak_queue_depth_ = 0U;
+};
@@ -5,20 +5,27 @@
 
 #include <algorithm>
 #include <array>
-#include <string>
+#include <atomic>
+#include <cstdint> // uint64_t
+#include <functional> // std::hash
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string_view>
+#include <utility> // std::pair
 #include <vector>
 
 #include "transmission.h"
 
 #include "quark.h"
+#include "tr-assert.h"
 
 using namespace std::literals;
 
 namespace
 {
 
-auto constexpr MyStatic = std::array<std::string_view, 402>{ ""sv,
+auto constexpr MyStatic = std::array<std::string_view, 433>{ ""sv,
                                                              "activeTorrentCount"sv,
                                                              "activity-date"sv,
                                                              "activityDate"sv,
@@ -45,6 +52,7 @@ auto constexpr MyStatic = std::array<std::string_view, 402>{ ""sv,
                                                              "anti-brute-force-threshold"sv,
                                                              "arguments"sv,
                                                              "availability"sv,
+                                                             "bandwidth"sv,
                                                              "bandwidth-priority"sv,
                                                              "bandwidthPriority"sv,
                                                              "bind-address-ipv4"sv,
@@ -56,8 +64,10 @@ auto constexpr MyStatic = std::array<std::string_view, 402>{ ""sv,
                                                              "blocklist-updates-enabled"sv,
                                                              "blocklist-url"sv,
                                                              "blocks"sv,
+                                                             "bytes-served"sv,
                                                              "bytesCompleted"sv,
                                                              "cache-size-mb"sv,
+                                                             "cache-stats"sv,
                                                              "clientIsChoked"sv,
                                                              "clientIsInterested"sv,
                                                              "clientName"sv,
@@ -69,6 +79,7 @@ auto constexpr MyStatic = std::array<std::string_view, 402>{ ""sv,
                                                              "cookies"sv,
                                                              "corrupt"sv,
                                                              "corruptEver"sv,
+                                                             "count"sv,
                                                              "created by"sv,
                                                              "created by.utf-8"sv,
                                                              "creation date"sv,
@@ -79,6 +90,7 @@ auto constexpr MyStatic = std::array<std::string_view, 402>{ ""sv,
                                                              "dateCreated"sv,
                                                              "default-trackers"sv,
                                                              "delete-local-data"sv,
+                                                             "depth"sv,
                                                              "desiredAvailable"sv,
                                                              "destination"sv,
                                                              "details-window-height"sv,
@@ -87,6 +99,7 @@ auto constexpr MyStatic = std::array<std::string_view, 402>{ ""sv,
                                                              "dnd"sv,
                                                              "done-date"sv,
                                                              "doneDate"sv,
+                                                             "download"sv,
                                                              "download-dir"sv,
                                                              "download-dir-free-space"sv,
                                                              "download-queue-enabled"sv,
@@ -181,6 +194,7 @@ auto constexpr MyStatic = std::array<std::string_view, 402>{ ""sv,
                                                              "leftUntilDone"sv,
                                                              "length"sv,
                                                              "location"sv,
+                                                             "loop-lag"sv,
                                                              "lpd-enabled"sv,
                                                              "m"sv,
                                                              "magnetLink"sv,
@@ -192,6 +206,7 @@ auto constexpr MyStatic = std::array<std::string_view, 402>{ ""sv,
                                                              "main-window-y"sv,
                                                              "manualAnnounceTime"sv,
                                                              "max-peers"sv,
+                                                             "max-usec"sv,
                                                              "maxConnectedPeers"sv,
                                                              "memory-bytes"sv,
                                                              "memory-units"sv,
@@ -212,10 +227,14 @@ auto constexpr MyStatic = std::array<std::string_view, 402>{ ""sv,
                                                              "nodes6"sv,
                                                              "open-dialog-dir"sv,
                                                              "p"sv,
+                                                             "p50-usec"sv,
+                                                             "p90-usec"sv,
+                                                             "p99-usec"sv,
                                                              "path"sv,
                                                              "path.utf-8"sv,
                                                              "paused"sv,
                                                              "pausedTorrentCount"sv,
+                                                             "peak-depth"sv,
                                                              "peer-congestion-algorithm"sv,
                                                              "peer-id-ttl-hours"sv,
                                                              "peer-limit"sv,
@@ -265,6 +284,7 @@ auto constexpr MyStatic = std::array<std::string_view, 402>{ ""sv,
                                                              "queue-stalled-enabled"sv,
                                                              "queue-stalled-minutes"sv,
                                                              "queuePosition"sv,
+                                                             "queued"sv,
                                                              "rateDownload"sv,
                                                              "rateToClient"sv,
                                                              "rateToPeer"sv,
@@ -272,7 +292,12 @@ auto constexpr MyStatic = std::array<std::string_view, 402>{ ""sv,
                                                              "ratio-limit"sv,
                                                              "ratio-limit-enabled"sv,
                                                              "ratio-mode"sv,
+                                                             "read-cache-size-mb"sv,
                                                              "read-clipboard"sv,
+                                                             "readCacheBytes"sv,
+                                                             "readCacheEvictions"sv,
+                                                             "readCacheHits"sv,
+                                                             "readCacheMisses"sv,
                                                              "recent-download-dir-1"sv,
                                                              "recent-download-dir-2"sv,
                                                              "recent-download-dir-3"sv,
@@ -293,11 +318,14 @@ auto constexpr MyStatic = std::array<std::string_view, 402>{ ""sv,
                                                              "rename-partial-files"sv,
                                                              "reqq"sv,
                                                              "result"sv,
+                                                             "resume-snapshot-enabled"sv,
+                                                             "revision"sv,
                                                              "rpc-authentication-required"sv,
                                                              "rpc-bind-address"sv,
                                                              "rpc-enabled"sv,
                                                              "rpc-host-whitelist"sv,
                                                              "rpc-host-whitelist-enabled"sv,
+                                                             "rpc-metrics-enabled"sv,
                                                              "rpc-password"sv,
                                                              "rpc-port"sv,
                                                              "rpc-socket-mode"sv,
@@ -341,6 +369,7 @@ auto constexpr MyStatic = std::array<std::string_view, 402>{ ""sv,
                                                              "show-statusbar"sv,
                                                              "show-toolbar"sv,
                                                              "show-tracker-scrapes"sv,
+                                                             "since"sv,
                                                              "sitename"sv,
                                                              "size-bytes"sv,
                                                              "size-units"sv,
@@ -362,6 +391,7 @@ auto constexpr MyStatic = std::array<std::string_view, 402>{ ""sv,
                                                              "status"sv,
                                                              "statusbar-stats"sv,
                                                              "tag"sv,
+                                                             "tasks"sv,
                                                              "tcp-enabled"sv,
                                                              "tier"sv,
                                                              "time-checked"sv,
@@ -380,6 +410,7 @@ auto constexpr MyStatic = std::array<std::string_view, 402>{ ""sv,
                                                              "torrentCount"sv,
                                                              "torrentFile"sv,
                                                              "torrents"sv,
+                                                             "total-usec"sv,
                                                              "totalSize"sv,
                                                              "total_size"sv,
                                                              "trackerAdd"sv,
@@ -390,8 +421,10 @@ auto constexpr MyStatic = std::array<std::string_view, 402>{ ""sv,
                                                              "trackers"sv,
                                                              "trash-can-enabled"sv,
                                                              "trash-original-torrent-files"sv,
+                                                             "turns"sv,
                                                              "umask"sv,
                                                              "units"sv,
+                                                             "upload"sv,
                                                              "upload-slots-per-torrent"sv,
                                                              "uploadLimit"sv,
                                                              "uploadLimited"sv,
@@ -413,12 +446,17 @@ auto constexpr MyStatic = std::array<std::string_view, 402>{ ""sv,
                                                              "ut_recommend"sv,
                                                              "utp-enabled"sv,
                                                              "v"sv,
+                                                             "verify-speed-limit-mb"sv,
+                                                             "verify-threads"sv,
+                                                             "verify-threads-per-device"sv,
                                                              "version"sv,
+                                                             "wait"sv,
                                                              "wanted"sv,
                                                              "watch-dir"sv,
                                                              "watch-dir-enabled"sv,
                                                              "webseeds"sv,
                                                              "webseedsSendingToUs"sv,
+                                                             "work-queue"sv,
                                                              "yourip"sv };
 
 bool constexpr quarks_are_sorted()
@@ -437,13 +475,216 @@ bool constexpr quarks_are_sorted()
 static_assert(quarks_are_sorted(), "Predefined quarks must be sorted by their string value");
 static_assert(std::size(MyStatic) == TR_N_KEYS);
 
-auto& my_runtime{ *new std::vector<std::string_view>{} };
+// Runtime quarks can be made from any thread, e.g. when parsing .torrent
+// files on worker threads, and looked up from any thread without a lock.
+// That works because nothing is moved or freed once it's published:
+// the strings live in an arena, the index's entries live in segments
+// that never move, and hash tables that get outgrown are kept around
+// for readers that might still be probing them.
+class RuntimeQuarks
+{
+public:
+    [[nodiscard]] std::optional<tr_quark> find(std::string_view key) const
+    {
+        return find(key, hash(key));
+    }
 
-} // namespace
+    [[nodiscard]] tr_quark findOrAdd(std::string_view key)
+    {
+        auto const key_hash = hash(key);
 
-std::optional<tr_quark> tr_quark_lookup(std::string_view key)
+        if (auto const prior = find(key, key_hash); prior)
+        {
+            return *prior;
+        }
+
+        auto const lock = std::lock_guard{ mutex_ };
+
+        // someone else might have added it while we waited for the lock
+        if (auto const prior = find(key, key_hash); prior)
+        {
+            return *prior;
+        }
+
+        return add(key, key_hash);
+    }
+
+    [[nodiscard]] std::string_view get(size_t idx) const
+    {
+        auto const [segment, offset] = locate(idx);
+        auto const* const entries = segments_[segment].load(std::memory_order_acquire);
+        TR_ASSERT(entries != nullptr);
+        return entries[offset];
+    }
+
+private:
+    // Each table slot holds the upper half of its string's hash, to skip most
+    // string compares, and the string's index + 1, so that zero means empty.
+    struct Table
+    {
+        explicit Table(size_t capacity_in)
+            : capacity{ capacity_in }
+            , slots{ std::make_unique<std::atomic<uint64_t>[]>(capacity_in) }
+        {
+        }
+
+        size_t const capacity;
+        std::unique_ptr<std::atomic<uint64_t>[]> const slots;
+    };
+
+    static auto constexpr FirstSegmentSize = size_t{ 256U };
+    static auto constexpr ArenaBlockSize = size_t{ 64U * 1024U };
+    static auto constexpr MinTableCapacity = size_t{ 1024U };
+
+    [[nodiscard]] static uint64_t hash(std::string_view key) noexcept
+    {
+        // mix the bits so that the tag is useful where size_t is 32 bits
+        return uint64_t{ std::hash<std::string_view>{}(key) } * 0x9E3779B97F4A7C15ULL;
+    }
+
+    [[nodiscard]] static constexpr uint64_t tag(uint64_t key_hash) noexcept
+    {
+        return key_hash & 0xFFFFFFFF00000000ULL;
+    }
+
+    // Segment n holds FirstSegmentSize << n entries.
+    // @return the segment and offset of entry `idx`
+    [[nodiscard]] static constexpr std::pair<size_t, size_t> locate(size_t idx) noexcept
+    {
+        auto segment = size_t{};
+        auto segment_size = FirstSegmentSize;
+
+        while (idx >= segment_size)
+        {
+            idx -= segment_size;
+            segment_size *= 2U;
+            ++segment;
+        }
+
+        return { segment, idx };
+    }
+
+    [[nodiscard]] std::optional<tr_quark> find(std::string_view key, uint64_t key_hash) const
+    {
+        auto const* const table = table_.load(std::memory_order_acquire);
+        if (table == nullptr)
+        {
+            return {};
+        }
+
+        for (auto pos = key_hash % table->capacity;; pos = (pos + 1U) % table->capacity)
+        {
+            auto const slot = table->slots[pos].load(std::memory_order_acquire);
+            if (slot == 0U)
+            {
+                return {};
+            }
+
+            if (auto const idx = static_cast<size_t>((slot & 0xFFFFFFFFU) - 1U); tag(slot) == tag(key_hash) && get(idx) == key)
+            {
+                return TR_N_KEYS + idx;
+            }
+        }
+    }
+
+    // Caller must hold mutex_
+    static void insert(Table& table, uint64_t key_hash, size_t idx)
+    {
+        auto pos = key_hash % table.capacity;
+
+        while (table.slots[pos].load(std::memory_order_relaxed) != 0U)
+        {
+            pos = (pos + 1U) % table.capacity;
+        }
+
+        table.slots[pos].store(tag(key_hash) | (idx + 1U), std::memory_order_release);
+    }
+
+    // Caller must hold mutex_
+    [[nodiscard]] std::string_view store(std::string_view str)
+    {
+        // keep them zero-terminated, as they always have been
+        auto const len = std::size(str) + 1U;
+
+        char* dst = nullptr;
+        if (len > ArenaBlockSize / 4U)
+        {
+            dst = blocks_.emplace_back(std::make_unique<char[]>(len)).get();
+        }
+        else
+        {
+            if (arena_left_ < len)
+            {
+                arena_pos_ = blocks_.emplace_back(std::make_unique<char[]>(ArenaBlockSize)).get();
+                arena_left_ = ArenaBlockSize;
+            }
+
+            dst = arena_pos_;
+            arena_pos_ += len;
+            arena_left_ -= len;
+        }
+
+        std::copy_n(std::data(str), std::size(str), dst);
+        dst[std::size(str)] = '\0';
+        return { dst, std::size(str) };
+    }
+
+    // Caller must hold mutex_
+    [[nodiscard]] tr_quark add(std::string_view key, uint64_t key_hash)
+    {
+        auto const idx = size_;
+        TR_ASSERT(idx < 0xFFFFFFFFU);
+
+        auto const [segment, offset] = locate(idx);
+        auto* entries = segments_[segment].load(std::memory_order_relaxed);
+        if (entries == nullptr)
+        {
+            entries = new std::string_view[FirstSegmentSize << segment];
+            segments_[segment].store(entries, std::memory_order_release);
+        }
+
+        entries[offset] = store(key);
+        ++size_;
+
+        // keep the table at most half full
+        auto* table = table_.load(std::memory_order_relaxed);
+        if (table == nullptr || size_ * 2U > table->capacity)
+        {
+            auto& bigger = tables_.emplace_back(
+                std::make_unique<Table>(table == nullptr ? MinTableCapacity : table->capacity * 2U));
+
+            for (size_t i = 0; i < idx; ++i)
+            {
+                insert(*bigger, hash(get(i)), i);
+            }
+
+            table = bigger.get();
+            table_.store(table, std::memory_order_release);
+        }
+
+        // publish it last so that lookups never find a half-made entry
+        insert(*table, key_hash, idx);
+        return TR_N_KEYS + idx;
+    }
+
+    std::mutex mutex_;
+
+    std::atomic<Table*> table_ = nullptr;
+    std::array<std::atomic<std::string_view*>, 32> segments_ = {};
+
+    // depends-on: mutex_
+    std::vector<std::unique_ptr<Table>> tables_;
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* arena_pos_ = nullptr;
+    size_t arena_left_ = 0U;
+    size_t size_ = 0U;
+};
+
+// Leaked on purpose so that it outlives anything that might use it at exit.
+auto& my_runtime{ *new RuntimeQuarks{} };
+
+[[nodiscard]] std::optional<tr_quark> lookupStatic(std::string_view key)
 {
-    // is it in our static array?
     auto constexpr Sbegin = std::begin(MyStatic);
     auto constexpr Send = std::end(MyStatic);
 
@@ -452,34 +693,37 @@ std::optional<tr_quark> tr_quark_lookup(std::string_view key)
         return std::distance(Sbegin, sit);
     }
 
-    /* was it added during runtime? */
-    auto const rbegin = std::begin(my_runtime);
-    auto const rend = std::end(my_runtime);
-    if (auto const rit = std::find(rbegin, rend, key); rit != rend)
+    return {};
+}
+
+} // namespace
+
+std::optional<tr_quark> tr_quark_lookup(std::string_view key)
+{
+    if (auto const quark = lookupStatic(key); quark)
     {
-        return TR_N_KEYS + std::distance(rbegin, rit);
+        return quark;
     }
 
-    return {};
+    return my_runtime.find(key);
 }
 
 tr_quark tr_quark_new(std::string_view str)
 {
-    if (auto const prior = tr_quark_lookup(str); prior)
+    if (auto const quark = lookupStatic(str); quark)
     {
-        return *prior;
+        return *quark;
     }
 
-    auto const ret = TR_N_KEYS + std::size(my_runtime);
-    auto const len = std::size(str);
-    auto* perma = new char[len + 1];
-    std::copy_n(std::begin(str), len, perma);
-    perma[len] = '\0';
-    my_runtime.emplace_back(perma);
-    return ret;
+    return my_runtime.findOrAdd(str);
 }
 
 std::string_view tr_quark_get_string_view(tr_quark q)
 {
-    return q < TR_N_KEYS ? MyStatic[q] : my_runtime[q - TR_N_KEYS];
+    if (q < TR_N_KEYS)
+    {
+        return MyStatic[q];
+    }
+
+    return my_runtime.get(q - TR_N_KEYS);
 }
@@ -48,6 +48,7 @@ enum
     TR_KEY_anti_brute_force_threshold, /* rpc */
     TR_KEY_arguments, /* rpc */
     TR_KEY_availability, // rpc
+    TR_KEY_bandwidth, /* session-thread-stats */
     TR_KEY_bandwidth_priority,
     TR_KEY_bandwidthPriority,
     TR_KEY_bind_address_ipv4,
@@ -59,8 +60,10 @@ enum
     TR_KEY_blocklist_updates_enabled,
     TR_KEY_blocklist_url,
     TR_KEY_blocks,
+    TR_KEY_bytes_served, /* session-thread-stats */
     TR_KEY_bytesCompleted,
     TR_KEY_cache_size_mb,
+    TR_KEY_cache_stats,
     TR_KEY_clientIsChoked,
     TR_KEY_clientIsInterested,
     TR_KEY_clientName,
@@ -72,6 +75,7 @@ enum
     TR_KEY_cookies,
     TR_KEY_corrupt,
     TR_KEY_corruptEver,
+    TR_KEY_count, /* rpc */
     TR_KEY_created_by,
     TR_KEY_created_by_utf_8,
     TR_KEY_creation_date,
@@ -82,6 +86,7 @@ enum
     TR_KEY_dateCreated,
     TR_KEY_default_trackers,
     TR_KEY_delete_local_data,
+    TR_KEY_depth, /* rpc */
     TR_KEY_desiredAvailable,
     TR_KEY_destination,
     TR_KEY_details_window_height,
@@ -90,6 +95,7 @@ enum
     TR_KEY_dnd,
     TR_KEY_done_date,
     TR_KEY_doneDate,
+    TR_KEY_download, /* session-thread-stats */
     TR_KEY_download_dir,
     TR_KEY_download_dir_free_space,
     TR_KEY_download_queue_enabled,
@@ -184,6 +190,7 @@ enum
     TR_KEY_leftUntilDone,
     TR_KEY_length,
     TR_KEY_location,
+    TR_KEY_loop_lag, /* rpc */
     TR_KEY_lpd_enabled,
     TR_KEY_m,
     TR_KEY_magnetLink,
@@ -195,6 +202,7 @@ enum
     TR_KEY_main_window_y,
     TR_KEY_manualAnnounceTime,
     TR_KEY_max_peers,
+    TR_KEY_max_usec, /* rpc */
     TR_KEY_maxConnectedPeers,
     TR_KEY_memory_bytes,
     TR_KEY_memory_units,
@@ -215,10 +223,14 @@ enum
     TR_KEY_nodes6,
     TR_KEY_open_dialog_dir,
     TR_KEY_p,
+    TR_KEY_p50_usec, /* rpc */
+    TR_KEY_p90_usec, /* rpc */
+    TR_KEY_p99_usec, /* rpc */
     TR_KEY_path,
     TR_KEY_path_utf_8,
     TR_KEY_paused,
     TR_KEY_pausedTorrentCount,
+    TR_KEY_peak_depth, /* rpc */
     TR_KEY_peer_congestion_algorithm,
     TR_KEY_peer_id_ttl_hours,
     TR_KEY_peer_limit,
@@ -268,6 +280,7 @@ enum
     TR_KEY_queue_stalled_enabled,
     TR_KEY_queue_stalled_minutes,
     TR_KEY_queuePosition,
+    TR_KEY_queued, /* session-thread-stats */
     TR_KEY_rateDownload,
     TR_KEY_rateToClient,
     TR_KEY_rateToPeer,
@@ -275,7 +288,12 @@ enum
     TR_KEY_ratio_limit,
     TR_KEY_ratio_limit_enabled,
     TR_KEY_ratio_mode,
+    TR_KEY_read_cache_size_mb,
     TR_KEY_read_clipboard,
+    TR_KEY_readCacheBytes,
+    TR_KEY_readCacheEvictions,
+    TR_KEY_readCacheHits,
+    TR_KEY_readCacheMisses,
     TR_KEY_recent_download_dir_1,
     TR_KEY_recent_download_dir_2,
     TR_KEY_recent_download_dir_3,
@@ -296,11 +314,14 @@ enum
     TR_KEY_rename_partial_files,
     TR_KEY_reqq,
     TR_KEY_result,
+    TR_KEY_resume_snapshot_enabled,
+    TR_KEY_revision,
     TR_KEY_rpc_authentication_required,
     TR_KEY_rpc_bind_address,
     TR_KEY_rpc_enabled,
     TR_KEY_rpc_host_whitelist,
     TR_KEY_rpc_host_whitelist_enabled,
+    TR_KEY_rpc_metrics_enabled, /* daemon */
     TR_KEY_rpc_password,
     TR_KEY_rpc_port,
     TR_KEY_rpc_socket_mode,
@@ -344,6 +365,7 @@ enum
     TR_KEY_show_statusbar,
     TR_KEY_show_toolbar,
     TR_KEY_show_tracker_scrapes,
+    TR_KEY_since,
     TR_KEY_sitename,
     TR_KEY_size_bytes,
     TR_KEY_size_units,
@@ -365,6 +387,7 @@ enum
     TR_KEY_status,
     TR_KEY_statusbar_stats,
     TR_KEY_tag,
+    TR_KEY_tasks, /* rpc */
     TR_KEY_tcp_enabled,
     TR_KEY_tier,
     TR_KEY_time_checked,
@@ -383,6 +406,7 @@ enum
     TR_KEY_torrentCount,
     TR_KEY_torrentFile,
     TR_KEY_torrents,
+    TR_KEY_total_usec, /* rpc */
     TR_KEY_totalSize,
     TR_KEY_total_size,
     TR_KEY_trackerAdd,
@@ -393,8 +417,10 @@ enum
     TR_KEY_trackers,
     TR_KEY_trash_can_enabled,
     TR_KEY_trash_original_torrent_files,
+    TR_KEY_turns, /* session-thread-stats */
     TR_KEY_umask,
     TR_KEY_units,
+    TR_KEY_upload, /* session-thread-stats */
     TR_KEY_upload_slots_per_torrent,
     TR_KEY_uploadLimit,
     TR_KEY_uploadLimited,
@@ -416,12 +442,17 @@ enum
     TR_KEY_ut_recommend,
     TR_KEY_utp_enabled,
     TR_KEY_v,
+    TR_KEY_verify_speed_limit_mb,
+    TR_KEY_verify_threads,
+    TR_KEY_verify_threads_per_device,
     TR_KEY_version,
+    TR_KEY_wait, /* rpc */
     TR_KEY_wanted,
     TR_KEY_watch_dir,
     TR_KEY_watch_dir_enabled,
     TR_KEY_webseeds,
     TR_KEY_webseedsSendingToUs,
+    TR_KEY_work_queue, /* rpc */
     TR_KEY_yourip,
     TR_N_KEYS
 };
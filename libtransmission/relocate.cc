@@ -0,0 +1,367 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "transmission.h"
+
+#include "error.h"
+#include "file.h"
+#include "log.h"
+#include "relocate.h"
+#include "tr-assert.h"
+#include "tr-strbuf.h"
+
+namespace
+{
+namespace relocate_helpers
+{
+// how much to copy between checks for whether the job was cancelled
+auto constexpr CopyChunkSize = size_t{ 1024U * 1024U * 4U };
+
+[[nodiscard]] bool writeAll(tr_sys_file_t fd, char const* buf, uint64_t len, tr_error** error)
+{
+    while (len > 0U)
+    {
+        auto n_written = uint64_t{};
+        if (!tr_sys_file_write(fd, buf, len, &n_written, error))
+        {
+            return false;
+        }
+
+        buf += n_written;
+        len -= n_written;
+    }
+
+    return true;
+}
+
+// Like tr_sys_path_copy(), but a chunk at a time so that
+// it can report its progress and be cancelled partway through.
+template<typename OnProgress>
+[[nodiscard]] bool copyFile(
+    tr_relocate_worker::File const& file,
+    std::vector<char>& buf,
+    std::atomic<bool> const& stop,
+    OnProgress const& on_progress,
+    tr_error** error)
+{
+    auto dir = tr_pathbuf{ file.new_path };
+    dir.popdir();
+    if (!tr_sys_dir_create(dir, TR_SYS_DIR_CREATE_PARENTS, 0777, error))
+    {
+        return false;
+    }
+
+    auto const in = tr_sys_file_open(file.old_path.c_str(), TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL, 0, error);
+    if (in == TR_BAD_SYS_FILE)
+    {
+        return false;
+    }
+
+    auto const out = tr_sys_file_open(
+        file.new_path.c_str(),
+        TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE | TR_SYS_FILE_TRUNCATE,
+        0666,
+        error);
+    if (out == TR_BAD_SYS_FILE)
+    {
+        tr_sys_file_close(in);
+        return false;
+    }
+
+    auto ok = true;
+    while (ok && !stop)
+    {
+        auto n_read = uint64_t{};
+        ok = tr_sys_file_read(in, std::data(buf), std::size(buf), &n_read, error);
+        if (!ok || n_read == 0U)
+        {
+            break;
+        }
+
+        ok = writeAll(out, std::data(buf), n_read, error);
+        on_progress(n_read);
+    }
+
+    // the old copy gets deleted after this, so make sure the new one is on disk
+    ok = ok && !stop && tr_sys_file_flush(out, error);
+    ok = tr_sys_file_close(out, ok ? error : nullptr) && ok;
+    tr_sys_file_close(in);
+    return ok;
+}
+} // namespace relocate_helpers
+} // namespace
+
+bool tr_relocate_worker::copyJob(Job& job) const
+{
+    using namespace relocate_helpers;
+
+    auto const new_device = device_key_(job.new_dir);
+
+    auto to_copy = std::vector<File*>{};
+    auto total_size = uint64_t{};
+    for (auto& file : job.files)
+    {
+        if (device_key_(file.old_path) != new_device)
+        {
+            to_copy.push_back(&file);
+            total_size += file.size;
+        }
+    }
+
+    auto buf = std::vector<char>(CopyChunkSize);
+    auto bytes_copied = uint64_t{};
+    auto const on_progress = [&job, &bytes_copied, total_size](uint64_t n_bytes)
+    {
+        bytes_copied += n_bytes;
+
+        if (job.setme_progress != nullptr && total_size > 0U)
+        {
+            *job.setme_progress = std::min(1.0, static_cast<double>(bytes_copied) / total_size);
+        }
+    };
+
+    for (auto* const file : to_copy)
+    {
+        tr_logAddTrace(fmt::format("Copying '{}' to '{}'", file->old_path, file->new_path));
+
+        tr_error* error = nullptr;
+        if (auto const info = tr_sys_path_get_info(file->old_path, 0, &error);
+            info && copyFile(*file, buf, job.stop, on_progress, &error))
+        {
+            file->copied_mtime = info->last_modified_at;
+            continue;
+        }
+
+        if (error != nullptr)
+        {
+            job.error_message = error->message;
+            job.error_code = error->code;
+            tr_error_free(error);
+        }
+
+        // don't leave a partial copy behind
+        tr_sys_path_remove(file->new_path);
+        removeCopies(job);
+        return false;
+    }
+
+    return !job.stop;
+}
+
+void tr_relocate_worker::removeCopies(Job& job)
+{
+    for (auto& file : job.files)
+    {
+        if (file.copied_mtime)
+        {
+            tr_sys_path_remove(file.new_path);
+            file.copied_mtime.reset();
+        }
+    }
+}
+
+void tr_relocate_worker::removeOriginals(Job const& job)
+{
+    for (auto const& file : job.files)
+    {
+        if (auto const info = tr_sys_path_get_info(file.old_path);
+            file.copied_mtime && info && info->last_modified_at == *file.copied_mtime)
+        {
+            tr_sys_path_remove(file.old_path);
+        }
+    }
+}
+
+std::list<tr_relocate_worker::Node>::iterator tr_relocate_worker::nextTodo()
+{
+    // the oldest job whose devices aren't already busy
+    return std::find_if(
+        std::begin(todo_),
+        std::end(todo_),
+        [this](auto const& node)
+        {
+            return countActive(node.old_device) < max_threads_per_device_ &&
+                countActive(node.new_device) < max_threads_per_device_;
+        });
+}
+
+size_t tr_relocate_worker::countActive(std::string const& device) const
+{
+    return std::count_if(
+        std::begin(active_),
+        std::end(active_),
+        [&device](auto const& active) { return active.old_device == device || active.new_device == device; });
+}
+
+void tr_relocate_worker::startThreads()
+{
+    // Start one thread at a time. When it takes a job,
+    // it calls this again in case there's more work to share.
+    auto const n_idle = n_threads_ - std::size(active_);
+    if (stopping_ || n_idle > 0U || n_threads_ >= max_threads_ || nextTodo() == std::end(todo_))
+    {
+        return;
+    }
+
+    ++n_threads_;
+    std::thread(&tr_relocate_worker::relocateThreadFunc, this).detach();
+}
+
+void tr_relocate_worker::relocateThreadFunc()
+{
+    auto lock = std::unique_lock(relocate_mutex_);
+
+    for (;;)
+    {
+        auto const it = stopping_ ? std::end(todo_) : nextTodo();
+        if (it == std::end(todo_))
+        {
+            --n_threads_;
+            done_cv_.notify_all();
+            return;
+        }
+
+        active_.splice(std::end(active_), todo_, it);
+        auto const job = active_.back().job;
+        startThreads();
+        lock.unlock();
+
+        if (!copyJob(*job) && job->stop)
+        {
+            removeCopies(*job);
+        }
+
+        lock.lock();
+        active_.remove_if([&job](auto const& node) { return node.job == job; });
+        if (!job->stop)
+        {
+            done_.push_back(job);
+            callCallback(job);
+        }
+
+        done_cv_.notify_all();
+    }
+}
+
+void tr_relocate_worker::add(std::shared_ptr<Job> job)
+{
+    TR_ASSERT(job);
+
+    remove(job->tor_id);
+
+    auto node = Node{};
+    node.old_device = device_key_(job->old_dir);
+    node.new_device = device_key_(job->new_dir);
+    node.job = std::move(job);
+
+    auto const lock = std::lock_guard(relocate_mutex_);
+    todo_.push_back(std::move(node));
+    startThreads();
+}
+
+void tr_relocate_worker::remove(tr_torrent_id_t tor_id)
+{
+    auto lock = std::unique_lock(relocate_mutex_);
+
+    auto const is_job = [tor_id](auto const& node)
+    {
+        return node.job->tor_id == tor_id;
+    };
+
+    auto removed = std::shared_ptr<Job>{};
+
+    if (auto const it = std::find_if(std::begin(todo_), std::end(todo_), is_job); it != std::end(todo_))
+    {
+        removed = it->job;
+        todo_.erase(it);
+    }
+    else if (auto const active = std::find_if(std::begin(active_), std::end(active_), is_job); active != std::end(active_))
+    {
+        // its thread removes the copies
+        removed = active->job;
+        removed->stop = true;
+        done_cv_.wait(lock, [this, &is_job]() { return std::none_of(std::begin(active_), std::end(active_), is_job); });
+    }
+    else if (auto const done = std::find_if(
+                 std::begin(done_),
+                 std::end(done_),
+                 [tor_id](auto const& job) { return job->tor_id == tor_id; });
+             done != std::end(done_))
+    {
+        removed = *done;
+        done_.erase(done);
+        removeCopies(*removed);
+    }
+
+    if (removed)
+    {
+        removed->stop = true;
+
+        if (removed->setme_state != nullptr)
+        {
+            *removed->setme_state = TR_LOC_ERROR;
+        }
+    }
+}
+
+bool tr_relocate_worker::finish(Job const& job)
+{
+    auto const lock = std::lock_guard(relocate_mutex_);
+
+    if (auto const it = std::find_if(
+            std::begin(done_),
+            std::end(done_),
+            [&job](auto const& candidate) { return candidate.get() == &job; });
+        it != std::end(done_))
+    {
+        done_.erase(it);
+        return true;
+    }
+
+    return false;
+}
+
+bool tr_relocate_worker::contains(tr_torrent_id_t tor_id) const
+{
+    auto const lock = std::lock_guard(relocate_mutex_);
+
+    auto const is_job = [tor_id](auto const& node)
+    {
+        return node.job->tor_id == tor_id;
+    };
+
+    return std::any_of(std::begin(todo_), std::end(todo_), is_job) ||
+        std::any_of(std::begin(active_), std::end(active_), is_job) ||
+        std::any_of(std::begin(done_), std::end(done_), [tor_id](auto const& job) { return job->tor_id == tor_id; });
+}
+
+tr_relocate_worker::~tr_relocate_worker()
+{
+    auto lock = std::unique_lock(relocate_mutex_);
+    stopping_ = true;
+    todo_.clear();
+    for (auto& active : active_)
+    {
+        active.job->stop = true;
+    }
+
+    done_cv_.wait(lock, [this]() { return n_threads_ == 0U; });
+
+    for (auto const& job : done_)
+    {
+        removeCopies(*job);
+    }
+}
@@ -0,0 +1,158 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <ctime> // time_t
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "transmission.h" // tr_torrent_id_t
+
+#include "utils.h" // tr_deviceKey()
+
+// Copies torrents' local data to another device in the background.
+//
+// Moving a torrent within a device is just a rename, but moving it to
+// another device means copying all of its data. That's done here, on a
+// small pool of threads, so that the session keeps running meanwhile.
+// The caller finishes the move in the session thread once the copy is
+// done by deleting the old copies and renaming whatever's left.
+//
+// As with verifying, the number of jobs reading from or writing to
+// any one device at the same time is capped.
+class tr_relocate_worker
+{
+public:
+    static auto constexpr DefaultMaxThreads = size_t{ 2U };
+    static auto constexpr DefaultMaxThreadsPerDevice = size_t{ 1U };
+
+    struct File
+    {
+        std::string old_path;
+        std::string new_path;
+        uint64_t size = 0;
+
+        // the old file's mtime when it was copied, or unset if it wasn't.
+        // It lets the caller tell if the old file changed since then.
+        std::optional<time_t> copied_mtime;
+    };
+
+    struct Job
+    {
+        tr_torrent_id_t tor_id = {};
+        std::string old_dir;
+        std::string new_dir;
+
+        // Only the files that are on a different device
+        // than `new_dir` get copied. The rest can be renamed.
+        std::vector<File> files;
+
+        double volatile* setme_progress = nullptr;
+        int volatile* setme_state = nullptr;
+
+        // set if copying failed
+        std::string error_message;
+        int error_code = 0;
+
+        std::atomic<bool> stop = false;
+    };
+
+    // Called in a worker thread when a job's files are all copied or when
+    // copying fails, in which case the job's error is set and no copies are
+    // left behind. It's not called for jobs that are removed.
+    using callback_func = std::function<void(std::shared_ptr<Job> const& job)>;
+
+    // Tells which device a path is on. Tests can use a fake one
+    // to copy between directories as if they were on different devices.
+    using device_key_func = std::string (*)(std::string_view path);
+
+    explicit tr_relocate_worker(device_key_func device_key = tr_deviceKey)
+        : device_key_{ device_key }
+    {
+    }
+
+    ~tr_relocate_worker();
+
+    void addCallback(callback_func callback)
+    {
+        callbacks_.emplace_back(std::move(callback));
+    }
+
+    // Queues `job`, replacing the torrent's earlier job if it has one.
+    void add(std::shared_ptr<Job> job);
+
+    // Cancels the torrent's job, if it has one, and removes the files it copied.
+    // If the job is being copied right now, this waits for that to stop.
+    void remove(tr_torrent_id_t tor_id);
+
+    // Tells the worker the caller is done with a job that it got from a callback.
+    // @return false if the job was removed in the meantime.
+    bool finish(Job const& job);
+
+    // @return true if the torrent has a job that's not finished yet
+    [[nodiscard]] bool contains(tr_torrent_id_t tor_id) const;
+
+    // Removes the old copies of the job's files that were copied, unless
+    // they changed since then. Call this once the job is done copying.
+    static void removeOriginals(Job const& job);
+
+private:
+    struct Node
+    {
+        std::shared_ptr<Job> job;
+        std::string old_device;
+        std::string new_device;
+    };
+
+    void callCallback(std::shared_ptr<Job> const& job) const
+    {
+        for (auto const& callback : callbacks_)
+        {
+            callback(job);
+        }
+    }
+
+    void startThreads();
+    void relocateThreadFunc();
+    [[nodiscard]] std::list<Node>::iterator nextTodo();
+    [[nodiscard]] size_t countActive(std::string const& device) const;
+    [[nodiscard]] bool copyJob(Job& job) const;
+    static void removeCopies(Job& job);
+
+    std::list<callback_func> callbacks_;
+    mutable std::mutex relocate_mutex_;
+
+    std::list<Node> todo_;
+    std::list<Node> active_;
+
+    // jobs that are done copying, or that failed to,
+    // but that the caller hasn't finished yet
+    std::list<std::shared_ptr<Job>> done_;
+
+    device_key_func const device_key_;
+
+    size_t max_threads_ = DefaultMaxThreads;
+    size_t max_threads_per_device_ = DefaultMaxThreadsPerDevice;
+    size_t n_threads_ = 0;
+    bool stopping_ = false;
+
+    // notified when an active job finishes or a thread exits
+    std::condition_variable done_cv_;
+};
@@ -0,0 +1,515 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <cstddef> // std::byte, size_t
+#include <cstdint>
+#include <cstring> // memcpy
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <libdeflate.h>
+
+#include "transmission.h"
+
+#include "error-types.h"
+#include "error.h"
+#include "file.h"
+#include "log.h"
+#include "resume-store.h"
+#include "tr-strbuf.h"
+#include "utils.h"
+
+using namespace std::literals;
+
+namespace
+{
+namespace resume_store_helpers
+{
+// File layout, all integers little-endian:
+//
+// header: [8] magic, [4] version, [4] reserved (0)
+// record: [4] payload length, [4] crc32 of the rest of the record,
+//         [1] record type, [3] reserved (0), [20] info hash,
+//         [n] payload, then zeroes up to the next multiple of 8
+auto constexpr Magic = "TRRESUME"sv;
+auto constexpr HeaderSize = size_t{ 16U };
+auto constexpr RecordHeaderSize = size_t{ 32U };
+auto constexpr Alignment = size_t{ 8U };
+
+auto constexpr PutRecord = char{ 'P' };
+auto constexpr EraseRecord = char{ 'E' };
+
+// Don't bother compacting files that are small anyway
+auto constexpr MinDeadBytesToCompact = uint64_t{ 256U * 1024U };
+
+// Write in chunks of about this size so that compacting a big store
+// doesn't need to hold a copy of the whole file in memory
+auto constexpr WriteChunkSize = size_t{ 1024U * 1024U };
+
+[[nodiscard]] constexpr size_t recordSize(size_t payload_len) noexcept
+{
+    auto const len = RecordHeaderSize + payload_len;
+    return (len + Alignment - 1U) & ~(Alignment - 1U);
+}
+
+void appendUint32(std::string& buf, uint32_t val)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        buf.push_back(static_cast<char>((val >> (8 * i)) & 0xFFU));
+    }
+}
+
+[[nodiscard]] uint32_t readUint32(std::string_view buf) noexcept
+{
+    auto val = uint32_t{};
+    for (int i = 3; i >= 0; --i)
+    {
+        val = (val << 8U) | static_cast<uint8_t>(buf[i]);
+    }
+    return val;
+}
+
+[[nodiscard]] uint32_t checksum(std::string_view record_tail, std::string_view payload) noexcept
+{
+    auto const crc = libdeflate_crc32(0U, std::data(record_tail), std::size(record_tail));
+
+    // libdeflate_crc32() treats a nullptr buffer as a request for the initial value
+    return std::empty(payload) ? crc : libdeflate_crc32(crc, std::data(payload), std::size(payload));
+}
+
+void appendHeader(std::string& buf)
+{
+    buf.append(Magic);
+    appendUint32(buf, tr_resume_store::Version);
+    appendUint32(buf, 0U);
+}
+
+void appendRecord(std::string& buf, char type, tr_sha1_digest_t const& hash, std::string_view payload)
+{
+    auto tail = std::array<char, RecordHeaderSize - 8U>{};
+    tail[0] = type;
+    std::memcpy(std::data(tail) + 4U, std::data(hash), std::size(hash));
+    auto const tail_sv = std::string_view{ std::data(tail), std::size(tail) };
+
+    appendUint32(buf, static_cast<uint32_t>(std::size(payload)));
+    appendUint32(buf, checksum(tail_sv, payload));
+    buf.append(tail_sv);
+    buf.append(payload);
+    buf.append(recordSize(std::size(payload)) - RecordHeaderSize - std::size(payload), '\0');
+}
+
+bool writeAll(tr_sys_file_t fd, std::string_view buf, uint64_t offset, tr_error** error)
+{
+    while (!std::empty(buf))
+    {
+        auto n_written = uint64_t{};
+        if (!tr_sys_file_write_at(fd, std::data(buf), std::size(buf), offset, &n_written, error))
+        {
+            return false;
+        }
+
+        buf.remove_prefix(n_written);
+        offset += n_written;
+    }
+
+    return true;
+}
+} // namespace resume_store_helpers
+} // namespace
+
+tr_resume_store::tr_resume_store(std::string filename)
+    : filename_{ std::move(filename) }
+{
+}
+
+tr_resume_store::~tr_resume_store()
+{
+    if (isDirty())
+    {
+        flush();
+    }
+}
+
+bool tr_resume_store::load(tr_error** error)
+{
+    using namespace resume_store_helpers;
+
+    entries_.clear();
+    dirty_.clear();
+    mapped_file_ = tr_mapped_file{};
+    dead_bytes_ = live_bytes_ = append_pos_ = file_size_ = 0U;
+    is_read_only_ = false;
+
+    if (!tr_sys_path_exists(filename_))
+    {
+        return true;
+    }
+
+    if (!mapped_file_.load(filename_, error))
+    {
+        // don't overwrite what we couldn't read
+        is_read_only_ = true;
+        return false;
+    }
+
+    auto const contents = mapped_file_.sv();
+    file_size_ = std::size(contents);
+
+    if (std::size(contents) < HeaderSize || contents.substr(0, std::size(Magic)) != Magic ||
+        readUint32(contents.substr(std::size(Magic))) != Version)
+    {
+        // It might be from a newer version of Transmission, so keep it
+        // and start over with an empty store.
+        mapped_file_ = tr_mapped_file{};
+        file_size_ = 0U;
+
+        auto const backup = tr_pathbuf{ filename_, ".bad"sv };
+        if (!tr_sys_path_rename(filename_, backup))
+        {
+            is_read_only_ = true;
+            tr_error_set(error, TR_ERROR_EINVAL, fmt::format("'{}' is not a version {} resume store", filename_, Version));
+            return false;
+        }
+
+        tr_error_set(
+            error,
+            TR_ERROR_EINVAL,
+            fmt::format("'{}' is not a version {} resume store; moved it to '{}'", filename_, Version, backup));
+        return false;
+    }
+
+    auto pos = HeaderSize;
+    while (pos + RecordHeaderSize <= std::size(contents))
+    {
+        auto const record = contents.substr(pos);
+        auto const payload_len = size_t{ readUint32(record) };
+        auto const record_size = recordSize(payload_len);
+        if (payload_len > std::size(record) - RecordHeaderSize || record_size > std::size(record))
+        {
+            break;
+        }
+
+        auto const tail = record.substr(8U, RecordHeaderSize - 8U);
+        auto const payload = record.substr(RecordHeaderSize, payload_len);
+        auto const type = tail[0];
+        if (readUint32(record.substr(4U)) != checksum(tail, payload) || (type != PutRecord && type != EraseRecord))
+        {
+            break;
+        }
+
+        auto hash = tr_sha1_digest_t{};
+        std::memcpy(std::data(hash), std::data(tail) + 4U, std::size(hash));
+
+        if (auto const iter = entries_.find(hash); iter != std::end(entries_))
+        {
+            dead_bytes_ += iter->second.record_size;
+            live_bytes_ -= iter->second.record_size;
+            entries_.erase(iter);
+        }
+
+        if (type == PutRecord)
+        {
+            auto& entry = entries_[hash];
+            entry.mapped = payload;
+            entry.record_size = record_size;
+            live_bytes_ += record_size;
+        }
+        else
+        {
+            dead_bytes_ += record_size;
+        }
+
+        pos += record_size;
+    }
+
+    append_pos_ = pos;
+
+    if (append_pos_ != file_size_)
+    {
+        tr_logAddWarn(fmt::format(
+            _("Discarding {count} damaged bytes at the end of '{path}'"),
+            fmt::arg("count", file_size_ - append_pos_),
+            fmt::arg("path", filename_)));
+    }
+
+    return true;
+}
+
+std::optional<std::string_view> tr_resume_store::get(tr_sha1_digest_t const& hash) const
+{
+    if (auto const iter = entries_.find(hash); iter != std::end(entries_))
+    {
+        return iter->second.benc();
+    }
+
+    return {};
+}
+
+void tr_resume_store::put(tr_sha1_digest_t const& hash, std::string_view benc)
+{
+    auto& entry = entries_[hash];
+    entry.owned.assign(benc);
+    entry.is_owned = true;
+    entry.mapped = {};
+
+    if (entry.record_size != 0U)
+    {
+        dead_bytes_ += entry.record_size;
+        live_bytes_ -= entry.record_size;
+        entry.record_size = 0U;
+    }
+
+    dirty_.insert(hash);
+}
+
+void tr_resume_store::erase(tr_sha1_digest_t const& hash)
+{
+    auto const iter = entries_.find(hash);
+    if (iter == std::end(entries_))
+    {
+        return;
+    }
+
+    dead_bytes_ += iter->second.record_size;
+    live_bytes_ -= iter->second.record_size;
+    entries_.erase(iter);
+
+    // An older record may still be on disk even if this one isn't,
+    // so always write a tombstone. If there isn't, it's harmless.
+    dirty_.insert(hash);
+}
+
+void tr_resume_store::removeAfterFlush(std::string filename)
+{
+    remove_after_flush_.emplace_back(std::move(filename));
+}
+
+bool tr_resume_store::shouldCompact() const noexcept
+{
+    using namespace resume_store_helpers;
+
+    return dead_bytes_ >= MinDeadBytesToCompact && dead_bytes_ > live_bytes_;
+}
+
+bool tr_resume_store::flush(tr_error** error)
+{
+    if (is_read_only_)
+    {
+        tr_error_set(error, TR_ERROR_EINVAL, fmt::format("Won't overwrite '{}', which couldn't be loaded", filename_));
+        return false;
+    }
+
+    if (!isDirty() && append_pos_ == file_size_ && append_pos_ != 0U)
+    {
+        return true;
+    }
+
+    if (append_pos_ == 0U || shouldCompact() ? !compact(error) : !append(error))
+    {
+        return false;
+    }
+
+    for (auto const& filename : remove_after_flush_)
+    {
+        tr_sys_path_remove(filename);
+    }
+
+    remove_after_flush_.clear();
+    return true;
+}
+
+bool tr_resume_store::append(tr_error** error)
+{
+    using namespace resume_store_helpers;
+
+    auto const fd = tr_sys_file_open(filename_.c_str(), TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE, 0666, error);
+    if (fd == TR_BAD_SYS_FILE)
+    {
+        return false;
+    }
+
+    // drop any damaged records found when loading
+    auto ok = append_pos_ == file_size_ || tr_sys_file_truncate(fd, append_pos_, error);
+
+    auto buf = std::string{};
+    auto pos = append_pos_;
+    auto const write_buf = [&]()
+    {
+        ok = ok && writeAll(fd, buf, pos, error);
+        pos += std::size(buf);
+        buf.clear();
+    };
+
+    auto n_added_live = uint64_t{};
+    auto n_added_dead = uint64_t{};
+    for (auto const& hash : dirty_)
+    {
+        if (auto const iter = entries_.find(hash); iter != std::end(entries_))
+        {
+            auto const benc = iter->second.benc();
+            appendRecord(buf, PutRecord, hash, benc);
+            n_added_live += recordSize(std::size(benc));
+        }
+        else
+        {
+            appendRecord(buf, EraseRecord, hash, {});
+            n_added_dead += recordSize(0U);
+        }
+
+        if (std::size(buf) >= WriteChunkSize)
+        {
+            write_buf();
+        }
+    }
+
+    write_buf();
+    ok = ok && tr_sys_file_flush(fd, error);
+    tr_sys_file_close(fd);
+
+    if (!ok)
+    {
+        // stay dirty and try again next time,
+        // overwriting whatever we managed to write
+        file_size_ = std::max(file_size_, pos);
+        return false;
+    }
+
+    for (auto const& hash : dirty_)
+    {
+        if (auto const iter = entries_.find(hash); iter != std::end(entries_))
+        {
+            iter->second.record_size = recordSize(std::size(iter->second.benc()));
+        }
+    }
+
+    dirty_.clear();
+    live_bytes_ += n_added_live;
+    dead_bytes_ += n_added_dead;
+    append_pos_ = file_size_ = pos;
+    return true;
+}
+
+bool tr_resume_store::compact(tr_error** error)
+{
+    using namespace resume_store_helpers;
+
+    // follow symlinks to make sure the temporary file is on the right partition
+    auto const realname = tr_sys_path_resolve(filename_);
+    auto const& target = std::empty(realname) ? filename_ : realname;
+
+    auto tmp = tr_pathbuf{ target, ".tmp.XXXXXX"sv };
+    auto const fd = tr_sys_file_open_temp(std::data(tmp), error);
+    if (fd == TR_BAD_SYS_FILE)
+    {
+        return false;
+    }
+
+    auto ok = true;
+    auto buf = std::string{};
+    auto pos = uint64_t{};
+    auto const write_buf = [&]()
+    {
+        ok = ok && writeAll(fd, buf, pos, error);
+        pos += std::size(buf);
+        buf.clear();
+    };
+
+    // where each entry's payload lands in the new file
+    auto offsets = std::vector<uint64_t>{};
+    offsets.reserve(std::size(entries_));
+
+    appendHeader(buf);
+    for (auto const& [hash, entry] : entries_)
+    {
+        offsets.push_back(pos + std::size(buf) + RecordHeaderSize);
+        appendRecord(buf, PutRecord, hash, entry.benc());
+
+        if (std::size(buf) >= WriteChunkSize)
+        {
+            write_buf();
+        }
+    }
+
+    write_buf();
+    ok = ok && tr_sys_file_flush(fd, error);
+    ok = tr_sys_file_close(fd, ok ? error : nullptr) && ok;
+    if (!ok)
+    {
+        tr_sys_path_remove(tmp);
+        return false;
+    }
+
+    // Some platforms can't replace a file that's mapped into memory,
+    // so copy out anything that still points into the old file first.
+    for (auto& [hash, entry] : entries_)
+    {
+        if (!entry.is_owned)
+        {
+            entry.owned.assign(entry.mapped);
+            entry.is_owned = true;
+            entry.mapped = {};
+        }
+    }
+    mapped_file_ = tr_mapped_file{};
+
+    if (!tr_sys_path_rename(tmp, tr_pathbuf{ target }, error))
+    {
+        tr_sys_path_remove(tmp);
+        return false;
+    }
+
+    live_bytes_ = 0U;
+    for (auto& [hash, entry] : entries_)
+    {
+        entry.record_size = recordSize(std::size(entry.benc()));
+        live_bytes_ += entry.record_size;
+    }
+
+    dirty_.clear();
+    dead_bytes_ = 0U;
+    append_pos_ = file_size_ = pos;
+
+    // Now map the new file and release the copies
+    if (mapped_file_.load(target) && std::size(mapped_file_.sv()) == pos)
+    {
+        auto const contents = mapped_file_.sv();
+        auto offset = std::begin(offsets);
+        for (auto& [hash, entry] : entries_)
+        {
+            entry.mapped = contents.substr(*offset++, std::size(entry.owned));
+            entry.owned = {};
+            entry.is_owned = false;
+        }
+    }
+    else
+    {
+        mapped_file_ = tr_mapped_file{};
+    }
+
+    tr_logAddTrace(fmt::format("Compacted '{}' to {} records", filename_, std::size(entries_)));
+    return true;
+}
+
+void tr_resume_store::remove()
+{
+    if (!is_read_only_)
+    {
+        tr_sys_path_remove(filename_);
+    }
+
+    entries_.clear();
+    dirty_.clear();
+    remove_after_flush_.clear();
+    mapped_file_ = tr_mapped_file{};
+    dead_bytes_ = live_bytes_ = append_pos_ = file_size_ = 0U;
+    is_read_only_ = false;
+}
@@ -0,0 +1,153 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "tr-macros.h" // tr_sha1_digest_t
+#include "utils.h" // tr_mapped_file
+
+struct tr_error;
+
+// A single file that holds the resume state of every torrent in a session,
+// so that startup is one sequential read instead of one small read per
+// torrent and the periodic save is one append instead of one rewrite per
+// dirty torrent.
+//
+// The file is a header followed by an append-only log of records. Each
+// record holds a torrent's info hash and either its benc-encoded resume
+// dict or a tombstone saying that the torrent was removed. The newest
+// record for a hash wins. Records are checksummed and 8-byte aligned, so
+// the file can be parsed in place from a read-only mapping, and a torn
+// write at the end is detected and discarded on the next load.
+//
+// When superseded records take up more space than live ones, the file is
+// compacted by writing the live records to a new file that replaces it.
+//
+// A file that isn't a store of this version is moved aside to
+// `filename.bad` instead of being overwritten. If that can't be done, or
+// if the file couldn't be read, the store won't write to it at all.
+class tr_resume_store
+{
+public:
+    static auto constexpr Version = uint32_t{ 1U };
+
+    explicit tr_resume_store(std::string filename);
+    tr_resume_store(tr_resume_store&&) = delete;
+    tr_resume_store(tr_resume_store const&) = delete;
+    tr_resume_store& operator=(tr_resume_store&&) = delete;
+    tr_resume_store& operator=(tr_resume_store const&) = delete;
+    ~tr_resume_store();
+
+    // Reads the whole file. A missing file is an empty store.
+    // If the file is damaged, the records before the damage are kept.
+    // If it has the wrong header or version, it's moved to `filename.bad`.
+    bool load(tr_error** error = nullptr);
+
+    // @return the newest resume dict saved for `hash`, if any.
+    // Only valid until the next call to put(), erase(), or flush().
+    [[nodiscard]] std::optional<std::string_view> get(tr_sha1_digest_t const& hash) const;
+
+    void put(tr_sha1_digest_t const& hash, std::string_view benc);
+    void erase(tr_sha1_digest_t const& hash);
+
+    // Removes `filename` after the next successful flush, e.g. a .resume
+    // file whose contents were just put() into the store.
+    void removeAfterFlush(std::string filename);
+
+    // Appends the records that changed since the last flush and syncs
+    // them to disk, compacting the file first if it has grown too sparse.
+    bool flush(tr_error** error = nullptr);
+
+    // Removes the file from disk, unless it couldn't be loaded, and forgets all records.
+    void remove();
+
+    [[nodiscard]] constexpr auto const& filename() const noexcept
+    {
+        return filename_;
+    }
+
+    [[nodiscard]] auto size() const noexcept
+    {
+        return std::size(entries_);
+    }
+
+    [[nodiscard]] auto empty() const noexcept
+    {
+        return std::empty(entries_);
+    }
+
+    [[nodiscard]] auto isDirty() const noexcept
+    {
+        return !std::empty(dirty_) || !std::empty(remove_after_flush_);
+    }
+
+    // bytes on disk taken up by superseded records and tombstones
+    [[nodiscard]] constexpr auto deadBytes() const noexcept
+    {
+        return dead_bytes_;
+    }
+
+    // bytes on disk, including any not-yet-discarded damaged tail
+    [[nodiscard]] constexpr auto fileSize() const noexcept
+    {
+        return file_size_;
+    }
+
+private:
+    struct Entry
+    {
+        [[nodiscard]] std::string_view benc() const noexcept
+        {
+            return is_owned ? std::string_view{ owned } : mapped;
+        }
+
+        // points into `mapped_file_` until the entry is changed
+        std::string_view mapped;
+        std::string owned;
+        bool is_owned = false;
+
+        // how many bytes this entry's newest record takes up on disk, or 0 if it hasn't been written yet
+        size_t record_size = 0U;
+    };
+
+    [[nodiscard]] bool shouldCompact() const noexcept;
+    bool compact(tr_error** error);
+    bool append(tr_error** error);
+
+    std::string const filename_;
+
+    tr_mapped_file mapped_file_;
+
+    std::map<tr_sha1_digest_t, Entry> entries_;
+
+    // hashes that were put or erased since the last flush
+    std::set<tr_sha1_digest_t> dirty_;
+
+    // files to remove once the records that replace them are on disk
+    std::vector<std::string> remove_after_flush_;
+
+    uint64_t dead_bytes_ = 0U;
+    uint64_t live_bytes_ = 0U;
+
+    // where the next record goes. Less than `file_size_` if the file has a damaged tail.
+    uint64_t append_pos_ = 0U;
+    uint64_t file_size_ = 0U;
+
+    // true if the file on disk couldn't be loaded and mustn't be overwritten
+    bool is_read_only_ = false;
+};
@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <cstring>
 #include <ctime>
+#include <optional>
 #include <string_view>
 #include <vector>
 
@@ -19,6 +20,7 @@
 #include "log.h"
 #include "magnet-metainfo.h"
 #include "peer-mgr.h" /* pex */
+#include "resume-store.h"
 #include "resume.h"
 #include "session.h"
 #include "torrent.h"
@@ -639,23 +641,62 @@ auto loadFromFile(tr_torrent* tor, tr_resume::fields_t fields_to_load, bool* did
     }
 
     auto const filename = tor->resumeFile();
-    if (!tr_sys_path_exists(filename))
+    auto* const store = tor->session->resumeStore();
+    auto const use_store = store != nullptr && tor->session->isResumeSnapshotEnabled();
+
+    // `top` refers to `benc`, which is in either the resume store
+    // or the mapped file, so keep them around until we're done
+    auto benc = std::string_view{};
+    auto file = tr_mapped_file{};
+    tr_error* error = nullptr;
+
+    if (auto const snapshot = store != nullptr ? store->get(tor->infoHash()) : std::nullopt; snapshot)
     {
-        return fields_loaded;
+        benc = *snapshot;
+
+        // if the snapshot has been turned off, move this torrent back to a .resume file
+        if (!use_store && tr_saveFile(filename, benc))
+        {
+            store->erase(tor->infoHash());
+            benc = {};
+        }
+    }
+
+    if (std::empty(benc))
+    {
+        if (!tr_sys_path_exists(filename))
+        {
+            return fields_loaded;
+        }
+
+        if (!file.load(filename, &error))
+        {
+            tr_logAddDebugTor(tor, fmt::format("Couldn't read '{}': {}", filename, error->message));
+            tr_error_clear(&error);
+            return fields_loaded;
+        }
+
+        benc = file.sv();
+
+        // if the snapshot has been turned on, move this torrent into it.
+        // the .resume file is removed once the store has been flushed.
+        if (use_store)
+        {
+            store->put(tor->infoHash(), benc);
+            store->removeAfterFlush(std::string{ filename.sv() });
+        }
     }
 
-    auto buf = std::vector<char>{};
-    tr_error* error = nullptr;
     auto top = tr_variant{};
-    if (!tr_loadFile(filename, buf, &error) ||
-        !tr_variantFromBuf(&top, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE, buf, nullptr, &error))
+    if (!tr_variantFromBuf(&top, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE, benc, nullptr, &error))
     {
-        tr_logAddDebugTor(tor, fmt::format("Couldn't read '{}': {}", filename, error->message));
+        tr_logAddDebugTor(tor, fmt::format("Couldn't parse resume state: {}", error->message));
         tr_error_clear(&error);
         return fields_loaded;
     }
 
-    tr_logAddDebugTor(tor, fmt::format("Read resume file '{}'", filename));
+    auto const source = std::empty(file.sv()) ? std::string_view{ store->filename() } : filename.sv();
+    tr_logAddDebugTor(tor, fmt::format("Read resume state from '{}'", source));
 
     auto i = int64_t{};
     auto sv = std::string_view{};
@@ -925,8 +966,12 @@ void save(tr_torrent* tor)
     saveLabels(&top, tor);
     saveGroup(&top, tor);
 
-    auto const resume_file = tor->resumeFile();
-    if (auto const err = tr_variantToFile(&top, TR_VARIANT_FMT_BENC, resume_file); err != 0)
+    if (auto* const store = tor->session->resumeStore(); store != nullptr && tor->session->isResumeSnapshotEnabled())
+    {
+        store->put(tor->infoHash(), tr_variantToStr(&top, TR_VARIANT_FMT_BENC));
+        tor->session->saveResumeStore();
+    }
+    else if (auto const err = tr_variantToFile(&top, TR_VARIANT_FMT_BENC, tor->resumeFile()); err != 0)
     {
         tor->setLocalError(fmt::format(FMT_STRING("Unable to save resume file: {:s}"), tr_strerror(err)));
     }
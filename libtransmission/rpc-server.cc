@@ -36,6 +36,7 @@
 #include "error.h"
 #include "log.h"
 #include "net.h"
+#include "perf-stats.h"
 #include "platform.h" /* tr_getWebClientDir() */
 #include "quark.h"
 #include "rpc-server.h"
@@ -283,11 +284,11 @@ struct rpc_response_data
     tr_rpc_server* server;
 };
 
-void rpc_response_func(tr_session* /*session*/, tr_variant* content, void* user_data)
+void rpc_response_func(tr_session* /*session*/, std::string_view json, void* user_data)
 {
     auto* data = static_cast<struct rpc_response_data*>(user_data);
 
-    auto* const response = make_response(data->req, data->server, tr_variantToStr(content, TR_VARIANT_FMT_JSON_LEAN));
+    auto* const response = make_response(data->req, data->server, json);
     evhttp_add_header(data->req->output_headers, "Content-Type", "application/json; charset=UTF-8");
     evhttp_send_reply(data->req, HTTP_OK, "OK", response);
     evbuffer_free(response);
@@ -300,7 +301,7 @@ void handle_rpc_from_json(struct evhttp_request* req, tr_rpc_server* server, std
     auto top = tr_variant{};
     auto const have_content = tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, json);
 
-    tr_rpc_request_exec_json(
+    tr_rpc_request_exec_serialized(
         server->session,
         have_content ? &top : nullptr,
         rpc_response_func,
@@ -417,6 +418,25 @@ bool isAuthorized(tr_rpc_server const* server, char const* auth_header)
     return server->username() == username && tr_ssha1_matches(server->salted_password_, password);
 }
 
+// Serves the session thread's timings for Prometheus to scrape.
+// This skips the session-id check because it's read-only, so there
+// is nothing to forge, and scrapers can't do the session-id handshake.
+void handle_metrics(struct evhttp_request* req, tr_rpc_server* server)
+{
+    if (req->type != EVHTTP_REQ_GET)
+    {
+        evhttp_add_header(req->output_headers, "Allow", "GET");
+        send_simple_response(req, HTTP_BADMETHOD);
+        return;
+    }
+
+    auto const metrics = server->session->perfStats().toPrometheus();
+    auto* const response = make_response(req, server, metrics);
+    evhttp_add_header(req->output_headers, "Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+    evhttp_send_reply(req, HTTP_OK, "OK", response);
+    evbuffer_free(response);
+}
+
 void handle_request(struct evhttp_request* req, void* arg)
 {
     auto constexpr HttpErrorUnauthorized = 401;
@@ -497,6 +517,10 @@ void handle_request(struct evhttp_request* req, void* arg)
                 "attacks.</p>";
             send_simple_response(req, 421, tmp);
         }
+        else if (location == "metrics"sv && server->isMetricsEnabled())
+        {
+            handle_metrics(req, server);
+        }
 #ifdef REQUIRE_SESSION_ID
         else if (!test_session_id(server, req))
         {
@@ -37,6 +37,7 @@ class Timer;
     V(TR_KEY_rpc_enabled, is_enabled_, bool, false, "") \
     V(TR_KEY_rpc_host_whitelist, host_whitelist_str_, std::string, "", "") \
     V(TR_KEY_rpc_host_whitelist_enabled, is_host_whitelist_enabled_, bool, true, "") \
+    V(TR_KEY_rpc_metrics_enabled, is_metrics_enabled_, bool, false, "") \
     V(TR_KEY_rpc_port, port_, tr_port, tr_port::fromHost(TR_DEFAULT_RPC_PORT), "") \
     V(TR_KEY_rpc_password, salted_password_, std::string, "", "") \
     V(TR_KEY_rpc_socket_mode, socket_mode_, tr_mode_t, 0750, "") \
@@ -74,6 +75,11 @@ public:
 
     void setEnabled(bool is_enabled);
 
+    [[nodiscard]] constexpr auto isMetricsEnabled() const noexcept
+    {
+        return is_metrics_enabled_;
+    }
+
     [[nodiscard]] constexpr auto isWhitelistEnabled() const noexcept
     {
         return is_whitelist_enabled_;
@@ -26,8 +26,10 @@
 #include "crypto-utils.h"
 #include "error.h"
 #include "file.h"
+#include "json-writer.h"
 #include "log.h"
 #include "peer-mgr.h"
+#include "perf-stats.h"
 #include "quark.h"
 #include "rpcimpl.h"
 #include "session-id.h"
@@ -47,9 +49,9 @@ using namespace std::literals;
 namespace
 {
 auto constexpr RecentlyActiveSeconds = time_t{ 60 };
-auto constexpr RpcVersion = int64_t{ 17 };
+auto constexpr RpcVersion = int64_t{ 18 };
 auto constexpr RpcVersionMin = int64_t{ 14 };
-auto constexpr RpcVersionSemver = "5.3.0"sv;
+auto constexpr RpcVersionSemver = "5.4.0"sv;
 
 enum class TrFormat
 {
@@ -300,120 +302,374 @@ char const* torrentVerify(tr_session* session, tr_variant* args_in, tr_variant*
 
 // ---
 
-void addLabels(tr_torrent const* tor, tr_variant* list)
+// Builds a tr_variant tree through the same interface as JsonWriter,
+// so that the RPC methods that support streaming only need to be written once.
+class VariantBuilder
 {
-    tr_variantInitList(list, std::size(tor->labels));
+public:
+    // `parent` must already be a dict or list. New values are added to it.
+    explicit VariantBuilder(tr_variant* parent)
+    {
+        parents_.push_back(parent);
+    }
+
+    void startDict()
+    {
+        auto* const dict = add();
+        tr_variantInitDict(dict, 0);
+        parents_.push_back(dict);
+    }
+
+    void endDict()
+    {
+        parents_.pop_back();
+    }
+
+    void startList()
+    {
+        auto* const list = add();
+        tr_variantInitList(list, 0);
+        parents_.push_back(list);
+    }
+
+    void endList()
+    {
+        parents_.pop_back();
+    }
+
+    void key(tr_quark key)
+    {
+        key_ = key;
+    }
+
+    void addBool(bool value)
+    {
+        tr_variantInitBool(add(), value);
+    }
+
+    void addInt(int64_t value)
+    {
+        tr_variantInitInt(add(), value);
+    }
+
+    void addReal(double value)
+    {
+        tr_variantInitReal(add(), value);
+    }
+
+    void addStr(std::string_view value)
+    {
+        tr_variantInitStr(add(), value);
+    }
+
+    void addQuark(tr_quark value)
+    {
+        tr_variantInitQuark(add(), value);
+    }
+
+    void addBool(tr_quark key, bool value)
+    {
+        this->key(key);
+        addBool(value);
+    }
+
+    void addInt(tr_quark key, int64_t value)
+    {
+        this->key(key);
+        addInt(value);
+    }
+
+    void addReal(tr_quark key, double value)
+    {
+        this->key(key);
+        addReal(value);
+    }
+
+    void addStr(tr_quark key, std::string_view value)
+    {
+        this->key(key);
+        addStr(value);
+    }
+
+private:
+    tr_variant* add()
+    {
+        auto* const parent = parents_.back();
+        return tr_variantIsDict(parent) ? tr_variantDictAdd(parent, key_) : tr_variantListAdd(parent);
+    }
+
+    std::vector<tr_variant*> parents_;
+    tr_quark key_ = TR_KEY_NONE;
+};
+
+// Hashes whatever is written to it through the JsonWriter interface instead
+// of keeping it. Used by delta torrent-get to tell whether a field's value
+// has changed since the last time it was looked at without having to keep
+// a copy of the old value around.
+class FingerprintWriter
+{
+public:
+    [[nodiscard]] constexpr auto fingerprint() const noexcept
+    {
+        return hash_;
+    }
+
+    void startDict()
+    {
+        mix(Tag::DictStart);
+    }
+
+    void endDict()
+    {
+        mix(Tag::DictEnd);
+    }
+
+    void startList()
+    {
+        mix(Tag::ListStart);
+    }
+
+    void endList()
+    {
+        mix(Tag::ListEnd);
+    }
+
+    void key(tr_quark key)
+    {
+        mix(Tag::Key);
+        mix(&key, sizeof(key));
+    }
+
+    void addBool(bool value)
+    {
+        mix(value ? Tag::True : Tag::False);
+    }
+
+    void addInt(int64_t value)
+    {
+        mix(Tag::Int);
+        mix(&value, sizeof(value));
+    }
+
+    void addReal(double value)
+    {
+        mix(Tag::Real);
+        mix(&value, sizeof(value));
+    }
+
+    void addStr(std::string_view value)
+    {
+        mix(Tag::Str);
+        auto const len = std::size(value);
+        mix(&len, sizeof(len));
+        mix(std::data(value), len);
+    }
+
+    void addQuark(tr_quark value)
+    {
+        addStr(tr_quark_get_string_view(value));
+    }
+
+    void addBool(tr_quark key, bool value)
+    {
+        this->key(key);
+        addBool(value);
+    }
+
+    void addInt(tr_quark key, int64_t value)
+    {
+        this->key(key);
+        addInt(value);
+    }
+
+    void addReal(tr_quark key, double value)
+    {
+        this->key(key);
+        addReal(value);
+    }
+
+    void addStr(tr_quark key, std::string_view value)
+    {
+        this->key(key);
+        addStr(value);
+    }
+
+private:
+    // keeps e.g. `[1],[]` and `[],[1]` from hashing the same
+    enum class Tag : uint8_t
+    {
+        DictStart,
+        DictEnd,
+        ListStart,
+        ListEnd,
+        Key,
+        True,
+        False,
+        Int,
+        Real,
+        Str
+    };
+
+    void mix(Tag tag)
+    {
+        mix(&tag, sizeof(tag));
+    }
+
+    // 64-bit FNV-1a
+    void mix(void const* data, size_t len)
+    {
+        auto const* const bytes = static_cast<unsigned char const*>(data);
+        for (size_t i = 0; i < len; ++i)
+        {
+            hash_ ^= bytes[i];
+            hash_ *= 0x100000001b3ULL;
+        }
+    }
+
+    uint64_t hash_ = 0xcbf29ce484222325ULL;
+};
+
+// These all write through a JsonWriter-like interface, `Out`, so that the same
+// code can fill in a tr_variant tree (VariantBuilder) or serialize straight
+// to JSON (libtransmission::JsonWriter).
+
+template<typename Out>
+void addLabels(Out& out, tr_torrent const* tor)
+{
+    out.startList();
     for (auto const& label : tor->labels)
     {
-        tr_variantListAddQuark(list, label);
+        out.addQuark(label);
     }
+    out.endList();
 }
 
-void addFileStats(tr_torrent const* tor, tr_variant* list)
+template<typename Out>
+void addFileStats(Out& out, tr_torrent const* tor)
 {
+    out.startList();
     for (tr_file_index_t i = 0, n = tor->fileCount(); i < n; ++i)
     {
         auto const file = tr_torrentFile(tor, i);
-        tr_variant* d = tr_variantListAddDict(list, 3);
-        tr_variantDictAddInt(d, TR_KEY_bytesCompleted, file.have);
-        tr_variantDictAddInt(d, TR_KEY_priority, file.priority);
-        tr_variantDictAddBool(d, TR_KEY_wanted, file.wanted);
+        out.startDict();
+        out.addInt(TR_KEY_bytesCompleted, file.have);
+        out.addInt(TR_KEY_priority, file.priority);
+        out.addBool(TR_KEY_wanted, file.wanted);
+        out.endDict();
     }
+    out.endList();
 }
 
-void addFiles(tr_torrent const* tor, tr_variant* list)
+template<typename Out>
+void addFiles(Out& out, tr_torrent const* tor)
 {
+    out.startList();
     for (tr_file_index_t i = 0, n = tor->fileCount(); i < n; ++i)
     {
         auto const file = tr_torrentFile(tor, i);
-        tr_variant* d = tr_variantListAddDict(list, 3);
-        tr_variantDictAddInt(d, TR_KEY_bytesCompleted, file.have);
-        tr_variantDictAddInt(d, TR_KEY_length, file.length);
-        tr_variantDictAddStr(d, TR_KEY_name, file.name);
+        out.startDict();
+        out.addInt(TR_KEY_bytesCompleted, file.have);
+        out.addInt(TR_KEY_length, file.length);
+        out.addStr(TR_KEY_name, file.name);
+        out.endDict();
     }
+    out.endList();
 }
 
-void addWebseeds(tr_torrent const* tor, tr_variant* webseeds)
+template<typename Out>
+void addWebseeds(Out& out, tr_torrent const* tor)
 {
+    out.startList();
     for (size_t i = 0, n = tor->webseedCount(); i < n; ++i)
     {
-        tr_variantListAddStr(webseeds, tor->webseed(i));
+        out.addStr(tor->webseed(i));
     }
+    out.endList();
 }
 
-void addTrackers(tr_torrent const* tor, tr_variant* trackers)
+template<typename Out>
+void addTrackers(Out& out, tr_torrent const* tor)
 {
+    out.startList();
     for (auto const& tracker : tor->announceList())
     {
-        auto* const d = tr_variantListAddDict(trackers, 5);
-        tr_variantDictAddQuark(d, TR_KEY_announce, tracker.announce.quark());
-        tr_variantDictAddInt(d, TR_KEY_id, tracker.id);
-        tr_variantDictAddQuark(d, TR_KEY_scrape, tracker.scrape.quark());
-        tr_variantDictAddStrView(d, TR_KEY_sitename, tracker.sitename);
-        tr_variantDictAddInt(d, TR_KEY_tier, tracker.tier);
-    }
-}
-
-void addTrackerStats(tr_tracker_view const& tracker, tr_variant* list)
-{
-    auto* const d = tr_variantListAddDict(list, 27);
-    tr_variantDictAddStr(d, TR_KEY_announce, tracker.announce);
-    tr_variantDictAddInt(d, TR_KEY_announceState, tracker.announceState);
-    tr_variantDictAddInt(d, TR_KEY_downloadCount, tracker.downloadCount);
-    tr_variantDictAddBool(d, TR_KEY_hasAnnounced, tracker.hasAnnounced);
-    tr_variantDictAddBool(d, TR_KEY_hasScraped, tracker.hasScraped);
-    tr_variantDictAddStr(d, TR_KEY_host, tracker.host);
-    tr_variantDictAddStr(d, TR_KEY_sitename, tracker.sitename);
-    tr_variantDictAddInt(d, TR_KEY_id, tracker.id);
-    tr_variantDictAddBool(d, TR_KEY_isBackup, tracker.isBackup);
-    tr_variantDictAddInt(d, TR_KEY_lastAnnouncePeerCount, tracker.lastAnnouncePeerCount);
-    tr_variantDictAddStr(d, TR_KEY_lastAnnounceResult, tracker.lastAnnounceResult);
-    tr_variantDictAddInt(d, TR_KEY_lastAnnounceStartTime, tracker.lastAnnounceStartTime);
-    tr_variantDictAddBool(d, TR_KEY_lastAnnounceSucceeded, tracker.lastAnnounceSucceeded);
-    tr_variantDictAddInt(d, TR_KEY_lastAnnounceTime, tracker.lastAnnounceTime);
-    tr_variantDictAddBool(d, TR_KEY_lastAnnounceTimedOut, tracker.lastAnnounceTimedOut);
-    tr_variantDictAddStr(d, TR_KEY_lastScrapeResult, tracker.lastScrapeResult);
-    tr_variantDictAddInt(d, TR_KEY_lastScrapeStartTime, tracker.lastScrapeStartTime);
-    tr_variantDictAddBool(d, TR_KEY_lastScrapeSucceeded, tracker.lastScrapeSucceeded);
-    tr_variantDictAddInt(d, TR_KEY_lastScrapeTime, tracker.lastScrapeTime);
-    tr_variantDictAddBool(d, TR_KEY_lastScrapeTimedOut, tracker.lastScrapeTimedOut);
-    tr_variantDictAddInt(d, TR_KEY_leecherCount, tracker.leecherCount);
-    tr_variantDictAddInt(d, TR_KEY_nextAnnounceTime, tracker.nextAnnounceTime);
-    tr_variantDictAddInt(d, TR_KEY_nextScrapeTime, tracker.nextScrapeTime);
-    tr_variantDictAddStr(d, TR_KEY_scrape, tracker.scrape);
-    tr_variantDictAddInt(d, TR_KEY_scrapeState, tracker.scrapeState);
-    tr_variantDictAddInt(d, TR_KEY_seederCount, tracker.seederCount);
-    tr_variantDictAddInt(d, TR_KEY_tier, tracker.tier);
-}
-
-void addPeers(tr_torrent const* tor, tr_variant* list)
+        out.startDict();
+        out.addStr(TR_KEY_announce, tracker.announce.sv());
+        out.addInt(TR_KEY_id, tracker.id);
+        out.addStr(TR_KEY_scrape, tracker.scrape.sv());
+        out.addStr(TR_KEY_sitename, tracker.sitename);
+        out.addInt(TR_KEY_tier, tracker.tier);
+        out.endDict();
+    }
+    out.endList();
+}
+
+template<typename Out>
+void addTrackerStats(Out& out, tr_tracker_view const& tracker)
+{
+    out.startDict();
+    out.addStr(TR_KEY_announce, tracker.announce);
+    out.addInt(TR_KEY_announceState, tracker.announceState);
+    out.addInt(TR_KEY_downloadCount, tracker.downloadCount);
+    out.addBool(TR_KEY_hasAnnounced, tracker.hasAnnounced);
+    out.addBool(TR_KEY_hasScraped, tracker.hasScraped);
+    out.addStr(TR_KEY_host, tracker.host);
+    out.addStr(TR_KEY_sitename, tracker.sitename);
+    out.addInt(TR_KEY_id, tracker.id);
+    out.addBool(TR_KEY_isBackup, tracker.isBackup);
+    out.addInt(TR_KEY_lastAnnouncePeerCount, tracker.lastAnnouncePeerCount);
+    out.addStr(TR_KEY_lastAnnounceResult, tracker.lastAnnounceResult);
+    out.addInt(TR_KEY_lastAnnounceStartTime, tracker.lastAnnounceStartTime);
+    out.addBool(TR_KEY_lastAnnounceSucceeded, tracker.lastAnnounceSucceeded);
+    out.addInt(TR_KEY_lastAnnounceTime, tracker.lastAnnounceTime);
+    out.addBool(TR_KEY_lastAnnounceTimedOut, tracker.lastAnnounceTimedOut);
+    out.addStr(TR_KEY_lastScrapeResult, tracker.lastScrapeResult);
+    out.addInt(TR_KEY_lastScrapeStartTime, tracker.lastScrapeStartTime);
+    out.addBool(TR_KEY_lastScrapeSucceeded, tracker.lastScrapeSucceeded);
+    out.addInt(TR_KEY_lastScrapeTime, tracker.lastScrapeTime);
+    out.addBool(TR_KEY_lastScrapeTimedOut, tracker.lastScrapeTimedOut);
+    out.addInt(TR_KEY_leecherCount, tracker.leecherCount);
+    out.addInt(TR_KEY_nextAnnounceTime, tracker.nextAnnounceTime);
+    out.addInt(TR_KEY_nextScrapeTime, tracker.nextScrapeTime);
+    out.addStr(TR_KEY_scrape, tracker.scrape);
+    out.addInt(TR_KEY_scrapeState, tracker.scrapeState);
+    out.addInt(TR_KEY_seederCount, tracker.seederCount);
+    out.addInt(TR_KEY_tier, tracker.tier);
+    out.endDict();
+}
+
+template<typename Out>
+void addPeers(Out& out, tr_torrent const* tor)
 {
     auto peer_count = size_t{};
     tr_peer_stat* peers = tr_torrentPeers(tor, &peer_count);
 
-    tr_variantInitList(list, peer_count);
+    out.startList();
 
     for (size_t i = 0; i < peer_count; ++i)
     {
-        tr_variant* d = tr_variantListAddDict(list, 16);
         tr_peer_stat const* peer = peers + i;
-        tr_variantDictAddStr(d, TR_KEY_address, peer->addr);
-        tr_variantDictAddStr(d, TR_KEY_clientName, peer->client);
-        tr_variantDictAddBool(d, TR_KEY_clientIsChoked, peer->clientIsChoked);
-        tr_variantDictAddBool(d, TR_KEY_clientIsInterested, peer->clientIsInterested);
-        tr_variantDictAddStr(d, TR_KEY_flagStr, peer->flagStr);
-        tr_variantDictAddBool(d, TR_KEY_isDownloadingFrom, peer->isDownloadingFrom);
-        tr_variantDictAddBool(d, TR_KEY_isEncrypted, peer->isEncrypted);
-        tr_variantDictAddBool(d, TR_KEY_isIncoming, peer->isIncoming);
-        tr_variantDictAddBool(d, TR_KEY_isUploadingTo, peer->isUploadingTo);
-        tr_variantDictAddBool(d, TR_KEY_isUTP, peer->isUTP);
-        tr_variantDictAddBool(d, TR_KEY_peerIsChoked, peer->peerIsChoked);
-        tr_variantDictAddBool(d, TR_KEY_peerIsInterested, peer->peerIsInterested);
-        tr_variantDictAddInt(d, TR_KEY_port, peer->port);
-        tr_variantDictAddReal(d, TR_KEY_progress, peer->progress);
-        tr_variantDictAddInt(d, TR_KEY_rateToClient, tr_toSpeedBytes(peer->rateToClient_KBps));
-        tr_variantDictAddInt(d, TR_KEY_rateToPeer, tr_toSpeedBytes(peer->rateToPeer_KBps));
-    }
+        out.startDict();
+        out.addStr(TR_KEY_address, peer->addr);
+        out.addStr(TR_KEY_clientName, peer->client);
+        out.addBool(TR_KEY_clientIsChoked, peer->clientIsChoked);
+        out.addBool(TR_KEY_clientIsInterested, peer->clientIsInterested);
+        out.addStr(TR_KEY_flagStr, peer->flagStr);
+        out.addBool(TR_KEY_isDownloadingFrom, peer->isDownloadingFrom);
+        out.addBool(TR_KEY_isEncrypted, peer->isEncrypted);
+        out.addBool(TR_KEY_isIncoming, peer->isIncoming);
+        out.addBool(TR_KEY_isUploadingTo, peer->isUploadingTo);
+        out.addBool(TR_KEY_isUTP, peer->isUTP);
+        out.addBool(TR_KEY_peerIsChoked, peer->peerIsChoked);
+        out.addBool(TR_KEY_peerIsInterested, peer->peerIsInterested);
+        out.addInt(TR_KEY_port, peer->port);
+        out.addReal(TR_KEY_progress, peer->progress);
+        out.addInt(TR_KEY_rateToClient, tr_toSpeedBytes(peer->rateToClient_KBps));
+        out.addInt(TR_KEY_rateToPeer, tr_toSpeedBytes(peer->rateToPeer_KBps));
+        out.endDict();
+    }
+
+    out.endList();
 
     tr_torrentPeersFree(peers, peer_count);
 }
@@ -506,203 +762,204 @@ void addPeers(tr_torrent const* tor, tr_variant* list)
     }
 }
 
-void initField(tr_torrent const* const tor, tr_stat const* const st, tr_variant* const initme, tr_quark key)
+template<typename Out>
+void addField(Out& out, tr_torrent const* const tor, tr_stat const* const st, tr_quark key)
 {
     TR_ASSERT(isSupportedTorrentGetField(key));
 
     switch (key)
     {
     case TR_KEY_activityDate:
-        tr_variantInitInt(initme, st->activityDate);
+        out.addInt(st->activityDate);
         break;
 
     case TR_KEY_addedDate:
-        tr_variantInitInt(initme, st->addedDate);
+        out.addInt(st->addedDate);
         break;
 
     case TR_KEY_availability:
-        tr_variantInitList(initme, tor->pieceCount());
+        out.startList();
         for (tr_piece_index_t piece = 0, n = tor->pieceCount(); piece < n; ++piece)
         {
-            tr_variantListAddInt(initme, tr_peerMgrPieceAvailability(tor, piece));
+            out.addInt(tr_peerMgrPieceAvailability(tor, piece));
         }
+        out.endList();
         break;
 
     case TR_KEY_bandwidthPriority:
-        tr_variantInitInt(initme, tor->getPriority());
+        out.addInt(tor->getPriority());
         break;
 
     case TR_KEY_comment:
-        tr_variantInitStr(initme, tor->comment());
+        out.addStr(tor->comment());
         break;
 
     case TR_KEY_corruptEver:
-        tr_variantInitInt(initme, st->corruptEver);
+        out.addInt(st->corruptEver);
         break;
 
     case TR_KEY_creator:
-        tr_variantInitStrView(initme, tor->creator());
+        out.addStr(tor->creator());
         break;
 
     case TR_KEY_dateCreated:
-        tr_variantInitInt(initme, tor->dateCreated());
+        out.addInt(tor->dateCreated());
         break;
 
     case TR_KEY_desiredAvailable:
-        tr_variantInitInt(initme, st->desiredAvailable);
+        out.addInt(st->desiredAvailable);
         break;
 
     case TR_KEY_doneDate:
-        tr_variantInitInt(initme, st->doneDate);
+        out.addInt(st->doneDate);
         break;
 
     case TR_KEY_downloadDir:
-        tr_variantInitStrView(initme, tr_torrentGetDownloadDir(tor));
+        out.addStr(tr_torrentGetDownloadDir(tor));
         break;
 
     case TR_KEY_downloadedEver:
-        tr_variantInitInt(initme, st->downloadedEver);
+        out.addInt(st->downloadedEver);
         break;
 
     case TR_KEY_downloadLimit:
-        tr_variantInitInt(initme, tr_torrentGetSpeedLimit_KBps(tor, TR_DOWN));
+        out.addInt(tr_torrentGetSpeedLimit_KBps(tor, TR_DOWN));
         break;
 
     case TR_KEY_downloadLimited:
-        tr_variantInitBool(initme, tor->usesSpeedLimit(TR_DOWN));
+        out.addBool(tor->usesSpeedLimit(TR_DOWN));
         break;
 
     case TR_KEY_error:
-        tr_variantInitInt(initme, st->error);
+        out.addInt(st->error);
         break;
 
     case TR_KEY_errorString:
-        tr_variantInitStrView(initme, st->errorString);
+        out.addStr(st->errorString);
         break;
 
     case TR_KEY_eta:
-        tr_variantInitInt(initme, st->eta);
+        out.addInt(st->eta);
         break;
 
     case TR_KEY_file_count:
-        tr_variantInitInt(initme, tor->fileCount());
+        out.addInt(tor->fileCount());
         break;
 
     case TR_KEY_files:
-        tr_variantInitList(initme, tor->fileCount());
-        addFiles(tor, initme);
+        addFiles(out, tor);
         break;
 
     case TR_KEY_fileStats:
-        tr_variantInitList(initme, tor->fileCount());
-        addFileStats(tor, initme);
+        addFileStats(out, tor);
         break;
 
     case TR_KEY_group:
-        tr_variantInitStrView(initme, tor->bandwidthGroup().sv());
+        out.addStr(tor->bandwidthGroup().sv());
         break;
 
     case TR_KEY_hashString:
-        tr_variantInitStrView(initme, tor->infoHashString());
+        out.addStr(tor->infoHashString());
         break;
 
     case TR_KEY_haveUnchecked:
-        tr_variantInitInt(initme, st->haveUnchecked);
+        out.addInt(st->haveUnchecked);
         break;
 
     case TR_KEY_haveValid:
-        tr_variantInitInt(initme, st->haveValid);
+        out.addInt(st->haveValid);
         break;
 
     case TR_KEY_honorsSessionLimits:
-        tr_variantInitBool(initme, tor->usesSessionLimits());
+        out.addBool(tor->usesSessionLimits());
         break;
 
     case TR_KEY_id:
-        tr_variantInitInt(initme, st->id);
+        out.addInt(st->id);
         break;
 
     case TR_KEY_editDate:
-        tr_variantInitInt(initme, st->editDate);
+        out.addInt(st->editDate);
         break;
 
     case TR_KEY_isFinished:
-        tr_variantInitBool(initme, st->finished);
+        out.addBool(st->finished);
         break;
 
     case TR_KEY_isPrivate:
-        tr_variantInitBool(initme, tor->isPrivate());
+        out.addBool(tor->isPrivate());
         break;
 
     case TR_KEY_isStalled:
-        tr_variantInitBool(initme, st->isStalled);
+        out.addBool(st->isStalled);
         break;
 
     case TR_KEY_labels:
-        addLabels(tor, initme);
+        addLabels(out, tor);
         break;
 
     case TR_KEY_leftUntilDone:
-        tr_variantInitInt(initme, st->leftUntilDone);
+        out.addInt(st->leftUntilDone);
         break;
 
     case TR_KEY_manualAnnounceTime:
-        tr_variantInitInt(initme, tr_announcerNextManualAnnounce(tor));
+        out.addInt(tr_announcerNextManualAnnounce(tor));
         break;
 
     case TR_KEY_maxConnectedPeers:
     case TR_KEY_peer_limit:
-        tr_variantInitInt(initme, tor->peerLimit());
+        out.addInt(tor->peerLimit());
         break;
 
     case TR_KEY_magnetLink:
-        tr_variantInitStr(initme, tor->metainfo_.magnet());
+        out.addStr(tor->metainfo_.magnet());
         break;
 
     case TR_KEY_metadataPercentComplete:
-        tr_variantInitReal(initme, st->metadataPercentComplete);
+        out.addReal(st->metadataPercentComplete);
         break;
 
     case TR_KEY_name:
-        tr_variantInitStrView(initme, tr_torrentName(tor));
+        out.addStr(tr_torrentName(tor));
         break;
 
     case TR_KEY_percentComplete:
-        tr_variantInitReal(initme, st->percentComplete);
+        out.addReal(st->percentComplete);
         break;
 
     case TR_KEY_percentDone:
-        tr_variantInitReal(initme, st->percentDone);
+        out.addReal(st->percentDone);
         break;
 
     case TR_KEY_peers:
-        addPeers(tor, initme);
+        addPeers(out, tor);
         break;
 
     case TR_KEY_peersConnected:
-        tr_variantInitInt(initme, st->peersConnected);
+        out.addInt(st->peersConnected);
         break;
 
     case TR_KEY_peersFrom:
         {
-            tr_variantInitDict(initme, 7);
+            out.startDict();
             auto const* f = st->peersFrom;
-            tr_variantDictAddInt(initme, TR_KEY_fromCache, f[TR_PEER_FROM_RESUME]);
-            tr_variantDictAddInt(initme, TR_KEY_fromDht, f[TR_PEER_FROM_DHT]);
-            tr_variantDictAddInt(initme, TR_KEY_fromIncoming, f[TR_PEER_FROM_INCOMING]);
-            tr_variantDictAddInt(initme, TR_KEY_fromLpd, f[TR_PEER_FROM_LPD]);
-            tr_variantDictAddInt(initme, TR_KEY_fromLtep, f[TR_PEER_FROM_LTEP]);
-            tr_variantDictAddInt(initme, TR_KEY_fromPex, f[TR_PEER_FROM_PEX]);
-            tr_variantDictAddInt(initme, TR_KEY_fromTracker, f[TR_PEER_FROM_TRACKER]);
+            out.addInt(TR_KEY_fromCache, f[TR_PEER_FROM_RESUME]);
+            out.addInt(TR_KEY_fromDht, f[TR_PEER_FROM_DHT]);
+            out.addInt(TR_KEY_fromIncoming, f[TR_PEER_FROM_INCOMING]);
+            out.addInt(TR_KEY_fromLpd, f[TR_PEER_FROM_LPD]);
+            out.addInt(TR_KEY_fromLtep, f[TR_PEER_FROM_LTEP]);
+            out.addInt(TR_KEY_fromPex, f[TR_PEER_FROM_PEX]);
+            out.addInt(TR_KEY_fromTracker, f[TR_PEER_FROM_TRACKER]);
+            out.endDict();
             break;
         }
 
     case TR_KEY_peersGettingFromUs:
-        tr_variantInitInt(initme, st->peersGettingFromUs);
+        out.addInt(st->peersGettingFromUs);
         break;
 
     case TR_KEY_peersSendingToUs:
-        tr_variantInitInt(initme, st->peersSendingToUs);
+        out.addInt(st->peersSendingToUs);
         break;
 
     case TR_KEY_pieces:
@@ -710,161 +967,162 @@ void initField(tr_torrent const* const tor, tr_stat const* const st, tr_variant*
         {
             auto const bytes = tor->createPieceBitfield();
             auto const enc = tr_base64_encode({ reinterpret_cast<char const*>(std::data(bytes)), std::size(bytes) });
-            tr_variantInitStr(initme, enc);
+            out.addStr(enc);
         }
         else
         {
-            tr_variantInitStrView(initme, ""sv);
+            out.addStr(""sv);
         }
 
         break;
 
     case TR_KEY_pieceCount:
-        tr_variantInitInt(initme, tor->pieceCount());
+        out.addInt(tor->pieceCount());
         break;
 
     case TR_KEY_pieceSize:
-        tr_variantInitInt(initme, tor->pieceSize());
+        out.addInt(tor->pieceSize());
         break;
 
     case TR_KEY_primary_mime_type:
-        tr_variantInitStrView(initme, tor->primaryMimeType());
+        out.addStr(tor->primaryMimeType());
         break;
 
     case TR_KEY_priorities:
         {
             auto const n = tor->fileCount();
-            tr_variantInitList(initme, n);
+            out.startList();
             for (tr_file_index_t i = 0; i < n; ++i)
             {
-                tr_variantListAddInt(initme, tr_torrentFile(tor, i).priority);
+                out.addInt(tr_torrentFile(tor, i).priority);
             }
+            out.endList();
         }
         break;
 
     case TR_KEY_queuePosition:
-        tr_variantInitInt(initme, st->queuePosition);
+        out.addInt(st->queuePosition);
         break;
 
     case TR_KEY_etaIdle:
-        tr_variantInitInt(initme, st->etaIdle);
+        out.addInt(st->etaIdle);
         break;
 
     case TR_KEY_rateDownload:
-        tr_variantInitInt(initme, tr_toSpeedBytes(st->pieceDownloadSpeed_KBps));
+        out.addInt(tr_toSpeedBytes(st->pieceDownloadSpeed_KBps));
         break;
 
     case TR_KEY_rateUpload:
-        tr_variantInitInt(initme, tr_toSpeedBytes(st->pieceUploadSpeed_KBps));
+        out.addInt(tr_toSpeedBytes(st->pieceUploadSpeed_KBps));
         break;
 
     case TR_KEY_recheckProgress:
-        tr_variantInitReal(initme, st->recheckProgress);
+        out.addReal(st->recheckProgress);
         break;
 
     case TR_KEY_seedIdleLimit:
-        tr_variantInitInt(initme, tor->idleLimitMinutes());
+        out.addInt(tor->idleLimitMinutes());
         break;
 
     case TR_KEY_seedIdleMode:
-        tr_variantInitInt(initme, tor->idleLimitMode());
+        out.addInt(tor->idleLimitMode());
         break;
 
     case TR_KEY_seedRatioLimit:
-        tr_variantInitReal(initme, tr_torrentGetRatioLimit(tor));
+        out.addReal(tr_torrentGetRatioLimit(tor));
         break;
 
     case TR_KEY_seedRatioMode:
-        tr_variantInitInt(initme, tr_torrentGetRatioMode(tor));
+        out.addInt(tr_torrentGetRatioMode(tor));
         break;
 
     case TR_KEY_sizeWhenDone:
-        tr_variantInitInt(initme, st->sizeWhenDone);
+        out.addInt(st->sizeWhenDone);
         break;
 
     case TR_KEY_source:
-        tr_variantInitStrView(initme, tor->source());
+        out.addStr(tor->source());
         break;
 
     case TR_KEY_startDate:
-        tr_variantInitInt(initme, st->startDate);
+        out.addInt(st->startDate);
         break;
 
     case TR_KEY_status:
-        tr_variantInitInt(initme, st->activity);
+        out.addInt(st->activity);
         break;
 
     case TR_KEY_secondsDownloading:
-        tr_variantInitInt(initme, st->secondsDownloading);
+        out.addInt(st->secondsDownloading);
         break;
 
     case TR_KEY_secondsSeeding:
-        tr_variantInitInt(initme, st->secondsSeeding);
+        out.addInt(st->secondsSeeding);
         break;
 
     case TR_KEY_trackers:
-        tr_variantInitList(initme, tor->trackerCount());
-        addTrackers(tor, initme);
+        addTrackers(out, tor);
         break;
 
     case TR_KEY_trackerList:
-        tr_variantInitStr(initme, tor->trackerList());
+        out.addStr(tor->trackerList());
         break;
 
     case TR_KEY_trackerStats:
         {
             auto const n = tr_torrentTrackerCount(tor);
-            tr_variantInitList(initme, n);
+            out.startList();
             for (size_t i = 0; i < n; ++i)
             {
                 auto const& tracker = tr_torrentTracker(tor, i);
-                addTrackerStats(tracker, initme);
+                addTrackerStats(out, tracker);
             }
+            out.endList();
             break;
         }
 
     case TR_KEY_torrentFile:
-        tr_variantInitStr(initme, tor->torrentFile());
+        out.addStr(tor->torrentFile());
         break;
 
     case TR_KEY_totalSize:
-        tr_variantInitInt(initme, tor->totalSize());
+        out.addInt(tor->totalSize());
         break;
 
     case TR_KEY_uploadedEver:
-        tr_variantInitInt(initme, st->uploadedEver);
+        out.addInt(st->uploadedEver);
         break;
 
     case TR_KEY_uploadLimit:
-        tr_variantInitInt(initme, tr_torrentGetSpeedLimit_KBps(tor, TR_UP));
+        out.addInt(tr_torrentGetSpeedLimit_KBps(tor, TR_UP));
         break;
 
     case TR_KEY_uploadLimited:
-        tr_variantInitBool(initme, tor->usesSpeedLimit(TR_UP));
+        out.addBool(tor->usesSpeedLimit(TR_UP));
         break;
 
     case TR_KEY_uploadRatio:
-        tr_variantInitReal(initme, st->ratio);
+        out.addReal(st->ratio);
         break;
 
     case TR_KEY_wanted:
         {
             auto const n = tor->fileCount();
-            tr_variantInitList(initme, n);
+            out.startList();
             for (tr_file_index_t i = 0; i < n; ++i)
             {
-                tr_variantListAddBool(initme, tr_torrentFile(tor, i).wanted);
+                out.addBool(tr_torrentFile(tor, i).wanted);
             }
+            out.endList();
         }
         break;
 
     case TR_KEY_webseeds:
-        tr_variantInitList(initme, tor->webseedCount());
-        addWebseeds(tor, initme);
+        addWebseeds(out, tor);
         break;
 
     case TR_KEY_webseedsSendingToUs:
-        tr_variantInitInt(initme, st->webseedsSendingToUs);
+        out.addInt(st->webseedsSendingToUs);
         break;
 
     default:
@@ -872,15 +1130,16 @@ void initField(tr_torrent const* const tor, tr_stat const* const st, tr_variant*
     }
 }
 
-void addTorrentInfo(tr_torrent* tor, TrFormat format, tr_variant* entry, tr_quark const* fields, size_t field_count)
+template<typename Out>
+void addTorrentInfo(Out& out, tr_torrent* tor, TrFormat format, tr_quark const* fields, size_t field_count)
 {
     if (format == TrFormat::Table)
     {
-        tr_variantInitList(entry, field_count);
+        out.startList();
     }
     else
     {
-        tr_variantInitDict(entry, field_count);
+        out.startDict();
     }
 
     if (field_count > 0)
@@ -889,33 +1148,165 @@ void addTorrentInfo(tr_torrent* tor, TrFormat format, tr_variant* entry, tr_quar
 
         for (size_t i = 0; i < field_count; ++i)
         {
-            tr_variant* child = format == TrFormat::Table ? tr_variantListAdd(entry) : tr_variantDictAdd(entry, fields[i]);
+            if (format == TrFormat::Object)
+            {
+                out.key(fields[i]);
+            }
 
-            initField(tor, st, child, fields[i]);
+            addField(out, tor, st, fields[i]);
         }
     }
+
+    if (format == TrFormat::Table)
+    {
+        out.endList();
+    }
+    else
+    {
+        out.endDict();
+    }
 }
 
-char const* torrentGet(tr_session* session, tr_variant* args_in, tr_variant* args_out, tr_rpc_idle_data* /*idle_data*/)
+// Fingerprints each of `tor`'s requested fields and records the ones whose
+// values differ from last time as having changed in `revision`.
+// @return the subset of `fields` that changed after revision `since`
+std::vector<tr_quark> getChangedFields(
+    tr_session const* session,
+    tr_torrent* tor,
+    std::vector<tr_quark> const& fields,
+    uint64_t revision,
+    uint64_t since)
+{
+    using State = tr_torrent::RpcFieldState;
+
+    auto changed = std::vector<tr_quark>{};
+
+    if (std::empty(fields))
+    {
+        return changed;
+    }
+
+    auto& states = tor->rpc_field_states_;
+    auto const find_state = [&states](tr_quark key)
+    {
+        return std::lower_bound(
+            std::begin(states),
+            std::end(states),
+            key,
+            [](auto const& state, tr_quark k) { return state.key < k; });
+    };
+
+    // A torrent that's running can change at any moment. One that isn't only
+    // changes when someone calls markRpcChanged(). So if nothing has called it
+    // since this torrent's fields were last looked at, they're still good,
+    // and there's no need to build its tr_stat just to find that out.
+    auto const n_changes = tor->rpcChanges() + session->torrents().rpcChanges();
+    auto const is_busy = tor->isRunning || tor->isStopping || tor->verifyState() != TR_VERIFY_NONE;
+    if (!is_busy &&
+        std::all_of(
+            std::begin(fields),
+            std::end(fields),
+            [&](tr_quark key)
+            {
+                auto const it = find_state(key);
+                return it != std::end(states) && it->key == key && it->seen_changes == n_changes;
+            }))
+    {
+        for (auto const key : fields)
+        {
+            if (find_state(key)->changed_at > since)
+            {
+                changed.push_back(key);
+            }
+        }
+
+        return changed;
+    }
+
+    tr_stat const* const st = tr_torrentStat(tor);
+
+    // speeds take a few seconds to wind down after a torrent stops
+    auto const is_settled = !is_busy && st->peersConnected == 0 && st->webseedsSendingToUs == 0 &&
+        st->pieceUploadSpeed_KBps == 0 && st->pieceDownloadSpeed_KBps == 0;
+    auto const seen_changes = is_settled ? n_changes : State::Unsettled;
+
+    for (auto const key : fields)
+    {
+        auto fingerprinter = FingerprintWriter{};
+        addField(fingerprinter, tor, st, key);
+        auto const fingerprint = fingerprinter.fingerprint();
+
+        auto it = find_state(key);
+        if (it == std::end(states) || it->key != key)
+        {
+            it = states.insert(it, { key, fingerprint, revision, seen_changes });
+        }
+        else if (it->fingerprint != fingerprint)
+        {
+            it->fingerprint = fingerprint;
+            it->changed_at = revision;
+        }
+
+        it->seen_changes = seen_changes;
+
+        if (it->changed_at > since)
+        {
+            changed.push_back(key);
+        }
+    }
+
+    return changed;
+}
+
+template<typename Out>
+char const* torrentGetImpl(tr_session* session, tr_variant* args_in, Out& args_out)
 {
     auto const torrents = getTorrents(session, args_in);
-    tr_variant* const list = tr_variantDictAddList(args_out, TR_KEY_torrents, std::size(torrents) + 1);
 
     auto sv = std::string_view{};
     auto const format = tr_variantDictFindStrView(args_in, TR_KEY_format, &sv) && sv == "table"sv ? TrFormat::Table :
                                                                                                     TrFormat::Object;
 
-    if (tr_variantDictFindStrView(args_in, TR_KEY_ids, &sv) && sv == "recently-active"sv)
+    // If the client gave us the revision from its last torrent-get,
+    // only send the torrents and fields that have changed since then.
+    // If it's not a revision that we handed out, e.g. if it's from before
+    // a restart, send everything as if `since` were 0.
+    auto since_arg = int64_t{};
+    auto const is_delta = tr_variantDictFindInt(args_in, TR_KEY_since, &since_arg) && since_arg >= 0;
+    auto const is_known_since = is_delta && session->torrents().isKnownRevision(static_cast<uint64_t>(since_arg));
+    auto const since = is_known_since ? static_cast<uint64_t>(since_arg) : uint64_t{};
+    auto const revision = is_delta ? session->torrents().nextRevision() : uint64_t{};
+
+    if (is_delta)
+    {
+        args_out.addInt(TR_KEY_revision, static_cast<int64_t>(revision));
+        args_out.key(TR_KEY_removed);
+        args_out.startList();
+        if (is_known_since)
+        {
+            for (auto const& id : session->torrents().removedSinceRevision(since))
+            {
+                args_out.addInt(id);
+            }
+        }
+        args_out.endList();
+    }
+    else if (tr_variantDictFindStrView(args_in, TR_KEY_ids, &sv) && sv == "recently-active"sv)
     {
         auto const cutoff = tr_time() - RecentlyActiveSeconds;
         auto const ids = session->torrents().removedSince(cutoff);
-        auto* const out = tr_variantDictAddList(args_out, TR_KEY_removed, std::size(ids));
+        args_out.key(TR_KEY_removed);
+        args_out.startList();
         for (auto const& id : ids)
         {
-            tr_variantListAddInt(out, id);
+            args_out.addInt(id);
         }
+        args_out.endList();
     }
 
+    args_out.key(TR_KEY_torrents);
+    args_out.startList();
+
     tr_variant* fields = nullptr;
     char const* errmsg = nullptr;
     if (!tr_variantDictFindList(args_in, TR_KEY_fields, &fields))
@@ -944,22 +1335,53 @@ char const* torrentGet(tr_session* session, tr_variant* args_in, tr_variant* arg
         if (format == TrFormat::Table)
         {
             /* first entry is an array of property names */
-            tr_variant* names = tr_variantListAddList(list, std::size(keys));
+            args_out.startList();
             for (auto const& key : keys)
             {
-                tr_variantListAddQuark(names, key);
+                args_out.addQuark(key);
             }
+            args_out.endList();
         }
 
         for (auto* tor : torrents)
         {
-            addTorrentInfo(tor, format, tr_variantListAdd(list), std::data(keys), std::size(keys));
+            if (!is_delta)
+            {
+                addTorrentInfo(args_out, tor, format, std::data(keys), std::size(keys));
+                continue;
+            }
+
+            auto changed = getChangedFields(session, tor, keys, revision, since);
+            if (std::empty(changed))
+            {
+                continue;
+            }
+
+            if (format == TrFormat::Table)
+            {
+                // rows have to line up with the header, so send the whole row
+                addTorrentInfo(args_out, tor, format, std::data(keys), std::size(keys));
+                continue;
+            }
+
+            // always include the id so the client knows which torrent this is
+            changed.erase(std::remove(std::begin(changed), std::end(changed), TR_KEY_id), std::end(changed));
+            changed.insert(std::begin(changed), TR_KEY_id);
+            addTorrentInfo(args_out, tor, format, std::data(changed), std::size(changed));
         }
     }
 
+    args_out.endList();
+
     return errmsg;
 }
 
+char const* torrentGet(tr_session* session, tr_variant* args_in, tr_variant* args_out, tr_rpc_idle_data* /*idle_data*/)
+{
+    auto builder = VariantBuilder{ args_out };
+    return torrentGetImpl(session, args_in, builder);
+}
+
 // ---
 
 [[nodiscard]] std::pair<std::vector<tr_quark>, char const* /*errmsg*/> makeLabels(tr_variant* list)
@@ -1500,25 +1922,18 @@ void addTorrentImpl(struct tr_rpc_idle_data* data, tr_ctor* ctor)
     }
 
     static auto constexpr Fields = std::array<tr_quark, 3>{ TR_KEY_id, TR_KEY_name, TR_KEY_hashString };
+    auto builder = VariantBuilder{ data->args_out };
     if (duplicate_of != nullptr)
     {
-        addTorrentInfo(
-            duplicate_of,
-            TrFormat::Object,
-            tr_variantDictAdd(data->args_out, TR_KEY_torrent_duplicate),
-            std::data(Fields),
-            std::size(Fields));
+        builder.key(TR_KEY_torrent_duplicate);
+        addTorrentInfo(builder, duplicate_of, TrFormat::Object, std::data(Fields), std::size(Fields));
         tr_idle_function_done(data, "duplicate torrent"sv);
         return;
     }
 
     data->session->rpcNotify(TR_RPC_TORRENT_ADDED, tor);
-    addTorrentInfo(
-        tor,
-        TrFormat::Object,
-        tr_variantDictAdd(data->args_out, TR_KEY_torrent_added),
-        std::data(Fields),
-        std::size(Fields));
+    builder.key(TR_KEY_torrent_added);
+    addTorrentInfo(builder, tor, TrFormat::Object, std::data(Fields), std::size(Fields));
     tr_idle_function_done(data, SuccessResult);
 }
 
@@ -1817,6 +2232,11 @@ char const* sessionSet(tr_session* session, tr_variant* args_in, tr_variant* /*a
         tr_sessionSetCacheLimit_MB(session, i);
     }
 
+    if (tr_variantDictFindInt(args_in, TR_KEY_read_cache_size_mb, &i))
+    {
+        tr_sessionSetReadCacheLimit_MB(session, i);
+    }
+
     if (tr_variantDictFindInt(args_in, TR_KEY_alt_speed_up, &i))
     {
         tr_sessionSetAltSpeed_KBps(session, TR_UP, i);
@@ -2056,7 +2476,8 @@ char const* sessionSet(tr_session* session, tr_variant* args_in, tr_variant* /*a
     return nullptr;
 }
 
-char const* sessionStats(tr_session* session, tr_variant* /*args_in*/, tr_variant* args_out, tr_rpc_idle_data* /*idle_data*/)
+template<typename Out>
+char const* sessionStatsImpl(tr_session* session, tr_variant* /*args_in*/, Out& args_out)
 {
     auto const& torrents = session->torrents();
     auto const total = std::size(torrents);
@@ -2065,31 +2486,107 @@ char const* sessionStats(tr_session* session, tr_variant* /*args_in*/, tr_varian
         std::end(torrents),
         [](auto const* tor) { return tor->isRunning; });
 
-    tr_variantDictAddInt(args_out, TR_KEY_activeTorrentCount, running);
-    tr_variantDictAddReal(args_out, TR_KEY_downloadSpeed, session->pieceSpeedBps(TR_DOWN));
-    tr_variantDictAddInt(args_out, TR_KEY_pausedTorrentCount, total - running);
-    tr_variantDictAddInt(args_out, TR_KEY_torrentCount, total);
-    tr_variantDictAddReal(args_out, TR_KEY_uploadSpeed, session->pieceSpeedBps(TR_UP));
-
-    auto stats = session->stats().cumulative();
-    tr_variant* d = tr_variantDictAddDict(args_out, TR_KEY_cumulative_stats, 5);
-    tr_variantDictAddInt(d, TR_KEY_downloadedBytes, stats.downloadedBytes);
-    tr_variantDictAddInt(d, TR_KEY_filesAdded, stats.filesAdded);
-    tr_variantDictAddInt(d, TR_KEY_secondsActive, stats.secondsActive);
-    tr_variantDictAddInt(d, TR_KEY_sessionCount, stats.sessionCount);
-    tr_variantDictAddInt(d, TR_KEY_uploadedBytes, stats.uploadedBytes);
-
-    stats = session->stats().current();
-    d = tr_variantDictAddDict(args_out, TR_KEY_current_stats, 5);
-    tr_variantDictAddInt(d, TR_KEY_downloadedBytes, stats.downloadedBytes);
-    tr_variantDictAddInt(d, TR_KEY_filesAdded, stats.filesAdded);
-    tr_variantDictAddInt(d, TR_KEY_secondsActive, stats.secondsActive);
-    tr_variantDictAddInt(d, TR_KEY_sessionCount, stats.sessionCount);
-    tr_variantDictAddInt(d, TR_KEY_uploadedBytes, stats.uploadedBytes);
+    args_out.addInt(TR_KEY_activeTorrentCount, running);
+    args_out.addReal(TR_KEY_downloadSpeed, session->pieceSpeedBps(TR_DOWN));
+    args_out.addInt(TR_KEY_pausedTorrentCount, total - running);
+    args_out.addInt(TR_KEY_torrentCount, total);
+    args_out.addReal(TR_KEY_uploadSpeed, session->pieceSpeedBps(TR_UP));
+
+    auto const add_stats = [&args_out](tr_quark key, tr_session_stats const& stats)
+    {
+        args_out.key(key);
+        args_out.startDict();
+        args_out.addInt(TR_KEY_downloadedBytes, stats.downloadedBytes);
+        args_out.addInt(TR_KEY_filesAdded, stats.filesAdded);
+        args_out.addInt(TR_KEY_secondsActive, stats.secondsActive);
+        args_out.addInt(TR_KEY_sessionCount, stats.sessionCount);
+        args_out.addInt(TR_KEY_uploadedBytes, stats.uploadedBytes);
+        args_out.endDict();
+    };
+    add_stats(TR_KEY_cumulative_stats, session->stats().cumulative());
+    add_stats(TR_KEY_current_stats, session->stats().current());
+
+    auto const cache_stats = session->cache->readCacheStats();
+    args_out.key(TR_KEY_cache_stats);
+    args_out.startDict();
+    args_out.addInt(TR_KEY_readCacheBytes, cache_stats.bytes);
+    args_out.addInt(TR_KEY_readCacheEvictions, cache_stats.evictions);
+    args_out.addInt(TR_KEY_readCacheHits, cache_stats.hits);
+    args_out.addInt(TR_KEY_readCacheMisses, cache_stats.misses);
+    args_out.endDict();
 
     return nullptr;
 }
 
+char const* sessionStats(tr_session* session, tr_variant* args_in, tr_variant* args_out, tr_rpc_idle_data* /*idle_data*/)
+{
+    auto builder = VariantBuilder{ args_out };
+    return sessionStatsImpl(session, args_in, builder);
+}
+
+template<typename Out>
+void addHistogram(Out& args_out, tr_quark key, tr_perf_stats::Histogram const& histogram)
+{
+    args_out.key(key);
+    args_out.startDict();
+    args_out.addInt(TR_KEY_count, histogram.count());
+    args_out.addInt(TR_KEY_max_usec, histogram.maxUsec());
+    args_out.addInt(TR_KEY_p50_usec, histogram.percentileUsec(50.0));
+    args_out.addInt(TR_KEY_p90_usec, histogram.percentileUsec(90.0));
+    args_out.addInt(TR_KEY_p99_usec, histogram.percentileUsec(99.0));
+    args_out.addInt(TR_KEY_total_usec, histogram.totalUsec());
+    args_out.endDict();
+}
+
+template<typename Out>
+char const* sessionThreadStatsImpl(tr_session* session, tr_variant* /*args_in*/, Out& args_out)
+{
+    auto const snapshot = session->perfStats().snapshot();
+
+    addHistogram(args_out, TR_KEY_loop_lag, snapshot.loop_lag);
+
+    args_out.key(TR_KEY_tasks);
+    args_out.startDict();
+    for (auto const& [name, histogram] : snapshot.tasks)
+    {
+        addHistogram(args_out, tr_quark_new(name), histogram);
+    }
+    args_out.endDict();
+
+    args_out.key(TR_KEY_work_queue);
+    args_out.startDict();
+    args_out.addInt(TR_KEY_depth, snapshot.queue_depth);
+    args_out.addInt(TR_KEY_peak_depth, snapshot.peak_queue_depth);
+    addHistogram(args_out, TR_KEY_wait, snapshot.queue_wait);
+    args_out.endDict();
+
+    args_out.key(TR_KEY_bandwidth);
+    args_out.startDict();
+    for (auto const& [key, dir] : { std::pair{ TR_KEY_download, TR_DOWN }, std::pair{ TR_KEY_upload, TR_UP } })
+    {
+        auto const stats = session->top_bandwidth_.schedulerStats(dir);
+        args_out.key(key);
+        args_out.startDict();
+        args_out.addInt(TR_KEY_bytes_served, stats.bytes_served);
+        args_out.addInt(TR_KEY_queued, stats.queued);
+        args_out.addInt(TR_KEY_turns, stats.turns);
+        args_out.endDict();
+    }
+    args_out.endDict();
+
+    return nullptr;
+}
+
+char const* sessionThreadStats(
+    tr_session* session,
+    tr_variant* args_in,
+    tr_variant* args_out,
+    tr_rpc_idle_data* /*idle_data*/)
+{
+    auto builder = VariantBuilder{ args_out };
+    return sessionThreadStatsImpl(session, args_in, builder);
+}
+
 constexpr std::string_view getEncryptionModeString(tr_encryption_mode mode)
 {
     switch (mode)
@@ -2149,6 +2646,10 @@ void addSessionField(tr_session const* s, tr_variant* d, tr_quark key)
         tr_variantDictAddInt(d, key, tr_sessionGetCacheLimit_MB(s));
         break;
 
+    case TR_KEY_read_cache_size_mb:
+        tr_variantDictAddInt(d, key, tr_sessionGetReadCacheLimit_MB(s));
+        break;
+
     case TR_KEY_blocklist_size:
         tr_variantDictAddInt(d, key, tr_blocklistGetRuleCount(s));
         break;
@@ -2429,7 +2930,7 @@ struct rpc_method
     handler func;
 };
 
-auto constexpr Methods = std::array<rpc_method, 24>{ {
+auto constexpr Methods = std::array<rpc_method, 25>{ {
     { "blocklist-update"sv, false, blocklistUpdate },
     { "free-space"sv, true, freeSpace },
     { "group-get"sv, true, groupGet },
@@ -2443,6 +2944,7 @@ auto constexpr Methods = std::array<rpc_method, 24>{ {
     { "session-get"sv, true, sessionGet },
     { "session-set"sv, true, sessionSet },
     { "session-stats"sv, true, sessionStats },
+    { "session-thread-stats"sv, true, sessionThreadStats },
     { "torrent-add"sv, false, torrentAdd },
     { "torrent-get"sv, true, torrentGet },
     { "torrent-reannounce"sv, true, torrentReannounce },
@@ -2460,6 +2962,37 @@ void noop_response_callback(tr_session* /*session*/, tr_variant* /*response*/, v
 {
 }
 
+// ---
+
+// Methods whose responses can be written straight to JSON.
+// Their results are identical to the tr_variant versions above.
+using serialized_handler = char const* (*)(tr_session*, tr_variant*, libtransmission::JsonWriter&);
+
+struct rpc_serialized_method
+{
+    std::string_view name;
+    serialized_handler func;
+};
+
+auto constexpr SerializedMethods = std::array<rpc_serialized_method, 3>{ {
+    { "session-stats"sv, sessionStatsImpl<libtransmission::JsonWriter> },
+    { "session-thread-stats"sv, sessionThreadStatsImpl<libtransmission::JsonWriter> },
+    { "torrent-get"sv, torrentGetImpl<libtransmission::JsonWriter> },
+} };
+
+struct rpc_serialized_response_data
+{
+    tr_rpc_serialized_response_func callback;
+    void* callback_user_data;
+};
+
+void serialize_response_callback(tr_session* session, tr_variant* response, void* user_data)
+{
+    auto* const data = static_cast<rpc_serialized_response_data*>(user_data);
+    (*data->callback)(session, tr_variantToStr(response, TR_VARIANT_FMT_JSON_LEAN), data->callback_user_data);
+    delete data;
+}
+
 } // namespace
 
 void tr_rpc_request_exec_json(
@@ -2521,7 +3054,9 @@ void tr_rpc_request_exec_json(
         auto response = tr_variant{};
         tr_variantInitDict(&response, 3);
         tr_variant* const args_out = tr_variantDictAddDict(&response, TR_KEY_arguments, 0);
+        auto const started_at = tr_perf_stats::Clock::now();
         result = (*method->func)(session, args_in, args_out, nullptr);
+        session->perfStats().addTask(fmt::format("rpc.{:s}", method->name), tr_perf_stats::Clock::now() - started_at);
 
         if (result == nullptr)
         {
@@ -2553,7 +3088,9 @@ void tr_rpc_request_exec_json(
         data->args_out = tr_variantDictAddDict(&data->response, TR_KEY_arguments, 0);
         data->callback = callback;
         data->callback_user_data = callback_user_data;
+        auto const started_at = tr_perf_stats::Clock::now();
         result = (*method->func)(session, args_in, data->args_out, data);
+        session->perfStats().addTask(fmt::format("rpc.{:s}", method->name), tr_perf_stats::Clock::now() - started_at);
 
         /* Async operation failed prematurely? Invoke callback or else client will not get a reply */
         if (result != nullptr)
@@ -2563,6 +3100,58 @@ void tr_rpc_request_exec_json(
     }
 }
 
+void tr_rpc_request_exec_serialized(
+    tr_session* session,
+    tr_variant const* request,
+    tr_rpc_serialized_response_func callback,
+    void* callback_user_data)
+{
+    TR_ASSERT(callback != nullptr);
+
+    auto* const mutable_request = const_cast<tr_variant*>(request);
+
+    auto sv = std::string_view{};
+    auto const* const method = tr_variantDictFindStrView(mutable_request, TR_KEY_method, &sv) ?
+        std::find_if(
+            std::begin(SerializedMethods),
+            std::end(SerializedMethods),
+            [&sv](auto const& row) { return row.name == sv; }) :
+        std::end(SerializedMethods);
+
+    if (method == std::end(SerializedMethods))
+    {
+        tr_rpc_request_exec_json(
+            session,
+            request,
+            serialize_response_callback,
+            new rpc_serialized_response_data{ callback, callback_user_data });
+        return;
+    }
+
+    auto const lock = session->unique_lock();
+
+    auto json = std::string{};
+    auto out = libtransmission::JsonWriter{ json };
+    out.startDict();
+    out.key(TR_KEY_arguments);
+    out.startDict();
+    auto const started_at = tr_perf_stats::Clock::now();
+    auto const* const result = (*method->func)(session, tr_variantDictFind(mutable_request, TR_KEY_arguments), out);
+    session->perfStats().addTask(fmt::format("rpc.{:s}", method->name), tr_perf_stats::Clock::now() - started_at);
+    out.endDict();
+    out.addStr(TR_KEY_result, result != nullptr ? result : SuccessResult);
+
+    if (auto tag = int64_t{}; tr_variantDictFindInt(mutable_request, TR_KEY_tag, &tag))
+    {
+        out.addInt(TR_KEY_tag, tag);
+    }
+
+    out.endDict();
+    json += '\n';
+
+    (*callback)(session, json, callback_user_data);
+}
+
 /**
  * Munge the URI into a usable form.
  *
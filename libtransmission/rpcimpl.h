@@ -12,6 +12,7 @@
 struct tr_variant;
 
 using tr_rpc_response_func = void (*)(tr_session* session, tr_variant* response, void* user_data);
+using tr_rpc_serialized_response_func = void (*)(tr_session* session, std::string_view json, void* user_data);
 
 /* https://www.json.org/ */
 void tr_rpc_request_exec_json(
@@ -20,4 +21,15 @@ void tr_rpc_request_exec_json(
     tr_rpc_response_func callback,
     void* callback_user_data);
 
+/**
+ * Like tr_rpc_request_exec_json(), but the response is handed back
+ * as compact JSON. Large responses such as torrent-get and session-stats
+ * are written straight to JSON instead of building a tr_variant first.
+ */
+void tr_rpc_request_exec_serialized(
+    tr_session* session,
+    tr_variant const* request,
+    tr_rpc_serialized_response_func callback,
+    void* callback_user_data);
+
 void tr_rpc_parse_list_str(tr_variant* setme, std::string_view str);
@@ -53,7 +53,9 @@ struct tr_variant;
     V(TR_KEY_queue_stalled_minutes, queue_stalled_minutes, size_t, 30U, "") \
     V(TR_KEY_ratio_limit, ratio_limit, double, 2.0, "") \
     V(TR_KEY_ratio_limit_enabled, ratio_limit_enabled, bool, false, "") \
+    V(TR_KEY_read_cache_size_mb, read_cache_size_mb, size_t, 16U, "") \
     V(TR_KEY_rename_partial_files, is_incomplete_file_naming_enabled, bool, false, "") \
+    V(TR_KEY_resume_snapshot_enabled, resume_snapshot_enabled, bool, false, "") \
     V(TR_KEY_scrape_paused_torrents_enabled, should_scrape_paused_torrents, bool, true, "") \
     V(TR_KEY_script_torrent_added_enabled, script_torrent_added_enabled, bool, false, "") \
     V(TR_KEY_script_torrent_added_filename, script_torrent_added_filename, std::string, "", "") \
@@ -73,7 +75,10 @@ struct tr_variant;
     V(TR_KEY_umask, umask, tr_mode_t, 022, "") \
     V(TR_KEY_upload_slots_per_torrent, upload_slots_per_torrent, size_t, 8U, "") \
     V(TR_KEY_utp_enabled, utp_enabled, bool, true, "") \
-    V(TR_KEY_torrent_added_verify_mode, torrent_added_verify_mode, tr_verify_added_mode, TR_VERIFY_ADDED_FAST, "")
+    V(TR_KEY_torrent_added_verify_mode, torrent_added_verify_mode, tr_verify_added_mode, TR_VERIFY_ADDED_FAST, "") \
+    V(TR_KEY_verify_speed_limit_mb, verify_speed_limit_mb, size_t, 0U, "") \
+    V(TR_KEY_verify_threads, verify_threads, size_t, 4U, "") \
+    V(TR_KEY_verify_threads_per_device, verify_threads_per_device, size_t, 1U, "")
 
 struct tr_session_settings
 {
@@ -3,6 +3,7 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm> // for std::max()
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
@@ -25,6 +26,8 @@
 #include "transmission.h"
 
 #include "log.h"
+#include "mpsc-queue.h"
+#include "perf-stats.h"
 #include "session-thread.h"
 #include "tr-assert.h"
 #include "utils.h" // for tr_net_init()
@@ -158,6 +161,10 @@ public:
     {
         auto lock = std::unique_lock(is_looping_mutex_);
 
+        auto const interval = timeval{ 0, static_cast<decltype(timeval::tv_usec)>(LagCheckInterval.count()) };
+        lag_check_at_ = tr_perf_stats::Clock::now() + LagCheckInterval;
+        event_add(lag_check_event_.get(), &interval);
+
         thread_ = std::thread(&tr_session_thread_impl::sessionThreadFunc, this, eventBase());
         thread_id_ = thread_.get_id();
 
@@ -199,25 +206,57 @@ public:
         return thread_id_ == std::this_thread::get_id();
     }
 
-    void run(std::function<void(void)>&& func) override
+    void run(Callback&& func) override
     {
         if (amInSessionThread())
         {
             func();
+            return;
+        }
+
+        auto work = Work{ std::move(func), tr_perf_stats::Clock::now() };
+
+        // Fast path: lock-free push into the ring. Once anything has gone to
+        // the overflow list, keep using it until the session thread drains it
+        // so that each producer's work still runs in the order it was posted.
+        if (!has_overflow_.load(std::memory_order_acquire) && work_queue_.tryPush(std::move(work)))
+        {
+            perf_stats_.setQueueDepth(work_queue_.sizeApprox());
         }
         else
         {
-            work_queue_mutex_.lock();
-            work_queue_.emplace_back(std::move(func));
-            work_queue_mutex_.unlock();
+            auto const lock = std::lock_guard{ overflow_mutex_ };
+            overflow_.emplace_back(std::move(work));
+            has_overflow_.store(true, std::memory_order_release);
+            perf_stats_.setQueueDepth(work_queue_.sizeApprox() + std::size(overflow_));
+        }
 
+        // Coalesce wakeups: only the first post since the session thread
+        // last started draining the queue needs to wake it up.
+        if (!wakeup_pending_.exchange(true, std::memory_order_acq_rel))
+        {
             event_active(work_queue_event_.get(), 0, {});
         }
     }
 
+    [[nodiscard]] tr_perf_stats& perfStats() noexcept override
+    {
+        return perf_stats_;
+    }
+
 private:
-    using callback = std::function<void(void)>;
-    using work_queue_t = std::list<callback>;
+    struct Work
+    {
+        Callback func;
+        tr_perf_stats::Clock::time_point queued_at;
+    };
+
+    // Enough room for a burst of RPC and web callbacks. If it fills up,
+    // run() falls back to the overflow list instead of blocking.
+    static auto constexpr WorkQueueCapacity = size_t{ 1024U };
+
+    // How often to check that the event loop is waking up on time
+    static auto constexpr LagCheckInterval = std::chrono::microseconds{ 250ms };
 
     void sessionThreadFunc(struct event_base* evbase)
     {
@@ -243,6 +282,7 @@ private:
         // continuously until `this` is destroyed. See: ~tr_session_thread_impl()
         TR_ASSERT(!is_shutting_down_);
         event_base_loop(evbase, EVLOOP_NO_EXIT_ON_EMPTY);
+        event_del(lag_check_event_.get());
 
         // Start the second event loop. This is the shutdown loop that exits as
         // soon as there are no events. It's used to give any remaining events
@@ -261,26 +301,84 @@ private:
     {
         TR_ASSERT(amInSessionThread());
 
-        // steal the work queue
-        auto work_queue_lock = std::unique_lock(work_queue_mutex_);
-        auto work_queue = work_queue_t{};
-        std::swap(work_queue, work_queue_);
-        work_queue_lock.unlock();
+        // Clear this before draining so that anything posted from here
+        // on triggers another wakeup instead of getting stranded.
+        wakeup_pending_.exchange(false, std::memory_order_acq_rel);
 
-        // process the work queue
-        for (auto const& func : work_queue)
+        // Only run what's already queued, so that work which keeps
+        // posting more work can't starve the rest of the event loop.
+        auto work = Work{};
+        for (auto n_left = WorkQueueCapacity; n_left > 0U && work_queue_.tryPop(work); --n_left)
         {
-            func();
+            runWork(work);
+        }
+
+        // The overflow list can only be taken once the ring is empty.
+        // Otherwise a producer's overflowed work could run before the
+        // work it had already pushed into the ring.
+        if (has_overflow_.load(std::memory_order_acquire) && work_queue_.isDrained())
+        {
+            auto overflow = std::list<Work>{};
+            {
+                auto const lock = std::lock_guard{ overflow_mutex_ };
+                std::swap(overflow, overflow_);
+                has_overflow_.store(false, std::memory_order_release);
+            }
+
+            for (auto& item : overflow)
+            {
+                runWork(item);
+            }
+        }
+
+        perf_stats_.setQueueDepth(work_queue_.sizeApprox());
+
+        // If work is still waiting, e.g. a push that was mid-flight when we
+        // stopped or overflow that's waiting on the ring, come back for it.
+        if ((!work_queue_.isDrained() || has_overflow_.load(std::memory_order_acquire)) &&
+            !wakeup_pending_.exchange(true, std::memory_order_acq_rel))
+        {
+            event_active(work_queue_event_.get(), 0, {});
         }
     }
 
+    void runWork(Work& work)
+    {
+        perf_stats_.addQueueWait(tr_perf_stats::Clock::now() - work.queued_at);
+        auto const timer = perf_stats_.time("session-thread.work"sv);
+        work.func();
+        work.func.reset();
+    }
+
+    static void onLagCheckStatic(evutil_socket_t /*fd*/, short /*flags*/, void* vself)
+    {
+        static_cast<tr_session_thread_impl*>(vself)->onLagCheck();
+    }
+
+    void onLagCheck()
+    {
+        auto const now = tr_perf_stats::Clock::now();
+        perf_stats_.addLoopLag(std::max(now - lag_check_at_, tr_perf_stats::Clock::duration{}));
+        lag_check_at_ = now + LagCheckInterval;
+    }
+
     libtransmission::evhelpers::evbase_unique_ptr const evbase_{ makeEventBase() };
     libtransmission::evhelpers::event_unique_ptr const work_queue_event_{
         event_new(evbase_.get(), -1, 0, onWorkAvailableStatic, this)
     };
 
-    work_queue_t work_queue_;
-    std::mutex work_queue_mutex_;
+    libtransmission::MpscQueue<Work, WorkQueueCapacity> work_queue_;
+    std::atomic<bool> wakeup_pending_ = false;
+
+    std::list<Work> overflow_;
+    std::mutex overflow_mutex_;
+    std::atomic<bool> has_overflow_ = false;
+
+    tr_perf_stats perf_stats_;
+    libtransmission::evhelpers::event_unique_ptr const lag_check_event_{
+        event_new(evbase_.get(), -1, EV_PERSIST, onLagCheckStatic, this)
+    };
+    tr_perf_stats::Clock::time_point lag_check_at_;
 
     std::thread thread_;
     std::thread::id thread_id_;
@@ -9,16 +9,23 @@
 #error only libtransmission should #include this header.
 #endif
 
-#include <functional>
 #include <memory>
 #include <tuple>
+#include <type_traits>
 #include <utility>
 
+#include "small-callback.h"
+
 struct event_base;
+class tr_perf_stats;
 
 class tr_session_thread
 {
 public:
+    // Big enough to hold a std::function or a lambda that captures a few
+    // pointers, so that most calls to run() don't need to allocate.
+    using Callback = libtransmission::SmallCallback<48U>;
+
     static void tr_evthread_init();
 
     static std::unique_ptr<tr_session_thread> create();
@@ -28,15 +35,26 @@ public:
 
     [[nodiscard]] virtual bool amInSessionThread() const noexcept = 0;
 
-    virtual void run(std::function<void(void)>&& func) = 0;
+    // Runs `func` in the session thread. If called from another thread,
+    // `func` is queued and this returns without waiting for it to run.
+    virtual void run(Callback&& func) = 0;
+
+    // Timings for the work done in this thread.
+    [[nodiscard]] virtual tr_perf_stats& perfStats() noexcept = 0;
 
-    template<typename Func, typename... Args>
+    template<typename Func, typename... Args, typename = std::enable_if_t<!std::is_same_v<std::decay_t<Func>, Callback>>>
     void run(Func&& func, Args&&... args)
     {
-        run(std::function<void(void)>{
-            [func = std::forward<Func&&>(func), args = std::make_tuple(std::forward<Args>(args)...)]()
-            {
-                std::apply(std::move(func), std::move(args));
-            } });
+        if constexpr (sizeof...(Args) == 0U)
+        {
+            run(Callback{ std::forward<Func>(func) });
+        }
+        else
+        {
+            run(Callback{ [func = std::forward<Func>(func), args = std::make_tuple(std::forward<Args>(args)...)]() mutable
+                          {
+                              std::apply(std::move(func), std::move(args));
+                          } });
+        }
     }
 };
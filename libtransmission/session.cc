@@ -4,6 +4,7 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm> // std::partial_sort(), std::min(), std::max()
+#include <atomic>
 #include <climits> /* INT_MAX */
 #include <condition_variable>
 #include <csignal>
@@ -17,6 +18,7 @@
 #include <numeric> // for std::accumulate()
 #include <string>
 #include <string_view>
+#include <thread>
 #include <unordered_set>
 #include <utility>
 #include <vector>
@@ -47,10 +49,12 @@
 #include "peer-io.h"
 #include "peer-mgr.h"
 #include "port-forwarding.h"
+#include "resume-store.h"
 #include "rpc-server.h"
 #include "session-id.h"
 #include "session.h"
 #include "timer-ev.h"
+#include "torrent-metainfo.h"
 #include "torrent.h"
 #include "tr-assert.h"
 #include "tr-lpd.h"
@@ -603,6 +607,7 @@ tr_session* tr_sessionInit(char const* config_dir, bool message_queueing_enabled
 void tr_session::onNowTimer()
 {
     TR_ASSERT(now_timer_);
+    auto const timer = perfStats().time("session.now-timer"sv);
     auto const now = std::chrono::system_clock::now();
 
     // tr_session upkeep tasks to perform once per second
@@ -641,11 +646,13 @@ void tr_session::initImpl(init_data& data)
 
     tr_logSetQueueEnabled(data.message_queuing_enabled);
 
-    this->blocklists_ = libtransmission::Blocklist::loadBlocklists(blocklist_dir_, useBlocklist());
+    this->blocklists_ = libtransmission::Blocklist::loadBlocklists(blocklist_dir_);
+    loadBlocklistIndex();
 
     tr_logAddInfo(fmt::format(_("Transmission version {version} starting"), fmt::arg("version", LONG_VERSION_STRING)));
 
     setSettings(client_settings, true);
+    loadResumeStore();
 
     if (this->allowsLPD())
     {
@@ -682,6 +689,9 @@ void tr_session::setSettings(tr_session_settings&& settings_in, bool force)
     auto const& new_settings = settings_;
     auto const& old_settings = settings_in;
 
+    // e.g. the seed ratio limit is reported for torrents that use the session's
+    torrents().markAllRpcChanged();
+
     // the rest of the func is session_ responding to settings changes
 
     if (auto const& val = new_settings.log_level; force || val != old_settings.log_level)
@@ -701,6 +711,26 @@ void tr_session::setSettings(tr_session_settings&& settings_in, bool force)
         tr_sessionSetCacheLimit_MB(this, val);
     }
 
+    if (auto const& val = new_settings.read_cache_size_mb; force || val != old_settings.read_cache_size_mb)
+    {
+        tr_sessionSetReadCacheLimit_MB(this, val);
+    }
+
+    if (auto const& val = new_settings.verify_threads; force || val != old_settings.verify_threads)
+    {
+        verifier_->setMaxThreads(val);
+    }
+
+    if (auto const& val = new_settings.verify_threads_per_device; force || val != old_settings.verify_threads_per_device)
+    {
+        verifier_->setMaxThreadsPerDevice(val);
+    }
+
+    if (auto const& val = new_settings.verify_speed_limit_mb; force || val != old_settings.verify_speed_limit_mb)
+    {
+        verifier_->setSpeedLimitBytesPerSecond(tr_toMemBytes(val));
+    }
+
     if (auto const& val = new_settings.default_trackers_str; force || val != old_settings.default_trackers_str)
     {
         setDefaultTrackers(val);
@@ -941,6 +971,7 @@ void tr_sessionSetRatioLimited(tr_session* session, bool is_limited)
     TR_ASSERT(session != nullptr);
 
     session->settings_.ratio_limit_enabled = is_limited;
+    session->torrents().markAllRpcChanged();
 }
 
 void tr_sessionSetRatioLimit(tr_session* session, double desired_ratio)
@@ -948,6 +979,7 @@ void tr_sessionSetRatioLimit(tr_session* session, double desired_ratio)
     TR_ASSERT(session != nullptr);
 
     session->settings_.ratio_limit = desired_ratio;
+    session->torrents().markAllRpcChanged();
 }
 
 bool tr_sessionIsRatioLimited(tr_session const* session)
@@ -971,6 +1003,7 @@ void tr_sessionSetIdleLimited(tr_session* session, bool is_limited)
     TR_ASSERT(session != nullptr);
 
     session->settings_.idle_seeding_limit_enabled = is_limited;
+    session->torrents().markAllRpcChanged();
 }
 
 void tr_sessionSetIdleLimit(tr_session* session, uint16_t idle_minutes)
@@ -978,6 +1011,7 @@ void tr_sessionSetIdleLimit(tr_session* session, uint16_t idle_minutes)
     TR_ASSERT(session != nullptr);
 
     session->settings_.idle_seeding_limit_minutes = idle_minutes;
+    session->torrents().markAllRpcChanged();
 }
 
 bool tr_sessionIsIdleLimited(tr_session const* session)
@@ -1250,6 +1284,7 @@ void tr_session::closeImplPart1(std::promise<void>* closed_promise, std::chrono:
     // close the low-hanging fruit that can be closed immediately w/o consequences
     utp_timer.reset();
     verifier_.reset();
+    relocator_.reset();
     save_timer_.reset();
     now_timer_.reset();
     rpc_server_.reset();
@@ -1273,9 +1308,12 @@ void tr_session::closeImplPart1(std::promise<void>* closed_promise, std::chrono:
             auto const b_cur = b->downloadedCur + b->uploadedCur;
             return a_cur > b_cur; // larger xfers go first
         });
-    for (auto* tor : torrents)
     {
-        tr_torrentFreeInSessionThread(tor);
+        auto const batch = ResumeStoreBatch{ *this };
+        for (auto* tor : torrents)
+        {
+            tr_torrentFreeInSessionThread(tor);
+        }
     }
     torrents.clear();
     // ...now that all the torrents have been closed, any remaining
@@ -1340,49 +1378,128 @@ namespace
 {
 namespace load_torrents_helpers
 {
-void session_load_torrents(tr_session* session, tr_ctor* ctor, std::promise<size_t>* loaded_promise)
+// A .torrent or .magnet file in the torrents dir, parsed on a worker thread
+struct ParsedTorrentFile
+{
+    std::string filename;
+    tr_torrent_metainfo metainfo;
+
+    // Only kept if tr_torrentNew() may need to save a copy of the file
+    std::string contents;
+
+    bool is_magnet = false;
+    bool ok = false;
+};
+
+[[nodiscard]] auto get_torrent_files(std::string_view dirname)
 {
-    auto const& dirname = session->torrentDir();
+    auto files = std::vector<ParsedTorrentFile>{};
+
     auto const info = tr_sys_path_get_info(dirname);
-    auto const odir = info && info->isFolder() ? tr_sys_dir_open(dirname.c_str()) : TR_BAD_SYS_DIR;
+    auto const odir = info && info->isFolder() ? tr_sys_dir_open(tr_pathbuf{ dirname }) : TR_BAD_SYS_DIR;
+    if (odir == TR_BAD_SYS_DIR)
+    {
+        return files;
+    }
 
-    auto n_torrents = size_t{};
-    if (odir != TR_BAD_SYS_DIR)
+    char const* name = nullptr;
+    while ((name = tr_sys_dir_read_name(odir)) != nullptr)
     {
-        char const* name = nullptr;
-        while ((name = tr_sys_dir_read_name(odir)) != nullptr)
+        if (tr_strvEndsWith(name, ".torrent"sv) || tr_strvEndsWith(name, ".magnet"sv))
         {
-            if (!tr_strvEndsWith(name, ".torrent"sv) && !tr_strvEndsWith(name, ".magnet"sv))
-            {
-                continue;
-            }
+            files.emplace_back().filename = tr_pathbuf{ dirname, '/', name };
+        }
+    }
 
-            // is a magnet link?
-            if (auto const path = tr_pathbuf{ dirname, '/', name }; !tr_ctorSetMetainfoFromFile(ctor, path.sv(), nullptr))
-            {
-                if (auto buf = std::vector<char>{}; tr_loadFile(path, buf))
-                {
-                    tr_ctorSetMetainfoFromMagnetLink(ctor, std::string_view{ std::data(buf), std::size(buf) }, nullptr);
-                }
-            }
+    tr_sys_dir_close(odir);
+    return files;
+}
 
-            if (tr_torrentNew(ctor, nullptr) != nullptr)
-            {
-                ++n_torrents;
-            }
+void parse_torrent_file(std::string_view torrent_dir, ParsedTorrentFile& parsed)
+{
+    // The file is parsed straight out of the mapping; only the fields
+    // that tr_torrent_metainfo keeps are copied out of it.
+    auto file = tr_mapped_file{};
+    if (!file.load(parsed.filename))
+    {
+        return;
+    }
+
+    auto const contents = file.sv();
+    if (parsed.metainfo.parseBenc(contents))
+    {
+        if (parsed.metainfo.torrentFile(torrent_dir).sv() != parsed.filename)
+        {
+            parsed.contents = contents;
         }
 
-        tr_sys_dir_close(odir);
+        parsed.ok = true;
+        return;
     }
 
-    if (n_torrents != 0U)
+    // is a magnet link?
+    parsed.metainfo = {};
+    parsed.is_magnet = true;
+    parsed.ok = parsed.metainfo.parseMagnet(contents);
+}
+
+// Parsing is the expensive part of loading a torrent, mostly because of
+// hashing the info dict, and it doesn't need the session, so spread it
+// across worker threads before handing the torrents to the session thread.
+void parse_torrent_files(std::string_view torrent_dir, std::vector<ParsedTorrentFile>& files)
+{
+    static auto constexpr MaxWorkers = size_t{ 8U };
+    static auto constexpr MinFilesPerWorker = size_t{ 16U };
+
+    auto next = std::atomic<size_t>{};
+    auto const parse_files = [&next, &files, torrent_dir]()
     {
-        tr_logAddInfo(fmt::format(
-            tr_ngettext("Loaded {count} torrent", "Loaded {count} torrents", n_torrents),
-            fmt::arg("count", n_torrents)));
+        for (auto idx = next++; idx < std::size(files); idx = next++)
+        {
+            parse_torrent_file(torrent_dir, files[idx]);
+        }
+    };
+
+    auto const n_workers = std::min(
+        { size_t{ std::max(std::thread::hardware_concurrency(), 1U) },
+          MaxWorkers,
+          (std::size(files) + MinFilesPerWorker - 1U) / MinFilesPerWorker });
+
+    auto workers = std::vector<std::thread>{};
+    for (size_t i = 1; i < n_workers; ++i)
+    {
+        workers.emplace_back(parse_files);
+    }
+
+    parse_files();
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+size_t add_parsed_torrents(tr_ctor* ctor, ParsedTorrentFile* begin, ParsedTorrentFile* end)
+{
+    auto n_torrents = size_t{};
+
+    for (auto* parsed = begin; parsed != end; ++parsed)
+    {
+        if (!parsed->ok)
+        {
+            continue;
+        }
+
+        auto const filename = parsed->is_magnet ? std::string_view{} : std::string_view{ parsed->filename };
+        tr_ctorSetParsedMetainfo(ctor, std::move(parsed->metainfo), filename, parsed->contents);
+
+        if (tr_torrentNew(ctor, nullptr) != nullptr)
+        {
+            ++n_torrents;
+        }
     }
 
-    loaded_promise->set_value(n_torrents);
+    return n_torrents;
 }
 } // namespace load_torrents_helpers
 } // namespace
@@ -1391,12 +1508,41 @@ size_t tr_sessionLoadTorrents(tr_session* session, tr_ctor* ctor)
 {
     using namespace load_torrents_helpers;
 
-    auto loaded_promise = std::promise<size_t>{};
-    auto loaded_future = loaded_promise.get_future();
+    // Add the torrents in batches so that the session
+    // thread can get other work done in between.
+    static auto constexpr BatchSize = size_t{ 256U };
+
+    auto const& torrent_dir = session->torrentDir();
+    auto files = get_torrent_files(torrent_dir);
+    parse_torrent_files(torrent_dir, files);
+
+    auto n_torrents = size_t{};
+    for (size_t begin = 0; begin < std::size(files); begin += BatchSize)
+    {
+        auto* const batch_begin = std::data(files) + begin;
+        auto* const batch_end = std::data(files) + std::min(begin + BatchSize, std::size(files));
+
+        auto added_promise = std::promise<size_t>{};
+        auto added_future = added_promise.get_future();
+        session->runInSessionThread(
+            [&]()
+            {
+                auto n_added = size_t{};
+                {
+                    auto const resume_batch = tr_session::ResumeStoreBatch{ *session };
+                    n_added = add_parsed_torrents(ctor, batch_begin, batch_end);
+                }
+                added_promise.set_value(n_added);
+            });
+        n_torrents += added_future.get();
+    }
 
-    session->runInSessionThread(session_load_torrents, session, ctor, &loaded_promise);
-    loaded_future.wait();
-    auto const n_torrents = loaded_future.get();
+    if (n_torrents != 0U)
+    {
+        tr_logAddInfo(fmt::format(
+            tr_ngettext("Loaded {count} torrent", "Loaded {count} torrents", n_torrents),
+            fmt::arg("count", n_torrents)));
+    }
 
     return n_torrents;
 }
@@ -1523,6 +1669,21 @@ size_t tr_sessionGetCacheLimit_MB(tr_session const* session)
     return session->settings_.cache_size_mb;
 }
 
+void tr_sessionSetReadCacheLimit_MB(tr_session* session, size_t mb)
+{
+    TR_ASSERT(session != nullptr);
+
+    session->settings_.read_cache_size_mb = mb;
+    session->cache->setReadLimit(tr_toMemBytes(mb));
+}
+
+size_t tr_sessionGetReadCacheLimit_MB(tr_session const* session)
+{
+    TR_ASSERT(session != nullptr);
+
+    return session->settings_.read_cache_size_mb;
+}
+
 // ---
 
 void tr_session::setDefaultTrackers(std::string_view trackers)
@@ -1591,27 +1752,73 @@ bool tr_sessionIsPortForwardingEnabled(tr_session const* session)
 
 // ---
 
-void tr_session::useBlocklist(bool enabled)
+void tr_session::loadResumeStore()
+{
+    // Open the store if it's enabled, or if it was enabled last time
+    // and still holds torrents that need to be moved back to .resume files.
+    // This can't be toggled at runtime: it has to be loaded before the torrents are.
+    auto filename = tr_pathbuf{ config_dir_, "/resume.snapshot"sv };
+    if (!settings_.resume_snapshot_enabled && !tr_sys_path_exists(filename))
+    {
+        return;
+    }
+
+    resume_store_ = std::make_unique<tr_resume_store>(std::string{ filename.sv() });
+
+    if (tr_error* error = nullptr; !resume_store_->load(&error))
+    {
+        tr_logAddWarn(fmt::format(
+            _("Couldn't read '{path}': {error} ({error_code})"),
+            fmt::arg("path", filename),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        tr_error_clear(&error);
+    }
+}
+
+void tr_session::flushResumeStore()
 {
-    settings_.blocklist_enabled = enabled;
+    if (!resume_store_)
+    {
+        return;
+    }
+
+    // once every torrent has been moved out of a disabled store, remove it
+    if (!settings_.resume_snapshot_enabled && resume_store_->empty())
+    {
+        resume_store_->remove();
+        resume_store_.reset();
+        return;
+    }
 
-    std::for_each(
-        std::begin(blocklists_),
-        std::end(blocklists_),
-        [enabled](auto& blocklist) { blocklist.setEnabled(enabled); });
+    if (tr_error* error = nullptr; !resume_store_->flush(&error))
+    {
+        tr_logAddWarn(fmt::format(
+            _("Couldn't save '{path}': {error} ({error_code})"),
+            fmt::arg("path", resume_store_->filename()),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        tr_error_clear(&error);
+    }
+}
+
+void tr_session::loadBlocklistIndex()
+{
+    // release the old index first: on some platforms,
+    // a file that's mapped into memory can't be replaced
+    blocklist_index_ = {};
+    blocklist_index_ = libtransmission::BlocklistIndex::load(blocklist_dir_, blocklists_);
 }
 
 bool tr_session::addressIsBlocked(tr_address const& addr) const noexcept
 {
-    return std::any_of(
-        std::begin(blocklists_),
-        std::end(blocklists_),
-        [&addr](auto& blocklist) { return blocklist.contains(addr); });
+    return useBlocklist() && blocklist_index_.contains(addr);
 }
 
 void tr_sessionReloadBlocklists(tr_session* session)
 {
-    session->blocklists_ = libtransmission::Blocklist::loadBlocklists(session->blocklist_dir_, session->useBlocklist());
+    session->blocklists_ = libtransmission::Blocklist::loadBlocklists(session->blocklist_dir_);
+    session->loadBlocklistIndex();
 
     if (session->peer_mgr_)
     {
@@ -1657,7 +1864,7 @@ size_t tr_blocklistSetContent(tr_session* session, char const* content_filename)
     auto const bin_file = tr_pathbuf{ session->blocklist_dir_, '/', DEFAULT_BLOCKLIST_FILENAME };
 
     // Try to save it
-    auto added = libtransmission::Blocklist::saveNew(content_filename, bin_file, session->useBlocklist());
+    auto added = libtransmission::Blocklist::saveNew(content_filename, bin_file);
     if (!added)
     {
         return 0U;
@@ -1680,6 +1887,8 @@ size_t tr_blocklistSetContent(tr_session* session, char const* content_filename)
         src.emplace_back(std::move(*added));
     }
 
+    session->loadBlocklistIndex();
+
     return n_rules;
 }
 
@@ -2142,9 +2351,12 @@ tr_session::tr_session(std::string_view config_dir, tr_variant* settings_dict)
     save_timer_ = timerMaker().create(
         [this]()
         {
-            for (auto* const tor : torrents())
             {
-                tr_torrentSave(tor);
+                auto const batch = ResumeStoreBatch{ *this };
+                for (auto* const tor : torrents())
+                {
+                    tr_torrentSave(tor);
+                }
             }
 
             stats().saveIfDirty();
@@ -2152,6 +2364,7 @@ tr_session::tr_session(std::string_view config_dir, tr_variant* settings_dict)
     save_timer_->startRepeating(SaveIntervalSecs);
 
     verifier_->addCallback(tr_torrentOnVerifyDone);
+    relocator_->addCallback([this](auto const& job) { runInSessionThread(tr_torrentOnRelocateDone, this, job); });
 }
 
 void tr_session::addIncoming(tr_peer_socket&& socket)
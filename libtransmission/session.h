@@ -33,11 +33,15 @@
 #include "bandwidth.h"
 #include "bitfield.h"
 #include "cache.h"
+#include "blocklist.h"
+#include "disk-io.h"
 #include "interned-string.h"
 #include "net.h" // tr_socket_t
 #include "open-files.h"
+#include "perf-stats.h"
 #include "port-forwarding.h"
 #include "quark.h"
+#include "relocate.h"
 #include "session-alt-speeds.h"
 #include "session-id.h"
 #include "session-settings.h"
@@ -57,6 +61,7 @@ struct event_base;
 class tr_lpd;
 class tr_peer_socket;
 class tr_port_forwarding;
+class tr_resume_store;
 class tr_rpc_server;
 class tr_session_thread;
 class tr_web;
@@ -65,7 +70,6 @@ struct tr_variant;
 
 namespace libtransmission
 {
-class Blocklist;
 class Dns;
 class Timer;
 class TimerMaker;
@@ -281,7 +285,12 @@ private:
         tr_udp_core(tr_session& session, tr_port udp_port);
         ~tr_udp_core();
 
-        void sendto(void const* buf, size_t buflen, struct sockaddr const* to, socklen_t tolen) const;
+        // Queues a datagram. The queue is sent as a batch once the current
+        // event loop iteration is done or when the batch is full.
+        void sendto(void const* buf, size_t buflen, struct sockaddr const* to, socklen_t tolen);
+
+        // Sends everything that's been queued by sendto().
+        void flush();
 
         [[nodiscard]] constexpr auto socket4() const noexcept
         {
@@ -294,12 +303,40 @@ private:
         }
 
     private:
+        struct OutPacket
+        {
+            sockaddr_storage to;
+            socklen_t tolen;
+            size_t offset; // into outbox_bytes_
+            size_t len;
+        };
+
+        // buffers that onReadable() receives datagrams into
+        struct Inbox;
+
+        static void onReadable(evutil_socket_t sock, short type, void* vself);
+        static void onFlush(evutil_socket_t sock, short type, void* vself);
+
+        void dispatch(unsigned char* buf, size_t buflen, sockaddr* from, socklen_t fromlen);
+        void sendBatch(tr_socket_t sock, OutPacket const* const* packets, size_t n_packets);
+        void sendOne(tr_socket_t sock, void const* buf, size_t buflen, sockaddr const* to, socklen_t tolen) const;
+
         tr_port const udp_port_;
         tr_session& session_;
         tr_socket_t udp4_socket_ = TR_BAD_SOCKET;
         tr_socket_t udp6_socket_ = TR_BAD_SOCKET;
         libtransmission::evhelpers::event_unique_ptr udp4_event_;
         libtransmission::evhelpers::event_unique_ptr udp6_event_;
+
+        std::unique_ptr<Inbox> const inbox_;
+
+        std::vector<OutPacket> outbox_;
+        std::vector<unsigned char> outbox_bytes_;
+        libtransmission::evhelpers::event_unique_ptr flush_event_;
+
+        // cleared if the kernel turns out not to support them
+        bool mmsg_supported_ = true;
+        bool gso_supported_ = true;
     };
 
 public:
@@ -336,6 +373,11 @@ public:
         return session_thread_->eventBase();
     }
 
+    [[nodiscard]] tr_perf_stats& perfStats() noexcept
+    {
+        return session_thread_->perfStats();
+    }
+
     [[nodiscard]] constexpr auto& torrents()
     {
         return torrents_;
@@ -368,6 +410,54 @@ public:
         return resume_dir_;
     }
 
+    [[nodiscard]] constexpr auto isResumeSnapshotEnabled() const noexcept
+    {
+        return settings_.resume_snapshot_enabled;
+    }
+
+    // The single-file store of all the torrents' resume state.
+    // nullptr unless it's enabled or one is left over from when it was.
+    [[nodiscard]] tr_resume_store* resumeStore() noexcept
+    {
+        return resume_store_.get();
+    }
+
+    // Writes the resume store's changes to disk now, or at the end of
+    // the current `ResumeStoreBatch` if there is one.
+    void saveResumeStore()
+    {
+        if (resume_store_batch_depth_ == 0U)
+        {
+            flushResumeStore();
+        }
+    }
+
+    // Holds off `saveResumeStore()` for its lifetime, so that saving many
+    // torrents at once costs one write and one sync instead of one each.
+    class ResumeStoreBatch
+    {
+    public:
+        explicit ResumeStoreBatch(tr_session& session) noexcept
+            : session_{ session }
+        {
+            ++session_.resume_store_batch_depth_;
+        }
+
+        ~ResumeStoreBatch()
+        {
+            --session_.resume_store_batch_depth_;
+            session_.saveResumeStore();
+        }
+
+        ResumeStoreBatch(ResumeStoreBatch&&) = delete;
+        ResumeStoreBatch(ResumeStoreBatch const&) = delete;
+        ResumeStoreBatch& operator=(ResumeStoreBatch&&) = delete;
+        ResumeStoreBatch& operator=(ResumeStoreBatch const&) = delete;
+
+    private:
+        tr_session& session_;
+    };
+
     [[nodiscard]] constexpr auto const& downloadDir() const noexcept
     {
         return settings_.download_dir;
@@ -444,7 +534,10 @@ public:
         return settings_.blocklist_enabled;
     }
 
-    void useBlocklist(bool enabled);
+    void useBlocklist(bool enabled) noexcept
+    {
+        settings_.blocklist_enabled = enabled;
+    }
 
     [[nodiscard]] constexpr auto const& blocklistUrl() const noexcept
     {
@@ -843,6 +936,33 @@ public:
         }
     }
 
+    void relocateAdd(std::shared_ptr<tr_relocate_worker::Job> job)
+    {
+        if (relocator_)
+        {
+            relocator_->add(std::move(job));
+        }
+    }
+
+    void relocateRemove(tr_torrent_id_t tor_id)
+    {
+        if (relocator_)
+        {
+            relocator_->remove(tor_id);
+        }
+    }
+
+    // @return false if the job was removed since it finished copying
+    bool relocateFinish(tr_relocate_worker::Job const& job)
+    {
+        return relocator_ && relocator_->finish(job);
+    }
+
+    [[nodiscard]] bool isRelocating(tr_torrent_id_t tor_id) const
+    {
+        return relocator_ && relocator_->contains(tor_id);
+    }
+
     void fetch(tr_web::FetchOptions&& options) const
     {
         if (web_)
@@ -913,6 +1033,11 @@ private:
 
     void onNowTimer();
 
+    void loadBlocklistIndex();
+
+    void loadResumeStore();
+    void flushResumeStore();
+
     static void onIncomingPeerConnection(tr_socket_t fd, void* vsession);
 
     friend class libtransmission::test::SessionTest;
@@ -934,6 +1059,7 @@ private:
     friend size_t tr_sessionGetAltSpeedBegin(tr_session const* session);
     friend size_t tr_sessionGetAltSpeedEnd(tr_session const* session);
     friend size_t tr_sessionGetCacheLimit_MB(tr_session const* session);
+    friend size_t tr_sessionGetReadCacheLimit_MB(tr_session const* session);
     friend tr_kilobytes_per_second_t tr_sessionGetAltSpeed_KBps(tr_session const* session, tr_direction dir);
     friend tr_kilobytes_per_second_t tr_sessionGetSpeedLimit_KBps(tr_session const* session, tr_direction dir);
     friend tr_port_forwarding_state tr_sessionGetPortForwarding(tr_session const* session);
@@ -955,6 +1081,7 @@ private:
     friend void tr_sessionSetAntiBruteForceEnabled(tr_session* session, bool is_enabled);
     friend void tr_sessionSetAntiBruteForceThreshold(tr_session* session, int max_bad_requests);
     friend void tr_sessionSetCacheLimit_MB(tr_session* session, size_t mb);
+    friend void tr_sessionSetReadCacheLimit_MB(tr_session* session, size_t mb);
     friend void tr_sessionSetDHTEnabled(tr_session* session, bool enabled);
     friend void tr_sessionSetDeleteSource(tr_session* session, bool delete_source);
     friend void tr_sessionSetEncryption(tr_session* session, tr_encryption_mode mode);
@@ -1061,6 +1188,9 @@ private:
 
     tr_stats session_stats_{ config_dir_, time(nullptr) };
 
+    std::unique_ptr<tr_resume_store> resume_store_;
+    size_t resume_store_batch_depth_ = 0U;
+
     tr_announce_list default_trackers_;
 
     tr_session_id session_id_;
@@ -1068,6 +1198,7 @@ private:
     tr_open_files open_files_;
 
     std::vector<libtransmission::Blocklist> blocklists_;
+    libtransmission::BlocklistIndex blocklist_index_;
 
     /// other fields
 
@@ -1109,9 +1240,12 @@ private:
     WebMediator web_mediator_{ this };
     std::unique_ptr<tr_web> web_ = tr_web::create(this->web_mediator_);
 
+    // depends-on: session_thread_, open_files_
+    std::unique_ptr<tr_disk_io> disk_io_ = std::make_unique<tr_disk_io>(*session_thread_);
+
 public:
-    // depends-on: settings_, open_files_, torrents_
-    std::unique_ptr<Cache> cache = std::make_unique<Cache>(torrents_, 1024 * 1024 * 2);
+    // depends-on: settings_, open_files_, torrents_, disk_io_
+    std::unique_ptr<Cache> cache = std::make_unique<Cache>(torrents_, *disk_io_, 1024 * 1024 * 2);
 
 private:
     // depends-on: timer_maker_, top_bandwidth_, utp_context, torrents_, web_
@@ -1151,6 +1285,8 @@ private:
 
     std::unique_ptr<tr_verify_worker> verifier_ = std::make_unique<tr_verify_worker>();
 
+    std::unique_ptr<tr_relocate_worker> relocator_ = std::make_unique<tr_relocate_worker>();
+
 public:
     std::unique_ptr<libtransmission::Timer> utp_timer;
 };
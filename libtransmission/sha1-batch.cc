@@ -0,0 +1,562 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring> // memcpy()
+#include <string_view>
+#include <utility> // std::index_sequence
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <immintrin.h>
+#define TR_SHA1_X86
+#endif
+
+// the multi-buffer engines are written with GCC / Clang vector extensions
+#ifdef __GNUC__
+#define TR_SHA1_VECTORS
+#endif
+
+#include "transmission.h"
+
+#include "crypto-utils.h"
+#include "sha1-batch.h"
+#include "tr-assert.h"
+
+using namespace std::literals;
+
+namespace
+{
+namespace sha1_batch_helpers
+{
+
+auto constexpr BlockSize = size_t{ 64U };
+
+auto constexpr InitialState = std::array<uint32_t, 5>{ 0x67452301U, 0xEFCDAB89U, 0x98BADCFEU, 0x10325476U, 0xC3D2E1F0U };
+
+using State = std::array<uint32_t, 5>;
+
+[[nodiscard]] constexpr uint32_t loadBE32(unsigned char const* p) noexcept
+{
+    return (uint32_t{ p[0] } << 24) | (uint32_t{ p[1] } << 16) | (uint32_t{ p[2] } << 8) | uint32_t{ p[3] };
+}
+
+[[nodiscard]] tr_sha1_digest_t toDigest(State const& state) noexcept
+{
+    auto digest = tr_sha1_digest_t{};
+    for (size_t i = 0; i < std::size(state); ++i)
+    {
+        digest[i * 4 + 0] = static_cast<std::byte>(state[i] >> 24);
+        digest[i * 4 + 1] = static_cast<std::byte>(state[i] >> 16);
+        digest[i * 4 + 2] = static_cast<std::byte>(state[i] >> 8);
+        digest[i * 4 + 3] = static_cast<std::byte>(state[i]);
+    }
+    return digest;
+}
+
+// A message that's being hashed. Hands out the message's 64-byte blocks
+// one at a time, followed by the block(s) holding the SHA-1 padding.
+class Message
+{
+public:
+    explicit Message(std::string_view data) noexcept
+        : body_{ reinterpret_cast<unsigned char const*>(std::data(data)) }
+        , n_body_blocks_{ std::size(data) / BlockSize }
+    {
+        // the tail is whatever doesn't fill a whole block,
+        // followed by a 1 bit, zeroes, and the bit length
+        auto const n_rest = std::size(data) % BlockSize;
+        std::copy_n(body_ + n_body_blocks_ * BlockSize, n_rest, std::data(tail_));
+        tail_[n_rest] = 0x80;
+        n_tail_blocks_ = n_rest + 1U + 8U <= BlockSize ? 1U : 2U;
+
+        auto const n_bits = uint64_t{ std::size(data) } * 8U;
+        auto* const length_at = std::data(tail_) + n_tail_blocks_ * BlockSize - 8U;
+        for (size_t i = 0; i < 8U; ++i)
+        {
+            length_at[i] = static_cast<unsigned char>(n_bits >> (56U - 8U * i));
+        }
+    }
+
+    [[nodiscard]] constexpr size_t blocksLeft() const noexcept
+    {
+        return n_body_blocks_ + n_tail_blocks_ - pos_;
+    }
+
+    [[nodiscard]] unsigned char const* nextBlock() noexcept
+    {
+        TR_ASSERT(blocksLeft() > 0U);
+
+        auto const idx = pos_++;
+        return idx < n_body_blocks_ ? body_ + idx * BlockSize : std::data(tail_) + (idx - n_body_blocks_) * BlockSize;
+    }
+
+    [[nodiscard]] constexpr auto const* body() const noexcept
+    {
+        return body_;
+    }
+
+    [[nodiscard]] constexpr auto bodyBlocks() const noexcept
+    {
+        return n_body_blocks_;
+    }
+
+    [[nodiscard]] constexpr auto const* tail() const noexcept
+    {
+        return std::data(tail_);
+    }
+
+    [[nodiscard]] constexpr auto tailBlocks() const noexcept
+    {
+        return n_tail_blocks_;
+    }
+
+private:
+    std::array<unsigned char, BlockSize * 2U> tail_ = {};
+    unsigned char const* const body_;
+    size_t const n_body_blocks_;
+    size_t n_tail_blocks_ = 1U;
+    size_t pos_ = 0U;
+};
+
+// --- CPU features
+
+struct CpuFeatures
+{
+    bool avx2 = false;
+    bool sha = false;
+};
+
+[[nodiscard]] CpuFeatures detectCpuFeatures() noexcept
+{
+    auto features = CpuFeatures{};
+
+#ifdef TR_SHA1_X86
+    unsigned int eax = 0;
+    unsigned int ebx = 0;
+    unsigned int ecx = 0;
+    unsigned int edx = 0;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0)
+    {
+        return features;
+    }
+
+    auto const has_ssse3 = (ecx & (1U << 9)) != 0U;
+    auto const has_sse41 = (ecx & (1U << 19)) != 0U;
+    auto const has_osxsave = (ecx & (1U << 27)) != 0U;
+    auto const has_avx = (ecx & (1U << 28)) != 0U;
+
+    // AVX registers are only usable if the OS saves them on context switches
+    auto os_saves_ymm = false;
+    if (has_osxsave)
+    {
+        unsigned int xcr0_lo = 0;
+        unsigned int xcr0_hi = 0;
+        __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        os_saves_ymm = (xcr0_lo & 0x6U) == 0x6U;
+    }
+
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) != 0)
+    {
+        features.avx2 = has_avx && os_saves_ymm && (ebx & (1U << 5)) != 0U;
+        features.sha = has_ssse3 && has_sse41 && (ebx & (1U << 29)) != 0U;
+    }
+#endif
+
+    return features;
+}
+
+[[nodiscard]] CpuFeatures const& cpuFeatures() noexcept
+{
+    static auto const features = detectCpuFeatures();
+    return features;
+}
+
+// --- multi-buffer engines
+
+// Runs `messages` through a `Lanes`-wide engine. Each lane hashes one
+// message; when a lane finishes its message, it picks up the next one.
+// `compress` takes the state and message words transposed so that word
+// `i` of lane `lane` is at [i * Lanes + lane].
+template<size_t Lanes, typename CompressFunc>
+void hashInLanes(std::vector<Message>& messages, std::vector<tr_sha1_digest_t>& digests, CompressFunc compress)
+{
+    static auto constexpr Idle = SIZE_MAX;
+
+    alignas(32) auto state = std::array<uint32_t, 5U * Lanes>{};
+    alignas(32) auto words = std::array<uint32_t, 16U * Lanes>{};
+    auto lane_message = std::array<size_t, Lanes>{};
+    auto n_busy = size_t{};
+    auto next_message = size_t{};
+
+    auto const start_next_message = [&](size_t lane)
+    {
+        if (next_message == std::size(messages))
+        {
+            lane_message[lane] = Idle;
+            return;
+        }
+
+        lane_message[lane] = next_message++;
+        ++n_busy;
+        for (size_t i = 0; i < std::size(InitialState); ++i)
+        {
+            state[i * Lanes + lane] = InitialState[i];
+        }
+    };
+
+    for (size_t lane = 0; lane < Lanes; ++lane)
+    {
+        start_next_message(lane);
+    }
+
+    while (n_busy > 0U)
+    {
+        // idle lanes just hash whatever their words were last time
+        for (size_t lane = 0; lane < Lanes; ++lane)
+        {
+            if (lane_message[lane] != Idle)
+            {
+                auto const* const block = messages[lane_message[lane]].nextBlock();
+                for (size_t i = 0; i < 16U; ++i)
+                {
+                    words[i * Lanes + lane] = loadBE32(block + i * 4U);
+                }
+            }
+        }
+
+        compress(std::data(state), std::data(words));
+
+        for (size_t lane = 0; lane < Lanes; ++lane)
+        {
+            if (auto const idx = lane_message[lane]; idx != Idle && messages[idx].blocksLeft() == 0U)
+            {
+                auto lane_state = State{};
+                for (size_t i = 0; i < std::size(lane_state); ++i)
+                {
+                    lane_state[i] = state[i * Lanes + lane];
+                }
+
+                digests[idx] = toDigest(lane_state);
+                --n_busy;
+                start_next_message(lane);
+            }
+        }
+    }
+}
+
+#ifdef TR_SHA1_VECTORS
+
+using U32x4 = uint32_t __attribute__((vector_size(16)));
+using U32x8 = uint32_t __attribute__((vector_size(32)));
+
+// These are macros rather than functions so that vectors never get passed
+// by value between functions compiled for different instruction sets.
+#define TR_SHA1_ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define TR_SHA1_ROUND(f, k, t) \
+    do \
+    { \
+        if ((t) >= 16) \
+        { \
+            w[(t)&15] = TR_SHA1_ROTL(w[((t) + 13) & 15] ^ w[((t) + 8) & 15] ^ w[((t) + 2) & 15] ^ w[(t)&15], 1); \
+        } \
+        auto const tmp = TR_SHA1_ROTL(a, 5) + (f) + e + (k) + w[(t)&15]; \
+        e = d; \
+        d = c; \
+        c = TR_SHA1_ROTL(b, 30); \
+        b = a; \
+        a = tmp; \
+    } while (0)
+
+// The standard SHA-1 compression function, but on vectors of lanes
+// instead of on single words.
+template<typename V>
+[[gnu::always_inline]] inline void compressVectors(uint32_t* state, uint32_t const* words)
+{
+    static auto constexpr Lanes = sizeof(V) / sizeof(uint32_t);
+
+    V w[16];
+    std::memcpy(&w, words, sizeof(w));
+
+    V s[5];
+    std::memcpy(&s, state, sizeof(s));
+    auto a = s[0];
+    auto b = s[1];
+    auto c = s[2];
+    auto d = s[3];
+    auto e = s[4];
+
+    for (int t = 0; t < 20; ++t)
+    {
+        TR_SHA1_ROUND(d ^ (b & (c ^ d)), 0x5A827999U, t);
+    }
+
+    for (int t = 20; t < 40; ++t)
+    {
+        TR_SHA1_ROUND(b ^ c ^ d, 0x6ED9EBA1U, t);
+    }
+
+    for (int t = 40; t < 60; ++t)
+    {
+        TR_SHA1_ROUND((b & c) | (d & (b | c)), 0x8F1BBCDCU, t);
+    }
+
+    for (int t = 60; t < 80; ++t)
+    {
+        TR_SHA1_ROUND(b ^ c ^ d, 0xCA62C1D6U, t);
+    }
+
+    s[0] += a;
+    s[1] += b;
+    s[2] += c;
+    s[3] += d;
+    s[4] += e;
+    std::memcpy(state, &s, sizeof(s));
+
+    static_assert(sizeof(s) == 5U * Lanes * sizeof(uint32_t));
+}
+
+#undef TR_SHA1_ROUND
+#undef TR_SHA1_ROTL
+
+void compressSimd4(uint32_t* state, uint32_t const* words)
+{
+    compressVectors<U32x4>(state, words);
+}
+
+#ifdef TR_SHA1_X86
+[[gnu::target("avx2")]] void compressAvx2(uint32_t* state, uint32_t const* words)
+{
+    compressVectors<U32x8>(state, words);
+}
+#endif
+
+#endif // TR_SHA1_VECTORS
+
+// --- SHA extensions engine
+
+#ifdef TR_SHA1_X86
+
+// Four rounds of SHA-1. Rounds are done in groups of four, with the message
+// schedule for later groups interleaved into earlier ones; see Intel's
+// "New Instructions Supporting the Secure Hash Algorithm on Intel Architecture Processors".
+template<int G>
+[[gnu::target("sha,sse4.1"), gnu::always_inline]] inline void shaNiGroup(__m128i& abcd, __m128i (&e)[2], __m128i (&msg)[4])
+{
+    auto& e_this = e[G % 2];
+    auto& e_next = e[(G + 1) % 2];
+
+    if constexpr (G == 0)
+    {
+        e_this = _mm_add_epi32(e_this, msg[0]);
+    }
+    else
+    {
+        e_this = _mm_sha1nexte_epu32(e_this, msg[G % 4]);
+    }
+
+    e_next = abcd;
+
+    if constexpr (G >= 3 && G <= 18)
+    {
+        msg[(G + 1) % 4] = _mm_sha1msg2_epu32(msg[(G + 1) % 4], msg[G % 4]);
+    }
+
+    abcd = _mm_sha1rnds4_epu32(abcd, e_this, G / 5);
+
+    if constexpr (G >= 1 && G <= 16)
+    {
+        msg[(G + 3) % 4] = _mm_sha1msg1_epu32(msg[(G + 3) % 4], msg[G % 4]);
+    }
+
+    if constexpr (G >= 2 && G <= 17)
+    {
+        msg[(G + 2) % 4] = _mm_xor_si128(msg[(G + 2) % 4], msg[G % 4]);
+    }
+}
+
+template<int... Gs>
+[[gnu::target("sha,sse4.1"), gnu::always_inline]] inline void shaNiRounds(
+    __m128i& abcd,
+    __m128i (&e)[2],
+    __m128i (&msg)[4],
+    std::integer_sequence<int, Gs...> /*unused*/)
+{
+    (shaNiGroup<Gs>(abcd, e, msg), ...);
+}
+
+[[gnu::target("sha,sse4.1")]] void compressShaNi(State& state, unsigned char const* blocks, size_t n_blocks)
+{
+    auto const byteswap = _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+
+    auto abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const*>(std::data(state))), 0x1B);
+    auto e0 = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+
+    for (size_t i = 0; i < n_blocks; ++i, blocks += BlockSize)
+    {
+        auto const abcd_save = abcd;
+        auto const e0_save = e0;
+
+        __m128i msg[4];
+        for (size_t j = 0; j < std::size(msg); ++j)
+        {
+            msg[j] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(blocks + j * 16U)), byteswap);
+        }
+
+        __m128i e[2] = { e0, _mm_setzero_si128() };
+        shaNiRounds(abcd, e, msg, std::make_integer_sequence<int, 20>{});
+
+        e0 = _mm_sha1nexte_epu32(e[0], e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(std::data(state)), _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+}
+
+#endif // TR_SHA1_X86
+
+} // namespace sha1_batch_helpers
+} // namespace
+
+bool tr_sha1_engine_is_supported(tr_sha1_engine engine) noexcept
+{
+    using namespace sha1_batch_helpers;
+
+    switch (engine)
+    {
+    case tr_sha1_engine::Backend:
+        return true;
+
+    case tr_sha1_engine::Simd4:
+#ifdef TR_SHA1_VECTORS
+        return true;
+#else
+        return false;
+#endif
+
+    case tr_sha1_engine::Avx2:
+#if defined(TR_SHA1_VECTORS) && defined(TR_SHA1_X86)
+        return cpuFeatures().avx2;
+#else
+        return false;
+#endif
+
+    case tr_sha1_engine::ShaNi:
+#ifdef TR_SHA1_X86
+        return cpuFeatures().sha;
+#else
+        return false;
+#endif
+    }
+
+    return false;
+}
+
+tr_sha1_engine tr_sha1_best_engine() noexcept
+{
+    // Fastest first. The SHA extensions do a whole round per instruction,
+    // which beats even eight lanes of AVX2.
+    for (auto const engine : { tr_sha1_engine::ShaNi, tr_sha1_engine::Avx2 })
+    {
+        if (tr_sha1_engine_is_supported(engine))
+        {
+            return engine;
+        }
+    }
+
+    // Crypto libraries' single-buffer code is usually SIMD-accelerated too,
+    // so the portable 4-lane engine doesn't reliably beat it.
+    return tr_sha1_engine::Backend;
+}
+
+std::string_view tr_sha1_engine_name(tr_sha1_engine engine) noexcept
+{
+    switch (engine)
+    {
+    case tr_sha1_engine::Backend:
+        return "backend"sv;
+
+    case tr_sha1_engine::Simd4:
+        return "simd4"sv;
+
+    case tr_sha1_engine::Avx2:
+        return "avx2"sv;
+
+    case tr_sha1_engine::ShaNi:
+        return "sha-ni"sv;
+    }
+
+    return "unknown"sv;
+}
+
+size_t tr_sha1_batch_size(tr_sha1_engine engine) noexcept
+{
+    switch (engine)
+    {
+    case tr_sha1_engine::Simd4:
+        return 4U;
+
+    case tr_sha1_engine::Avx2:
+        return 8U;
+
+    default:
+        return 1U;
+    }
+}
+
+std::vector<tr_sha1_digest_t> tr_sha1_digest_many(std::vector<std::string_view> const& messages, tr_sha1_engine engine)
+{
+    using namespace sha1_batch_helpers;
+
+    TR_ASSERT(tr_sha1_engine_is_supported(engine));
+
+    auto digests = std::vector<tr_sha1_digest_t>(std::size(messages));
+
+    auto pending = std::vector<Message>{};
+    pending.reserve(std::size(messages));
+    for (auto const& message : messages)
+    {
+        pending.emplace_back(message);
+    }
+
+    switch (engine)
+    {
+#ifdef TR_SHA1_VECTORS
+    case tr_sha1_engine::Simd4:
+        hashInLanes<4U>(pending, digests, compressSimd4);
+        return digests;
+
+#ifdef TR_SHA1_X86
+    case tr_sha1_engine::Avx2:
+        hashInLanes<8U>(pending, digests, compressAvx2);
+        return digests;
+#endif
+#endif
+
+#ifdef TR_SHA1_X86
+    case tr_sha1_engine::ShaNi:
+        for (size_t i = 0, n = std::size(pending); i < n; ++i)
+        {
+            auto state = InitialState;
+            compressShaNi(state, pending[i].body(), pending[i].bodyBlocks());
+            compressShaNi(state, pending[i].tail(), pending[i].tailBlocks());
+            digests[i] = toDigest(state);
+        }
+        return digests;
+#endif
+
+    default:
+        std::transform(
+            std::begin(messages),
+            std::end(messages),
+            std::begin(digests),
+            [](auto const& message) { return tr_sha1::digest(message); });
+        return digests;
+    }
+}
@@ -0,0 +1,67 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <string_view>
+#include <vector>
+
+#include "transmission.h" // tr_sha1_digest_t
+
+/**
+ * @addtogroup utils Utilities
+ * @{
+ */
+
+/**
+ * The implementations that tr_sha1_digest_many() can use.
+ *
+ * Piece hashing is CPU-bound once the data is in the page cache, and one
+ * SHA-1 stream can't use more than a sliver of a modern CPU's SIMD units.
+ * The multi-buffer engines hash several independent pieces in lock-step,
+ * one piece per SIMD lane.
+ */
+enum class tr_sha1_engine
+{
+    // one message at a time through tr_sha1, i.e. the linked crypto library
+    Backend,
+
+    // four messages at a time in 128-bit vectors, e.g. SSE2 or NEON
+    Simd4,
+
+    // eight messages at a time in AVX2 registers
+    Avx2,
+
+    // one message at a time with the x86 SHA extensions
+    ShaNi
+};
+
+[[nodiscard]] bool tr_sha1_engine_is_supported(tr_sha1_engine engine) noexcept;
+
+/** @brief The fastest engine that this CPU supports. */
+[[nodiscard]] tr_sha1_engine tr_sha1_best_engine() noexcept;
+
+[[nodiscard]] std::string_view tr_sha1_engine_name(tr_sha1_engine engine) noexcept;
+
+/**
+ * @brief How many messages to pass to tr_sha1_digest_many() at once
+ * to keep all of the engine's lanes busy.
+ */
+[[nodiscard]] size_t tr_sha1_batch_size(tr_sha1_engine engine = tr_sha1_best_engine()) noexcept;
+
+/**
+ * @brief Compute the SHA-1 digests of several independent messages.
+ * @return the digests, in the same order as `messages`
+ */
+[[nodiscard]] std::vector<tr_sha1_digest_t> tr_sha1_digest_many(
+    std::vector<std::string_view> const& messages,
+    tr_sha1_engine engine = tr_sha1_best_engine());
+
+/** @} */
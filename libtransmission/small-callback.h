@@ -0,0 +1,144 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // std::byte, std::max_align_t, size_t
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace libtransmission
+{
+
+// A move-only `void()` callable, like a std::function that can't be copied.
+// Callables that fit in `InlineSize` bytes are stored inline so that
+// posting a typical lambda doesn't need a heap allocation. Bigger ones
+// fall back to the heap.
+template<size_t InlineSize>
+class SmallCallback
+{
+public:
+    SmallCallback() noexcept = default;
+
+    template<typename Func, typename = std::enable_if_t<!std::is_same_v<std::decay_t<Func>, SmallCallback>>>
+    SmallCallback(Func&& func) // NOLINT(bugprone-forwarding-reference-overload, google-explicit-constructor)
+    {
+        using Callable = std::decay_t<Func>;
+
+        if constexpr (IsInline<Callable>)
+        {
+            new (&storage_) Callable{ std::forward<Func>(func) };
+            ops_ = &InlineOps<Callable>;
+        }
+        else
+        {
+            new (&storage_) Callable*{ new Callable{ std::forward<Func>(func) } };
+            ops_ = &HeapOps<Callable>;
+        }
+    }
+
+    SmallCallback(SmallCallback&& that) noexcept
+    {
+        moveFrom(that);
+    }
+
+    SmallCallback& operator=(SmallCallback&& that) noexcept
+    {
+        if (this != &that)
+        {
+            reset();
+            moveFrom(that);
+        }
+
+        return *this;
+    }
+
+    SmallCallback(SmallCallback const&) = delete;
+    SmallCallback& operator=(SmallCallback const&) = delete;
+
+    ~SmallCallback()
+    {
+        reset();
+    }
+
+    void operator()()
+    {
+        ops_->invoke(&storage_);
+    }
+
+    [[nodiscard]] explicit operator bool() const noexcept
+    {
+        return ops_ != nullptr;
+    }
+
+    [[nodiscard]] bool isInline() const noexcept
+    {
+        return ops_ != nullptr && ops_->is_inline;
+    }
+
+    void reset() noexcept
+    {
+        if (ops_ != nullptr)
+        {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    struct Ops
+    {
+        void (*invoke)(void* storage);
+        void (*move)(void* tgt, void* src) noexcept; // also destroys `src`
+        void (*destroy)(void* storage) noexcept;
+        bool is_inline;
+    };
+
+    template<typename Callable>
+    static auto constexpr IsInline = sizeof(Callable) <= InlineSize && alignof(Callable) <= alignof(std::max_align_t) &&
+        std::is_nothrow_move_constructible_v<Callable>;
+
+    template<typename Callable>
+    static constexpr Ops InlineOps = {
+        [](void* storage) { (*static_cast<Callable*>(storage))(); },
+        [](void* tgt, void* src) noexcept
+        {
+            auto* const callable = static_cast<Callable*>(src);
+            new (tgt) Callable{ std::move(*callable) };
+            callable->~Callable();
+        },
+        [](void* storage) noexcept { static_cast<Callable*>(storage)->~Callable(); },
+        true,
+    };
+
+    template<typename Callable>
+    static constexpr Ops HeapOps = {
+        [](void* storage) { (**static_cast<Callable**>(storage))(); },
+        [](void* tgt, void* src) noexcept { new (tgt) Callable*{ *static_cast<Callable**>(src) }; },
+        [](void* storage) noexcept { delete *static_cast<Callable**>(storage); },
+        false,
+    };
+
+    void moveFrom(SmallCallback& that) noexcept
+    {
+        if (that.ops_ != nullptr)
+        {
+            that.ops_->move(&storage_, &that.storage_);
+            ops_ = std::exchange(that.ops_, nullptr);
+        }
+    }
+
+    static_assert(InlineSize >= sizeof(void*));
+
+    alignas(std::max_align_t) std::byte storage_[InlineSize];
+    Ops const* ops_ = nullptr;
+};
+
+} // namespace libtransmission
@@ -98,6 +98,17 @@ bool tr_ctorSetMetainfo(tr_ctor* ctor, char const* metainfo, size_t len, tr_erro
     return ctor->metainfo.parseBenc(contents_sv, error);
 }
 
+void tr_ctorSetParsedMetainfo(
+    tr_ctor* ctor,
+    tr_torrent_metainfo&& metainfo,
+    std::string_view filename,
+    std::string_view contents)
+{
+    ctor->torrent_filename = filename;
+    ctor->contents.assign(std::begin(contents), std::end(contents));
+    ctor->metainfo = std::move(metainfo);
+}
+
 bool tr_ctorSetMetainfoFromMagnetLink(tr_ctor* ctor, std::string_view magnet_link, tr_error** error)
 {
     ctor->torrent_filename.clear();
@@ -41,6 +41,7 @@
 #include "log.h"
 #include "magnet-metainfo.h"
 #include "peer-mgr.h"
+#include "resume-store.h"
 #include "resume.h"
 #include "session.h"
 #include "subprocess.h"
@@ -167,6 +168,7 @@ void tr_torrentClearError(tr_torrent* tor)
     tor->error = TR_STAT_OK;
     tor->error_announce_url.clear();
     tor->error_string.clear();
+    tor->markRpcChanged();
 }
 
 constexpr void tr_torrentUnsetPeerId(tr_torrent* tor)
@@ -765,6 +767,7 @@ void removeTorrentInSessionThread(tr_torrent* tor, bool delete_flag, tr_fileFunc
         // ensure the files are all closed and idle before moving
         tor->session->closeTorrentFiles(tor);
         tor->session->verifyRemove(tor);
+        tor->session->relocateRemove(tor->id());
 
         if (delete_func == nullptr)
         {
@@ -832,6 +835,13 @@ void torrentStart(tr_torrent* tor, torrent_start_opts opts)
 
     auto const lock = tor->unique_lock();
 
+    // moving its files right now... it'd write to the old copy,
+    // so wait until that's done
+    if (!tor->isDone() && tor->session->isRelocating(tor->id()))
+    {
+        return;
+    }
+
     switch (tor->activity())
     {
     case TR_STATUS_SEED:
@@ -955,6 +965,7 @@ void tr_torrentFreeInSessionThread(tr_torrent* tor)
         tr_logAddInfoTor(tor, _("Removing torrent"));
     }
 
+    tor->session->relocateRemove(tor->id());
     torrentStop(tor);
 
     if (tor->isDeleting)
@@ -962,6 +973,12 @@ void tr_torrentFreeInSessionThread(tr_torrent* tor)
         tr_torrent_metainfo::removeFile(tor->session->torrentDir(), tor->name(), tor->infoHashString(), ".torrent"sv);
         tr_torrent_metainfo::removeFile(tor->session->torrentDir(), tor->name(), tor->infoHashString(), ".magnet"sv);
         tr_torrent_metainfo::removeFile(tor->session->resumeDir(), tor->name(), tor->infoHashString(), ".resume"sv);
+
+        if (auto* const store = tor->session->resumeStore(); store != nullptr)
+        {
+            store->erase(tor->infoHash());
+            tor->session->saveResumeStore();
+        }
     }
 
     freeTorrent(tor);
@@ -1202,6 +1219,12 @@ void torrentInit(tr_torrent* tor, tr_ctor const* ctor)
     {
         setLocalErrorIfFilesDisappeared(tor, has_local_data);
     }
+
+    if (is_new_torrent)
+    {
+        tor->setDirty();
+        tr_torrentSave(tor);
+    }
 }
 } // namespace torrent_init_helpers
 } // namespace
@@ -1259,6 +1282,53 @@ namespace
 {
 namespace location_helpers
 {
+// Tell the torrent where its files are.
+// If `error` is set, the files couldn't be moved.
+void finishSetLocation(
+    tr_torrent* tor,
+    std::string_view old_path,
+    std::string_view path,
+    bool move_from_old_path,
+    int volatile* setme_state,
+    tr_error* error)
+{
+    if (error != nullptr)
+    {
+        tor->setLocalError(fmt::format(
+            _("Couldn't move '{old_path}' to '{path}': {error} ({error_code})"),
+            fmt::arg("old_path", old_path),
+            fmt::arg("path", path),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        tr_torrentStop(tor);
+    }
+    else
+    {
+        tor->setDownloadDir(path);
+
+        if (move_from_old_path)
+        {
+            tor->incomplete_dir.clear();
+            tor->current_dir = tor->downloadDir();
+        }
+    }
+
+    if (setme_state != nullptr)
+    {
+        *setme_state = error == nullptr ? TR_LOC_DONE : TR_LOC_ERROR;
+    }
+
+    // Restart it if it was stopped for the move. Do this even if the
+    // files didn't move, since this may have cancelled an earlier move.
+    if (tor->start_when_stable)
+    {
+        torrentStart(tor, {});
+    }
+
+    // don't lose track of the files if we crash before the next periodic save
+    tr_torrentSave(tor);
+}
+
 void setLocationInSessionThread(
     tr_torrent* tor,
     std::string const& path,
@@ -1269,50 +1339,69 @@ void setLocationInSessionThread(
     TR_ASSERT(tr_isTorrent(tor));
     TR_ASSERT(tor->session->amInSessionThread());
 
-    auto ok = bool{ true };
-    if (move_from_old_path)
+    // this replaces any move that's still in progress
+    tor->session->relocateRemove(tor->id());
+
+    if (!move_from_old_path)
     {
-        if (setme_state != nullptr)
-        {
-            *setme_state = TR_LOC_MOVING;
-        }
+        finishSetLocation(tor, tor->currentDir(), path, false, setme_state, nullptr);
+        return;
+    }
 
-        // ensure the files are all closed and idle before moving
-        tor->session->closeTorrentFiles(tor);
-        tor->session->verifyRemove(tor);
+    if (setme_state != nullptr)
+    {
+        *setme_state = TR_LOC_MOVING;
+    }
 
-        tr_error* error = nullptr;
-        ok = tor->metainfo_.files().move(tor->currentDir(), path, setme_progress, tor->name(), &error);
-        if (error != nullptr)
-        {
-            tor->setLocalError(fmt::format(
-                _("Couldn't move '{old_path}' to '{path}': {error} ({error_code})"),
-                fmt::arg("old_path", tor->currentDir()),
-                fmt::arg("path", path),
-                fmt::arg("error", error->message),
-                fmt::arg("error_code", error->code)));
-            tr_torrentStop(tor);
-            tr_error_clear(&error);
-        }
+    if (setme_progress != nullptr)
+    {
+        *setme_progress = 0.0;
     }
 
-    // tell the torrent where the files are
-    if (ok)
+    tor->session->verifyRemove(tor);
+
+    auto const old_path = std::string{ tor->currentDir().sv() };
+    if (tr_error* error = nullptr; !tr_sys_dir_create(path.c_str(), TR_SYS_DIR_CREATE_PARENTS, 0777, &error))
     {
-        tor->setDownloadDir(path);
+        finishSetLocation(tor, old_path, path, true, setme_state, error);
+        tr_error_free(error);
+        return;
+    }
 
-        if (move_from_old_path)
-        {
-            tor->incomplete_dir.clear();
-            tor->current_dir = tor->downloadDir();
-        }
+    // the old files are copied while the torrent keeps using them,
+    // so stop it if it might still write to them
+    if (tor->isRunning && !tor->isDone())
+    {
+        torrentStop(tor);
     }
 
-    if (setme_state != nullptr)
+    auto job = std::make_shared<tr_relocate_worker::Job>();
+    job->tor_id = tor->id();
+    job->old_dir = old_path;
+    job->new_dir = path;
+    job->setme_progress = setme_progress;
+    job->setme_state = setme_state;
+
+    if (!tr_sys_path_is_same(old_path.c_str(), path.c_str()))
     {
-        *setme_state = ok ? TR_LOC_DONE : TR_LOC_ERROR;
+        auto const paths = std::array<std::string_view, 1>{ old_path };
+        auto const& files = tor->metainfo_.files();
+
+        for (tr_file_index_t i = 0, n = files.fileCount(); i < n; ++i)
+        {
+            if (auto const found = files.find(i, std::data(paths), std::size(paths)); found)
+            {
+                auto& file = job->files.emplace_back();
+                file.old_path = found->filename();
+                file.new_path = tr_pathbuf{ path, '/', found->subpath() }.sv();
+                file.size = files.fileSize(i);
+            }
+        }
     }
+
+    tor->session->relocateAdd(std::move(job));
 }
+
 size_t buildSearchPathArray(tr_torrent const* tor, std::string_view* paths)
 {
     auto* walk = paths;
@@ -1354,6 +1443,51 @@ void tr_torrent::setLocation(
         setme_state);
 }
 
+void tr_torrentOnRelocateDone(tr_session* session, std::shared_ptr<tr_relocate_worker::Job> const& job)
+{
+    using namespace location_helpers;
+
+    TR_ASSERT(session->amInSessionThread());
+
+    // was it cancelled in the meantime?
+    if (!session->relocateFinish(*job))
+    {
+        return;
+    }
+
+    auto* const tor = session->torrents().get(job->tor_id);
+    if (tor == nullptr || tor->isDeleting)
+    {
+        return;
+    }
+
+    tr_error* error = nullptr;
+
+    if (!std::empty(job->error_message))
+    {
+        tr_error_set(&error, job->error_code, job->error_message);
+    }
+    else
+    {
+        // The torrent's paused from here until its location is updated,
+        // since this all happens in the session thread.
+        tor->session->closeTorrentFiles(tor);
+
+        tr_relocate_worker::removeOriginals(*job);
+
+        // rename the rest
+        tor->metainfo_.files().move(job->old_dir, job->new_dir, nullptr, tor->name(), &error);
+    }
+
+    if (job->setme_progress != nullptr && error == nullptr)
+    {
+        *job->setme_progress = 1.0;
+    }
+
+    finishSetLocation(tor, job->old_dir, job->new_dir, true, job->setme_state, error);
+    tr_error_clear(&error);
+}
+
 void tr_torrentSetLocation(
     tr_torrent* tor,
     char const* location,
@@ -1872,6 +2006,14 @@ void tr_torrent::setVerifyState(tr_verify_state state)
     this->markChanged();
 }
 
+void tr_torrent::onPiecesChanged()
+{
+    if (swarm != nullptr)
+    {
+        tr_peerMgrOnPiecesChanged(this);
+    }
+}
+
 // ---
 
 void tr_torrentSave(tr_torrent* tor)
@@ -2221,12 +2363,14 @@ void tr_torrent::onTrackerResponse(tr_tracker_event const* event)
         error = TR_STAT_TRACKER_WARNING;
         error_announce_url = event->announce_url;
         error_string = event->text;
+        markRpcChanged();
         break;
 
     case tr_tracker_event::Type::Error:
         error = TR_STAT_TRACKER_ERROR;
         error_announce_url = event->announce_url;
         error_string = event->text;
+        markRpcChanged();
         break;
 
     case tr_tracker_event::Type::ErrorClear:
@@ -2671,11 +2815,13 @@ bool tr_torrentHasMetadata(tr_torrent const* tor)
 void tr_torrent::markEdited()
 {
     this->editDate = tr_time();
+    markRpcChanged();
 }
 
 void tr_torrent::markChanged()
 {
     this->anyDate = tr_time();
+    markRpcChanged();
 }
 
 void tr_torrent::setBlocks(tr_bitfield blocks)
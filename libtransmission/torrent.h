@@ -11,6 +11,7 @@
 
 #include <cstddef> // size_t
 #include <ctime>
+#include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
@@ -349,12 +350,14 @@ public:
     {
         file_priorities_.set(files, file_count, priority);
         setDirty();
+        onPiecesChanged();
     }
 
     void setFilePriority(tr_file_index_t file, tr_priority_t priority)
     {
         file_priorities_.set(file, priority);
         setDirty();
+        onPiecesChanged();
     }
 
     /// LOCATION
@@ -580,6 +583,7 @@ public:
         this->error = TR_STAT_LOCAL_ERROR;
         this->error_announce_url = TR_KEY_NONE;
         this->error_string = errmsg;
+        markRpcChanged();
     }
 
     void setDownloadDir(std::string_view path)
@@ -673,11 +677,26 @@ public:
     constexpr void setDirty() noexcept
     {
         this->isDirty = true;
+        markRpcChanged();
     }
 
     void markEdited();
     void markChanged();
 
+    // Call this when something that torrent-get reports may have changed.
+    // While a torrent is stopped, this is the only way RPC clients that ask
+    // for changes since their last request will find out about them.
+    // setDirty(), markEdited(), and markChanged() call this too.
+    constexpr void markRpcChanged() noexcept
+    {
+        ++rpc_changes_;
+    }
+
+    [[nodiscard]] constexpr auto rpcChanges() const noexcept
+    {
+        return rpc_changes_;
+    }
+
     void setBandwidthGroup(std::string_view group_name) noexcept;
 
     [[nodiscard]] constexpr auto getPriority() const noexcept
@@ -815,6 +834,26 @@ public:
     using labels_t = std::vector<tr_quark>;
     labels_t labels;
 
+    // For RPC clients that only want what changed since their last
+    // torrent-get: a fingerprint of each field's last-seen value and the
+    // tr_torrents::revision() at which that value was first seen.
+    // Sorted by key; only holds fields that have been asked for.
+    struct RpcFieldState
+    {
+        // `seen_changes` if the torrent was busy when the field was
+        // fingerprinted, so it has to be looked at again next time
+        static auto constexpr Unsettled = ~uint64_t{};
+
+        tr_quark key;
+        uint64_t fingerprint;
+        uint64_t changed_at;
+
+        // the torrent's and session's rpcChanges() when this was fingerprinted
+        uint64_t seen_changes;
+    };
+
+    std::vector<RpcFieldState> rpc_field_states_;
+
     // when Transmission thinks the torrent's files were last changed
     std::vector<time_t> file_mtimes_;
 
@@ -939,13 +978,19 @@ private:
         {
             setDirty();
             recheckCompleteness();
+            onPiecesChanged();
         }
     }
 
+    // let the peer manager know that pieces' priorities or wanted flags changed
+    void onPiecesChanged();
+
     tr_verify_state verify_state_ = TR_VERIFY_NONE;
 
     float verify_progress_ = -1;
 
+    uint64_t rpc_changes_ = 0;
+
     tr_announce_key_t announce_key_ = tr_rand_obj<tr_announce_key_t>();
 
     tr_interned_string bandwidth_group_;
@@ -971,6 +1016,13 @@ tr_torrent_metainfo tr_ctorStealMetainfo(tr_ctor* ctor);
 
 bool tr_ctorSetMetainfoFromFile(tr_ctor* ctor, std::string_view filename, tr_error** error = nullptr);
 bool tr_ctorSetMetainfoFromMagnetLink(tr_ctor* ctor, std::string_view magnet_link, tr_error** error = nullptr);
+// Uses metainfo that was already parsed, e.g. on a worker thread. `contents`
+// is only needed if the .torrent file might need to be saved.
+void tr_ctorSetParsedMetainfo(
+    tr_ctor* ctor,
+    tr_torrent_metainfo&& metainfo,
+    std::string_view filename,
+    std::string_view contents = {});
 void tr_ctorSetLabels(tr_ctor* ctor, tr_quark const* labels, size_t n_labels);
 void tr_ctorSetBandwidthPriority(tr_ctor* ctor, tr_priority_t priority);
 tr_priority_t tr_ctorGetBandwidthPriority(tr_ctor const* ctor);
@@ -978,6 +1030,8 @@ tr_torrent::labels_t const& tr_ctorGetLabels(tr_ctor const* ctor);
 
 void tr_torrentOnVerifyDone(tr_torrent* tor, bool aborted);
 
+void tr_torrentOnRelocateDone(tr_session* session, std::shared_ptr<tr_relocate_worker::Job> const& job);
+
 #define tr_logAddCriticalTor(tor, msg) tr_logAddCritical(msg, (tor)->name())
 #define tr_logAddErrorTor(tor, msg) tr_logAddError(msg, (tor)->name())
 #define tr_logAddWarnTor(tor, msg) tr_logAddWarn(msg, (tor)->name())
@@ -3,6 +3,8 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm>
+#include <chrono>
 #include <set>
 #include <string_view>
 #include <vector>
@@ -76,14 +78,14 @@ void tr_torrents::remove(tr_torrent const* tor, time_t current_time)
     by_id_[tor->id()] = nullptr;
     auto const [begin, end] = std::equal_range(std::begin(by_hash_), std::end(by_hash_), tor, CompareTorrentByHash{});
     by_hash_.erase(begin, end);
-    removed_.emplace_back(tor->id(), current_time);
+    removed_.push_back({ tor->id(), current_time, revision_ });
 }
 
 std::vector<tr_torrent_id_t> tr_torrents::removedSince(time_t timestamp) const
 {
     auto ids = std::set<tr_torrent_id_t>{};
 
-    for (auto const& [id, removed_at] : removed_)
+    for (auto const& [id, removed_at, revision] : removed_)
     {
         if (removed_at >= timestamp)
         {
@@ -93,3 +95,31 @@ std::vector<tr_torrent_id_t> tr_torrents::removedSince(time_t timestamp) const
 
     return { std::begin(ids), std::end(ids) };
 }
+
+std::vector<tr_torrent_id_t> tr_torrents::removedSinceRevision(uint64_t revision) const
+{
+    auto ids = std::set<tr_torrent_id_t>{};
+
+    // a torrent removed before the next revision was handed out
+    // is tagged with the current one, so use >= here
+    for (auto const& removed : removed_)
+    {
+        if (removed.revision >= revision)
+        {
+            ids.insert(removed.id);
+        }
+    }
+
+    return { std::begin(ids), std::end(ids) };
+}
+
+uint64_t tr_torrents::makeFirstRevision() noexcept
+{
+    // Leave room for about a million torrent-get requests per second of
+    // uptime before a session's revisions could reach the next session's.
+    // This stays below 2^53 for a long time, so JavaScript clients can
+    // hold revisions in a plain number.
+    auto const now = std::chrono::system_clock::now().time_since_epoch();
+    auto const secs = std::chrono::duration_cast<std::chrono::seconds>(now).count();
+    return static_cast<uint64_t>(std::max(decltype(secs){ 1 }, secs)) << 20U;
+}
@@ -9,6 +9,7 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <cstdint> // uint64_t
 #include <ctime>
 #include <string_view>
 #include <utility>
@@ -64,6 +65,41 @@ public:
 
     [[nodiscard]] std::vector<tr_torrent_id_t> removedSince(time_t timestamp) const;
 
+    // A counter that RPC clients use as a token to ask for changes since
+    // their last torrent-get. Each of those requests gets a new revision.
+    [[nodiscard]] constexpr auto revision() const noexcept
+    {
+        return revision_;
+    }
+
+    uint64_t nextRevision() noexcept
+    {
+        return ++revision_;
+    }
+
+    // @return true if `revision` was handed out by this session.
+    // Each session's revisions start where the last session's can't reach,
+    // so a client holding a revision from before a restart gets a `false` here.
+    [[nodiscard]] constexpr bool isKnownRevision(uint64_t revision) const noexcept
+    {
+        return first_revision_ <= revision && revision <= revision_;
+    }
+
+    // Something that affects every torrent's torrent-get fields has changed,
+    // e.g. the session's seed ratio limit. See tr_torrent::markRpcChanged().
+    constexpr void markAllRpcChanged() noexcept
+    {
+        ++rpc_changes_;
+    }
+
+    [[nodiscard]] constexpr auto rpcChanges() const noexcept
+    {
+        return rpc_changes_;
+    }
+
+    // @return the torrents removed since `revision` was handed out
+    [[nodiscard]] std::vector<tr_torrent_id_t> removedSinceRevision(uint64_t revision) const;
+
     [[nodiscard]] TR_CONSTEXPR20 auto cbegin() const noexcept
     {
         return std::cbegin(by_hash_);
@@ -119,5 +155,19 @@ private:
     // may be testing for >0 as a validity check.
     std::vector<tr_torrent*> by_id_{ nullptr };
 
-    std::vector<std::pair<tr_torrent_id_t, time_t>> removed_;
+    struct Removed
+    {
+        tr_torrent_id_t id;
+        time_t removed_at;
+        uint64_t revision;
+    };
+
+    std::vector<Removed> removed_;
+
+    [[nodiscard]] static uint64_t makeFirstRevision() noexcept;
+
+    uint64_t const first_revision_ = makeFirstRevision();
+    uint64_t revision_ = first_revision_;
+
+    uint64_t rpc_changes_ = 0;
 };
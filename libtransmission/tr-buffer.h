@@ -6,14 +6,17 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <iterator>
 #include <limits>
 #include <memory>
 #include <string>
+#include <utility>
 
 #include <event2/buffer.h>
 
 #include "error.h"
+#include "file.h" // tr_sys_file_t
 #include "net.h" // tr_socket_t
 #include "utils-ev.h"
 #include "utils.h" // for tr_htonll(), tr_ntohll()
@@ -292,6 +295,45 @@ public:
         evbuffer_add(buf_.get(), bytes, n_bytes);
     }
 
+    // Add `n_bytes` from an open file, starting at `offset`, without
+    // reading them into memory. When the buffer is written to a TCP socket,
+    // the bytes go straight from the page cache to the socket, e.g. with
+    // sendfile(). The buffer can't be read from or pulled up afterwards.
+    //
+    // `keepalive` is held until libevent is done with the file,
+    // so use it to keep `fd` from being closed too soon.
+    // @return false if the file couldn't be added
+    bool add_file(
+        [[maybe_unused]] tr_sys_file_t fd,
+        [[maybe_unused]] uint64_t offset,
+        [[maybe_unused]] size_t n_bytes,
+        [[maybe_unused]] std::shared_ptr<void const> keepalive)
+    {
+#ifdef _WIN32
+        // libevent wants a CRT file descriptor, not a HANDLE
+        return false;
+#else
+        auto* const seg = evbuffer_file_segment_new(fd, static_cast<ev_off_t>(offset), static_cast<ev_off_t>(n_bytes), 0);
+        if (seg == nullptr)
+        {
+            return false;
+        }
+
+        evbuffer_file_segment_add_cleanup_cb(
+            seg,
+            [](evbuffer_file_segment const* /*seg*/, int /*flags*/, void* vkeepalive)
+            {
+                delete static_cast<std::shared_ptr<void const>*>(vkeepalive);
+            },
+            new std::shared_ptr<void const>{ std::move(keepalive) });
+
+        evbuffer_set_flags(buf_.get(), EVBUFFER_FLAG_DRAINS_TO_FD);
+        auto const added = evbuffer_add_file_segment(buf_.get(), seg, 0, static_cast<ev_off_t>(n_bytes)) == 0;
+        evbuffer_file_segment_free(seg);
+        return added;
+#endif
+    }
+
     template<typename T>
     void add(T const& data)
     {
@@ -2,10 +2,19 @@
 // It may be used under the MIT (SPDX: MIT) license.
 // License text can be found in the licenses/ folder.
 
+#undef _GNU_SOURCE
+#define _GNU_SOURCE // NOLINT recvmmsg(), sendmmsg()
+
+#include <algorithm>
 #include <array>
 #include <cerrno>
 #include <cstdint>
-#include <cstring> /* memcmp(), memset() */
+#include <cstring> /* memcmp(), memcpy(), memset() */
+#include <memory>
+
+#ifdef __linux__
+#include <netinet/udp.h> /* UDP_SEGMENT */
+#endif
 
 #include <event2/event.h>
 
@@ -84,66 +93,68 @@ void set_socket_buffers(tr_socket_t fd, bool large)
     }
 }
 
-void event_callback(evutil_socket_t s, [[maybe_unused]] short type, void* vsession)
-{
-    TR_ASSERT(vsession != nullptr);
-    TR_ASSERT(type == EV_READ);
+#if defined(HAVE_SENDMMSG) && defined(UDP_SEGMENT)
+#define TR_UDP_GSO
+#endif
 
-    auto buf = std::array<unsigned char, 8192>{};
-    auto from = sockaddr_storage{};
-    auto fromlen = socklen_t{ sizeof(from) };
-    auto* const from_sa = reinterpret_cast<sockaddr*>(&from);
+// how many datagrams to read or send per syscall
+auto constexpr BatchSize = size_t{ 32U };
 
-    auto const rc = recvfrom(s, reinterpret_cast<char*>(std::data(buf)), std::size(buf) - 1, 0, from_sa, &fromlen);
-    if (rc <= 0)
-    {
-        return;
-    }
+// cap how much we read per wakeup so that a flood of
+// incoming packets can't starve the rest of the event loop
+auto constexpr MaxDatagramsPerWakeup = size_t{ 256U };
 
-    /* Since most packets we receive here are µTP, make quick inline
-       checks for the other protocols. The logic is as follows:
-       - all DHT packets start with 'd'
-       - all UDP tracker packets start with a 32-bit (!) "action", which
-         is between 0 and 3
-       - the above cannot be µTP packets, since these start with a 4-bit
-         version number (1). */
-    auto* const session = static_cast<tr_session*>(vsession);
-    if (buf[0] == 'd')
-    {
-        if (session->dht_)
-        {
-            buf[rc] = '\0'; // libdht requires zero-terminated messages
-            session->dht_->handleMessage(std::data(buf), rc, from_sa, fromlen);
-        }
-    }
-    else if (rc >= 8 && buf[0] == 0 && buf[1] == 0 && buf[2] == 0 && buf[3] <= 3)
-    {
-        if (!session->announcer_udp_->handleMessage(std::data(buf), rc))
-        {
-            tr_logAddTrace("Couldn't parse UDP tracker packet.");
-        }
-    }
-    else if (session->allowsUTP() && (session->utp_context != nullptr))
+// big enough for any datagram we care about, plus the '\0' that libdht needs
+auto constexpr DatagramBufferSize = size_t{ 8192U };
+
+#ifdef TR_UDP_GSO
+// Consecutive packets of the same size to the same peer -- which is what
+// a uTP socket sending at full speed looks like -- can go to the kernel as
+// one buffer that it splits into datagrams (UDP generic segmentation offload).
+auto constexpr MaxGsoSegments = size_t{ 16U };
+auto constexpr MaxGsoBytes = size_t{ 65000U }; // has to fit in one IP packet
+
+[[nodiscard]] bool probeGso(tr_socket_t sock)
+{
+    auto segment_size = int{};
+    auto len = socklen_t{ sizeof(segment_size) };
+    return getsockopt(sock, IPPROTO_UDP, UDP_SEGMENT, &segment_size, &len) == 0;
+}
+#endif
+
+[[nodiscard]] constexpr bool isTransientSendError(int err) noexcept
+{
+#if EWOULDBLOCK != EAGAIN
+    if (err == EWOULDBLOCK)
     {
-        if (!tr_utpPacket(std::data(buf), rc, from_sa, fromlen, session))
-        {
-            tr_logAddTrace("Unexpected UDP packet");
-        }
+        return true;
     }
+#endif
+
+    return err == EAGAIN || err == ENOBUFS || err == EINTR;
 }
 } // namespace
 
+struct tr_session::tr_udp_core::Inbox
+{
+    std::array<std::array<unsigned char, DatagramBufferSize>, BatchSize> bufs;
+    std::array<sockaddr_storage, BatchSize> froms;
+};
+
 // BEP-32 explains why we need to bind to one IPv6 address
 
 tr_session::tr_udp_core::tr_udp_core(tr_session& session, tr_port udp_port)
     : udp_port_{ udp_port }
     , session_{ session }
+    , inbox_{ std::make_unique<Inbox>() }
 {
     if (std::empty(udp_port_))
     {
         return;
     }
 
+    flush_event_.reset(event_new(session_.eventBase(), -1, 0, onFlush, this));
+
     if (auto sock = socket(PF_INET, SOCK_DGRAM, 0); sock != TR_BAD_SOCKET)
     {
         auto optval = int{ 1 };
@@ -169,7 +180,7 @@ tr_session::tr_udp_core::tr_udp_core(tr_session& session, tr_port udp_port)
             session_.setSocketTOS(sock, TR_AF_INET);
             set_socket_buffers(sock, session_.allowsUTP());
             udp4_socket_ = sock;
-            udp4_event_.reset(event_new(session_.eventBase(), udp4_socket_, EV_READ | EV_PERSIST, event_callback, &session_));
+            udp4_event_.reset(event_new(session_.eventBase(), udp4_socket_, EV_READ | EV_PERSIST, onReadable, this));
             event_add(udp4_event_.get(), nullptr);
         }
     }
@@ -203,7 +214,7 @@ tr_session::tr_udp_core::tr_udp_core(tr_session& session, tr_port udp_port)
             session_.setSocketTOS(sock, TR_AF_INET6);
             set_socket_buffers(sock, session_.allowsUTP());
             udp6_socket_ = sock;
-            udp6_event_.reset(event_new(session_.eventBase(), udp6_socket_, EV_READ | EV_PERSIST, event_callback, &session_));
+            udp6_event_.reset(event_new(session_.eventBase(), udp6_socket_, EV_READ | EV_PERSIST, onReadable, this));
             event_add(udp6_event_.get(), nullptr);
 
 #ifdef IPV6_V6ONLY
@@ -214,10 +225,20 @@ tr_session::tr_udp_core::tr_udp_core(tr_session& session, tr_port udp_port)
 #endif
         }
     }
+
+#ifdef TR_UDP_GSO
+    auto const probe_sock = udp4_socket_ != TR_BAD_SOCKET ? udp4_socket_ : udp6_socket_;
+    gso_supported_ = probe_sock != TR_BAD_SOCKET && probeGso(probe_sock);
+#else
+    gso_supported_ = false;
+#endif
 }
 
 tr_session::tr_udp_core::~tr_udp_core()
 {
+    flush();
+    flush_event_.reset();
+
     udp6_event_.reset();
 
     if (udp6_socket_ != TR_BAD_SOCKET)
@@ -235,18 +256,348 @@ tr_session::tr_udp_core::~tr_udp_core()
     }
 }
 
-void tr_session::tr_udp_core::sendto(void const* buf, size_t buflen, struct sockaddr const* to, socklen_t const tolen) const
+// ---
+
+void tr_session::tr_udp_core::onReadable(evutil_socket_t sock, [[maybe_unused]] short type, void* vself)
+{
+    TR_ASSERT(vself != nullptr);
+    TR_ASSERT(type == EV_READ);
+
+    auto* const self = static_cast<tr_udp_core*>(vself);
+
+    auto& [bufs, froms] = *self->inbox_;
+
+    auto n_read = size_t{};
+    auto drained = false;
+
+#ifdef HAVE_RECVMMSG
+    while (!drained && self->mmsg_supported_ && n_read < MaxDatagramsPerWakeup)
+    {
+        auto iovs = std::array<iovec, BatchSize>{};
+        auto msgs = std::array<mmsghdr, BatchSize>{};
+        for (size_t i = 0; i < BatchSize; ++i)
+        {
+            iovs[i] = { std::data(bufs[i]), std::size(bufs[i]) - 1 };
+            msgs[i].msg_hdr.msg_name = &froms[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(froms[i]);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        auto const n_msgs = recvmmsg(sock, std::data(msgs), BatchSize, MSG_DONTWAIT, nullptr);
+        if (n_msgs < 0 && errno == ENOSYS)
+        {
+            self->mmsg_supported_ = false;
+            break;
+        }
+
+        if (n_msgs <= 0)
+        {
+            drained = true;
+            break;
+        }
+
+        for (int i = 0; i < n_msgs; ++i)
+        {
+            auto const& hdr = msgs[i].msg_hdr;
+            self->dispatch(std::data(bufs[i]), msgs[i].msg_len, static_cast<sockaddr*>(hdr.msg_name), hdr.msg_namelen);
+        }
+
+        n_read += n_msgs;
+        drained = static_cast<size_t>(n_msgs) < BatchSize;
+    }
+#endif
+
+    // Fall back to one recvfrom() at a time. Keep reading until the socket
+    // is drained if we can do so without blocking, or else just read once.
+    while (!drained && n_read < MaxDatagramsPerWakeup)
+    {
+        auto& buf = bufs.front();
+        auto* const from = reinterpret_cast<sockaddr*>(&froms.front());
+        auto fromlen = socklen_t{ sizeof(froms.front()) };
+
+#ifdef MSG_DONTWAIT
+        static auto constexpr Flags = MSG_DONTWAIT;
+#else
+        static auto constexpr Flags = 0;
+        drained = true;
+#endif
+
+        auto const rc = recvfrom(sock, reinterpret_cast<char*>(std::data(buf)), std::size(buf) - 1, Flags, from, &fromlen);
+        if (rc <= 0)
+        {
+            break;
+        }
+
+        self->dispatch(std::data(buf), rc, from, fromlen);
+        ++n_read;
+    }
+
+    // libutp wants to know when the socket's been drained so that
+    // it can send one ack for all the packets it just got
+    tr_utpSocketDrained(&self->session_);
+}
+
+void tr_session::tr_udp_core::dispatch(unsigned char* buf, size_t buflen, sockaddr* from, socklen_t fromlen)
+{
+    if (buflen == 0U)
+    {
+        return;
+    }
+
+    /* Since most packets we receive here are µTP, make quick inline
+       checks for the other protocols. The logic is as follows:
+       - all DHT packets start with 'd'
+       - all UDP tracker packets start with a 32-bit (!) "action", which
+         is between 0 and 3
+       - the above cannot be µTP packets, since these start with a 4-bit
+         version number (1). */
+    if (buf[0] == 'd')
+    {
+        if (session_.dht_)
+        {
+            buf[buflen] = '\0'; // libdht requires zero-terminated messages
+            session_.dht_->handleMessage(buf, buflen, from, fromlen);
+        }
+    }
+    else if (buflen >= 8 && buf[0] == 0 && buf[1] == 0 && buf[2] == 0 && buf[3] <= 3)
+    {
+        if (!session_.announcer_udp_->handleMessage(buf, buflen))
+        {
+            tr_logAddTrace("Couldn't parse UDP tracker packet.");
+        }
+    }
+    else if (session_.allowsUTP() && (session_.utp_context != nullptr))
+    {
+        if (!tr_utpPacket(buf, buflen, from, fromlen, &session_))
+        {
+            tr_logAddTrace("Unexpected UDP packet");
+        }
+    }
+}
+
+// ---
+
+void tr_session::tr_udp_core::sendto(void const* buf, size_t buflen, struct sockaddr const* to, socklen_t const tolen)
 {
     if (to->sa_family != AF_INET && to->sa_family != AF_INET6)
     {
         errno = EAFNOSUPPORT;
+        sendOne(TR_BAD_SOCKET, buf, buflen, to, tolen); // just to log the error
+        return;
     }
-    else if (auto const sock = to->sa_family == AF_INET ? udp4_socket_ : udp6_socket_; sock == TR_BAD_SOCKET)
+
+    if (auto const sock = to->sa_family == AF_INET ? udp4_socket_ : udp6_socket_; sock == TR_BAD_SOCKET)
     {
         // don't warn on bad sockets; the system may not support IPv6
         return;
     }
-    else if (::sendto(sock, static_cast<char const*>(buf), buflen, 0, to, tolen) != -1)
+
+    if (std::empty(outbox_) && flush_event_)
+    {
+        event_active(flush_event_.get(), 0, 0);
+    }
+
+    auto packet = OutPacket{};
+    std::memcpy(&packet.to, to, std::min(static_cast<size_t>(tolen), sizeof(packet.to)));
+    packet.tolen = tolen;
+    packet.offset = std::size(outbox_bytes_);
+    packet.len = buflen;
+    outbox_.push_back(packet);
+
+    auto const* const bytes = static_cast<unsigned char const*>(buf);
+    outbox_bytes_.insert(std::end(outbox_bytes_), bytes, bytes + buflen);
+
+    if (std::size(outbox_) >= BatchSize * 4)
+    {
+        flush();
+    }
+}
+
+void tr_session::tr_udp_core::onFlush(evutil_socket_t /*sock*/, short /*type*/, void* vself)
+{
+    static_cast<tr_udp_core*>(vself)->flush();
+}
+
+void tr_session::tr_udp_core::flush()
+{
+    if (std::empty(outbox_))
+    {
+        return;
+    }
+
+    auto packets = std::vector<OutPacket const*>{};
+    packets.reserve(std::size(outbox_));
+
+    for (auto const family : { AF_INET, AF_INET6 })
+    {
+        packets.clear();
+        for (auto const& packet : outbox_)
+        {
+            if (packet.to.ss_family == family)
+            {
+                packets.push_back(&packet);
+            }
+        }
+
+        if (!std::empty(packets))
+        {
+            sendBatch(family == AF_INET ? udp4_socket_ : udp6_socket_, std::data(packets), std::size(packets));
+        }
+    }
+
+    outbox_.clear();
+    outbox_bytes_.clear();
+}
+
+void tr_session::tr_udp_core::sendBatch(tr_socket_t sock, OutPacket const* const* packets, size_t n_packets)
+{
+    auto const send_one = [this, sock](OutPacket const& packet)
+    {
+        sendOne(sock, &outbox_bytes_[packet.offset], packet.len, reinterpret_cast<sockaddr const*>(&packet.to), packet.tolen);
+    };
+
+#ifdef HAVE_SENDMMSG
+    static auto constexpr SameDestination = [](OutPacket const& a, OutPacket const& b)
+    {
+        return a.tolen == b.tolen && std::memcmp(&a.to, &b.to, a.tolen) == 0;
+    };
+
+#ifdef TR_UDP_GSO
+    static auto constexpr ControlSize = CMSG_SPACE(sizeof(uint16_t));
+    using control_buf_t = std::array<char, ControlSize>;
+    alignas(cmsghdr) auto controls = std::array<control_buf_t, BatchSize>{};
+#endif
+
+    auto iovs = std::array<iovec, BatchSize * 4>{};
+    auto msgs = std::array<mmsghdr, BatchSize>{};
+    auto first_packet = std::array<size_t, BatchSize + 1>{}; // index of each message's first packet
+
+    auto pos = size_t{};
+    while (mmsg_supported_ && pos < n_packets)
+    {
+        // build a batch of messages
+        auto n_msgs = size_t{};
+        auto n_iovs = size_t{};
+        while (n_msgs < BatchSize && pos < n_packets && n_iovs < std::size(iovs))
+        {
+            auto const& lead = *packets[pos];
+            auto& msg = msgs[n_msgs];
+            msg = {};
+            msg.msg_hdr.msg_name = const_cast<sockaddr_storage*>(&lead.to);
+            msg.msg_hdr.msg_namelen = lead.tolen;
+            msg.msg_hdr.msg_iov = &iovs[n_iovs];
+            first_packet[n_msgs] = pos;
+
+            // how many packets can be coalesced into this message?
+            auto n_segments = size_t{ 1U };
+#ifdef TR_UDP_GSO
+            if (gso_supported_)
+            {
+                // GSO splits the buffer into lead.len-sized datagrams,
+                // so all but the last segment have to be that size
+                while (n_segments < MaxGsoSegments && (n_segments + 1U) * lead.len <= MaxGsoBytes &&
+                       pos + n_segments < n_packets && n_iovs + n_segments < std::size(iovs))
+                {
+                    auto const& next = *packets[pos + n_segments];
+                    if (!SameDestination(lead, next) || next.len > lead.len)
+                    {
+                        break;
+                    }
+
+                    ++n_segments;
+
+                    if (next.len < lead.len)
+                    {
+                        break;
+                    }
+                }
+            }
+#endif
+
+            for (size_t i = 0; i < n_segments; ++i)
+            {
+                auto const& packet = *packets[pos + i];
+                iovs[n_iovs++] = { &outbox_bytes_[packet.offset], packet.len };
+            }
+            msg.msg_hdr.msg_iovlen = n_segments;
+
+#ifdef TR_UDP_GSO
+            if (n_segments > 1U)
+            {
+                msg.msg_hdr.msg_control = std::data(controls[n_msgs]);
+                msg.msg_hdr.msg_controllen = ControlSize;
+                auto* const cmsg = CMSG_FIRSTHDR(&msg.msg_hdr);
+                cmsg->cmsg_level = IPPROTO_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                auto const segment_size = static_cast<uint16_t>(lead.len);
+                std::memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+            }
+#endif
+
+            pos += n_segments;
+            ++n_msgs;
+        }
+        first_packet[n_msgs] = pos;
+
+        // send it
+        auto n_sent = size_t{};
+        while (n_sent < n_msgs)
+        {
+            auto const rc = sendmmsg(sock, &msgs[n_sent], n_msgs - n_sent, 0);
+            if (rc > 0)
+            {
+                n_sent += rc;
+                continue;
+            }
+
+            auto const err = errno;
+            if (err == EINTR)
+            {
+                continue;
+            }
+
+            if (err == ENOSYS)
+            {
+                // no sendmmsg(); send the rest of the batch one at a time
+                mmsg_supported_ = false;
+                pos = first_packet[n_sent];
+                break;
+            }
+
+            // sendmmsg() only reports the first message's error.
+            // Send that message's packets one at a time to log why
+            // it failed, or to get them out without GSO if that's
+            // what the kernel or NIC didn't like.
+            if (msgs[n_sent].msg_hdr.msg_iovlen > 1U && !isTransientSendError(err))
+            {
+                tr_logAddDebug(fmt::format("Disabling UDP GSO: {} ({})", tr_strerror(err), err));
+                gso_supported_ = false;
+            }
+
+            for (auto i = first_packet[n_sent]; i < first_packet[n_sent + 1]; ++i)
+            {
+                send_one(*packets[i]);
+            }
+            ++n_sent;
+        }
+    }
+
+    n_packets -= pos;
+    packets += pos;
+#endif
+
+    for (size_t i = 0; i < n_packets; ++i)
+    {
+        send_one(*packets[i]);
+    }
+}
+
+void tr_session::tr_udp_core::sendOne(tr_socket_t sock, void const* buf, size_t buflen, sockaddr const* to, socklen_t tolen)
+    const
+{
+    if (sock != TR_BAD_SOCKET && ::sendto(sock, static_cast<char const*>(buf), buflen, 0, to, tolen) != -1)
     {
         return;
     }
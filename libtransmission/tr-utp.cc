@@ -57,6 +57,10 @@ bool tr_utpPacket(
     return false;
 }
 
+void tr_utpSocketDrained(tr_session* /*ss*/)
+{
+}
+
 struct UTPSocket* utp_create_socket(struct_utp_context* /*ctx*/)
 {
     return nullptr;
@@ -172,6 +176,7 @@ void reset_timer(tr_session* session)
 void timer_callback(void* vsession)
 {
     auto* session = static_cast<tr_session*>(vsession);
+    auto const timer = session->perfStats().time("utp.timer"sv);
 
     /* utp_internal.cpp says "Should be called each time the UDP socket is drained" but it's tricky with libevent */
     utp_issue_deferred_acks(session->utp_context);
@@ -218,12 +223,15 @@ bool tr_utpPacket(unsigned char const* buf, size_t buflen, struct sockaddr const
         reset_timer(ss);
     }
 
-    auto const ret = utp_process_udp(ss->utp_context, buf, buflen, from, fromlen);
-
-    /* utp_internal.cpp says "Should be called each time the UDP socket is drained" but it's tricky with libevent */
-    utp_issue_deferred_acks(ss->utp_context);
+    return utp_process_udp(ss->utp_context, buf, buflen, from, fromlen) != 0;
+}
 
-    return ret != 0;
+void tr_utpSocketDrained(tr_session* ss)
+{
+    if (ss->utp_context != nullptr)
+    {
+        utp_issue_deferred_acks(ss->utp_context);
+    }
 }
 
 void tr_utpClose(tr_session* session)
@@ -462,6 +462,9 @@ void tr_sessionSetLPDEnabled(tr_session* session, bool is_enabled);
 size_t tr_sessionGetCacheLimit_MB(tr_session const* session);
 void tr_sessionSetCacheLimit_MB(tr_session* session, size_t mb);
 
+size_t tr_sessionGetReadCacheLimit_MB(tr_session const* session);
+void tr_sessionSetReadCacheLimit_MB(tr_session* session, size_t mb);
+
 tr_encryption_mode tr_sessionGetEncryption(tr_session const* session);
 void tr_sessionSetEncryption(tr_session* session, tr_encryption_mode mode);
 
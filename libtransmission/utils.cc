@@ -19,6 +19,7 @@
 #include <set>
 #include <string>
 #include <string_view>
+#include <utility> // std::exchange()
 #include <vector>
 
 #ifdef _WIN32
@@ -29,7 +30,7 @@
 #endif
 
 #ifndef _WIN32
-#include <sys/stat.h> // mode_t
+#include <sys/stat.h> // mode_t, stat()
 #endif
 
 #define UTF_CPP_CPLUSPLUS 201703L
@@ -115,6 +116,98 @@ bool tr_loadFile(std::string_view filename, std::vector<char>& contents, tr_erro
     return true;
 }
 
+tr_mapped_file::tr_mapped_file(tr_mapped_file&& that) noexcept
+    : data_{ std::exchange(that.data_, nullptr) }
+    , size_{ std::exchange(that.size_, 0U) }
+{
+}
+
+tr_mapped_file& tr_mapped_file::operator=(tr_mapped_file&& that) noexcept
+{
+    if (this != &that)
+    {
+        reset();
+        data_ = std::exchange(that.data_, nullptr);
+        size_ = std::exchange(that.size_, 0U);
+    }
+
+    return *this;
+}
+
+tr_mapped_file::~tr_mapped_file()
+{
+    reset();
+}
+
+void tr_mapped_file::reset() noexcept
+{
+    if (data_ != nullptr)
+    {
+        tr_sys_file_unmap(data_, size_);
+    }
+
+    data_ = nullptr;
+    size_ = 0U;
+}
+
+bool tr_mapped_file::load(std::string_view filename, tr_error** error)
+{
+    reset();
+
+    auto const szfilename = tr_pathbuf{ filename };
+    auto const log_error = [&filename](tr_error const* err)
+    {
+        tr_logAddError(fmt::format(
+            _("Couldn't read '{path}': {error} ({error_code})"),
+            fmt::arg("path", filename),
+            fmt::arg("error", err->message),
+            fmt::arg("error_code", err->code)));
+    };
+
+    tr_error* my_error = nullptr;
+    auto const info = tr_sys_path_get_info(szfilename, 0, &my_error);
+    if (my_error != nullptr)
+    {
+        log_error(my_error);
+        tr_error_propagate(error, &my_error);
+        return false;
+    }
+
+    if (!info || !info->isFile())
+    {
+        tr_logAddError(fmt::format(_("Couldn't read '{path}': Not a regular file"), fmt::arg("path", filename)));
+        tr_error_set(error, TR_ERROR_EISDIR, "Not a regular file"sv);
+        return false;
+    }
+
+    // there's nothing to map
+    if (info->size == 0U)
+    {
+        return true;
+    }
+
+    auto const fd = tr_sys_file_open(szfilename, TR_SYS_FILE_READ, 0, &my_error);
+    if (fd == TR_BAD_SYS_FILE)
+    {
+        log_error(my_error);
+        tr_error_propagate(error, &my_error);
+        return false;
+    }
+
+    // the mapping stays valid after the file is closed
+    data_ = tr_sys_file_map_for_reading(fd, 0, info->size, &my_error);
+    tr_sys_file_close(fd);
+    if (data_ == nullptr)
+    {
+        log_error(my_error);
+        tr_error_propagate(error, &my_error);
+        return false;
+    }
+
+    size_ = info->size;
+    return true;
+}
+
 bool tr_saveFile(std::string_view filename, std::string_view contents, tr_error** error)
 {
     // follow symlinks to find the "real" file, to make sure the temporary
@@ -577,6 +670,31 @@ bool tr_moveFile(std::string_view oldpath_in, std::string_view newpath_in, tr_er
     return true;
 }
 
+std::string tr_deviceKey(std::string_view path)
+{
+#ifdef _WIN32
+    // the drive letter or UNC share is close enough
+    if (std::size(path) >= 2U && path[1] == ':')
+    {
+        return { static_cast<char>(toupper(path.front())), ':' };
+    }
+
+    if (auto const is_unc = path.substr(0, 2) == "\\\\" || path.substr(0, 2) == "//"; is_unc)
+    {
+        auto const server_end = path.find_first_of("\\/", 2);
+        auto const share_end = server_end == std::string_view::npos ? server_end : path.find_first_of("\\/", server_end + 1);
+        return std::string{ path.substr(0, share_end) };
+    }
+#else
+    if (struct stat sb = {}; stat(tr_pathbuf{ path }, &sb) == 0)
+    {
+        return std::to_string(sb.st_dev);
+    }
+#endif
+
+    return std::string{ path };
+}
+
 // ---
 
 uint64_t tr_htonll(uint64_t hostlonglong)
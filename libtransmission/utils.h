@@ -68,6 +68,35 @@ struct tr_error;
 
 bool tr_loadFile(std::string_view filename, std::vector<char>& contents, tr_error** error = nullptr);
 
+/**
+ * A read-only view of a file's contents. The file is memory-mapped rather
+ * than read, so that it can be parsed in place without copying it first.
+ */
+class tr_mapped_file
+{
+public:
+    tr_mapped_file() noexcept = default;
+    tr_mapped_file(tr_mapped_file&& that) noexcept;
+    tr_mapped_file& operator=(tr_mapped_file&& that) noexcept;
+    tr_mapped_file(tr_mapped_file const&) = delete;
+    tr_mapped_file& operator=(tr_mapped_file const&) = delete;
+    ~tr_mapped_file();
+
+    bool load(std::string_view filename, tr_error** error = nullptr);
+
+    // Only valid for as long as this object is.
+    [[nodiscard]] constexpr std::string_view sv() const noexcept
+    {
+        return { static_cast<char const*>(data_), size_ };
+    }
+
+private:
+    void reset() noexcept;
+
+    void const* data_ = nullptr;
+    size_t size_ = 0U;
+};
+
 bool tr_saveFile(std::string_view filename, std::string_view contents, tr_error** error = nullptr);
 
 template<typename ContiguousRange>
@@ -261,6 +290,12 @@ size_t tr_strvToBuf(std::string_view src, char* buf, size_t buflen);
  */
 bool tr_moveFile(std::string_view oldpath, std::string_view newpath, struct tr_error** error = nullptr);
 
+/**
+ * @return a key that's the same for all paths on the same device,
+ * e.g. to limit how many tasks at once read or write to one disk
+ */
+[[nodiscard]] std::string tr_deviceKey(std::string_view path);
+
 // ---
 
 namespace libtransmission::detail::tr_time
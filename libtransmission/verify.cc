@@ -4,10 +4,13 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <chrono>
 #include <ctime>
+#include <memory>
 #include <mutex>
-#include <optional>
 #include <set>
+#include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
 
@@ -19,20 +22,12 @@
 #include "crypto-utils.h"
 #include "file.h"
 #include "log.h"
+#include "sha1-batch.h"
 #include "torrent.h"
 #include "tr-assert.h"
-#include "utils.h" // tr_time(), tr_wait()
+#include "utils.h" // tr_time()
 #include "verify.h"
 
-using namespace std::chrono_literals;
-
-namespace
-{
-
-auto constexpr SleepPerSecondDuringVerify = 100ms;
-
-}
-
 int tr_verify_worker::Node::compare(tr_verify_worker::Node const& that) const
 {
     // higher priority comes before lower priority
@@ -58,34 +53,98 @@ int tr_verify_worker::Node::compare(tr_verify_worker::Node const& that) const
     return 0;
 }
 
+void tr_verify_worker::throttle(uint64_t n_bytes)
+{
+    auto const bytes_per_second = speed_limit_bytes_per_second_.load();
+    if (bytes_per_second == 0U)
+    {
+        return;
+    }
+
+    // reserve the next free slot in the schedule, then wait for it
+    auto const read_duration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>{ static_cast<double>(n_bytes) / bytes_per_second });
+    auto read_at = std::chrono::steady_clock::time_point{};
+    {
+        auto const lock = std::lock_guard(throttle_mutex_);
+        read_at = std::max(next_read_at_, std::chrono::steady_clock::now());
+        next_read_at_ = read_at + read_duration;
+    }
+
+    std::this_thread::sleep_until(read_at);
+}
+
 bool tr_verify_worker::verifyTorrent(tr_torrent* tor, std::atomic<bool> const& stop_flag)
 {
+    // how much of the torrent to hold in memory at once for hashing
+    static auto constexpr MaxBatchBytes = uint64_t{ 1024 * 1024 * 32 };
+    static auto constexpr ReadSize = uint64_t{ 1024 * 256 };
+
     auto const begin = tr_time();
 
     tr_sys_file_t fd = TR_BAD_SYS_FILE;
     uint64_t file_pos = 0;
     bool changed = false;
-    bool had_piece = false;
-    time_t last_slept_at = 0;
     uint32_t piece_pos = 0;
     tr_file_index_t file_index = 0;
     tr_file_index_t prev_file_index = ~file_index;
     tr_piece_index_t piece = 0;
-    auto buffer = std::vector<std::byte>(1024 * 256);
-    auto sha = tr_sha1::create();
 
-    tr_logAddDebugTor(tor, "verifying torrent...");
+    // When the engine can hash several pieces at once, pieces are read whole
+    // into `buffer`, one slot per piece, and hashed a batch at a time.
+    // Otherwise, or if only one piece fits in a batch, each piece is
+    // streamed through tr_sha1 in small reads.
+    auto engine = tr_sha1_best_engine();
+    auto const slot_size = uint64_t{ tor->pieceSize() };
+    auto const batch_size = std::clamp(MaxBatchBytes / slot_size, uint64_t{ 1U }, uint64_t{ tr_sha1_batch_size(engine) });
+    auto const is_streaming = batch_size == 1U;
+    if (is_streaming)
+    {
+        engine = tr_sha1_engine::Backend;
+    }
 
-    while (!stop_flag && piece < tor->pieceCount())
+    auto buffer = std::vector<std::byte>(is_streaming ? ReadSize : batch_size * slot_size);
+    auto sha = is_streaming ? tr_sha1::create() : std::unique_ptr<tr_sha1>{};
+    auto batch = std::vector<std::string_view>{};
+    batch.reserve(batch_size);
+    auto batch_begin = tr_piece_index_t{ 0 };
+    auto* piece_end = std::data(buffer);
+
+    auto const check_piece = [&](tr_piece_index_t checked, tr_sha1_digest_t const& hash)
     {
-        auto const file_length = tor->fileSize(file_index);
+        auto const had_piece = tor->hasPiece(checked);
+        if (auto const has_piece = hash == tor->pieceHash(checked); has_piece || had_piece)
+        {
+            tor->setHasPiece(checked, has_piece);
+            changed |= has_piece != had_piece;
+        }
+
+        tor->checked_pieces_.set(checked, true);
+    };
+
+    auto const check_batch = [&]()
+    {
+        auto const hashes = tr_sha1_digest_many(batch, engine);
 
-        /* if we're starting a new piece... */
-        if (piece_pos == 0)
+        for (size_t i = 0, n = std::size(batch); i < n; ++i)
         {
-            had_piece = tor->hasPiece(piece);
+            check_piece(static_cast<tr_piece_index_t>(batch_begin + i), hashes[i]);
         }
 
+        tor->markChanged();
+
+        batch_begin += std::size(batch);
+        tor->setVerifyProgress(batch_begin / float(tor->pieceCount()));
+        batch.clear();
+        piece_end = std::data(buffer);
+    };
+
+    tr_logAddDebugTor(tor, fmt::format("verifying torrent with {} SHA-1...", tr_sha1_engine_name(engine)));
+
+    while (!stop_flag && piece < tor->pieceCount())
+    {
+        auto const file_length = tor->fileSize(file_index);
+
         /* if we're starting a new file... */
         if (file_pos == 0 && fd == TR_BAD_SYS_FILE && file_index != prev_file_index)
         {
@@ -98,16 +157,28 @@ bool tr_verify_worker::verifyTorrent(tr_torrent* tor, std::atomic<bool> const& s
         uint64_t left_in_piece = tor->pieceSize(piece) - piece_pos;
         uint64_t left_in_file = file_length - file_pos;
         uint64_t bytes_this_pass = std::min(left_in_file, left_in_piece);
-        bytes_this_pass = std::min(bytes_this_pass, uint64_t(std::size(buffer)));
+        bytes_this_pass = std::min(bytes_this_pass, ReadSize);
 
         /* read a bit */
         if (fd != TR_BAD_SYS_FILE)
         {
+            throttle(bytes_this_pass);
+
+            // Bytes that can't be read are left out of the piece rather
+            // than zero-filled, so that the piece can't pass its check.
+            auto* const dest = is_streaming ? std::data(buffer) : piece_end;
             auto num_read = uint64_t{};
-            if (tr_sys_file_read_at(fd, std::data(buffer), bytes_this_pass, file_pos, &num_read) && num_read > 0)
+            if (tr_sys_file_read_at(fd, dest, bytes_this_pass, file_pos, &num_read) && num_read > 0)
             {
                 bytes_this_pass = num_read;
-                sha->add(std::data(buffer), bytes_this_pass);
+                if (is_streaming)
+                {
+                    sha->add(dest, num_read);
+                }
+                else
+                {
+                    piece_end += num_read;
+                }
                 tr_sys_file_advise(fd, file_pos, bytes_this_pass, TR_SYS_FILE_ADVICE_DONT_NEED);
             }
         }
@@ -119,30 +190,32 @@ bool tr_verify_worker::verifyTorrent(tr_torrent* tor, std::atomic<bool> const& s
         file_pos += bytes_this_pass;
 
         /* if we're finishing a piece... */
-        if (left_in_piece == 0)
+        if (left_in_piece == 0 && is_streaming)
         {
-            if (auto const has_piece = sha->finish() == tor->pieceHash(piece); has_piece || had_piece)
-            {
-                tor->setHasPiece(piece, has_piece);
-                changed |= has_piece != had_piece;
-            }
-
-            tor->checked_pieces_.set(piece, true);
+            check_piece(piece, sha->finish());
             tor->markChanged();
 
-            /* sleeping even just a few msec per second goes a long
-             * way towards reducing IO load... */
-            if (auto const now = tr_time(); last_slept_at != now)
-            {
-                last_slept_at = now;
-                tr_wait(SleepPerSecondDuringVerify);
-            }
-
             sha->clear();
             ++piece;
             tor->setVerifyProgress(piece / float(tor->pieceCount()));
             piece_pos = 0;
         }
+        else if (left_in_piece == 0)
+        {
+            auto* const slot = std::data(buffer) + std::size(batch) * slot_size;
+            batch.emplace_back(reinterpret_cast<char const*>(slot), piece_end - slot);
+            ++piece;
+            piece_pos = 0;
+
+            if (std::size(batch) == batch_size || piece == tor->pieceCount())
+            {
+                check_batch();
+            }
+            else
+            {
+                piece_end = slot + slot_size;
+            }
+        }
 
         /* if we're finishing a file... */
         if (left_in_file == 0)
@@ -177,44 +250,73 @@ bool tr_verify_worker::verifyTorrent(tr_torrent* tor, std::atomic<bool> const& s
     return changed;
 }
 
-void tr_verify_worker::verifyThreadFunc()
+std::set<tr_verify_worker::Node>::iterator tr_verify_worker::nextTodo()
 {
-    for (;;)
+    // the highest-priority torrent whose device isn't already busy
+    return std::find_if(
+        std::begin(todo_),
+        std::end(todo_),
+        [this](auto const& node) { return countActive(node.device) < max_threads_per_device_; });
+}
+
+size_t tr_verify_worker::countActive(std::string const& device) const
+{
+    return std::count_if(
+        std::begin(active_),
+        std::end(active_),
+        [&device](auto const& active) { return active.node.device == device; });
+}
+
+void tr_verify_worker::startThreads()
+{
+    // Start one thread at a time. When it takes a torrent,
+    // it calls this again in case there's more work to share.
+    auto const n_idle = n_threads_ - std::size(active_);
+    if (stopping_ || n_idle > 0U || n_threads_ >= max_threads_ || nextTodo() == std::end(todo_))
     {
-        {
-            auto const lock = std::lock_guard(verify_mutex_);
+        return;
+    }
 
-            if (stop_current_)
-            {
-                stop_current_ = false;
-                stop_current_cv_.notify_one();
-            }
+    ++n_threads_;
+    std::thread(&tr_verify_worker::verifyThreadFunc, this).detach();
+}
 
-            if (std::empty(todo_))
-            {
-                current_node_.reset();
-                verify_thread_id_.reset();
-                return;
-            }
+void tr_verify_worker::verifyThreadFunc()
+{
+    auto lock = std::unique_lock(verify_mutex_);
 
-            auto const it = std::begin(todo_);
-            current_node_ = *it;
-            todo_.erase(it);
+    for (;;)
+    {
+        auto const it = stopping_ ? std::end(todo_) : nextTodo();
+        if (it == std::end(todo_))
+        {
+            --n_threads_;
+            done_cv_.notify_all();
+            return;
         }
 
-        auto* const tor = current_node_->torrent;
+        auto& active = active_.emplace_back(*it);
+        todo_.erase(it);
+        startThreads();
+        lock.unlock();
+
+        auto* const tor = active.node.torrent;
         tr_logAddTraceTor(tor, "Verifying torrent");
         tor->setVerifyState(TR_VERIFY_NOW);
-        auto const changed = verifyTorrent(tor, stop_current_);
+        auto const changed = verifyTorrent(tor, active.stop);
         tor->setVerifyState(TR_VERIFY_NONE);
         TR_ASSERT(tr_isTorrent(tor));
 
-        if (!stop_current_ && changed)
+        if (!active.stop && changed)
         {
             tor->setDirty();
         }
 
-        callCallback(tor, stop_current_);
+        callCallback(tor, active.stop);
+
+        lock.lock();
+        active_.remove_if([&active](auto const& candidate) { return &candidate == &active; });
+        done_cv_.notify_all();
     }
 }
 
@@ -226,17 +328,12 @@ void tr_verify_worker::add(tr_torrent* tor)
     auto node = Node{};
     node.torrent = tor;
     node.current_size = tor->hasTotal();
+    node.device = device_key_(tor->currentDir().sv());
 
     auto const lock = std::lock_guard(verify_mutex_);
     tor->setVerifyState(TR_VERIFY_WAIT);
-    todo_.insert(node);
-
-    if (!verify_thread_id_)
-    {
-        auto thread = std::thread(&tr_verify_worker::verifyThreadFunc, this);
-        verify_thread_id_ = thread.get_id();
-        thread.detach();
-    }
+    todo_.insert(std::move(node));
+    startThreads();
 }
 
 void tr_verify_worker::remove(tr_torrent* tor)
@@ -245,10 +342,22 @@ void tr_verify_worker::remove(tr_torrent* tor)
 
     auto lock = std::unique_lock(verify_mutex_);
 
-    if (current_node_ && current_node_->torrent == tor)
+    auto const is_active = [this, tor]()
     {
-        stop_current_ = true;
-        stop_current_cv_.wait(lock, [this]() { return !stop_current_; });
+        return std::any_of(
+            std::begin(active_),
+            std::end(active_),
+            [tor](auto const& active) { return active.node.torrent == tor; });
+    };
+
+    if (auto active = std::find_if(
+            std::begin(active_),
+            std::end(active_),
+            [tor](auto const& candidate) { return candidate.node.torrent == tor; });
+        active != std::end(active_))
+    {
+        active->stop = true;
+        done_cv_.wait(lock, [&is_active]() { return !is_active(); });
     }
     else
     {
@@ -267,16 +376,29 @@ void tr_verify_worker::remove(tr_torrent* tor)
     }
 }
 
+void tr_verify_worker::setMaxThreads(size_t n_threads)
+{
+    auto const lock = std::lock_guard(verify_mutex_);
+    max_threads_ = std::max(n_threads, size_t{ 1U });
+    startThreads();
+}
+
+void tr_verify_worker::setMaxThreadsPerDevice(size_t n_threads)
+{
+    auto const lock = std::lock_guard(verify_mutex_);
+    max_threads_per_device_ = std::max(n_threads, size_t{ 1U });
+    startThreads();
+}
+
 tr_verify_worker::~tr_verify_worker()
 {
+    auto lock = std::unique_lock(verify_mutex_);
+    stopping_ = true;
+    todo_.clear();
+    for (auto& active : active_)
     {
-        auto const lock = std::lock_guard(verify_mutex_);
-        stop_current_ = true;
-        todo_.clear();
+        active.stop = true;
     }
 
-    while (verify_thread_id_.has_value())
-    {
-        tr_wait(20ms);
-    }
+    done_cv_.wait(lock, [this]() { return n_threads_ == 0U; });
 }
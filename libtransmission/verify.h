@@ -10,23 +10,45 @@
 #endif
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef> // size_t
 #include <cstdint>
 #include <functional>
 #include <list>
 #include <mutex>
-#include <optional>
 #include <set>
-#include <thread>
+#include <string>
+#include <string_view>
+
+#include "utils.h" // tr_deviceKey()
 
 struct tr_session;
 struct tr_torrent;
 
+// Verifies torrents' local data against their piece hashes.
+//
+// Several torrents can be verified at once on a small pool of threads.
+// Torrents whose data is on the same device compete for the same disk,
+// so the number of torrents verified at once on any one device is capped
+// separately. An optional speed limit is shared by all the threads.
 class tr_verify_worker
 {
 public:
     using callback_func = std::function<void(tr_torrent*, bool aborted)>;
 
+    static auto constexpr DefaultMaxThreads = size_t{ 4U };
+    static auto constexpr DefaultMaxThreadsPerDevice = size_t{ 1U };
+
+    // Tells which device a path is on. Tests can use a fake one
+    // to verify torrents as if they were on different devices.
+    using device_key_func = std::string (*)(std::string_view path);
+
+    explicit tr_verify_worker(device_key_func device_key = tr_deviceKey)
+        : device_key_{ device_key }
+    {
+    }
+
     ~tr_verify_worker();
 
     void addCallback(callback_func callback)
@@ -38,11 +60,24 @@ public:
 
     void remove(tr_torrent* tor);
 
+    // how many torrents can be verified at once
+    void setMaxThreads(size_t n_threads);
+
+    // how many torrents on the same device can be verified at once
+    void setMaxThreadsPerDevice(size_t n_threads);
+
+    // cap how fast all the threads combined read from disk; 0 means no limit
+    void setSpeedLimitBytesPerSecond(uint64_t bytes_per_second) noexcept
+    {
+        speed_limit_bytes_per_second_ = bytes_per_second;
+    }
+
 private:
     struct Node
     {
         tr_torrent* torrent = nullptr;
         uint64_t current_size = 0;
+        std::string device;
 
         [[nodiscard]] int compare(Node const& that) const;
 
@@ -52,6 +87,18 @@ private:
         }
     };
 
+    // a torrent that's being verified right now
+    struct Active
+    {
+        explicit Active(Node node_in)
+            : node{ std::move(node_in) }
+        {
+        }
+
+        Node node;
+        std::atomic<bool> stop = false;
+    };
+
     void callCallback(tr_torrent* tor, bool aborted) const
     {
         for (auto const& callback : callbacks_)
@@ -60,17 +107,32 @@ private:
         }
     }
 
+    void startThreads();
     void verifyThreadFunc();
-    [[nodiscard]] static bool verifyTorrent(tr_torrent* tor, std::atomic<bool> const& stop_flag);
+    [[nodiscard]] std::set<Node>::iterator nextTodo();
+    [[nodiscard]] size_t countActive(std::string const& device) const;
+    [[nodiscard]] bool verifyTorrent(tr_torrent* tor, std::atomic<bool> const& stop_flag);
+
+    // sleep as long as needed to read `n_bytes` without exceeding the speed limit
+    void throttle(uint64_t n_bytes);
+
+    device_key_func const device_key_;
 
     std::list<callback_func> callbacks_;
     std::mutex verify_mutex_;
 
     std::set<Node> todo_;
-    std::optional<Node> current_node_;
+    std::list<Active> active_;
+
+    size_t max_threads_ = DefaultMaxThreads;
+    size_t max_threads_per_device_ = DefaultMaxThreadsPerDevice;
+    size_t n_threads_ = 0;
+    bool stopping_ = false;
 
-    std::optional<std::thread::id> verify_thread_id_;
+    // notified when an active torrent finishes or a thread exits
+    std::condition_variable done_cv_;
 
-    std::atomic<bool> stop_current_ = false;
-    std::condition_variable stop_current_cv_;
+    std::atomic<uint64_t> speed_limit_bytes_per_second_ = 0;
+    std::mutex throttle_mutex_;
+    std::chrono::steady_clock::time_point next_read_at_ = {};
 };
@@ -0,0 +1,214 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#endif
+
+#include <event2/util.h>
+
+#include <benchmark/benchmark.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/bandwidth.h>
+#include <libtransmission/net.h>
+#include <libtransmission/peer-io.h>
+#include <libtransmission/peer-socket.h>
+
+#include "bench-fixtures.h"
+
+#ifdef _WIN32
+#define LOCAL_SOCKETPAIR_AF AF_INET
+#else
+#define LOCAL_SOCKETPAIR_AF AF_UNIX
+#endif
+
+namespace libtransmission::bench
+{
+namespace
+{
+
+// Torrents of peers under one bandwidth root. Each peer is connected
+// over a socketpair to a remote end that just swallows what it's sent.
+class SyntheticSwarm
+{
+public:
+    SyntheticSwarm(tr_session* session, size_t n_torrents, size_t n_peers)
+    {
+        static auto constexpr Priorities = std::array<tr_priority_t, 3>{ TR_PRI_LOW, TR_PRI_NORMAL, TR_PRI_HIGH };
+
+        for (size_t i = 0; i < n_torrents; ++i)
+        {
+            auto& torrent = torrents_.emplace_back(std::make_unique<tr_bandwidth>(&top_));
+            torrent->setPriority(Priorities[i % std::size(Priorities)]);
+        }
+
+        auto const addr = *tr_address::from_string("127.0.0.1"sv);
+        auto const port = tr_port::fromHost(51413);
+        peers_.reserve(n_peers);
+        for (size_t i = 0; i < n_peers; ++i)
+        {
+            auto sockpair = std::array<evutil_socket_t, 2>{ TR_BAD_SOCKET, TR_BAD_SOCKET };
+            if (evutil_socketpair(LOCAL_SOCKETPAIR_AF, SOCK_STREAM, 0, std::data(sockpair)) != 0)
+            {
+                break;
+            }
+
+            evutil_make_socket_nonblocking(sockpair[0]);
+            evutil_make_socket_nonblocking(sockpair[1]);
+
+            auto const& parent = torrents_[i % std::size(torrents_)];
+            auto& peer = peers_.emplace_back();
+            peer.io = tr_peerIo::new_incoming(session, parent.get(), tr_peer_socket{ session, addr, port, sockpair[0] });
+            peer.io->set_callbacks(nullptr, &SyntheticSwarm::onDidWrite, nullptr, &peer);
+            peer.remote = sockpair[1];
+        }
+    }
+
+    SyntheticSwarm(SyntheticSwarm&&) = delete;
+    SyntheticSwarm(SyntheticSwarm const&) = delete;
+    SyntheticSwarm& operator=(SyntheticSwarm&&) = delete;
+    SyntheticSwarm& operator=(SyntheticSwarm const&) = delete;
+
+    ~SyntheticSwarm()
+    {
+        for (auto& peer : peers_)
+        {
+            peer.io.reset();
+            evutil_closesocket(peer.remote);
+        }
+    }
+
+    [[nodiscard]] constexpr auto& top() noexcept
+    {
+        return top_;
+    }
+
+    [[nodiscard]] auto size() const noexcept
+    {
+        return std::size(peers_);
+    }
+
+    // Top up each peer's outbuf to `n_bytes` of piece data.
+    void queue(size_t n_bytes)
+    {
+        static auto const payload = std::vector<char>(16384U, 'x');
+
+        for (auto& peer : peers_)
+        {
+            while (peer.pending < n_bytes)
+            {
+                peer.io->write_bytes(std::data(payload), std::size(payload), true);
+                peer.pending += std::size(payload);
+            }
+        }
+    }
+
+    // @return the number of bytes that the remote ends received
+    size_t drain()
+    {
+        auto buf = std::array<char, 65536U>{};
+        auto n_bytes = size_t{};
+
+        for (auto const& peer : peers_)
+        {
+            for (;;)
+            {
+                auto const n_read = recv(peer.remote, std::data(buf), std::size(buf), 0);
+                if (n_read <= 0)
+                {
+                    break;
+                }
+
+                n_bytes += static_cast<size_t>(n_read);
+            }
+        }
+
+        return n_bytes;
+    }
+
+private:
+    struct Peer
+    {
+        std::shared_ptr<tr_peerIo> io;
+        evutil_socket_t remote = TR_BAD_SOCKET;
+        size_t pending = 0U; // bytes queued but not yet written
+    };
+
+    static void onDidWrite(tr_peerIo* /*io*/, size_t bytes_written, bool /*was_piece_data*/, void* vpeer)
+    {
+        auto& pending = static_cast<Peer*>(vpeer)->pending;
+        pending -= std::min(pending, bytes_written);
+    }
+
+    tr_bandwidth top_;
+    std::vector<std::unique_ptr<tr_bandwidth>> torrents_;
+    std::vector<Peer> peers_;
+};
+
+// One bandwidth pulse over a swarm of peers that all want to upload.
+// The arguments are the number of peers and an upload limit in KiB/s,
+// where 0 means unlimited.
+void BM_BandwidthAllocate(benchmark::State& state)
+{
+    static auto constexpr PeriodMsec = 500U;
+    static auto constexpr BytesPerPeer = size_t{ 32768U };
+    static auto constexpr NumTorrents = size_t{ 16U };
+
+    auto& bench = BenchSession::instance();
+    auto const n_peers = static_cast<size_t>(state.range(0));
+    auto const limit_kbps = state.range(1);
+
+    auto swarm = std::unique_ptr<SyntheticSwarm>{};
+    bench.runInSessionThread(
+        [&]()
+        {
+            swarm = std::make_unique<SyntheticSwarm>(bench.session(), NumTorrents, n_peers);
+            swarm->top().setLimited(TR_UP, limit_kbps != 0);
+            swarm->top().setDesiredSpeedBytesPerSecond(TR_UP, limit_kbps * 1024);
+        });
+
+    if (swarm->size() < n_peers)
+    {
+        state.SkipWithError("couldn't create enough sockets");
+    }
+
+    auto n_bytes = size_t{};
+    for (auto _ : state)
+    {
+        bench.runInSessionThread(
+            [&]()
+            {
+                swarm->queue(BytesPerPeer);
+                swarm->top().allocate(PeriodMsec);
+                n_bytes += swarm->drain();
+            });
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * n_peers));
+    state.SetBytesProcessed(static_cast<int64_t>(n_bytes));
+
+    bench.runInSessionThread([&]() { swarm.reset(); });
+}
+
+BENCHMARK(BM_BandwidthAllocate)
+    ->Args({ 64, 0 })
+    ->Args({ 256, 0 })
+    ->Args({ 64, 1024 })
+    ->Args({ 256, 1024 })
+    ->Unit(benchmark::kMicrosecond);
+
+} // namespace
+} // namespace libtransmission::bench
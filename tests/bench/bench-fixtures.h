@@ -0,0 +1,169 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib> // getenv()
+#include <functional>
+#include <future>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <fmt/core.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/file.h>
+#include <libtransmission/log.h>
+#include <libtransmission/quark.h>
+#include <libtransmission/session.h>
+#include <libtransmission/torrent.h>
+#include <libtransmission/utils.h>
+#include <libtransmission/variant.h>
+
+namespace libtransmission::bench
+{
+
+using namespace std::literals;
+
+// A session that lives in a temporary directory,
+// for benchmarks that need real torrents and a real session thread.
+class BenchSession
+{
+public:
+    BenchSession()
+        : sandbox_dir_{ createSandbox() }
+    {
+        tr_formatter_mem_init(1024, "KiB", "MiB", "GiB", "TiB");
+        tr_formatter_size_init(1024, "KiB", "MiB", "GiB", "TiB");
+        tr_formatter_speed_init(1024, "KiB/s", "MiB/s", "GiB/s", "TiB/s");
+
+        auto const download_dir = tr_pathbuf{ sandbox_dir_, "/Downloads"sv };
+        tr_sys_dir_create(download_dir, TR_SYS_DIR_CREATE_PARENTS, 0700);
+
+        auto settings = tr_variant{};
+        tr_variantInitDict(&settings, 6);
+        tr_variantDictAddStr(&settings, TR_KEY_download_dir, download_dir);
+        tr_variantDictAddBool(&settings, TR_KEY_dht_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_lpd_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_port_forwarding_enabled, false);
+        tr_variantDictAddInt(&settings, TR_KEY_message_level, TR_LOG_ERROR);
+        session_ = tr_sessionInit(sandbox_dir_.c_str(), true, &settings);
+        tr_variantClear(&settings);
+    }
+
+    BenchSession(BenchSession&&) = delete;
+    BenchSession(BenchSession const&) = delete;
+    BenchSession& operator=(BenchSession&&) = delete;
+    BenchSession& operator=(BenchSession const&) = delete;
+
+    ~BenchSession()
+    {
+        tr_sessionClose(session_);
+        tr_logFreeQueue(tr_logGetQueue());
+        removeRecursive(sandbox_dir_);
+    }
+
+    // The session that all the benchmarks in this binary share,
+    // since libtransmission only expects one session per process.
+    static BenchSession& instance()
+    {
+        static auto bench_session = BenchSession{};
+        return bench_session;
+    }
+
+    [[nodiscard]] constexpr tr_session* session() noexcept
+    {
+        return session_;
+    }
+
+    // a scratch directory that's removed when the session is closed
+    [[nodiscard]] constexpr auto const& sandboxDir() const noexcept
+    {
+        return sandbox_dir_;
+    }
+
+    // Add a paused single-file torrent whose data doesn't exist yet.
+    // The piece hashes are bogus, so its pieces will never pass a check.
+    tr_torrent* addSyntheticTorrent(uint64_t total_size, uint32_t piece_size)
+    {
+        auto const n_pieces = (total_size + piece_size - 1U) / piece_size;
+        return addSyntheticTorrent(total_size, piece_size, std::string(n_pieces * 20U, '\0'));
+    }
+
+    // Add a paused single-file torrent whose data doesn't exist yet,
+    // given the concatenated SHA-1 hashes of its pieces.
+    tr_torrent* addSyntheticTorrent(uint64_t total_size, uint32_t piece_size, std::string_view pieces)
+    {
+        auto top = tr_variant{};
+        tr_variantInitDict(&top, 1);
+        auto* const info = tr_variantDictAddDict(&top, TR_KEY_info, 4);
+        tr_variantDictAddInt(info, TR_KEY_length, total_size);
+        tr_variantDictAddStrView(info, TR_KEY_name, fmt::format("synthetic-{:d}", ++n_torrents_));
+        tr_variantDictAddInt(info, TR_KEY_piece_length, piece_size);
+        tr_variantDictAddRaw(info, TR_KEY_pieces, std::data(pieces), std::size(pieces));
+        auto const benc = tr_variantToStr(&top, TR_VARIANT_FMT_BENC);
+        tr_variantClear(&top);
+
+        auto* const ctor = tr_ctorNew(session_);
+        tr_ctorSetMetainfo(ctor, std::data(benc), std::size(benc), nullptr);
+        tr_ctorSetPaused(ctor, TR_FORCE, true);
+        auto* const tor = tr_torrentNew(ctor, nullptr);
+        tr_ctorFree(ctor);
+        return tor;
+    }
+
+    // Run `func` in the session thread and wait for it to finish.
+    void runInSessionThread(std::function<void()> func)
+    {
+        auto promise = std::promise<void>{};
+        auto future = promise.get_future();
+        session_->runInSessionThread(
+            [&func, &promise]()
+            {
+                func();
+                promise.set_value();
+            });
+        future.wait();
+    }
+
+private:
+    static std::string createSandbox()
+    {
+        auto const* const tmpdir = getenv("TMPDIR");
+        auto path = fmt::format("{:s}/transmission-bench-XXXXXX", tmpdir != nullptr ? tmpdir : "/tmp");
+        tr_sys_dir_create_temp(std::data(path));
+        return path;
+    }
+
+    static void removeRecursive(std::string const& path)
+    {
+        if (auto const info = tr_sys_path_get_info(path); info && info->isFolder())
+        {
+            if (auto const odir = tr_sys_dir_open(path.c_str()); odir != TR_BAD_SYS_DIR)
+            {
+                for (char const* name = nullptr; (name = tr_sys_dir_read_name(odir)) != nullptr;)
+                {
+                    if ("."sv != name && ".."sv != name)
+                    {
+                        removeRecursive(fmt::format("{:s}/{:s}", path, name));
+                    }
+                }
+
+                tr_sys_dir_close(odir);
+            }
+        }
+
+        tr_sys_path_remove(path);
+    }
+
+    std::string const sandbox_dir_;
+    tr_session* session_ = nullptr;
+    int n_torrents_ = 0;
+};
+
+} // namespace libtransmission::bench
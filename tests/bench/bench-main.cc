@@ -0,0 +1,32 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/sha1-batch.h>
+#include <libtransmission/version.h>
+
+int main(int argc, char** argv)
+{
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+
+    // Recorded in the `context` section of --benchmark_format=json output,
+    // so that saved results can be matched up with the build that made them.
+    benchmark::AddCustomContext("transmission_version", LONG_VERSION_STRING);
+    benchmark::AddCustomContext("transmission_revision", VCS_REVISION);
+    benchmark::AddCustomContext("sha1_engine", std::string{ tr_sha1_engine_name(tr_sha1_best_engine()) });
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,126 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/bitfield.h>
+
+namespace libtransmission::bench
+{
+namespace
+{
+
+// what a peer's piece bitfield looks like partway through a download
+[[nodiscard]] tr_bitfield makeSparseBitfield(size_t bit_count, unsigned int seed)
+{
+    auto bitfield = tr_bitfield{ bit_count };
+    auto rng = std::mt19937{ seed };
+    for (size_t i = 0; i < bit_count; ++i)
+    {
+        if (rng() % 2U == 0U)
+        {
+            bitfield.set(i);
+        }
+    }
+    return bitfield;
+}
+
+// Marking blocks as received in random order.
+void BM_BitfieldSet(benchmark::State& state)
+{
+    auto const bit_count = static_cast<size_t>(state.range(0));
+    auto order = std::vector<size_t>(bit_count);
+    auto rng = std::mt19937{ 0U };
+    for (auto& bit : order)
+    {
+        bit = rng() % bit_count;
+    }
+
+    for (auto _ : state)
+    {
+        auto bitfield = tr_bitfield{ bit_count };
+        for (auto const bit : order)
+        {
+            bitfield.set(bit);
+        }
+        benchmark::DoNotOptimize(bitfield.count());
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * bit_count));
+}
+
+// Marking whole pieces' worth of blocks at once, e.g. after a verify.
+void BM_BitfieldSetSpan(benchmark::State& state)
+{
+    static auto constexpr SpanSize = size_t{ 64U };
+
+    auto const bit_count = static_cast<size_t>(state.range(0));
+
+    for (auto _ : state)
+    {
+        auto bitfield = tr_bitfield{ bit_count };
+        for (size_t begin = 0; begin < bit_count; begin += SpanSize * 2U)
+        {
+            bitfield.setSpan(begin, std::min(begin + SpanSize, bit_count));
+        }
+        benchmark::DoNotOptimize(bitfield.count());
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * bit_count / 2U));
+}
+
+// Counting how many of a piece's blocks we have.
+void BM_BitfieldCountRange(benchmark::State& state)
+{
+    static auto constexpr SpanSize = size_t{ 64U };
+
+    auto const bit_count = static_cast<size_t>(state.range(0));
+    auto const bitfield = makeSparseBitfield(bit_count, 0U);
+
+    for (auto _ : state)
+    {
+        auto total = size_t{};
+        for (size_t begin = 0; begin < bit_count; begin += SpanSize)
+        {
+            total += bitfield.count(begin, std::min(begin + SpanSize, bit_count));
+        }
+        benchmark::DoNotOptimize(total);
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * bit_count));
+}
+
+// Merging peers' bitfields, as when tallying piece availability.
+void BM_BitfieldOr(benchmark::State& state)
+{
+    auto const bit_count = static_cast<size_t>(state.range(0));
+    auto const a = makeSparseBitfield(bit_count, 0U);
+    auto const b = makeSparseBitfield(bit_count, 1U);
+
+    for (auto _ : state)
+    {
+        auto merged = a;
+        merged |= b;
+        benchmark::DoNotOptimize(merged.count());
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * bit_count));
+}
+
+BENCHMARK(BM_BitfieldSet)->Arg(1 << 10)->Arg(1 << 16)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_BitfieldSetSpan)->Arg(1 << 10)->Arg(1 << 16)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_BitfieldCountRange)->Arg(1 << 10)->Arg(1 << 16)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_BitfieldOr)->Arg(1 << 10)->Arg(1 << 16)->Unit(benchmark::kMicrosecond);
+
+} // namespace
+} // namespace libtransmission::bench
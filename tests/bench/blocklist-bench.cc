@@ -0,0 +1,82 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <fmt/core.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/blocklist.h>
+#include <libtransmission/crypto-utils.h>
+#include <libtransmission/file.h>
+#include <libtransmission/net.h>
+#include <libtransmission/utils.h>
+
+#include "bench-fixtures.h"
+
+namespace libtransmission::bench
+{
+namespace
+{
+
+[[nodiscard]] std::string formatIpv4(uint32_t addr)
+{
+    return fmt::format("{:d}.{:d}.{:d}.{:d}", addr >> 24, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF);
+}
+
+// Checking a peer's address against a blocklist the size of the
+// popular public ones, which have a few hundred thousand ranges.
+void BM_BlocklistContains(benchmark::State& state)
+{
+    static auto constexpr NumAddresses = size_t{ 4096U };
+
+    auto const n_ranges = static_cast<size_t>(state.range(0));
+    auto const dir = tr_pathbuf{ BenchSession::instance().sandboxDir(), fmt::format("/blocklists-{:d}", n_ranges) };
+    tr_sys_dir_create(dir, TR_SYS_DIR_CREATE_PARENTS, 0700);
+
+    auto rng = std::mt19937{ 0U };
+    auto contents = std::string{};
+    for (size_t i = 0; i < n_ranges; ++i)
+    {
+        auto const begin = static_cast<uint32_t>(rng());
+        auto const end = begin + std::min(static_cast<uint32_t>(rng() % 4096U), UINT32_MAX - begin);
+        contents += fmt::format("range{:d}:{:s}-{:s}\n", i, formatIpv4(begin), formatIpv4(end));
+    }
+    tr_saveFile(tr_pathbuf{ dir, "/level1"sv }, contents);
+
+    auto const index = BlocklistIndex::load(dir, Blocklist::loadBlocklists(dir));
+
+    auto addresses = std::vector<tr_address>{};
+    addresses.reserve(NumAddresses);
+    for (size_t i = 0; i < NumAddresses; ++i)
+    {
+        auto compact = std::array<std::byte, 4>{};
+        tr_rand_buffer(std::data(compact), std::size(compact));
+        addresses.push_back(tr_address::from_compact_ipv4(std::data(compact)).first);
+    }
+
+    auto i = size_t{};
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(index.contains(addresses[i++ % NumAddresses]));
+    }
+
+    state.SetLabel(fmt::format("{:d} merged ranges", index.size()));
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_BlocklistContains)->Arg(1000)->Arg(100000)->Arg(500000)->Unit(benchmark::kNanosecond);
+
+} // namespace
+} // namespace libtransmission::bench
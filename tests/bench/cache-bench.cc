@@ -0,0 +1,86 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/block-info.h>
+#include <libtransmission/cache.h>
+
+#include "bench-fixtures.h"
+
+namespace libtransmission::bench
+{
+namespace
+{
+
+auto constexpr MiB = int64_t{ 1024 * 1024 };
+
+// Writes blocks in random order into a full write cache, which is what a
+// busy download looks like to the cache: every new block forces the oldest
+// blocks to be flushed. The torrent is 4x the cache size so that flushes
+// are mostly single blocks rather than long contiguous runs.
+void BM_CacheWriteBlock(benchmark::State& state)
+{
+    static auto constexpr BatchSize = size_t{ 256U };
+
+    auto& bench = BenchSession::instance();
+    auto* const cache = bench.session()->cache.get();
+    auto const cache_bytes = state.range(0) * MiB;
+    auto* const tor = bench.addSyntheticTorrent(cache_bytes * 4, 1 * MiB);
+    auto const tor_id = tor->id();
+
+    auto order = std::vector<tr_block_index_t>(tor->blockCount());
+    std::iota(std::begin(order), std::end(order), tr_block_index_t{});
+    std::shuffle(std::begin(order), std::end(order), std::mt19937{ 0U });
+    auto pos = size_t{};
+
+    auto const write_blocks = [&](size_t n_blocks)
+    {
+        for (size_t i = 0; i < n_blocks; ++i)
+        {
+            auto const block = order[pos++ % std::size(order)];
+            auto buf = cache->makeBlockBuffer();
+            buf->resize(tor->blockSize(block));
+            cache->writeBlock(tor_id, block, buf);
+        }
+    };
+
+    auto const old_limit = cache->getLimit();
+    bench.runInSessionThread(
+        [&]()
+        {
+            cache->setLimit(cache_bytes);
+            write_blocks(cache_bytes / tr_block_info::BlockSize);
+        });
+
+    for (auto _ : state)
+    {
+        bench.runInSessionThread([&]() { write_blocks(BatchSize); });
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * BatchSize));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * BatchSize * tr_block_info::BlockSize));
+
+    bench.runInSessionThread(
+        [&]()
+        {
+            cache->flushTorrent(tor);
+            cache->setLimit(old_limit);
+        });
+    tr_torrentRemove(tor, true, nullptr, nullptr);
+}
+
+BENCHMARK(BM_CacheWriteBlock)->Arg(16)->Arg(256)->Arg(1024)->Unit(benchmark::kMicrosecond);
+
+} // namespace
+} // namespace libtransmission::bench
@@ -0,0 +1,115 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/crypto-utils.h>
+#include <libtransmission/sha1-batch.h>
+#include <libtransmission/tr-arc4.h>
+
+namespace libtransmission::bench
+{
+namespace
+{
+
+auto constexpr KiB = int64_t{ 1024 };
+
+[[nodiscard]] std::vector<char> makeRandomBuffer(size_t size)
+{
+    auto buf = std::vector<char>(size);
+    tr_rand_buffer(std::data(buf), std::size(buf));
+    return buf;
+}
+
+// Hashes one piece the way tr_ioTestPiece() does: a block at a time.
+void BM_Sha1(benchmark::State& state)
+{
+    static auto constexpr BlockSize = size_t{ 16 * KiB };
+
+    auto const piece = makeRandomBuffer(state.range(0) * KiB);
+    auto sha = tr_sha1::create();
+
+    for (auto _ : state)
+    {
+        for (size_t pos = 0; pos < std::size(piece); pos += BlockSize)
+        {
+            sha->add(std::data(piece) + pos, std::min(BlockSize, std::size(piece) - pos));
+        }
+
+        benchmark::DoNotOptimize(sha->finish());
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * std::size(piece)));
+}
+
+// Hashes a batch of 256 KiB pieces the way the verifier does.
+// The argument is a tr_sha1_engine.
+void BM_Sha1Batch(benchmark::State& state)
+{
+    static auto constexpr PieceSize = size_t{ 256 * KiB };
+
+    auto const engine = static_cast<tr_sha1_engine>(state.range(0));
+    state.SetLabel(std::string{ tr_sha1_engine_name(engine) });
+    if (!tr_sha1_engine_is_supported(engine))
+    {
+        state.SkipWithError("not supported on this CPU");
+        return;
+    }
+
+    auto const batch_size = tr_sha1_batch_size(engine);
+    auto const buf = makeRandomBuffer(batch_size * PieceSize);
+    auto pieces = std::vector<std::string_view>{};
+    for (size_t i = 0; i < batch_size; ++i)
+    {
+        pieces.emplace_back(std::data(buf) + i * PieceSize, PieceSize);
+    }
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(tr_sha1_digest_many(pieces, engine));
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * batch_size));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * std::size(buf)));
+}
+
+// Message stream encryption of a peer's traffic, a buffer at a time.
+void BM_Arc4Process(benchmark::State& state)
+{
+    auto const key = makeRandomBuffer(20);
+    auto const plaintext = makeRandomBuffer(state.range(0));
+    auto ciphertext = std::vector<char>(std::size(plaintext));
+    auto arc4 = tr_arc4{ std::data(key), std::size(key) };
+    arc4.discard(1024);
+
+    for (auto _ : state)
+    {
+        arc4.process(std::data(plaintext), std::data(ciphertext), std::size(plaintext));
+        benchmark::ClobberMemory();
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * std::size(plaintext)));
+}
+
+BENCHMARK(BM_Sha1)->Arg(256)->Arg(4096)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Sha1Batch)
+    ->Arg(static_cast<int64_t>(tr_sha1_engine::Backend))
+    ->Arg(static_cast<int64_t>(tr_sha1_engine::Simd4))
+    ->Arg(static_cast<int64_t>(tr_sha1_engine::Avx2))
+    ->Arg(static_cast<int64_t>(tr_sha1_engine::ShaNi))
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Arc4Process)->Arg(68)->Arg(16 * KiB)->Unit(benchmark::kNanosecond);
+
+} // namespace
+} // namespace libtransmission::bench
@@ -0,0 +1,111 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <thread>
+
+#include <benchmark/benchmark.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/log.h>
+
+using namespace std::literals;
+
+namespace libtransmission::bench
+{
+namespace
+{
+
+auto constexpr Name = "Some.Linux.Distro-x86_64-DVD.iso"sv;
+auto constexpr Message = "got 16384 bytes of piece 1234 from peer [203.0.113.7]:51413"sv;
+
+class LogSettings
+{
+public:
+    LogSettings(bool queue_enabled, tr_log_overflow_policy policy)
+        : old_level_{ tr_logGetLevel() }
+        , old_queue_enabled_{ tr_logGetQueueEnabled() }
+        , old_policy_{ tr_logGetOverflowPolicy() }
+    {
+        tr_logSetLevel(TR_LOG_TRACE);
+        tr_logSetQueueEnabled(queue_enabled);
+        tr_logSetOverflowPolicy(policy);
+    }
+
+    LogSettings(LogSettings&&) = delete;
+    LogSettings(LogSettings const&) = delete;
+    LogSettings& operator=(LogSettings&&) = delete;
+    LogSettings& operator=(LogSettings const&) = delete;
+
+    ~LogSettings()
+    {
+        tr_logFreeQueue(tr_logGetQueue());
+        tr_logSetLevel(old_level_);
+        tr_logSetQueueEnabled(old_queue_enabled_);
+        tr_logSetOverflowPolicy(old_policy_);
+    }
+
+private:
+    tr_log_level const old_level_;
+    bool const old_queue_enabled_;
+    tr_log_overflow_policy const old_policy_;
+};
+
+// What logging costs the thread that logs, e.g. the session thread tracing
+// peer messages, when messages come in bursts that the log can keep up with.
+// state.range(0) is 1 for the message queue or 0 for the log file. Redirect
+// stderr to /dev/null for the latter, or it'll be written to the terminal.
+void BM_LogAddTraceBurst(benchmark::State& state)
+{
+    static auto constexpr BurstSize = 256;
+
+    auto const settings = LogSettings{ state.range(0) != 0, TR_LOG_OVERFLOW_BLOCK };
+
+    for (auto _ : state)
+    {
+        auto const begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < BurstSize; ++i)
+        {
+            tr_logAddTrace(Message, Name);
+        }
+        auto const end = std::chrono::steady_clock::now();
+        state.SetIterationTime(std::chrono::duration<double>(end - begin).count());
+
+        // let the log catch up before the next burst
+        tr_logFreeQueue(tr_logGetQueue());
+        std::this_thread::sleep_for(std::chrono::microseconds{ 200 });
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * BurstSize));
+}
+
+BENCHMARK(BM_LogAddTraceBurst)->Arg(1)->Arg(0)->UseManualTime();
+
+// Threads logging faster than the log can keep up with.
+// state.range(0) is a tr_log_overflow_policy.
+void BM_LogAddTraceFlood(benchmark::State& state)
+{
+    auto settings = std::unique_ptr<LogSettings>{};
+    if (state.thread_index() == 0)
+    {
+        settings = std::make_unique<LogSettings>(true, static_cast<tr_log_overflow_policy>(state.range(0)));
+    }
+
+    for (auto _ : state)
+    {
+        tr_logAddTrace(Message, Name);
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+BENCHMARK(BM_LogAddTraceFlood)->Arg(TR_LOG_OVERFLOW_BLOCK)->Arg(TR_LOG_OVERFLOW_DROP)->ThreadRange(1, 8)->UseRealTime();
+
+} // namespace
+} // namespace libtransmission::bench
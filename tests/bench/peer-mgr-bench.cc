@@ -0,0 +1,92 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <fmt/core.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/net.h>
+#include <libtransmission/peer-mgr.h>
+
+#include "bench-fixtures.h"
+
+namespace libtransmission::bench
+{
+namespace
+{
+
+// `n` distinct public IPv4 addresses
+std::vector<tr_pex> makePex(size_t n)
+{
+    auto const port = tr_port::fromHost(51413);
+
+    auto pex = std::vector<tr_pex>{};
+    pex.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        auto const str = fmt::format("20.{:d}.{:d}.{:d}", (i >> 16U) & 0xFFU, (i >> 8U) & 0xFFU, i & 0xFFU);
+        pex.emplace_back(*tr_address::from_string(str), port);
+    }
+
+    return pex;
+}
+
+// Adds a tracker-response-sized batch of peers to a swarm that already
+// knows about state.range(0) peers, which is what a popular public torrent
+// looks like after it's been running for a while. Most of the batch is
+// peers the swarm already knows, as in a typical reannounce.
+void BM_PeerMgrAddPex(benchmark::State& state)
+{
+    static auto constexpr BatchSize = size_t{ 200U };
+    static auto constexpr NewPerBatch = size_t{ 10U };
+
+    auto& bench = BenchSession::instance();
+    auto* const tor = bench.addSyntheticTorrent(64U * 1024U * 1024U, 1024U * 1024U);
+    auto const n_atoms = static_cast<size_t>(state.range(0));
+
+    // pick the batches ahead of time so that the loop only measures adding them
+    auto batches = std::vector<std::vector<tr_pex>>(64U);
+    auto const pex = makePex(n_atoms + std::size(batches) * NewPerBatch);
+    auto rng = std::mt19937{ 0U };
+    auto pick = std::uniform_int_distribution<size_t>{ 0U, n_atoms - 1U };
+    auto next_fresh = n_atoms;
+    for (auto& batch : batches)
+    {
+        for (size_t i = 0; i < BatchSize - NewPerBatch; ++i)
+        {
+            batch.push_back(pex[pick(rng)]);
+        }
+
+        for (size_t i = 0; i < NewPerBatch; ++i)
+        {
+            batch.push_back(pex[next_fresh++]);
+        }
+    }
+
+    bench.runInSessionThread([&]() { tr_peerMgrAddPex(tor, TR_PEER_FROM_TRACKER, std::data(pex), n_atoms); });
+
+    auto n_batches = size_t{};
+    for (auto _ : state)
+    {
+        auto const& batch = batches[n_batches++ % std::size(batches)];
+        bench.runInSessionThread([&]() { tr_peerMgrAddPex(tor, TR_PEER_FROM_PEX, std::data(batch), std::size(batch)); });
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * BatchSize));
+
+    tr_torrentRemove(tor, true, nullptr, nullptr);
+}
+
+BENCHMARK(BM_PeerMgrAddPex)->Arg(1000)->Arg(10000)->Arg(50000)->Unit(benchmark::kMicrosecond);
+
+} // namespace
+} // namespace libtransmission::bench
@@ -0,0 +1,100 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <fmt/core.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/quark.h>
+
+namespace libtransmission::bench
+{
+namespace
+{
+
+// about as many as a session with lots of trackers, labels, and RPC clients could make
+auto constexpr NumRuntimeQuarks = size_t{ 100000U };
+
+// Tracker-host-shaped strings, all of them interned as runtime quarks.
+// Quarks are never freed, so this is built once and shared by all the benchmarks.
+std::vector<std::string> const& runtimeStrings()
+{
+    static auto const strings = []()
+    {
+        auto ret = std::vector<std::string>{};
+        ret.reserve(NumRuntimeQuarks);
+        for (size_t i = 0; i < NumRuntimeQuarks; ++i)
+        {
+            ret.emplace_back(fmt::format("tracker{:d}.example.org:6969", i));
+            (void)tr_quark_new(ret.back());
+        }
+        return ret;
+    }();
+
+    return strings;
+}
+
+// What tr_announcerGetKey() and tr_interned_string do with an already-known string
+void BM_QuarkNewExisting(benchmark::State& state)
+{
+    auto const& strings = runtimeStrings();
+    auto idx = static_cast<size_t>(state.thread_index()) * 7919U;
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(tr_quark_new(strings[idx++ % std::size(strings)]));
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+BENCHMARK(BM_QuarkNewExisting)->ThreadRange(1, 4)->UseRealTime();
+
+void BM_QuarkLookup(benchmark::State& state)
+{
+    auto const& strings = runtimeStrings();
+    auto const missing = std::string{ "this string was never interned" };
+    auto idx = static_cast<size_t>(state.thread_index()) * 7919U;
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(tr_quark_lookup(strings[idx++ % std::size(strings)]));
+        benchmark::DoNotOptimize(tr_quark_lookup(missing));
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * 2));
+}
+
+BENCHMARK(BM_QuarkLookup)->ThreadRange(1, 4)->UseRealTime();
+
+void BM_QuarkGetStringView(benchmark::State& state)
+{
+    auto quarks = std::vector<tr_quark>{};
+    quarks.reserve(NumRuntimeQuarks);
+    for (auto const& str : runtimeStrings())
+    {
+        quarks.push_back(tr_quark_new(str));
+    }
+
+    auto idx = static_cast<size_t>(state.thread_index()) * 7919U;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(tr_quark_get_string_view(quarks[idx++ % std::size(quarks)]));
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+BENCHMARK(BM_QuarkGetStringView)->ThreadRange(1, 4)->UseRealTime();
+
+} // namespace
+} // namespace libtransmission::bench
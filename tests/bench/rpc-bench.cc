@@ -0,0 +1,144 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/rpcimpl.h>
+#include <libtransmission/variant.h>
+
+#include "bench-fixtures.h"
+
+namespace libtransmission::bench
+{
+namespace
+{
+
+// roughly what a web dashboard asks for on each refresh
+auto constexpr PollFields = std::array<std::string_view, 16>{
+    "error"sv,
+    "errorString"sv,
+    "eta"sv,
+    "id"sv,
+    "isFinished"sv,
+    "leftUntilDone"sv,
+    "name"sv,
+    "peersConnected"sv,
+    "percentDone"sv,
+    "queuePosition"sv,
+    "rateDownload"sv,
+    "rateUpload"sv,
+    "sizeWhenDone"sv,
+    "status"sv,
+    "trackerStats"sv,
+    "uploadRatio"sv,
+};
+
+// Keeps `n_torrents` synthetic torrents in the session for the duration of a benchmark.
+class Torrents
+{
+public:
+    Torrents(BenchSession& bench, size_t n_torrents)
+    {
+        torrents_.reserve(n_torrents);
+        for (size_t i = 0; i < n_torrents; ++i)
+        {
+            torrents_.push_back(bench.addSyntheticTorrent(16 * 1024 * 1024, 256 * 1024));
+        }
+    }
+
+    Torrents(Torrents&&) = delete;
+    Torrents(Torrents const&) = delete;
+    Torrents& operator=(Torrents&&) = delete;
+    Torrents& operator=(Torrents const&) = delete;
+
+    ~Torrents()
+    {
+        for (auto* const tor : torrents_)
+        {
+            tr_torrentRemove(tor, true, nullptr, nullptr);
+        }
+    }
+
+private:
+    std::vector<tr_torrent*> torrents_;
+};
+
+tr_variant makeTorrentGetRequest()
+{
+    auto request = tr_variant{};
+    tr_variantInitDict(&request, 2);
+    tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-get"sv);
+    auto* const args = tr_variantDictAddDict(&request, TR_KEY_arguments, 1);
+    auto* const fields = tr_variantDictAddList(args, TR_KEY_fields, std::size(PollFields));
+    for (auto const field : PollFields)
+    {
+        tr_variantListAddStrView(fields, field);
+    }
+    return request;
+}
+
+// The old path: build the response as a tr_variant tree, then serialize it.
+void BM_TorrentGetVariant(benchmark::State& state)
+{
+    auto& bench = BenchSession::instance();
+    auto const torrents = Torrents{ bench, static_cast<size_t>(state.range(0)) };
+    auto request = makeTorrentGetRequest();
+
+    auto n_bytes = size_t{};
+    for (auto _ : state)
+    {
+        tr_rpc_request_exec_json(
+            bench.session(),
+            &request,
+            [](tr_session* /*session*/, tr_variant* response, void* vn_bytes)
+            {
+                auto const json = tr_variantToStr(response, TR_VARIANT_FMT_JSON_LEAN);
+                *static_cast<size_t*>(vn_bytes) += std::size(json);
+            },
+            &n_bytes);
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(static_cast<int64_t>(n_bytes));
+    tr_variantClear(&request);
+}
+
+// The streaming path that the RPC server uses.
+void BM_TorrentGetSerialized(benchmark::State& state)
+{
+    auto& bench = BenchSession::instance();
+    auto const torrents = Torrents{ bench, static_cast<size_t>(state.range(0)) };
+    auto request = makeTorrentGetRequest();
+
+    auto n_bytes = size_t{};
+    for (auto _ : state)
+    {
+        tr_rpc_request_exec_serialized(
+            bench.session(),
+            &request,
+            [](tr_session* /*session*/, std::string_view json, void* vn_bytes)
+            { *static_cast<size_t*>(vn_bytes) += std::size(json); },
+            &n_bytes);
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(static_cast<int64_t>(n_bytes));
+    tr_variantClear(&request);
+}
+
+BENCHMARK(BM_TorrentGetVariant)->Arg(100)->Arg(1000)->Arg(10000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_TorrentGetSerialized)->Arg(100)->Arg(1000)->Arg(10000)->Unit(benchmark::kMillisecond);
+
+} // namespace
+} // namespace libtransmission::bench
@@ -0,0 +1,116 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <thread>
+
+#include <benchmark/benchmark.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/session-thread.h>
+
+namespace libtransmission::bench
+{
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+// A session thread of its own, so that the benchmarks
+// measure the work queue rather than a busy session.
+tr_session_thread& benchSessionThread()
+{
+    static auto const session_thread = tr_session_thread::create();
+    return *session_thread;
+}
+
+// Each benchmark thread posts callbacks to the session thread as fast as
+// it can, so the iteration time is the cost of run() to the caller while
+// other threads contend for the queue.
+template<typename Callback>
+void runPostingBenchmark(benchmark::State& state, Callback const& callback)
+{
+    auto& session_thread = benchSessionThread();
+
+    for (auto _ : state)
+    {
+        session_thread.run(callback);
+    }
+
+    // wait for the backlog to drain so it doesn't spill into the next run
+    auto done = std::promise<void>{};
+    session_thread.run([&done]() { done.set_value(); });
+    done.get_future().wait();
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+// A callback that fits in tr_session_thread::Callback's inline storage,
+// which is the common case: a lambda capturing a couple of pointers.
+void BM_SessionThreadRun(benchmark::State& state)
+{
+    static auto n_ran = std::atomic<uint64_t>{};
+    runPostingBenchmark(state, []() { n_ran.fetch_add(1U, std::memory_order_relaxed); });
+}
+
+// A callback with a capture too big to store inline.
+void BM_SessionThreadRunLargeCapture(benchmark::State& state)
+{
+    static auto n_ran = std::atomic<uint64_t>{};
+    auto payload = std::array<uint64_t, 16>{};
+    payload.front() = 1U;
+    runPostingBenchmark(state, [payload]() { n_ran.fetch_add(payload.front(), std::memory_order_relaxed); });
+}
+
+// Each benchmark thread posts a callback and waits for it to run, so the
+// iteration time is the round trip through the queue and the wakeup while
+// other threads do the same. The counters show the time from run() until
+// the session thread got to the callback.
+void BM_SessionThreadRoundTrip(benchmark::State& state)
+{
+    auto& session_thread = benchSessionThread();
+    auto total_nsec = uint64_t{};
+    auto max_nsec = uint64_t{};
+
+    for (auto _ : state)
+    {
+        auto waited = std::atomic<int64_t>{ -1 };
+        auto const posted_at = Clock::now();
+        session_thread.run(
+            [&waited, posted_at]()
+            {
+                auto const elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - posted_at);
+                waited.store(elapsed.count(), std::memory_order_release);
+            });
+
+        auto nsec = int64_t{};
+        while ((nsec = waited.load(std::memory_order_acquire)) < 0)
+        {
+            std::this_thread::yield();
+        }
+
+        total_nsec += static_cast<uint64_t>(nsec);
+        max_nsec = std::max(max_nsec, static_cast<uint64_t>(nsec));
+    }
+
+    auto const n_iterations = std::max(static_cast<double>(state.iterations()), 1.0);
+    state.counters["latency_mean_us"] = benchmark::Counter{ static_cast<double>(total_nsec) / n_iterations / 1000.0,
+                                                            benchmark::Counter::kAvgThreads };
+    state.counters["latency_max_us"] = benchmark::Counter{ static_cast<double>(max_nsec) / 1000.0,
+                                                           benchmark::Counter::kAvgThreads };
+}
+
+BENCHMARK(BM_SessionThreadRun)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_SessionThreadRunLargeCapture)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_SessionThreadRoundTrip)->ThreadRange(1, 8)->UseRealTime();
+
+} // namespace
+} // namespace libtransmission::bench
@@ -0,0 +1,117 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include <benchmark/benchmark.h>
+
+#include <libtransmission/transmission.h>
+
+#include "bench-fixtures.h"
+#include "swarm-sim.h"
+
+namespace libtransmission::bench
+{
+namespace
+{
+
+// Downloads a torrent from a swarm of virtual peers and reports how
+// the session coped. The iteration time is how long the download took.
+// The arguments are the number of peers, their max latency in msec,
+// and each peer's upload speed in KiB/s, where 0 means unlimited.
+void runSwarmBenchmark(benchmark::State& state, SwarmConfig config)
+{
+    static auto constexpr MiB = 1024.0 * 1024.0;
+
+    config.n_peers = static_cast<size_t>(state.range(0));
+    config.max_latency = std::chrono::milliseconds{ state.range(1) };
+    config.min_latency = config.max_latency / 5;
+    config.upload_speed_bps = static_cast<size_t>(state.range(2) * 1024);
+
+    auto& bench = BenchSession::instance();
+    auto totals = SwarmResult{};
+    auto blocks_in_torrent = uint64_t{};
+
+    for (auto _ : state)
+    {
+        auto const result = runSwarm(bench, config);
+        if (!result.completed)
+        {
+            state.SkipWithError("the download timed out");
+            break;
+        }
+
+        state.SetIterationTime(result.seconds_to_complete);
+        blocks_in_torrent += result.blocks_in_torrent;
+        totals.seconds_to_first_block += result.seconds_to_first_block;
+        totals.peak_peers += result.peak_peers;
+        totals.blocks_requested += result.blocks_requested;
+        totals.cancels_received += result.cancels_received;
+        totals.bytes_downloaded += result.bytes_downloaded;
+        totals.bytes_uploaded += result.bytes_uploaded;
+        totals.session_cpu_seconds += result.session_cpu_seconds;
+        totals.loop_latency_mean_usec += result.loop_latency_mean_usec;
+        totals.loop_latency_p99_usec += result.loop_latency_p99_usec;
+        totals.loop_latency_max_usec += result.loop_latency_max_usec;
+    }
+
+    if (blocks_in_torrent == 0U)
+    {
+        return;
+    }
+
+    auto const mib_downloaded = static_cast<double>(totals.bytes_downloaded) / MiB;
+    auto const avg = [](double total) { return benchmark::Counter{ total, benchmark::Counter::kAvgIterations }; };
+    state.counters["peers"] = avg(static_cast<double>(totals.peak_peers));
+    state.counters["first_block_s"] = avg(totals.seconds_to_first_block);
+    state.counters["requests_per_block"] = static_cast<double>(totals.blocks_requested) / blocks_in_torrent;
+    state.counters["cancels"] = avg(static_cast<double>(totals.cancels_received));
+    state.counters["uploaded_MiB"] = avg(static_cast<double>(totals.bytes_uploaded) / MiB);
+    state.counters["cpu_ms_per_MiB"] = totals.session_cpu_seconds * 1000.0 / mib_downloaded;
+    state.counters["loop_mean_us"] = avg(totals.loop_latency_mean_usec);
+    state.counters["loop_p99_us"] = avg(totals.loop_latency_p99_usec);
+    state.counters["loop_max_us"] = avg(totals.loop_latency_max_usec);
+    state.SetBytesProcessed(static_cast<int64_t>(totals.bytes_downloaded));
+}
+
+// Every peer is a seed, so it's all about piece picking and bandwidth.
+void BM_SwarmFromSeeds(benchmark::State& state)
+{
+    auto config = SwarmConfig{};
+    config.seed_fraction = 1.0;
+    runSwarmBenchmark(state, config);
+}
+
+// Mostly partial seeds that also download from us, so requests
+// have to be spread by availability and the session uploads too.
+void BM_SwarmMixed(benchmark::State& state)
+{
+    auto config = SwarmConfig{};
+    config.seed_fraction = 0.1;
+    config.piece_coverage = 0.3;
+    config.partial_seeds_download = true;
+    runSwarmBenchmark(state, config);
+}
+
+BENCHMARK(BM_SwarmFromSeeds)
+    ->Args({ 50, 50, 0 })
+    ->Args({ 200, 100, 1024 })
+    ->Args({ 1000, 100, 256 })
+    ->UseManualTime()
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_SwarmMixed)
+    ->Args({ 50, 50, 0 })
+    ->Args({ 200, 100, 1024 })
+    ->Args({ 1000, 100, 256 })
+    ->UseManualTime()
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace
+} // namespace libtransmission::bench
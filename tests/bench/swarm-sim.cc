@@ -0,0 +1,835 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <initializer_list>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <sys/socket.h>
+#endif
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/util.h>
+
+#include <fmt/core.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/block-info.h>
+#include <libtransmission/crypto-utils.h>
+#include <libtransmission/net.h>
+#include <libtransmission/peer-socket.h>
+#include <libtransmission/session.h>
+#include <libtransmission/sha1-batch.h>
+#include <libtransmission/torrent.h>
+
+#include "bench-fixtures.h"
+#include "swarm-sim.h"
+
+#ifdef _WIN32
+#define LOCAL_SOCKETPAIR_AF AF_INET
+#else
+#define LOCAL_SOCKETPAIR_AF AF_UNIX
+#endif
+
+namespace libtransmission::bench
+{
+namespace
+{
+namespace swarm_helpers
+{
+
+using Clock = std::chrono::steady_clock;
+
+auto constexpr BlockSize = tr_block_info::BlockSize;
+auto constexpr HandshakeSize = size_t{ 68U };
+auto constexpr MaxRequestsPerPeer = size_t{ 8U };
+
+// the BitTorrent messages that the virtual peers understand
+enum MessageId : uint8_t
+{
+    Choke = 0,
+    Unchoke = 1,
+    Interested = 2,
+    NotInterested = 3,
+    Have = 4,
+    Bitfield = 5,
+    Request = 6,
+    Piece = 7,
+    Cancel = 8,
+};
+
+void appendUint32(std::string& buf, uint32_t val)
+{
+    buf.push_back(static_cast<char>((val >> 24U) & 0xFFU));
+    buf.push_back(static_cast<char>((val >> 16U) & 0xFFU));
+    buf.push_back(static_cast<char>((val >> 8U) & 0xFFU));
+    buf.push_back(static_cast<char>(val & 0xFFU));
+}
+
+[[nodiscard]] uint32_t readUint32(uint8_t const* walk)
+{
+    return (uint32_t{ walk[0] } << 24U) | (uint32_t{ walk[1] } << 16U) | (uint32_t{ walk[2] } << 8U) | uint32_t{ walk[3] };
+}
+
+[[nodiscard]] std::string makeMessage(MessageId id, std::initializer_list<uint32_t> args = {}, size_t payload_len = 0U)
+{
+    auto msg = std::string{};
+    appendUint32(msg, static_cast<uint32_t>(1U + 4U * std::size(args) + payload_len));
+    msg.push_back(static_cast<char>(id));
+    for (auto const arg : args)
+    {
+        appendUint32(msg, arg);
+    }
+    return msg;
+}
+
+// CPU time used by the calling thread
+[[nodiscard]] double threadCpuSeconds()
+{
+#ifdef _WIN32
+    auto creation = FILETIME{};
+    auto exit = FILETIME{};
+    auto kernel = FILETIME{};
+    auto user = FILETIME{};
+    GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+    auto const ticks = (uint64_t{ kernel.dwHighDateTime } << 32U) + kernel.dwLowDateTime +
+        (uint64_t{ user.dwHighDateTime } << 32U) + user.dwLowDateTime;
+    return static_cast<double>(ticks) / 1e7;
+#else
+    auto ts = timespec{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+#endif
+}
+
+// Each virtual peer uses a socketpair, so make sure there are enough fds.
+void raiseFileLimit([[maybe_unused]] size_t n_peers)
+{
+#ifndef _WIN32
+    static auto constexpr Headroom = rlim_t{ 256U };
+
+    auto limit = rlimit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < n_peers * 2U + Headroom)
+    {
+        limit.rlim_cur = std::min(limit.rlim_max, rlim_t{ n_peers * 2U + Headroom });
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+}
+
+// The torrent's payload, which the virtual peers serve from memory.
+struct Content
+{
+    Content(uint64_t total_size, uint32_t piece_size_in)
+        : data(total_size)
+        , block_info{ total_size, piece_size_in }
+    {
+        tr_rand_buffer(std::data(data), std::size(data));
+
+        auto pieces = std::vector<std::string_view>{};
+        pieces.reserve(block_info.pieceCount());
+        for (tr_piece_index_t piece = 0; piece < block_info.pieceCount(); ++piece)
+        {
+            pieces.emplace_back(std::data(data) + block_info.pieceLoc(piece).byte, block_info.pieceSize(piece));
+        }
+
+        for (auto const& digest : tr_sha1_digest_many(pieces))
+        {
+            hashes.append(reinterpret_cast<char const*>(std::data(digest)), std::size(digest));
+        }
+    }
+
+    std::vector<char> data;
+    std::string hashes;
+    tr_block_info block_info;
+};
+
+// Counters that the virtual peers update. They all run in the
+// simulator's thread, so these don't need to be atomic.
+struct SwarmStats
+{
+    explicit SwarmStats(tr_block_index_t n_blocks)
+        : requests_per_block(n_blocks)
+    {
+    }
+
+    std::vector<uint16_t> requests_per_block;
+    uint64_t blocks_requested = 0U;
+    uint64_t cancels_received = 0U;
+    uint64_t bytes_downloaded = 0U;
+    uint64_t bytes_uploaded = 0U;
+    size_t connected_peers = 0U;
+    size_t peak_peers = 0U;
+    std::optional<Clock::time_point> first_block_at;
+};
+
+// One remote end of a socketpair, speaking just enough of the
+// BitTorrent wire protocol to seed to the session and leech from it.
+class VirtualPeer
+{
+public:
+    VirtualPeer(
+        event_base* base,
+        evutil_socket_t sock,
+        Content const& content,
+        SwarmStats& stats,
+        std::vector<bool> have,
+        bool downloads,
+        std::chrono::milliseconds latency,
+        ev_token_bucket_cfg* rate_limit)
+        : content_{ content }
+        , stats_{ stats }
+        , bev_{ bufferevent_socket_new(base, sock, BEV_OPT_CLOSE_ON_FREE) }
+        , delay_timer_{ evtimer_new(base, &VirtualPeer::onDelayTimer, this) }
+        , have_{ std::move(have) }
+        , session_has_(content.block_info.pieceCount())
+        , requested_(content.block_info.pieceCount())
+        , blocks_received_(content.block_info.pieceCount())
+        , latency_{ latency }
+        , downloads_{ downloads }
+    {
+        if (rate_limit != nullptr)
+        {
+            bufferevent_set_rate_limit(bev_, rate_limit);
+        }
+
+        bufferevent_setcb(bev_, &VirtualPeer::onRead, nullptr, &VirtualPeer::onEvent, this);
+        bufferevent_enable(bev_, EV_READ | EV_WRITE);
+    }
+
+    VirtualPeer(VirtualPeer&&) = delete;
+    VirtualPeer(VirtualPeer const&) = delete;
+    VirtualPeer& operator=(VirtualPeer&&) = delete;
+    VirtualPeer& operator=(VirtualPeer const&) = delete;
+
+    ~VirtualPeer()
+    {
+        event_free(delay_timer_);
+        bufferevent_free(bev_);
+    }
+
+    void sendHandshake(tr_sha1_digest_t const& info_hash, size_t index)
+    {
+        auto msg = std::string{ "\x13"
+                                "BitTorrent protocol"sv };
+        msg.append(8U, '\0'); // no extensions
+        msg.append(reinterpret_cast<char const*>(std::data(info_hash)), std::size(info_hash));
+        msg += fmt::format("-SM0001-{:012d}", index);
+        write(msg);
+
+        auto bits = std::string((std::size(have_) + 7U) / 8U, '\0');
+        for (size_t i = 0; i < std::size(have_); ++i)
+        {
+            if (have_[i])
+            {
+                bits[i / 8U] |= static_cast<char>(0x80U >> (i % 8U));
+            }
+        }
+        send(makeMessage(Bitfield, {}, std::size(bits)) + bits);
+    }
+
+private:
+    struct Outgoing
+    {
+        Clock::time_point due;
+        std::string msg;
+        char const* payload = nullptr;
+        uint32_t payload_len = 0U;
+    };
+
+    static void onRead(bufferevent* /*bev*/, void* vpeer)
+    {
+        static_cast<VirtualPeer*>(vpeer)->read();
+    }
+
+    static void onEvent(bufferevent* /*bev*/, short events, void* vpeer)
+    {
+        if ((events & (BEV_EVENT_EOF | BEV_EVENT_ERROR)) != 0)
+        {
+            static_cast<VirtualPeer*>(vpeer)->disconnect();
+        }
+    }
+
+    static void onDelayTimer(evutil_socket_t /*fd*/, short /*events*/, void* vpeer)
+    {
+        static_cast<VirtualPeer*>(vpeer)->flushDue();
+    }
+
+    void disconnect()
+    {
+        bufferevent_disable(bev_, EV_READ | EV_WRITE);
+        evtimer_del(delay_timer_);
+        outbox_.clear();
+
+        if (std::exchange(is_connected_, false))
+        {
+            --stats_.connected_peers;
+        }
+    }
+
+    void write(std::string_view msg, char const* payload = nullptr, uint32_t payload_len = 0U)
+    {
+        bufferevent_write(bev_, std::data(msg), std::size(msg));
+
+        if (payload != nullptr)
+        {
+            evbuffer_add_reference(bufferevent_get_output(bev_), payload, payload_len, nullptr, nullptr);
+            stats_.bytes_downloaded += payload_len;
+            if (!stats_.first_block_at)
+            {
+                stats_.first_block_at = Clock::now();
+            }
+        }
+    }
+
+    // Send a message after this peer's latency has passed.
+    void send(std::string msg, char const* payload = nullptr, uint32_t payload_len = 0U)
+    {
+        if (latency_.count() == 0)
+        {
+            write(msg, payload, payload_len);
+            return;
+        }
+
+        outbox_.push_back({ Clock::now() + latency_, std::move(msg), payload, payload_len });
+        if (std::size(outbox_) == 1U)
+        {
+            armDelayTimer();
+        }
+    }
+
+    void armDelayTimer()
+    {
+        auto const usec = std::chrono::duration_cast<std::chrono::microseconds>(outbox_.front().due - Clock::now()).count();
+        auto const tv = timeval{ static_cast<decltype(timeval::tv_sec)>(std::max(usec, decltype(usec){}) / 1000000),
+                                 static_cast<decltype(timeval::tv_usec)>(std::max(usec, decltype(usec){}) % 1000000) };
+        evtimer_add(delay_timer_, &tv);
+    }
+
+    void flushDue()
+    {
+        auto const now = Clock::now();
+        while (!std::empty(outbox_) && outbox_.front().due <= now)
+        {
+            auto const& out = outbox_.front();
+            write(out.msg, out.payload, out.payload_len);
+            outbox_.pop_front();
+        }
+
+        if (!std::empty(outbox_))
+        {
+            armDelayTimer();
+        }
+    }
+
+    void read()
+    {
+        auto* const input = bufferevent_get_input(bev_);
+
+        if (!is_connected_)
+        {
+            if (evbuffer_get_length(input) < HandshakeSize)
+            {
+                return;
+            }
+
+            evbuffer_drain(input, HandshakeSize);
+            is_connected_ = true;
+            stats_.peak_peers = std::max(stats_.peak_peers, ++stats_.connected_peers);
+        }
+
+        for (;;)
+        {
+            auto len_buf = std::array<uint8_t, 4>{};
+            if (evbuffer_copyout(input, std::data(len_buf), std::size(len_buf)) < static_cast<ev_ssize_t>(std::size(len_buf)))
+            {
+                return;
+            }
+
+            auto const msg_len = readUint32(std::data(len_buf));
+            if (evbuffer_get_length(input) < std::size(len_buf) + msg_len)
+            {
+                return;
+            }
+
+            evbuffer_drain(input, std::size(len_buf));
+            if (msg_len == 0U) // keepalive
+            {
+                continue;
+            }
+
+            msg_.resize(msg_len);
+            evbuffer_remove(input, std::data(msg_), msg_len);
+            handleMessage(msg_[0], std::data(msg_) + 1, msg_len - 1U);
+        }
+    }
+
+    void handleMessage(uint8_t id, uint8_t const* payload, size_t payload_len)
+    {
+        switch (id)
+        {
+        case Choke:
+            // Without the fast extension, choking drops all pending requests,
+            // so start over on any pieces that were in progress.
+            is_choked_ = true;
+            for (auto const& [piece, begin] : pending_)
+            {
+                restartPiece(piece);
+            }
+            if (current_piece_)
+            {
+                restartPiece(*current_piece_);
+            }
+            pending_.clear();
+            current_piece_.reset();
+            break;
+
+        case Unchoke:
+            is_choked_ = false;
+            requestMore();
+            break;
+
+        case Interested:
+            send(makeMessage(Unchoke));
+            break;
+
+        case Have:
+            if (payload_len >= 4U)
+            {
+                if (auto const piece = readUint32(payload); piece < std::size(session_has_))
+                {
+                    session_has_[piece] = true;
+                    updateInterest();
+                }
+            }
+            break;
+
+        case Bitfield:
+            for (size_t piece = 0; piece < std::size(session_has_) && piece / 8U < payload_len; ++piece)
+            {
+                session_has_[piece] = (payload[piece / 8U] & (0x80U >> (piece % 8U))) != 0U;
+            }
+            updateInterest();
+            break;
+
+        case Request:
+            if (payload_len >= 12U)
+            {
+                onRequest(readUint32(payload), readUint32(payload + 4), readUint32(payload + 8));
+            }
+            break;
+
+        case Piece:
+            if (payload_len >= 8U)
+            {
+                onPiece(readUint32(payload), readUint32(payload + 4), static_cast<uint32_t>(payload_len - 8U));
+            }
+            break;
+
+        case Cancel:
+            if (payload_len >= 12U)
+            {
+                onCancel(readUint32(payload), readUint32(payload + 4));
+            }
+            break;
+
+        default: // NotInterested, and anything else we don't need
+            break;
+        }
+    }
+
+    void onRequest(tr_piece_index_t piece, uint32_t begin, uint32_t length)
+    {
+        auto const& info = content_.block_info;
+        if (piece >= info.pieceCount() || !have_[piece] || length > BlockSize || begin + length > info.pieceSize(piece))
+        {
+            return;
+        }
+
+        auto const loc = info.pieceLoc(piece, begin);
+        ++stats_.blocks_requested;
+        ++stats_.requests_per_block[loc.block];
+
+        send(makeMessage(Piece, { piece, begin }, length), std::data(content_.data) + loc.byte, length);
+    }
+
+    void onCancel(tr_piece_index_t piece, uint32_t begin)
+    {
+        ++stats_.cancels_received;
+
+        auto const loc = content_.block_info.pieceLoc(piece, begin);
+        auto const* const payload = std::data(content_.data) + loc.byte;
+        auto const it = std::find_if(
+            std::begin(outbox_),
+            std::end(outbox_),
+            [payload](auto const& out) { return out.payload == payload; });
+        if (it != std::end(outbox_))
+        {
+            outbox_.erase(it);
+        }
+    }
+
+    void onPiece(tr_piece_index_t piece, uint32_t begin, uint32_t length)
+    {
+        auto const it = std::find(std::begin(pending_), std::end(pending_), std::make_pair(piece, begin));
+        if (it == std::end(pending_))
+        {
+            return;
+        }
+
+        pending_.erase(it);
+        stats_.bytes_uploaded += length;
+
+        auto const span = content_.block_info.blockSpanForPiece(piece);
+        if (++blocks_received_[piece] == span.end - span.begin)
+        {
+            have_[piece] = true;
+            send(makeMessage(Have, { piece }));
+        }
+
+        requestMore();
+    }
+
+    void restartPiece(tr_piece_index_t piece)
+    {
+        if (!have_[piece])
+        {
+            requested_[piece] = false;
+            blocks_received_[piece] = 0U;
+        }
+    }
+
+    void updateInterest()
+    {
+        if (!downloads_ || is_interested_)
+        {
+            return;
+        }
+
+        for (size_t piece = 0; piece < std::size(have_); ++piece)
+        {
+            if (session_has_[piece] && !have_[piece])
+            {
+                is_interested_ = true;
+                send(makeMessage(Interested));
+                return;
+            }
+        }
+    }
+
+    // Keep a few block requests in flight, a piece at a time.
+    void requestMore()
+    {
+        auto const& info = content_.block_info;
+
+        while (is_interested_ && !is_choked_ && std::size(pending_) < MaxRequestsPerPeer)
+        {
+            if (!current_piece_ || next_offset_ >= info.pieceSize(*current_piece_))
+            {
+                current_piece_ = nextPiece();
+                next_offset_ = 0U;
+                if (!current_piece_)
+                {
+                    return;
+                }
+            }
+
+            auto const piece = *current_piece_;
+            auto const length = std::min(BlockSize, info.pieceSize(piece) - next_offset_);
+            send(makeMessage(Request, { piece, next_offset_, length }));
+            pending_.emplace_back(piece, next_offset_);
+            next_offset_ += length;
+        }
+    }
+
+    [[nodiscard]] std::optional<tr_piece_index_t> nextPiece()
+    {
+        for (tr_piece_index_t piece = 0; piece < std::size(have_); ++piece)
+        {
+            if (session_has_[piece] && !have_[piece] && !requested_[piece])
+            {
+                requested_[piece] = true;
+                return piece;
+            }
+        }
+
+        return {};
+    }
+
+    Content const& content_;
+    SwarmStats& stats_;
+    bufferevent* const bev_;
+    event* const delay_timer_;
+
+    std::vector<bool> have_;
+    std::vector<bool> session_has_;
+    std::vector<bool> requested_;
+    std::vector<uint32_t> blocks_received_;
+    std::vector<std::pair<tr_piece_index_t, uint32_t>> pending_; // requests we've sent
+    std::optional<tr_piece_index_t> current_piece_;
+    uint32_t next_offset_ = 0U;
+
+    std::deque<Outgoing> outbox_;
+    std::vector<uint8_t> msg_;
+
+    std::chrono::milliseconds const latency_;
+    bool const downloads_;
+    bool is_connected_ = false;
+    bool is_choked_ = true;
+    bool is_interested_ = false;
+};
+
+// The virtual peers and the thread they run in.
+class Swarm
+{
+public:
+    Swarm(tr_session* session, tr_sha1_digest_t const& info_hash, Content const& content, SwarmConfig const& config)
+        : stats_{ content.block_info.blockCount() }
+        , thread_{ &Swarm::run, this, session, info_hash, std::cref(content), std::cref(config) }
+    {
+    }
+
+    Swarm(Swarm&&) = delete;
+    Swarm(Swarm const&) = delete;
+    Swarm& operator=(Swarm&&) = delete;
+    Swarm& operator=(Swarm const&) = delete;
+
+    ~Swarm()
+    {
+        stop();
+    }
+
+    // @return the stats, which are safe to read once the thread has stopped
+    SwarmStats const& stop()
+    {
+        is_stopping_ = true;
+        if (thread_.joinable())
+        {
+            thread_.join();
+        }
+        return stats_;
+    }
+
+    [[nodiscard]] constexpr auto cpuSeconds() const noexcept
+    {
+        return cpu_seconds_;
+    }
+
+private:
+    static void onStopCheck(evutil_socket_t /*fd*/, short /*events*/, void* vswarm)
+    {
+        auto* const swarm = static_cast<Swarm*>(vswarm);
+        if (swarm->is_stopping_)
+        {
+            event_base_loopbreak(swarm->base_);
+        }
+    }
+
+    void run(tr_session* session, tr_sha1_digest_t info_hash, Content const& content, SwarmConfig const& config)
+    {
+        auto const cpu_at_start = threadCpuSeconds();
+
+        base_ = event_base_new();
+        auto* const stop_check = event_new(base_, -1, EV_PERSIST, &Swarm::onStopCheck, this);
+        auto const interval = timeval{ 0, 10000 };
+        event_add(stop_check, &interval);
+
+        auto* const rate_limit = config.upload_speed_bps == 0U ?
+            nullptr :
+            ev_token_bucket_cfg_new(
+                EV_RATE_LIMIT_MAX,
+                EV_RATE_LIMIT_MAX,
+                config.upload_speed_bps,
+                config.upload_speed_bps,
+                nullptr);
+
+        auto rng = std::mt19937{ config.random_seed };
+        auto coin = std::uniform_real_distribution<double>{ 0.0, 1.0 };
+        auto latency = std::uniform_int_distribution<int64_t>{ config.min_latency.count(), config.max_latency.count() };
+        auto const n_pieces = content.block_info.pieceCount();
+        auto const n_seeds = static_cast<size_t>(config.seed_fraction * static_cast<double>(config.n_peers));
+
+        auto peers = std::vector<std::unique_ptr<VirtualPeer>>{};
+        peers.reserve(config.n_peers);
+        for (size_t i = 0; i < config.n_peers; ++i)
+        {
+            auto sockpair = std::array<evutil_socket_t, 2>{ TR_BAD_SOCKET, TR_BAD_SOCKET };
+            if (evutil_socketpair(LOCAL_SOCKETPAIR_AF, SOCK_STREAM, 0, std::data(sockpair)) != 0)
+            {
+                break;
+            }
+
+            evutil_make_socket_nonblocking(sockpair[0]);
+            evutil_make_socket_nonblocking(sockpair[1]);
+
+            auto const is_seed = i < n_seeds;
+            auto have = std::vector<bool>(n_pieces, is_seed);
+            if (!is_seed)
+            {
+                std::generate(std::begin(have), std::end(have), [&]() { return coin(rng) < config.piece_coverage; });
+            }
+
+            auto& peer = peers.emplace_back(std::make_unique<VirtualPeer>(
+                base_,
+                sockpair[1],
+                content,
+                stats_,
+                std::move(have),
+                !is_seed && config.partial_seeds_download,
+                std::chrono::milliseconds{ latency(rng) },
+                rate_limit));
+            peer->sendHandshake(info_hash, i);
+
+            // The session keys peers by address, so give each one its own.
+            auto const addr = *tr_address::from_string(
+                fmt::format("10.{:d}.{:d}.{:d}", (i >> 16U) & 0xFFU, (i >> 8U) & 0xFFU, (i & 0xFFU) + 1U));
+            session->runInSessionThread(
+                [session, addr, sock = sockpair[0]]()
+                { session->addIncoming(tr_peer_socket{ session, addr, tr_port::fromHost(51413), sock }); });
+        }
+
+        event_base_dispatch(base_);
+
+        peers.clear();
+        if (rate_limit != nullptr)
+        {
+            ev_token_bucket_cfg_free(rate_limit);
+        }
+        event_free(stop_check);
+        event_base_free(base_);
+        base_ = nullptr;
+
+        cpu_seconds_ = threadCpuSeconds() - cpu_at_start;
+    }
+
+    SwarmStats stats_;
+    event_base* base_ = nullptr;
+    double cpu_seconds_ = 0.0;
+    std::atomic<bool> is_stopping_ = false;
+    std::thread thread_;
+};
+
+// Measures how long work posted to the session thread waits before it runs.
+class LoopLatencyProbe
+{
+public:
+    explicit LoopLatencyProbe(tr_session* session)
+        : session_{ session }
+    {
+    }
+
+    // Post a sample. `on_sampled` is called in the session thread.
+    template<typename Func>
+    void post(Func&& on_sampled)
+    {
+        session_->runInSessionThread(
+            [this, posted_at = Clock::now(), on_sampled = std::forward<Func>(on_sampled)]()
+            {
+                samples_.emplace_back(std::chrono::duration<double, std::micro>(Clock::now() - posted_at).count());
+                on_sampled();
+            });
+    }
+
+    // Call this from the session thread once the last sample has run.
+    void summarize(SwarmResult& setme) const
+    {
+        if (std::empty(samples_))
+        {
+            return;
+        }
+
+        auto sorted = samples_;
+        std::sort(std::begin(sorted), std::end(sorted));
+        setme.loop_latency_mean_usec = std::accumulate(std::begin(sorted), std::end(sorted), 0.0) / std::size(sorted);
+        setme.loop_latency_p99_usec = sorted[(std::size(sorted) - 1U) * 99U / 100U];
+        setme.loop_latency_max_usec = sorted.back();
+    }
+
+private:
+    tr_session* const session_;
+    std::vector<double> samples_;
+};
+
+} // namespace swarm_helpers
+} // namespace
+
+SwarmResult runSwarm(BenchSession& bench, SwarmConfig const& config)
+{
+    using namespace swarm_helpers;
+
+    static auto constexpr SampleInterval = std::chrono::milliseconds{ 10 };
+
+    raiseFileLimit(config.n_peers);
+
+    auto* const session = bench.session();
+    auto const content = Content{ config.total_size, config.piece_size };
+    auto* const tor = bench.addSyntheticTorrent(config.total_size, config.piece_size, content.hashes);
+    auto const peer_limit = static_cast<uint16_t>(std::min(config.n_peers, size_t{ UINT16_MAX }));
+    tr_sessionSetPeerLimit(session, peer_limit);
+    tr_sessionSetPeerLimitPerTorrent(session, peer_limit);
+    tr_torrentSetPeerLimit(tor, peer_limit);
+    tr_torrentStartNow(tor);
+
+    auto const cpu_at_start = std::clock();
+    auto const started_at = Clock::now();
+    auto swarm = std::make_unique<Swarm>(session, tor->infoHash(), content, config);
+
+    auto probe = LoopLatencyProbe{ session };
+    auto is_done = std::atomic<bool>{ false };
+    while (!is_done && Clock::now() - started_at < config.timeout)
+    {
+        probe.post([tor, &is_done]() { is_done = tor->isDone(); });
+        std::this_thread::sleep_for(SampleInterval);
+    }
+    auto const finished_at = Clock::now();
+
+    auto const& stats = swarm->stop();
+    auto const cpu_used = static_cast<double>(std::clock() - cpu_at_start) / CLOCKS_PER_SEC;
+
+    auto result = SwarmResult{};
+    result.completed = is_done;
+    result.seconds_to_complete = std::chrono::duration<double>(finished_at - started_at).count();
+    if (stats.first_block_at)
+    {
+        result.seconds_to_first_block = std::chrono::duration<double>(*stats.first_block_at - started_at).count();
+    }
+    result.peak_peers = stats.peak_peers;
+    result.blocks_in_torrent = content.block_info.blockCount();
+    result.blocks_requested = stats.blocks_requested;
+    result.cancels_received = stats.cancels_received;
+    result.bytes_downloaded = stats.bytes_downloaded;
+    result.bytes_uploaded = stats.bytes_uploaded;
+    result.session_cpu_seconds = std::max(cpu_used - swarm->cpuSeconds(), 0.0);
+
+    bench.runInSessionThread([&]() { probe.summarize(result); });
+    tr_torrentRemove(tor, true, nullptr, nullptr);
+
+    return result;
+}
+
+} // namespace libtransmission::bench
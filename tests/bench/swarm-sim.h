@@ -0,0 +1,79 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace libtransmission::bench
+{
+
+class BenchSession;
+
+// What the virtual peers in a simulated swarm look like.
+struct SwarmConfig
+{
+    size_t n_peers = 50U;
+
+    // the torrent that the session downloads from the swarm
+    uint64_t total_size = uint64_t{ 64U } * 1024U * 1024U;
+    uint32_t piece_size = 256U * 1024U;
+
+    // Virtual peers are either seeds or partial seeds. A partial seed
+    // has each piece with a probability of `piece_coverage`, and if
+    // `partial_seeds_download` is set it also downloads from the session.
+    double seed_fraction = 0.5;
+    double piece_coverage = 0.5;
+    bool partial_seeds_download = true;
+
+    // Each virtual peer delays everything it sends by a latency picked
+    // from this range, and uploads no faster than `upload_speed_bps`.
+    std::chrono::milliseconds min_latency = std::chrono::milliseconds{ 10 };
+    std::chrono::milliseconds max_latency = std::chrono::milliseconds{ 50 };
+    size_t upload_speed_bps = 0U; // 0 means unlimited
+
+    std::chrono::seconds timeout = std::chrono::seconds{ 120 };
+    unsigned int random_seed = 0U;
+};
+
+struct SwarmResult
+{
+    bool completed = false;
+
+    // seconds since the peers started connecting
+    double seconds_to_first_block = 0.0;
+    double seconds_to_complete = 0.0;
+
+    size_t peak_peers = 0U;
+
+    // Blocks that the session requested from the virtual peers.
+    // More requests than blocks in the torrent means some were duplicated,
+    // e.g. in endgame or after a peer choked us.
+    uint64_t blocks_in_torrent = 0U;
+    uint64_t blocks_requested = 0U;
+    uint64_t cancels_received = 0U;
+
+    uint64_t bytes_downloaded = 0U; // piece data the virtual peers sent
+    uint64_t bytes_uploaded = 0U; // piece data the session sent
+
+    // CPU used by everything but the virtual peers
+    double session_cpu_seconds = 0.0;
+
+    // How long work posted to the session thread waited to run.
+    double loop_latency_mean_usec = 0.0;
+    double loop_latency_p99_usec = 0.0;
+    double loop_latency_max_usec = 0.0;
+};
+
+// Adds a torrent to `bench`'s session and has it download that torrent
+// from a swarm of virtual peers until it's done or `config.timeout` passes.
+// The peers run in their own thread and talk to the session over
+// socketpairs, so the real handshake, peer-msgs, peer-mgr, and
+// bandwidth code are all exercised. The torrent is removed afterwards.
+SwarmResult runSwarm(BenchSession& bench, SwarmConfig const& config);
+
+} // namespace libtransmission::bench
@@ -0,0 +1,121 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include <fmt/core.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/quark.h>
+#include <libtransmission/variant.h>
+
+namespace libtransmission::bench
+{
+namespace
+{
+
+// Something shaped like a .resume file or a torrent-get response:
+// a list of dicts with a mix of ints, reals, strings, and nested lists.
+void buildDocument(tr_variant* setme, size_t n_torrents)
+{
+    tr_variantInitDict(setme, 1);
+    auto* const torrents = tr_variantDictAddList(setme, TR_KEY_torrents, n_torrents);
+
+    for (size_t i = 0; i < n_torrents; ++i)
+    {
+        auto* const tor = tr_variantListAddDict(torrents, 9);
+        tr_variantDictAddInt(tor, TR_KEY_id, static_cast<int64_t>(i));
+        tr_variantDictAddStr(tor, TR_KEY_name, fmt::format("Some.Linux.Distro-{:d}-x86_64-DVD.iso", i));
+        tr_variantDictAddStr(tor, TR_KEY_downloadDir, "/home/user/Downloads/some/deeper/path");
+        tr_variantDictAddInt(tor, TR_KEY_totalSize, static_cast<int64_t>(i) * 1048576 + 12345);
+        tr_variantDictAddReal(tor, TR_KEY_percentDone, static_cast<double>(i % 100) / 100.0);
+        tr_variantDictAddReal(tor, TR_KEY_uploadRatio, 1.2345);
+        tr_variantDictAddBool(tor, TR_KEY_isFinished, i % 2 == 0);
+        tr_variantDictAddStr(tor, TR_KEY_errorString, "");
+
+        auto* const files = tr_variantDictAddList(tor, TR_KEY_files, 4);
+        for (int j = 0; j < 4; ++j)
+        {
+            auto* const file = tr_variantListAddDict(files, 3);
+            tr_variantDictAddStr(file, TR_KEY_name, fmt::format("folder/file-{:d}.bin", j));
+            tr_variantDictAddInt(file, TR_KEY_length, 1048576 * (j + 1));
+            tr_variantDictAddInt(file, TR_KEY_bytesCompleted, 524288 * j);
+        }
+    }
+}
+
+[[nodiscard]] std::string makeSerialized(size_t n_torrents, tr_variant_fmt fmt)
+{
+    auto doc = tr_variant{};
+    buildDocument(&doc, n_torrents);
+    auto serialized = tr_variantToStr(&doc, fmt);
+    tr_variantClear(&doc);
+    return serialized;
+}
+
+void parse(benchmark::State& state, tr_variant_fmt fmt, int parse_opts)
+{
+    auto const serialized = makeSerialized(static_cast<size_t>(state.range(0)), fmt);
+
+    for (auto _ : state)
+    {
+        auto doc = tr_variant{};
+        auto const ok = tr_variantFromBuf(&doc, parse_opts, serialized);
+        benchmark::DoNotOptimize(ok);
+        tr_variantClear(&doc);
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * std::size(serialized)));
+}
+
+void serialize(benchmark::State& state, tr_variant_fmt fmt)
+{
+    auto doc = tr_variant{};
+    buildDocument(&doc, static_cast<size_t>(state.range(0)));
+
+    auto n_bytes = size_t{};
+    for (auto _ : state)
+    {
+        n_bytes += std::size(tr_variantToStr(&doc, fmt));
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(static_cast<int64_t>(n_bytes));
+    tr_variantClear(&doc);
+}
+
+void BM_VariantParseJson(benchmark::State& state)
+{
+    parse(state, TR_VARIANT_FMT_JSON_LEAN, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE);
+}
+
+void BM_VariantParseBenc(benchmark::State& state)
+{
+    parse(state, TR_VARIANT_FMT_BENC, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE);
+}
+
+void BM_VariantToJson(benchmark::State& state)
+{
+    serialize(state, TR_VARIANT_FMT_JSON_LEAN);
+}
+
+void BM_VariantToBenc(benchmark::State& state)
+{
+    serialize(state, TR_VARIANT_FMT_BENC);
+}
+
+BENCHMARK(BM_VariantParseJson)->Arg(100)->Arg(10000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_VariantParseBenc)->Arg(100)->Arg(10000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_VariantToJson)->Arg(100)->Arg(10000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_VariantToBenc)->Arg(100)->Arg(10000)->Unit(benchmark::kMicrosecond);
+
+} // namespace
+} // namespace libtransmission::bench
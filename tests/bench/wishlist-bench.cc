@@ -0,0 +1,159 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#define LIBTRANSMISSION_PEER_MODULE
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/peer-mgr-wishlist.h>
+
+namespace libtransmission::bench
+{
+namespace
+{
+
+// A torrent whose pieces are all wanted, with random availability.
+// Blocks stay requested until every block has been, and then they
+// all become requestable again.
+class SyntheticMediator final : public Wishlist::Mediator
+{
+public:
+    static auto constexpr BlocksPerPiece = tr_block_index_t{ 16U };
+
+    explicit SyntheticMediator(tr_piece_index_t piece_count)
+        : piece_count_{ piece_count }
+        , replication_(piece_count)
+        , requested_(size_t{ piece_count } * BlocksPerPiece)
+        , missing_(piece_count, BlocksPerPiece)
+    {
+        auto rng = std::mt19937{ 0U };
+        for (auto& replication : replication_)
+        {
+            replication = rng() % 50U;
+        }
+    }
+
+    // @return true iff every block has been requested and the requests were cleared
+    bool markRequested(std::vector<tr_block_span_t> const& spans)
+    {
+        for (auto const& [begin, end] : spans)
+        {
+            for (auto block = begin; block < end; ++block)
+            {
+                requested_[block] = true;
+                --missing_[block / BlocksPerPiece];
+                ++n_requested_;
+            }
+        }
+
+        if (n_requested_ < std::size(requested_))
+        {
+            return false;
+        }
+
+        std::fill(std::begin(requested_), std::end(requested_), false);
+        std::fill(std::begin(missing_), std::end(missing_), BlocksPerPiece);
+        n_requested_ = 0U;
+        return true;
+    }
+
+    [[nodiscard]] bool clientCanRequestBlock(tr_block_index_t block) const override
+    {
+        return !requested_[block];
+    }
+
+    [[nodiscard]] bool clientCanRequestPiece(tr_piece_index_t /*piece*/) const override
+    {
+        return true;
+    }
+
+    [[nodiscard]] bool clientWantsPiece(tr_piece_index_t /*piece*/) const override
+    {
+        return true;
+    }
+
+    [[nodiscard]] bool isEndgame() const override
+    {
+        return false;
+    }
+
+    [[nodiscard]] size_t countActiveRequests(tr_block_index_t block) const override
+    {
+        return requested_[block] ? 1U : 0U;
+    }
+
+    [[nodiscard]] size_t countMissingBlocks(tr_piece_index_t piece) const override
+    {
+        return missing_[piece];
+    }
+
+    [[nodiscard]] size_t countPeersWithPiece(tr_piece_index_t piece) const override
+    {
+        return replication_[piece];
+    }
+
+    [[nodiscard]] tr_block_span_t blockSpan(tr_piece_index_t piece) const override
+    {
+        return { piece * BlocksPerPiece, (piece + 1U) * BlocksPerPiece };
+    }
+
+    [[nodiscard]] tr_piece_index_t countAllPieces() const override
+    {
+        return piece_count_;
+    }
+
+    [[nodiscard]] tr_priority_t priority(tr_piece_index_t /*piece*/) const override
+    {
+        return TR_PRI_NORMAL;
+    }
+
+private:
+    tr_piece_index_t const piece_count_;
+    std::vector<size_t> replication_;
+    std::vector<bool> requested_;
+    std::vector<size_t> missing_;
+    size_t n_requested_ = 0U;
+};
+
+// Picking the next blocks to request from a peer, which happens
+// whenever a peer's request queue has room.
+void BM_WishlistNext(benchmark::State& state)
+{
+    static auto constexpr NumWanted = size_t{ 16U };
+
+    auto mediator = SyntheticMediator{ static_cast<tr_piece_index_t>(state.range(0)) };
+    auto wishlist = Wishlist{};
+
+    for (auto _ : state)
+    {
+        auto const spans = wishlist.next(mediator, NumWanted);
+        if (mediator.markRequested(spans))
+        {
+            wishlist.invalidate();
+        }
+        else
+        {
+            for (auto const& [begin, end] : spans)
+            {
+                wishlist.pieceChanged(begin / SyntheticMediator::BlocksPerPiece);
+            }
+        }
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * NumWanted));
+}
+
+BENCHMARK(BM_WishlistNext)->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMicrosecond);
+
+} // namespace
+} // namespace libtransmission::bench
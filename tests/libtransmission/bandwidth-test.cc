@@ -0,0 +1,281 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <cstddef> // size_t
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <event2/util.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/bandwidth.h>
+#include <libtransmission/net.h>
+#include <libtransmission/peer-io.h>
+#include <libtransmission/peer-socket.h>
+#include <libtransmission/session.h>
+
+#include "test-fixtures.h"
+
+#ifdef _WIN32
+#define LOCAL_SOCKETPAIR_AF AF_INET
+#else
+#define LOCAL_SOCKETPAIR_AF AF_UNIX
+#endif
+
+namespace libtransmission::test
+{
+
+class BandwidthTest : public SessionTest
+{
+protected:
+    static auto constexpr MaxWaitMsec = 5000;
+    static auto constexpr PeriodMsec = 1000U;
+
+    // more than any test uploads, so that peers always have something to send
+    static auto constexpr PeerOutbufSize = size_t{ 1024U * 1024U };
+
+    // A peer-io that always has more to upload than it's allowed to, and nothing to download.
+    // Its remote end is a socketpair that throws away whatever it's sent.
+    struct Peer
+    {
+        ~Peer()
+        {
+            io.reset();
+            evutil_closesocket(remote);
+        }
+
+        std::shared_ptr<tr_peerIo> io;
+        evutil_socket_t remote = TR_BAD_SOCKET;
+        size_t id = 0;
+        size_t used = 0;
+        std::vector<std::pair<size_t /*id*/, size_t /*n_bytes*/>>* log = nullptr;
+    };
+
+    // A bandwidth tree: `top`, with `torrents` underneath it, and peers underneath those.
+    // Must be used in the session thread.
+    struct Tree
+    {
+        Tree(tr_session* session_in, size_t top_bytes_per_pulse)
+            : session{ session_in }
+        {
+            top.setLimited(TR_UP, true);
+            top.setDesiredSpeedBytesPerSecond(TR_UP, top_bytes_per_pulse * 1000U / PeriodMsec);
+        }
+
+        tr_bandwidth* addTorrent(tr_priority_t priority)
+        {
+            auto& torrent = torrents.emplace_back(std::make_unique<tr_bandwidth>(&top));
+            torrent->setPriority(priority);
+            return torrent.get();
+        }
+
+        Peer& addPeer(tr_bandwidth* torrent)
+        {
+            auto sockpair = std::array<evutil_socket_t, 2>{ TR_BAD_SOCKET, TR_BAD_SOCKET };
+            EXPECT_EQ(0, evutil_socketpair(LOCAL_SOCKETPAIR_AF, SOCK_STREAM, 0, std::data(sockpair)));
+            evutil_make_socket_nonblocking(sockpair[0]);
+            evutil_make_socket_nonblocking(sockpair[1]);
+
+            auto& peer = *peers.emplace_back(std::make_unique<Peer>());
+            peer.io = tr_peerIo::new_incoming(
+                session,
+                torrent,
+                tr_peer_socket{ session, *tr_address::from_string("127.0.0.1"), tr_port::fromHost(51413), sockpair[0] });
+            peer.remote = sockpair[1];
+            peer.id = std::size(peers) - 1U;
+            peer.log = &log;
+            peer.io->set_callbacks(nullptr, &didWrite, nullptr, &peer);
+
+            auto const piece_data = std::vector<uint8_t>(PeerOutbufSize);
+            peer.io->write_bytes(std::data(piece_data), std::size(piece_data), true);
+            return peer;
+        }
+
+        void allocate()
+        {
+            top.allocate(PeriodMsec);
+
+            // make room in the sockets for the next pulse
+            auto buf = std::array<char, 65536>{};
+            for (auto const& peer : peers)
+            {
+                while (recv(peer->remote, std::data(buf), std::size(buf), 0) > 0)
+                {
+                }
+            }
+        }
+
+        tr_session* const session;
+        tr_bandwidth top;
+        std::vector<std::unique_ptr<tr_bandwidth>> torrents;
+        std::vector<std::unique_ptr<Peer>> peers;
+        std::vector<std::pair<size_t, size_t>> log;
+    };
+
+    static void didWrite(tr_peerIo* /*io*/, size_t n_bytes, bool /*is_piece_data*/, void* vpeer)
+    {
+        auto* const peer = static_cast<Peer*>(vpeer);
+        peer->used += n_bytes;
+        peer->log->emplace_back(peer->id, n_bytes);
+    }
+
+    static auto credit(tr_bandwidth const& bandwidth)
+    {
+        return bandwidth.schedulerStats(TR_UP).credit;
+    }
+
+    // peer-ios belong to the session thread, so build and run the tree there
+    void runInSession(std::function<void()> func)
+    {
+        auto done = false;
+        session_->runInSessionThread(
+            [&]()
+            {
+                func();
+                done = true;
+            });
+        EXPECT_TRUE(waitFor([&done]() { return done; }, MaxWaitMsec));
+    }
+};
+
+TEST_F(BandwidthTest, siblingsShareByWeight)
+{
+    runInSession(
+        [&]()
+        {
+            // Weights are 3:2:1 for high, normal, and low priority.
+            // The top node is low priority here so that `low` doesn't inherit normal from it.
+            auto tree = Tree{ session_, 60000U };
+            tree.top.setPriority(TR_PRI_LOW);
+            auto const& high = tree.addPeer(tree.addTorrent(TR_PRI_HIGH));
+            auto const& normal = tree.addPeer(tree.addTorrent(TR_PRI_NORMAL));
+            auto const& low = tree.addPeer(tree.addTorrent(TR_PRI_LOW));
+
+            tree.allocate();
+
+            EXPECT_EQ(30000U, high.used);
+            EXPECT_EQ(20000U, normal.used);
+            EXPECT_EQ(10000U, low.used);
+
+            auto const stats = tree.top.schedulerStats(TR_UP);
+            EXPECT_EQ(3U, stats.queued);
+            EXPECT_EQ(3U, stats.turns);
+            EXPECT_EQ(60000U, stats.bytes_served);
+        });
+}
+
+TEST_F(BandwidthTest, lowPriorityIsNotStarved)
+{
+    runInSession(
+        [&]()
+        {
+            // Priorities used to be strict: high-priority peers could use up the
+            // whole budget before normal or low ones got any. Now they share by weight.
+            auto tree = Tree{ session_, 60000U };
+            tree.top.setPriority(TR_PRI_LOW);
+            auto const& high = tree.addPeer(tree.addTorrent(TR_PRI_HIGH));
+            auto const& low = tree.addPeer(tree.addTorrent(TR_PRI_LOW));
+
+            tree.allocate();
+
+            EXPECT_EQ(45000U, high.used);
+            EXPECT_EQ(15000U, low.used);
+        });
+}
+
+TEST_F(BandwidthTest, fairnessIsPerSubtree)
+{
+    runInSession(
+        [&]()
+        {
+            // Equal-priority torrents get equal shares, no matter how many peers
+            // each one has. The peers then split their torrent's share.
+            auto tree = Tree{ session_, 60000U };
+            auto* const one = tree.addTorrent(TR_PRI_NORMAL);
+            auto* const three = tree.addTorrent(TR_PRI_NORMAL);
+            auto const& lone_peer = tree.addPeer(one);
+            auto const& peer_a = tree.addPeer(three);
+            auto const& peer_b = tree.addPeer(three);
+            auto const& peer_c = tree.addPeer(three);
+
+            tree.allocate();
+
+            EXPECT_EQ(30000U, lone_peer.used);
+            EXPECT_EQ(10000U, peer_a.used);
+            EXPECT_EQ(10000U, peer_b.used);
+            EXPECT_EQ(10000U, peer_c.used);
+        });
+}
+
+TEST_F(BandwidthTest, budgetRunsOutMidRound)
+{
+    runInSession(
+        [&]()
+        {
+            // 10000 bytes isn't enough for a round of three 6000-byte turns,
+            // so the second torrent's turn gets cut short and the third gets none.
+            auto tree = Tree{ session_, 10000U };
+            auto* const first = tree.addTorrent(TR_PRI_NORMAL);
+            auto* const second = tree.addTorrent(TR_PRI_NORMAL);
+            auto* const third = tree.addTorrent(TR_PRI_NORMAL);
+            auto const& first_peer = tree.addPeer(first);
+            auto const& second_peer = tree.addPeer(second);
+            auto const& third_peer = tree.addPeer(third);
+
+            tree.allocate();
+
+            EXPECT_EQ(6000U, first_peer.used);
+            EXPECT_EQ(4000U, second_peer.used);
+            EXPECT_EQ(0U, third_peer.used);
+            EXPECT_EQ(0U, credit(*first));
+            EXPECT_EQ(2000U, credit(*second));
+            EXPECT_EQ(0U, credit(*third));
+
+            // the next pulse starts with the torrent that got cut short
+            tree.allocate();
+
+            EXPECT_EQ(6000U, first_peer.used);
+            EXPECT_EQ(10000U, second_peer.used);
+            EXPECT_EQ(4000U, third_peer.used);
+            EXPECT_EQ(0U, credit(*second));
+            EXPECT_EQ(2000U, credit(*third));
+        });
+}
+
+TEST_F(BandwidthTest, isDeterministic)
+{
+    auto const run = [this]()
+    {
+        auto tree = Tree{ session_, 50000U };
+        auto* const high = tree.addTorrent(TR_PRI_HIGH);
+        auto* const normal = tree.addTorrent(TR_PRI_NORMAL);
+        tree.addPeer(high);
+        tree.addPeer(high);
+        tree.addPeer(normal);
+        tree.addPeer(normal);
+        tree.addPeer(normal);
+
+        for (int i = 0; i < 5; ++i)
+        {
+            tree.allocate();
+        }
+
+        return tree.log;
+    };
+
+    runInSession(
+        [&]()
+        {
+            auto const log = run();
+            EXPECT_FALSE(std::empty(log));
+            EXPECT_EQ(log, run());
+        });
+}
+
+} // namespace libtransmission::test
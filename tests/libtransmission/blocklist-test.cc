@@ -4,8 +4,11 @@
 // License text can be found in the licenses/ folder.
 
 #include <cstring> // strlen()
+#include <string>
 // #include <unistd.h> // sync()
 
+#include <fmt/format.h>
+
 #include <libtransmission/transmission.h>
 
 #include <libtransmission/blocklist.h>
@@ -123,4 +126,76 @@ TEST_F(BlocklistTest, updating)
     // cleanup
 }
 
+TEST_F(BlocklistTest, mergesBlocklists)
+{
+    auto const blocklist_dir = tr_pathbuf{ session_->configDir(), "/blocklists"sv };
+    tr_blocklistSetEnabled(session_, true);
+
+    // two lists, some of whose rules overlap each other
+    createFileWithContents(
+        tr_pathbuf{ blocklist_dir, "/level1"sv },
+        "first:10.0.0.0-10.0.0.255\n"
+        "second:10.0.2.0-10.0.2.255\n"
+        "IPv6 example:2001:db8::-2001:db8::ffff\n");
+    createFileWithContents(
+        tr_pathbuf{ blocklist_dir, "/level2"sv },
+        "third:10.0.0.128-10.0.1.127\n"
+        "fourth:10.0.3.0-10.0.3.0\n"
+        "IPv6 example:2001:db8::8000-2001:db8::1:ffff\n");
+    tr_sessionReloadBlocklists(session_);
+    EXPECT_EQ(6U, tr_blocklistGetRuleCount(session_));
+
+    // the merged index should have been written to disk
+    EXPECT_TRUE(tr_sys_path_exists(tr_pathbuf{ blocklist_dir, "/.blocklist-index"sv }));
+
+    EXPECT_FALSE(addressIsBlocked("9.255.255.255"));
+    EXPECT_TRUE(addressIsBlocked("10.0.0.0"));
+    EXPECT_TRUE(addressIsBlocked("10.0.0.200"));
+    EXPECT_TRUE(addressIsBlocked("10.0.1.127"));
+    EXPECT_FALSE(addressIsBlocked("10.0.1.128"));
+    EXPECT_TRUE(addressIsBlocked("10.0.2.0"));
+    EXPECT_TRUE(addressIsBlocked("10.0.2.255"));
+    EXPECT_TRUE(addressIsBlocked("10.0.3.0"));
+    EXPECT_FALSE(addressIsBlocked("10.0.3.1"));
+    EXPECT_TRUE(addressIsBlocked("2001:db8::1"));
+    EXPECT_TRUE(addressIsBlocked("2001:db8::1:1"));
+    EXPECT_FALSE(addressIsBlocked("2001:db8::2:0"));
+
+    // reloading with nothing changed should give the same answers
+    tr_sessionReloadBlocklists(session_);
+    EXPECT_TRUE(addressIsBlocked("10.0.0.200"));
+    EXPECT_FALSE(addressIsBlocked("10.0.1.128"));
+    EXPECT_TRUE(addressIsBlocked("2001:db8::1:1"));
+
+    // disabling the blocklist should unblock everything
+    tr_blocklistSetEnabled(session_, false);
+    EXPECT_FALSE(addressIsBlocked("10.0.0.200"));
+}
+
+TEST_F(BlocklistTest, manyRanges)
+{
+    // enough ranges that the index is several levels deep,
+    // with a gap between each one
+    auto contents = std::string{};
+    for (int i = 0; i < 1000; ++i)
+    {
+        contents += fmt::format("range{}:11.{}.{}.0-11.{}.{}.127\n", i, i / 256, i % 256, i / 256, i % 256);
+    }
+
+    createFileWithContents(tr_pathbuf{ session_->configDir(), "/blocklists/level1"sv }, contents);
+    tr_sessionReloadBlocklists(session_);
+    tr_blocklistSetEnabled(session_, true);
+    EXPECT_EQ(1000U, tr_blocklistGetRuleCount(session_));
+
+    EXPECT_FALSE(addressIsBlocked("10.255.255.255"));
+    for (int i = 0; i < 1000; ++i)
+    {
+        auto const prefix = fmt::format("11.{}.{}.", i / 256, i % 256);
+        EXPECT_TRUE(addressIsBlocked((prefix + "0").c_str()));
+        EXPECT_TRUE(addressIsBlocked((prefix + "127").c_str()));
+        EXPECT_FALSE(addressIsBlocked((prefix + "128").c_str()));
+        EXPECT_FALSE(addressIsBlocked((prefix + "255").c_str()));
+    }
+}
+
 } // namespace libtransmission::test
@@ -3,9 +3,20 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <array>
+#include <memory>
+#include <string>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
 #include <libtransmission/transmission.h>
 
+#include <libtransmission/file.h>
 #include <libtransmission/tr-buffer.h>
+#include <libtransmission/tr-strbuf.h>
 
 #include "test-fixtures.h"
 
@@ -61,3 +72,48 @@ TEST_F(BufferTest, startsWithInMultiSegment)
     EXPECT_TRUE(buf->starts_with("Hello, World"sv));
     EXPECT_TRUE(buf->starts_with("Hello, World!"sv));
 }
+
+#ifndef _WIN32
+using BufferFileTest = libtransmission::test::SandboxedTest;
+
+TEST_F(BufferFileTest, addFileSendsFileContents)
+{
+    auto const path = tr_pathbuf{ sandboxDir(), "/hello.txt"sv };
+    createFileWithContents(path, "Hello, World!"sv);
+
+    auto const fd = tr_sys_file_open(path, TR_SYS_FILE_READ, 0);
+    ASSERT_NE(TR_BAD_SYS_FILE, fd);
+    auto const keepalive = std::shared_ptr<tr_sys_file_t const>{ new tr_sys_file_t{ fd },
+                                                                 [](tr_sys_file_t const* pfd)
+                                                                 {
+                                                                     tr_sys_file_close(*pfd);
+                                                                     delete pfd;
+                                                                 } };
+
+    auto buf = Buffer{};
+    buf.add("<"sv);
+    EXPECT_TRUE(buf.add_file(fd, 7U, 5U, keepalive));
+    buf.add(">"sv);
+    EXPECT_EQ(7U, std::size(buf));
+
+    auto sockets = std::array<int, 2>{};
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, std::data(sockets)));
+
+    // the file segment may be written separately from the bytes around it
+    while (!std::empty(buf))
+    {
+        auto const n_written = buf.to_socket(sockets[0], std::size(buf));
+        ASSERT_LT(0U, n_written);
+    }
+
+    // libevent should be done with the file by now
+    EXPECT_EQ(1, keepalive.use_count());
+
+    auto received = std::string(7U, '\0');
+    ASSERT_EQ(7, read(sockets[1], std::data(received), std::size(received)));
+    EXPECT_EQ("<World>"sv, received);
+
+    close(sockets[0]);
+    close(sockets[1]);
+}
+#endif
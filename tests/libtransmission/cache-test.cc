@@ -0,0 +1,199 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/cache.h>
+#include <libtransmission/inout.h>
+#include <libtransmission/session.h>
+#include <libtransmission/torrent.h>
+
+#include "test-fixtures.h"
+
+namespace libtransmission::test
+{
+
+auto constexpr MaxWaitMsec = 5000;
+
+using CacheTest = SessionTest;
+
+TEST_F(CacheTest, writesEveryBlockWhenTrimmed)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    auto* const cache = session_->cache.get();
+    auto const n_blocks = tor->blockCount();
+
+    // write every block in random order to a cache that only holds a few of them,
+    // so that blocks are flushed by age while their neighbors are still cached
+    auto blocks = std::vector<tr_block_index_t>(n_blocks);
+    std::iota(std::begin(blocks), std::end(blocks), tr_block_index_t{});
+    std::shuffle(std::begin(blocks), std::end(blocks), std::mt19937{ 0U });
+
+    auto done = false;
+    session_->runInSessionThread(
+        [&]()
+        {
+            cache->setLimit(tr_block_info::BlockSize * 8);
+
+            for (auto const block : blocks)
+            {
+                auto buf = cache->makeBlockBuffer();
+                buf->assign(tor->blockSize(block), static_cast<uint8_t>(block));
+                cache->writeBlock(tor->id(), block, buf);
+            }
+
+            cache->flushTorrent(tor);
+            done = true;
+        });
+    EXPECT_TRUE(waitFor([&done]() { return done; }, MaxWaitMsec));
+
+    for (tr_block_index_t block = 0; block < n_blocks; ++block)
+    {
+        auto const len = tor->blockSize(block);
+        auto contents = std::vector<uint8_t>(len);
+        EXPECT_EQ(0, tr_ioRead(tor, tor->blockLoc(block), len, std::data(contents)));
+        EXPECT_EQ(std::vector<uint8_t>(len, static_cast<uint8_t>(block)), contents) << "block " << block;
+    }
+}
+
+TEST_F(CacheTest, readCacheLoadsWholePieces)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    auto* const cache = session_->cache.get();
+    EXPECT_LT(1U, tor->blockSpanForPiece(0).end - tor->blockSpanForPiece(0).begin);
+
+    auto stats = std::optional<Cache::ReadCacheStats>{};
+    auto contents = std::vector<uint8_t>{};
+    session_->runInSessionThread(
+        [&]()
+        {
+            cache->setReadLimit(tor->pieceSize() * 4);
+
+            // the first read misses and loads the whole piece,
+            // so reading the piece's next block should be a hit
+            auto const first = tor->blockLoc(0);
+            auto const queued = cache->readBlockAsync(
+                tor,
+                first,
+                tor->blockSize(0),
+                [&, second = tor->blockLoc(1)](int err, std::vector<uint8_t>&& /*data*/)
+                {
+                    EXPECT_EQ(0, err);
+                    EXPECT_TRUE(cache->readBlockAsync(
+                        tor,
+                        second,
+                        tor->blockSize(1),
+                        [&](int err2, std::vector<uint8_t>&& data)
+                        {
+                            EXPECT_EQ(0, err2);
+                            contents = std::move(data);
+                            stats = cache->readCacheStats();
+                        }));
+                });
+            EXPECT_TRUE(queued);
+        });
+
+    EXPECT_TRUE(waitFor([&stats]() { return stats.has_value(); }, MaxWaitMsec));
+    EXPECT_EQ(1U, stats->misses);
+    EXPECT_EQ(1U, stats->hits);
+    EXPECT_EQ(0U, stats->evictions);
+    EXPECT_EQ(tor->pieceSize(0), stats->bytes);
+    EXPECT_EQ(std::vector<uint8_t>(tor->blockSize(1)), contents);
+}
+
+TEST_F(CacheTest, readCacheEvictsLeastRecentlyUsedPiece)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    auto* const cache = session_->cache.get();
+
+    auto stats = std::optional<Cache::ReadCacheStats>{};
+    session_->runInSessionThread(
+        [&]()
+        {
+            // only room for one piece
+            cache->setReadLimit(tor->pieceSize());
+
+            auto const queued = cache->readBlockAsync(
+                tor,
+                tor->pieceLoc(0),
+                tor->blockSize(0),
+                [&](int /*err*/, std::vector<uint8_t>&& /*data*/)
+                {
+                    EXPECT_TRUE(cache->readBlockAsync(
+                        tor,
+                        tor->pieceLoc(1),
+                        tor->blockSize(0),
+                        [&](int /*err*/, std::vector<uint8_t>&& /*data*/) { stats = cache->readCacheStats(); }));
+                });
+            EXPECT_TRUE(queued);
+        });
+
+    EXPECT_TRUE(waitFor([&stats]() { return stats.has_value(); }, MaxWaitMsec));
+    EXPECT_EQ(2U, stats->misses);
+    EXPECT_EQ(0U, stats->hits);
+    EXPECT_EQ(1U, stats->evictions);
+    EXPECT_EQ(tor->pieceSize(1), stats->bytes);
+}
+
+TEST_F(CacheTest, readCacheSkipsPiecesWithUnwrittenBlocks)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    auto* const cache = session_->cache.get();
+    EXPECT_LT(1U, tor->blockSpanForPiece(0).end - tor->blockSpanForPiece(0).begin);
+
+    auto constexpr NewByte = uint8_t{ 0xAB };
+    auto contents = std::optional<std::vector<uint8_t>>{};
+    session_->runInSessionThread(
+        [&]()
+        {
+            cache->setLimit(tr_block_info::BlockSize * 64);
+            cache->setReadLimit(tor->pieceSize() * 4);
+
+            // piece 0 is complete, but one of its blocks is only in the write cache
+            auto buf = cache->makeBlockBuffer();
+            buf->assign(tor->blockSize(1), NewByte);
+            cache->writeBlock(tor->id(), 1, buf);
+
+            auto const queued = cache->readBlockAsync(
+                tor,
+                tor->blockLoc(0),
+                tor->blockSize(0),
+                [&](int err, std::vector<uint8_t>&& /*data*/)
+                {
+                    EXPECT_EQ(0, err);
+
+                    // write the block to disk without dropping the read cache
+                    for (tr_file_index_t file = 0; file < tor->fileCount(); ++file)
+                    {
+                        cache->flushFile(tor, file);
+                    }
+                    EXPECT_FALSE(cache->isInMemory(tor, tor->blockLoc(1), tor->blockSize(1)));
+
+                    EXPECT_TRUE(cache->readBlockAsync(
+                        tor,
+                        tor->blockLoc(1),
+                        tor->blockSize(1),
+                        [&](int err2, std::vector<uint8_t>&& data)
+                        {
+                            EXPECT_EQ(0, err2);
+                            contents = std::move(data);
+                        }));
+                });
+            EXPECT_TRUE(queued);
+        });
+
+    EXPECT_TRUE(waitFor([&contents]() { return contents.has_value(); }, MaxWaitMsec));
+    EXPECT_EQ(std::vector<uint8_t>(tor->blockSize(1), NewByte), *contents);
+}
+
+} // namespace libtransmission::test
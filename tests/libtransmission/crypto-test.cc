@@ -7,16 +7,19 @@
 #include <array>
 #include <cstring>
 #include <iostream>
+#include <iterator>
 #include <numeric>
 #include <sstream>
 #include <string>
 #include <string_view>
 #include <unordered_set>
+#include <vector>
 
 #include <libtransmission/transmission.h>
 
 #include <libtransmission/peer-mse.h>
 #include <libtransmission/crypto-utils.h>
+#include <libtransmission/sha1-batch.h>
 #include <libtransmission/utils.h>
 
 #include "crypto-test-ref.h"
@@ -134,6 +137,46 @@ TEST(Crypto, sha1)
     EXPECT_EQ("a94a8fe5ccb19ba61c4c0873d391e987982fbbd3"sv, tr_sha1_to_string(hash5));
 }
 
+TEST(Crypto, sha1Many)
+{
+    auto buf = std::vector<char>(1024 * 1024);
+    tr_rand_buffer(std::data(buf), std::size(buf));
+
+    // lengths around the 55/56/64-byte padding edge cases, plus some bigger
+    // ones, at odd offsets so that some lanes finish before others
+    auto messages = std::vector<std::string_view>{};
+    for (size_t len = 0; len <= 200; ++len)
+    {
+        messages.emplace_back(std::data(buf) + len, len);
+    }
+    for (size_t const len : { 4095U, 16384U, 100000U, 262144U })
+    {
+        messages.emplace_back(std::data(buf) + len % 7, len);
+    }
+
+    auto expected = std::vector<tr_sha1_digest_t>{};
+    std::transform(
+        std::begin(messages),
+        std::end(messages),
+        std::back_inserter(expected),
+        [](auto const& message) { return tr_sha1::digest(message); });
+
+    for (auto const engine : { tr_sha1_engine::Backend, tr_sha1_engine::Simd4, tr_sha1_engine::Avx2, tr_sha1_engine::ShaNi })
+    {
+        if (!tr_sha1_engine_is_supported(engine))
+        {
+            continue;
+        }
+
+        EXPECT_EQ(expected, tr_sha1_digest_many(messages, engine)) << tr_sha1_engine_name(engine);
+        EXPECT_TRUE(std::empty(tr_sha1_digest_many({}, engine))) << tr_sha1_engine_name(engine);
+        EXPECT_EQ(tr_sha1::digest("test"sv), tr_sha1_digest_many({ "test"sv }, engine).front()) << tr_sha1_engine_name(engine);
+    }
+
+    EXPECT_TRUE(tr_sha1_engine_is_supported(tr_sha1_best_engine()));
+    EXPECT_GE(tr_sha1_batch_size(), 1U);
+}
+
 TEST(Crypto, ssha1)
 {
     struct LocalTest
@@ -0,0 +1,107 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/disk-io.h>
+#include <libtransmission/session-thread.h>
+#include <libtransmission/torrent.h>
+
+#include "test-fixtures.h"
+
+namespace libtransmission::test
+{
+
+auto constexpr MaxWaitMsec = 5000;
+
+using DiskIoTest = SessionTest;
+
+TEST_F(DiskIoTest, readsWhatWasWritten)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    auto const session_thread = tr_session_thread::create();
+    auto disk_io = tr_disk_io{ *session_thread };
+
+    auto const loc = tor->blockLoc(0);
+    auto const len = tor->blockSize(0);
+
+    // queue two writes to the same block; the second should win.
+    // jobs must be queued from the session thread, which owns `tor`
+    auto n_written = 0;
+    auto read_err = std::optional<int>{};
+    auto contents = std::vector<uint8_t>{};
+    auto queued = std::optional<bool>{};
+    session_thread->run(
+        [&]()
+        {
+            for (auto const ch : { uint8_t{ 'a' }, uint8_t{ 'b' } })
+            {
+                disk_io.write(
+                    tor,
+                    loc,
+                    std::make_shared<std::vector<uint8_t> const>(len, ch),
+                    [&n_written](int err, tr_file_index_t /*failed_file*/)
+                    {
+                        EXPECT_EQ(0, err);
+                        ++n_written;
+                    });
+            }
+
+            queued = disk_io.read(
+                tor,
+                loc,
+                len,
+                [&read_err, &contents](int err, std::vector<uint8_t>&& data)
+                {
+                    contents = std::move(data);
+                    read_err = err;
+                });
+        });
+
+    EXPECT_TRUE(waitFor([&read_err]() { return read_err.has_value(); }, MaxWaitMsec));
+    EXPECT_EQ(std::optional<bool>{ true }, queued);
+    EXPECT_EQ(2, n_written);
+    EXPECT_EQ(0, *read_err);
+    EXPECT_EQ(std::vector<uint8_t>(len, uint8_t{ 'b' }), contents);
+}
+
+TEST_F(DiskIoTest, flushTorrentRunsPendingCallbacks)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    auto const tor_id = tor->id();
+    auto const session_thread = tr_session_thread::create();
+    auto disk_io = tr_disk_io{ *session_thread };
+
+    // after flushTorrent() returns, every callback should have been invoked
+    auto n_written = 0;
+    auto n_written_at_flush = std::optional<int>{};
+    session_thread->run(
+        [&]()
+        {
+            for (tr_block_index_t block = 0; block < tor->blockCount(); ++block)
+            {
+                disk_io.write(
+                    tor,
+                    tor->blockLoc(block),
+                    std::make_shared<std::vector<uint8_t> const>(tor->blockSize(block), uint8_t{ 'x' }),
+                    [&n_written](int /*err*/, tr_file_index_t /*failed_file*/) { ++n_written; });
+            }
+
+            disk_io.flushTorrent(tor_id);
+            n_written_at_flush = n_written;
+        });
+
+    EXPECT_TRUE(waitFor([&n_written_at_flush]() { return n_written_at_flush.has_value(); }, MaxWaitMsec));
+    EXPECT_EQ(static_cast<int>(tor->blockCount()), *n_written_at_flush);
+    EXPECT_EQ(0U, disk_io.size());
+}
+
+} // namespace libtransmission::test
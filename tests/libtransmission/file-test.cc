@@ -1217,6 +1217,28 @@ TEST_F(FileTest, fileTruncate)
     tr_sys_path_remove(path);
 }
 
+TEST_F(FileTest, map)
+{
+    auto const test_dir = createTestDir(currentTestName());
+
+    auto const path1 = tr_pathbuf{ test_dir, "/a"sv };
+    auto const contents = "test"sv;
+    createFileWithContents(path1, contents);
+
+    auto const fd = tr_sys_file_open(path1, TR_SYS_FILE_READ, 0600);
+
+    tr_error* err = nullptr;
+    auto* const view = static_cast<char const*>(tr_sys_file_map_for_reading(fd, 0, std::size(contents), &err));
+    EXPECT_NE(nullptr, view);
+    EXPECT_EQ(nullptr, err) << *err;
+    EXPECT_EQ(contents, std::string_view(view, std::size(contents)));
+
+    EXPECT_TRUE(tr_sys_file_unmap(view, std::size(contents), &err));
+    EXPECT_EQ(nullptr, err) << *err;
+
+    tr_sys_file_close(fd);
+}
+
 TEST_F(FileTest, filePreallocate)
 {
     auto const test_dir = createTestDir(currentTestName());
@@ -0,0 +1,150 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef>
+#include <cstdio> // sscanf()
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/log.h>
+
+#include "gtest/gtest.h"
+
+using namespace std::literals;
+
+class LogTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        ::testing::Test::SetUp();
+
+        old_level_ = tr_logGetLevel();
+        old_queue_enabled_ = tr_logGetQueueEnabled();
+        old_policy_ = tr_logGetOverflowPolicy();
+
+        tr_logSetLevel(TR_LOG_TRACE);
+        tr_logSetQueueEnabled(true);
+        tr_logFreeQueue(tr_logGetQueue());
+    }
+
+    void TearDown() override
+    {
+        tr_logFreeQueue(tr_logGetQueue());
+        tr_logSetLevel(old_level_);
+        tr_logSetQueueEnabled(old_queue_enabled_);
+        tr_logSetOverflowPolicy(old_policy_);
+
+        ::testing::Test::TearDown();
+    }
+
+    // Each thread logs "{thread} {i}" for i in [0..n_messages)
+    static void logFromThreads(size_t n_threads, size_t n_messages)
+    {
+        auto threads = std::vector<std::thread>{};
+        for (size_t thread = 0; thread < n_threads; ++thread)
+        {
+            threads.emplace_back(
+                [thread, n_messages]()
+                {
+                    auto const name = fmt::format("thread {:d}", thread);
+                    for (size_t i = 0; i < n_messages; ++i)
+                    {
+                        tr_logAddMessage(__FILE__, __LINE__, TR_LOG_TRACE, fmt::format("{:d} {:d}", thread, i), name);
+                    }
+                });
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    tr_log_level old_level_ = {};
+    bool old_queue_enabled_ = {};
+    tr_log_overflow_policy old_policy_ = {};
+};
+
+TEST_F(LogTest, queuesMessagesInOrder)
+{
+    static auto constexpr NumThreads = size_t{ 4U };
+    static auto constexpr NumMessages = size_t{ 2000U };
+
+    tr_logSetOverflowPolicy(TR_LOG_OVERFLOW_BLOCK);
+    logFromThreads(NumThreads, NumMessages);
+
+    // nothing is lost, and each thread's messages are in the order it logged them
+    auto next = std::vector<size_t>(NumThreads);
+    auto* const messages = tr_logGetQueue();
+    for (auto const* msg = messages; msg != nullptr; msg = msg->next)
+    {
+        auto thread = size_t{};
+        auto i = size_t{};
+        ASSERT_EQ(2, sscanf(msg->message.c_str(), "%zu %zu", &thread, &i)) << msg->message;
+        ASSERT_LT(thread, NumThreads);
+        EXPECT_EQ(next[thread], i);
+        EXPECT_EQ(fmt::format("thread {:d}", thread), msg->name);
+        EXPECT_EQ(TR_LOG_TRACE, msg->level);
+        next[thread] = i + 1U;
+    }
+    tr_logFreeQueue(messages);
+
+    EXPECT_EQ(std::vector<size_t>(NumThreads, NumMessages), next);
+}
+
+TEST_F(LogTest, keepsLongMessages)
+{
+    auto const name = std::string(100U, 'n');
+    auto const message = std::string(1000U, 'm');
+    tr_logAddMessage(__FILE__, __LINE__, TR_LOG_INFO, message, name);
+    auto const line = __LINE__ + 1;
+    tr_logAddMessage(__FILE__, line, TR_LOG_INFO, "short"sv);
+
+    auto* const messages = tr_logGetQueue();
+    ASSERT_NE(nullptr, messages);
+    EXPECT_EQ(name, messages->name);
+    EXPECT_EQ(message, messages->message);
+    ASSERT_NE(nullptr, messages->next);
+    EXPECT_EQ("short"sv, messages->next->message);
+    EXPECT_EQ(fmt::format("log-test.cc:{:d}", line), messages->next->name);
+    EXPECT_EQ(nullptr, messages->next->next);
+    tr_logFreeQueue(messages);
+}
+
+TEST_F(LogTest, dropPolicyCountsWhatItDrops)
+{
+    static auto constexpr NumThreads = size_t{ 4U };
+    static auto constexpr NumMessages = size_t{ 2000U };
+
+    tr_logSetOverflowPolicy(TR_LOG_OVERFLOW_DROP);
+    logFromThreads(NumThreads, NumMessages);
+
+    // every message is either queued or counted as dropped
+    auto n_queued = size_t{};
+    auto n_dropped = size_t{};
+    auto* const messages = tr_logGetQueue();
+    for (auto const* msg = messages; msg != nullptr; msg = msg->next)
+    {
+        if (auto n = size_t{}; sscanf(msg->message.c_str(), "Couldn't keep up with logging, so %zu", &n) == 1)
+        {
+            EXPECT_EQ(TR_LOG_WARN, msg->level);
+            n_dropped += n;
+        }
+        else
+        {
+            ++n_queued;
+        }
+    }
+    tr_logFreeQueue(messages);
+
+    EXPECT_EQ(NumThreads * NumMessages, n_queued + n_dropped);
+}
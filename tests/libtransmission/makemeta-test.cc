@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <array>
 #include <cstdlib> // mktemp()
+#include <iterator>
 #include <numeric>
 #include <string>
 #include <string_view>
@@ -137,6 +138,47 @@ TEST_F(MakemetaTest, pieceSize)
     }
 }
 
+TEST_F(MakemetaTest, checksumThreads)
+{
+    static auto constexpr PieceSize = uint32_t{ 16384U };
+
+    auto const files = makeRandomFiles(sandboxDir(), 8, PieceSize * 4U);
+
+    for (size_t const n_threads : { 1U, 3U, 0U })
+    {
+        auto builder = tr_metainfo_builder{ sandboxDir() };
+        builder.setPieceSize(PieceSize);
+        builder.setChecksumThreads(n_threads);
+        auto const metainfo = testBuilder(builder);
+
+        // concatenate the files in the order that the builder sees them
+        auto contents = std::vector<std::byte>{};
+        for (tr_file_index_t i = 0; i < builder.fileCount(); ++i)
+        {
+            auto const basename = tr_sys_path_basename(builder.path(i));
+            auto const it = std::find_if(
+                std::begin(files),
+                std::end(files),
+                [&basename](auto const& file) { return tr_sys_path_basename(file.first) == basename; });
+            ASSERT_NE(std::end(files), it);
+            std::copy(std::begin(it->second), std::end(it->second), std::back_inserter(contents));
+        }
+
+        auto const [n_hashed, n_pieces] = builder.checksumStatus();
+        EXPECT_EQ(metainfo.pieceCount(), n_pieces);
+        EXPECT_EQ(n_pieces, n_hashed);
+
+        // the hashes should be in piece order regardless of which thread made them
+        for (tr_piece_index_t piece = 0; piece < metainfo.pieceCount(); ++piece)
+        {
+            auto const begin = std::data(contents) + size_t{ piece } * PieceSize;
+            auto const len = std::min(size_t{ PieceSize }, std::size(contents) - size_t{ piece } * PieceSize);
+            auto const piece_data = std::string_view{ reinterpret_cast<char const*>(begin), len };
+            EXPECT_EQ(tr_sha1::digest(piece_data), metainfo.pieceHash(piece));
+        }
+    }
+}
+
 TEST_F(MakemetaTest, webseeds)
 {
     auto const files = makeRandomFiles(sandboxDir(), 1);
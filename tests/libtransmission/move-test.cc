@@ -16,6 +16,7 @@
 #include <libtransmission/cache.h> // tr_cacheWriteBlock()
 #include <libtransmission/file.h> // tr_sys_path_*()
 #include <libtransmission/tr-strbuf.h>
+#include <libtransmission/utils.h> // tr_strvStartsWith()
 #include <libtransmission/variant.h>
 
 #include "test-fixtures.h"
@@ -122,12 +123,21 @@ TEST_P(IncompleteDirTest, incompleteDir)
     EXPECT_TRUE(waitFor(test, MaxWaitMsec));
     EXPECT_EQ(TR_SEED, completeness);
 
+    // the files get moved to the download dir in the background
     auto const n = tr_torrentFileCount(tor);
-    for (tr_file_index_t i = 0; i < n; ++i)
+    auto const files_moved = [tor, n, download_dir]()
     {
-        auto const expected = tr_pathbuf{ download_dir, '/', tr_torrentFile(tor, i).name };
-        EXPECT_EQ(expected, tr_torrentFindFile(tor, i));
-    }
+        for (tr_file_index_t i = 0; i < n; ++i)
+        {
+            if (tr_pathbuf{ download_dir, '/', tr_torrentFile(tor, i).name }.sv() != tr_torrentFindFile(tor, i))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    };
+    EXPECT_TRUE(waitFor(files_moved, MaxWaitMsec));
 
     // cleanup
     tr_torrentRemove(tor, true, nullptr, nullptr);
@@ -187,4 +197,86 @@ TEST_F(MoveTest, setLocation)
     tr_torrentRemove(tor, true, nullptr, nullptr);
 }
 
+TEST_F(MoveTest, setLocationOfIncompleteTorrent)
+{
+    auto const target_dir = tr_pathbuf{ session_->configDir(), "/target"sv };
+
+    // init a torrent that's still downloading
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Partial);
+    blockingTorrentVerify(tor);
+    EXPECT_LT(0U, tr_torrentStat(tor)->leftUntilDone);
+    tr_torrentStart(tor);
+
+    // now move it
+    auto state = int{ -1 };
+    auto progress = double{ -1.0 };
+    tr_torrentSetLocation(tor, target_dir, true, &progress, &state);
+    auto test = [&state]()
+    {
+        return state != TR_LOC_MOVING && state != -1;
+    };
+    EXPECT_TRUE(waitFor(test, MaxWaitMsec));
+    EXPECT_EQ(TR_LOC_DONE, state);
+    EXPECT_EQ(1.0, progress);
+
+    // confirm the files really got moved.
+    // some of them are partial, so only look at their directory
+    auto const n = tr_torrentFileCount(tor);
+    for (tr_file_index_t i = 0; i < n; ++i)
+    {
+        EXPECT_TRUE(tr_strvStartsWith(tr_torrentFindFile(tor, i), tr_pathbuf{ target_dir, '/' }.sv()));
+    }
+
+    // it was stopped for the move, so confirm it got restarted
+    auto const restarted = [tor]()
+    {
+        return tr_torrentStat(tor)->activity != TR_STATUS_STOPPED;
+    };
+    EXPECT_TRUE(waitFor(restarted, MaxWaitMsec));
+
+    // cleanup
+    tr_torrentRemove(tor, true, nullptr, nullptr);
+}
+
+TEST_F(MoveTest, cancelledMoveRestartsTorrent)
+{
+    auto const target_dir = tr_pathbuf{ session_->configDir(), "/target"sv };
+    auto const other_dir = tr_pathbuf{ session_->configDir(), "/other"sv };
+
+    // init a torrent that's still downloading
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Partial);
+    blockingTorrentVerify(tor);
+    EXPECT_LT(0U, tr_torrentStat(tor)->leftUntilDone);
+    tr_torrentStart(tor);
+
+    // start moving it, which stops it, then replace that move with one
+    // that doesn't move any files. Do both in the session thread so
+    // that the first move can't finish in between.
+    auto move_state = int{ -1 };
+    auto set_state = int{ -1 };
+    session_->runInSessionThread(
+        [&]()
+        {
+            tr_torrentSetLocation(tor, target_dir, true, nullptr, &move_state);
+            tr_torrentSetLocation(tor, other_dir, false, nullptr, &set_state);
+        });
+    auto test = [&set_state]()
+    {
+        return set_state == TR_LOC_DONE;
+    };
+    EXPECT_TRUE(waitFor(test, MaxWaitMsec));
+    EXPECT_EQ(TR_LOC_ERROR, move_state);
+    EXPECT_EQ(other_dir, tor->downloadDir());
+
+    // the cancelled move stopped it, so confirm it got restarted
+    auto const restarted = [tor]()
+    {
+        return tr_torrentStat(tor)->activity != TR_STATUS_STOPPED;
+    };
+    EXPECT_TRUE(waitFor(restarted, MaxWaitMsec));
+
+    // cleanup
+    tr_torrentRemove(tor, true, nullptr, nullptr);
+}
+
 } // namespace libtransmission::test
@@ -0,0 +1,163 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/mpsc-queue.h>
+#include <libtransmission/small-callback.h>
+
+#include "gtest/gtest.h"
+
+using MpscQueueTest = ::testing::Test;
+using SmallCallbackTest = ::testing::Test;
+
+TEST_F(MpscQueueTest, fifo)
+{
+    auto queue = libtransmission::MpscQueue<int, 4U>{};
+
+    auto value = int{};
+    EXPECT_FALSE(queue.tryPop(value));
+    EXPECT_TRUE(queue.isDrained());
+
+    for (int i = 0; i < 4; ++i)
+    {
+        EXPECT_TRUE(queue.tryPush(int{ i }));
+    }
+    EXPECT_FALSE(queue.tryPush(4));
+    EXPECT_EQ(4U, queue.sizeApprox());
+
+    for (int i = 0; i < 4; ++i)
+    {
+        EXPECT_TRUE(queue.tryPop(value));
+        EXPECT_EQ(i, value);
+    }
+    EXPECT_FALSE(queue.tryPop(value));
+    EXPECT_TRUE(queue.isDrained());
+
+    // wrap around
+    for (int i = 0; i < 10; ++i)
+    {
+        EXPECT_TRUE(queue.tryPush(int{ i }));
+        EXPECT_TRUE(queue.tryPop(value));
+        EXPECT_EQ(i, value);
+    }
+}
+
+TEST_F(MpscQueueTest, movesOnlyOnSuccess)
+{
+    auto queue = libtransmission::MpscQueue<std::unique_ptr<int>, 2U>{};
+
+    EXPECT_TRUE(queue.tryPush(std::make_unique<int>(1)));
+    EXPECT_TRUE(queue.tryPush(std::make_unique<int>(2)));
+
+    auto rejected = std::make_unique<int>(3);
+    EXPECT_FALSE(queue.tryPush(std::move(rejected)));
+    ASSERT_TRUE(rejected); // NOLINT(bugprone-use-after-move)
+    EXPECT_EQ(3, *rejected);
+}
+
+TEST_F(MpscQueueTest, multipleProducers)
+{
+    static auto constexpr NumProducers = size_t{ 4U };
+    static auto constexpr NumPerProducer = size_t{ 20000U };
+
+    auto queue = libtransmission::MpscQueue<size_t, 64U>{};
+
+    auto producers = std::vector<std::thread>{};
+    for (size_t producer = 0; producer < NumProducers; ++producer)
+    {
+        producers.emplace_back(
+            [&queue, producer]()
+            {
+                for (size_t i = 0; i < NumPerProducer; ++i)
+                {
+                    while (!queue.tryPush(producer * NumPerProducer + i))
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+    }
+
+    // every value should arrive exactly once, and
+    // each producer's values should arrive in order
+    auto next = std::array<size_t, NumProducers>{};
+    auto n_popped = size_t{};
+    auto value = size_t{};
+    while (n_popped < NumProducers * NumPerProducer)
+    {
+        if (!queue.tryPop(value))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        auto const producer = value / NumPerProducer;
+        ASSERT_LT(producer, NumProducers);
+        EXPECT_EQ(next[producer], value % NumPerProducer);
+        ++next[producer];
+        ++n_popped;
+    }
+
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+
+    EXPECT_TRUE(queue.isDrained());
+    for (auto const n : next)
+    {
+        EXPECT_EQ(NumPerProducer, n);
+    }
+}
+
+TEST_F(SmallCallbackTest, inlineAndHeap)
+{
+    using Callback = libtransmission::SmallCallback<16U>;
+
+    auto n_calls = 0;
+    auto small = Callback{ [&n_calls]() { ++n_calls; } };
+    EXPECT_TRUE(small);
+    EXPECT_TRUE(small.isInline());
+    small();
+    EXPECT_EQ(1, n_calls);
+
+    auto big_capture = std::array<char, 64>{};
+    auto big = Callback{ [&n_calls, big_capture]() { n_calls += static_cast<int>(std::size(big_capture)); } };
+    EXPECT_FALSE(big.isInline());
+    big();
+    EXPECT_EQ(65, n_calls);
+
+    auto empty = Callback{};
+    EXPECT_FALSE(empty);
+}
+
+TEST_F(SmallCallbackTest, moveOnly)
+{
+    using Callback = libtransmission::SmallCallback<32U>;
+
+    auto value = std::make_shared<int>(0);
+    auto weak = std::weak_ptr<int>{ value };
+
+    auto callback = Callback{ [ptr = std::make_unique<std::shared_ptr<int>>(std::move(value))]() { ++**ptr; } };
+    EXPECT_TRUE(callback.isInline());
+
+    auto moved = Callback{ std::move(callback) };
+    EXPECT_FALSE(callback); // NOLINT(bugprone-use-after-move)
+    moved();
+    ASSERT_FALSE(weak.expired());
+    EXPECT_EQ(1, *weak.lock());
+
+    // destroying the callback destroys its captures
+    callback = std::move(moved);
+    callback.reset();
+    EXPECT_TRUE(weak.expired());
+}
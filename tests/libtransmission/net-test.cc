@@ -4,7 +4,9 @@
 // License text can be found in the licenses/ folder.
 
 #include <array>
+#include <functional>
 #include <string_view>
+#include <unordered_set>
 #include <utility>
 
 #include <libtransmission/transmission.h>
@@ -44,6 +46,26 @@ TEST_F(NetTest, trAddress)
     EXPECT_EQ("::", tr_address::any_ipv6().display_name());
 }
 
+TEST_F(NetTest, hashAddress)
+{
+    auto const hash = std::hash<tr_address>{};
+
+    auto const a = tr_address::from_string("192.0.2.1"sv);
+    auto const b = tr_address::from_string("192.0.2.1"sv);
+    auto const c = tr_address::from_string("192.0.2.2"sv);
+    auto const d = tr_address::from_string("2001:db8::1"sv);
+    auto const e = tr_address::from_string("2001:db8:0::1"sv);
+    ASSERT_TRUE(a && b && c && d && e);
+
+    EXPECT_EQ(hash(*a), hash(*b));
+    EXPECT_NE(hash(*a), hash(*c));
+    EXPECT_EQ(hash(*d), hash(*e));
+    EXPECT_NE(hash(*a), hash(*d));
+
+    auto const set = std::unordered_set<tr_address>{ *a, *b, *c, *d, *e };
+    EXPECT_EQ(3U, std::size(set));
+}
+
 TEST_F(NetTest, compact4)
 {
     static auto constexpr ExpectedReadable = "10.10.10.5"sv;
@@ -20,7 +20,7 @@ using OpenFilesTest = libtransmission::test::SessionTest;
 
 TEST_F(OpenFilesTest, getCachedFailsIfNotCached)
 {
-    auto const fd = session_->openFiles().get(0, 0, false);
+    auto const fd = session_->openFiles().acquire(0, 0, false);
     EXPECT_FALSE(fd);
 }
 
@@ -31,12 +31,12 @@ TEST_F(OpenFilesTest, getOpensIfNotCached)
     createFileWithContents(filename, Contents);
 
     // confirm that it's not pre-cached
-    EXPECT_FALSE(session_->openFiles().get(0, 0, false));
+    EXPECT_FALSE(session_->openFiles().acquire(0, 0, false));
 
     // confirm that we can cache the file
-    auto fd = session_->openFiles().get(0, 0, false, filename, TR_PREALLOCATE_FULL, std::size(Contents));
-    EXPECT_TRUE(fd.has_value());
-    assert(fd.has_value());
+    auto fd = session_->openFiles().acquire(0, 0, false, filename, TR_PREALLOCATE_FULL, std::size(Contents));
+    EXPECT_TRUE(fd);
+    assert(fd);
     EXPECT_NE(TR_BAD_SYS_FILE, *fd);
 
     // test the file contents to confirm that fd points to the right file
@@ -53,9 +53,9 @@ TEST_F(OpenFilesTest, getCacheSucceedsIfCached)
     auto filename = tr_pathbuf{ sandboxDir(), "/test-file.txt" };
     createFileWithContents(filename, Contents);
 
-    EXPECT_FALSE(session_->openFiles().get(0, 0, false));
-    EXPECT_TRUE(session_->openFiles().get(0, 0, false, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
-    EXPECT_TRUE(session_->openFiles().get(0, 0, false));
+    EXPECT_FALSE(session_->openFiles().acquire(0, 0, false));
+    EXPECT_TRUE(session_->openFiles().acquire(0, 0, false, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
+    EXPECT_TRUE(session_->openFiles().acquire(0, 0, false));
 }
 
 TEST_F(OpenFilesTest, getCachedReturnsTheSameFd)
@@ -64,13 +64,13 @@ TEST_F(OpenFilesTest, getCachedReturnsTheSameFd)
     auto filename = tr_pathbuf{ sandboxDir(), "/test-file.txt" };
     createFileWithContents(filename, Contents);
 
-    EXPECT_FALSE(session_->openFiles().get(0, 0, false));
-    auto const fd1 = session_->openFiles().get(0, 0, false, filename, TR_PREALLOCATE_FULL, std::size(Contents));
-    auto const fd2 = session_->openFiles().get(0, 0, false);
-    EXPECT_TRUE(fd1.has_value());
-    EXPECT_TRUE(fd2.has_value());
-    assert(fd1.has_value());
-    assert(fd2.has_value());
+    EXPECT_FALSE(session_->openFiles().acquire(0, 0, false));
+    auto const fd1 = session_->openFiles().acquire(0, 0, false, filename, TR_PREALLOCATE_FULL, std::size(Contents));
+    auto const fd2 = session_->openFiles().acquire(0, 0, false);
+    EXPECT_TRUE(fd1);
+    EXPECT_TRUE(fd2);
+    assert(fd1);
+    assert(fd2);
     EXPECT_EQ(*fd1, *fd2);
 }
 
@@ -81,12 +81,12 @@ TEST_F(OpenFilesTest, getCachedFailsIfWrongPermissions)
     createFileWithContents(filename, Contents);
 
     // cache it in ro mode
-    EXPECT_FALSE(session_->openFiles().get(0, 0, false));
-    EXPECT_TRUE(session_->openFiles().get(0, 0, false, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
+    EXPECT_FALSE(session_->openFiles().acquire(0, 0, false));
+    EXPECT_TRUE(session_->openFiles().acquire(0, 0, false, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
 
     // now try to get it in r/w mode
-    EXPECT_TRUE(session_->openFiles().get(0, 0, false));
-    EXPECT_FALSE(session_->openFiles().get(0, 0, true));
+    EXPECT_TRUE(session_->openFiles().acquire(0, 0, false));
+    EXPECT_FALSE(session_->openFiles().acquire(0, 0, true));
 }
 
 TEST_F(OpenFilesTest, opensInReadOnlyUnlessWritableIsRequested)
@@ -97,9 +97,9 @@ TEST_F(OpenFilesTest, opensInReadOnlyUnlessWritableIsRequested)
 
     // cache a file read-only mode
     tr_error* error = nullptr;
-    auto fd = session_->openFiles().get(0, 0, false, filename, TR_PREALLOCATE_FULL, std::size(Contents));
-    EXPECT_TRUE(fd.has_value());
-    assert(fd.has_value());
+    auto fd = session_->openFiles().acquire(0, 0, false, filename, TR_PREALLOCATE_FULL, std::size(Contents));
+    EXPECT_TRUE(fd);
+    assert(fd);
 
     // confirm that writing to it fails
     EXPECT_FALSE(tr_sys_file_write(*fd, std::data(Contents), std::size(Contents), nullptr, &error));
@@ -113,13 +113,13 @@ TEST_F(OpenFilesTest, createsMissingFileIfWriteRequested)
     auto filename = tr_pathbuf{ sandboxDir(), "/test-file.txt" };
     EXPECT_FALSE(tr_sys_path_exists(filename));
 
-    auto fd = session_->openFiles().get(0, 0, false);
+    auto fd = session_->openFiles().acquire(0, 0, false);
     EXPECT_FALSE(fd);
     EXPECT_FALSE(tr_sys_path_exists(filename));
 
-    fd = session_->openFiles().get(0, 0, true, filename, TR_PREALLOCATE_FULL, std::size(Contents));
-    EXPECT_TRUE(fd.has_value());
-    assert(fd.has_value());
+    fd = session_->openFiles().acquire(0, 0, true, filename, TR_PREALLOCATE_FULL, std::size(Contents));
+    EXPECT_TRUE(fd);
+    assert(fd);
     EXPECT_NE(TR_BAD_SYS_FILE, *fd);
     EXPECT_TRUE(tr_sys_path_exists(filename));
 }
@@ -131,14 +131,14 @@ TEST_F(OpenFilesTest, closeFileClosesTheFile)
     createFileWithContents(filename, Contents);
 
     // cache a file read-only mode
-    EXPECT_TRUE(session_->openFiles().get(0, 0, false, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
-    EXPECT_TRUE(session_->openFiles().get(0, 0, false));
+    EXPECT_TRUE(session_->openFiles().acquire(0, 0, false, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
+    EXPECT_TRUE(session_->openFiles().acquire(0, 0, false));
 
     // close the file
     session_->openFiles().closeFile(0, 0);
 
     // confirm that its fd is no longer cached
-    EXPECT_FALSE(session_->openFiles().get(0, 0, false));
+    EXPECT_FALSE(session_->openFiles().acquire(0, 0, false));
 }
 
 TEST_F(OpenFilesTest, closeTorrentClosesTheTorrentFiles)
@@ -148,21 +148,21 @@ TEST_F(OpenFilesTest, closeTorrentClosesTheTorrentFiles)
 
     auto filename = tr_pathbuf{ sandboxDir(), "/a.txt" };
     createFileWithContents(filename, Contents);
-    EXPECT_TRUE(session_->openFiles().get(TorId, 1, false, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
+    EXPECT_TRUE(session_->openFiles().acquire(TorId, 1, false, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
 
     filename.assign(sandboxDir(), "/b.txt");
     createFileWithContents(filename, Contents);
-    EXPECT_TRUE(session_->openFiles().get(TorId, 3, false, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
+    EXPECT_TRUE(session_->openFiles().acquire(TorId, 3, false, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
 
     // confirm that closing a different torrent does not affect these files
     session_->openFiles().closeTorrent(TorId + 1);
-    EXPECT_TRUE(session_->openFiles().get(TorId, 1, false));
-    EXPECT_TRUE(session_->openFiles().get(TorId, 3, false));
+    EXPECT_TRUE(session_->openFiles().acquire(TorId, 1, false));
+    EXPECT_TRUE(session_->openFiles().acquire(TorId, 3, false));
 
     // confirm that closing this torrent closes and uncaches the files
     session_->openFiles().closeTorrent(TorId);
-    EXPECT_FALSE(session_->openFiles().get(TorId, 1, false));
-    EXPECT_FALSE(session_->openFiles().get(TorId, 3, false));
+    EXPECT_FALSE(session_->openFiles().acquire(TorId, 1, false));
+    EXPECT_FALSE(session_->openFiles().acquire(TorId, 3, false));
 }
 
 TEST_F(OpenFilesTest, closesLeastRecentlyUsedFile)
@@ -177,7 +177,7 @@ TEST_F(OpenFilesTest, closesLeastRecentlyUsedFile)
     for (int i = 0; i < LargerThanCacheLimit; ++i)
     {
         auto filename = tr_pathbuf{ sandboxDir(), fmt::format("/file-{:d}.txt"sv, i) };
-        EXPECT_TRUE(session_->openFiles().get(TorId, i, true, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
+        EXPECT_TRUE(session_->openFiles().acquire(TorId, i, true, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
     }
 
     // Do a lookup-only for the files again *in the same order*. By following the
@@ -189,7 +189,7 @@ TEST_F(OpenFilesTest, closesLeastRecentlyUsedFile)
     for (int i = 0; i < LargerThanCacheLimit; ++i)
     {
         auto filename = tr_pathbuf{ sandboxDir(), fmt::format("/file-{:d}.txt"sv, i) };
-        results[i] = !!session_->openFiles().get(TorId, i, false);
+        results[i] = !!session_->openFiles().acquire(TorId, i, false);
     }
     sorted = results;
     std::sort(std::begin(sorted), std::end(sorted));
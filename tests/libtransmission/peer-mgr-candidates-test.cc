@@ -0,0 +1,115 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#define LIBTRANSMISSION_PEER_MODULE
+
+#include <array>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/peer-mgr-candidates.h>
+
+#include "gtest/gtest.h"
+
+class PeerMgrCandidatesTest : public ::testing::Test
+{
+protected:
+    using Queue = PeerCandidateQueue<int>;
+
+    std::array<int, 4> items_ = { 0, 1, 2, 3 };
+};
+
+TEST_F(PeerMgrCandidatesTest, popsBestKeyFirst)
+{
+    auto queue = Queue{};
+    EXPECT_TRUE(queue.empty());
+    EXPECT_EQ(nullptr, queue.top());
+
+    queue.push(&items_[0], 30U);
+    queue.push(&items_[1], 10U);
+    queue.push(&items_[2], 20U);
+    EXPECT_EQ(3U, queue.size());
+
+    auto popped = std::vector<int*>{};
+    while (auto* const item = queue.top())
+    {
+        popped.push_back(item);
+        queue.pop();
+    }
+
+    EXPECT_EQ((std::vector<int*>{ &items_[1], &items_[2], &items_[0] }), popped);
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST_F(PeerMgrCandidatesTest, pushReplacesOldEntry)
+{
+    auto queue = Queue{};
+    queue.push(&items_[0], 10U);
+    queue.push(&items_[1], 20U);
+
+    // item 0 got worse
+    queue.push(&items_[0], 30U);
+    EXPECT_EQ(2U, queue.size());
+    EXPECT_EQ(&items_[1], queue.top());
+    EXPECT_EQ(20U, queue.topKey());
+    queue.pop();
+    EXPECT_EQ(&items_[0], queue.top());
+    EXPECT_EQ(30U, queue.topKey());
+    queue.pop();
+    EXPECT_EQ(nullptr, queue.top());
+
+    // removed items are skipped
+    queue.push(&items_[2], 10U);
+    queue.push(&items_[3], 20U);
+    queue.remove(&items_[2]);
+    EXPECT_EQ(1U, queue.size());
+    EXPECT_EQ(&items_[3], queue.top());
+}
+
+TEST_F(PeerMgrCandidatesTest, scheduledItemsWait)
+{
+    auto queue = Queue{};
+    queue.schedule(&items_[0], 100);
+    queue.schedule(&items_[1], 200);
+    queue.push(&items_[2], 10U);
+    EXPECT_EQ(3U, queue.size());
+
+    // waiting items aren't ready
+    EXPECT_EQ(&items_[2], queue.top());
+    queue.pop();
+    EXPECT_EQ(nullptr, queue.top());
+    EXPECT_TRUE(std::empty(queue.popDue(99)));
+
+    EXPECT_EQ(std::vector<int*>{ &items_[0] }, queue.popDue(150));
+    EXPECT_EQ(1U, queue.size());
+
+    // pushing a waiting item makes it ready now
+    queue.push(&items_[1], 5U);
+    EXPECT_TRUE(std::empty(queue.popDue(300)));
+    EXPECT_EQ(&items_[1], queue.top());
+}
+
+TEST_F(PeerMgrCandidatesTest, replacedEntriesDoNotPileUp)
+{
+    auto queue = Queue{};
+
+    for (unsigned i = 0; i < 10000U; ++i)
+    {
+        queue.push(&items_[i % std::size(items_)], i);
+        queue.schedule(&items_[(i + 1U) % std::size(items_)], i);
+    }
+
+    EXPECT_EQ(std::size(items_), queue.size());
+
+    auto n_ready = size_t{};
+    for (; queue.top() != nullptr; queue.pop())
+    {
+        ++n_ready;
+    }
+
+    EXPECT_EQ(std::size(items_) - n_ready, std::size(queue.popDue(10000)));
+    EXPECT_TRUE(queue.empty());
+}
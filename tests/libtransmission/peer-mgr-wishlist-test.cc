@@ -5,7 +5,9 @@
 
 #include <algorithm>
 #include <map>
+#include <set>
 #include <type_traits>
+#include <vector>
 
 #define LIBTRANSMISSION_PEER_MODULE
 
@@ -22,6 +24,7 @@ protected:
     {
         mutable std::map<tr_block_index_t, size_t> active_request_count_;
         mutable std::map<tr_piece_index_t, size_t> missing_block_count_;
+        mutable std::map<tr_piece_index_t, size_t> peers_with_piece_count_;
         mutable std::map<tr_piece_index_t, tr_block_span_t> block_span_;
         mutable std::map<tr_piece_index_t, tr_priority_t> piece_priority_;
         mutable std::set<tr_block_index_t> can_request_block_;
@@ -39,6 +42,11 @@ protected:
             return can_request_piece_.count(piece) != 0;
         }
 
+        [[nodiscard]] bool clientWantsPiece(tr_piece_index_t /*piece*/) const final
+        {
+            return true;
+        }
+
         [[nodiscard]] bool isEndgame() const final
         {
             return is_endgame_;
@@ -54,6 +62,11 @@ protected:
             return missing_block_count_[piece];
         }
 
+        [[nodiscard]] size_t countPeersWithPiece(tr_piece_index_t piece) const final
+        {
+            return peers_with_piece_count_[piece];
+        }
+
         [[nodiscard]] tr_block_span_t blockSpan(tr_piece_index_t piece) const final
         {
             return block_span_[piece];
@@ -92,7 +105,7 @@ TEST_F(PeerMgrWishlistTest, doesNotRequestPiecesThatCannotBeRequested)
     }
 
     // we should only get the first piece back
-    auto spans = Wishlist::next(mediator, 1000);
+    auto spans = Wishlist{}.next(mediator, 1000);
     ASSERT_EQ(1U, std::size(spans));
     EXPECT_EQ(mediator.block_span_[0].begin, spans[0].begin);
     EXPECT_EQ(mediator.block_span_[0].end, spans[0].end);
@@ -125,7 +138,7 @@ TEST_F(PeerMgrWishlistTest, doesNotRequestBlocksThatCannotBeRequested)
 
     // even if we ask wishlist for more blocks than exist,
     // it should omit blocks 1-10 from the return set
-    auto spans = Wishlist::next(mediator, 1000);
+    auto spans = Wishlist{}.next(mediator, 1000);
     auto requested = tr_bitfield(250);
     for (auto const& span : spans)
     {
@@ -162,7 +175,7 @@ TEST_F(PeerMgrWishlistTest, doesNotRequestTooManyBlocks)
     // but we only ask for 10 blocks,
     // so that's how many we should get back
     auto const n_wanted = 10U;
-    auto const spans = Wishlist::next(mediator, n_wanted);
+    auto const spans = Wishlist{}.next(mediator, n_wanted);
     auto n_got = size_t{};
     for (auto const& span : spans)
     {
@@ -206,7 +219,7 @@ TEST_F(PeerMgrWishlistTest, prefersHighPriorityPieces)
     for (int run = 0; run < num_runs; ++run)
     {
         auto const n_wanted = 10U;
-        auto spans = Wishlist::next(mediator, n_wanted);
+        auto spans = Wishlist{}.next(mediator, n_wanted);
         auto n_got = size_t{};
         for (auto const& span : spans)
         {
@@ -252,7 +265,7 @@ TEST_F(PeerMgrWishlistTest, onlyRequestsDupesDuringEndgame)
 
     // even if we ask wishlist to list more blocks than exist,
     // those first 150 should be omitted from the return list
-    auto spans = Wishlist::next(mediator, 1000);
+    auto spans = Wishlist{}.next(mediator, 1000);
     auto requested = tr_bitfield(300);
     for (auto const& span : spans)
     {
@@ -265,7 +278,7 @@ TEST_F(PeerMgrWishlistTest, onlyRequestsDupesDuringEndgame)
     // BUT during endgame it's OK to request dupes,
     // so then we _should_ see the first 150 in the list
     mediator.is_endgame_ = true;
-    spans = Wishlist::next(mediator, 1000);
+    spans = Wishlist{}.next(mediator, 1000);
     requested = tr_bitfield(300);
     for (auto const& span : spans)
     {
@@ -315,7 +328,7 @@ TEST_F(PeerMgrWishlistTest, prefersNearlyCompletePieces)
     auto const num_runs = 1000;
     for (int run = 0; run < num_runs; ++run)
     {
-        auto const ranges = Wishlist::next(mediator, 10);
+        auto const ranges = Wishlist{}.next(mediator, 10);
         auto requested = tr_bitfield(300);
         for (auto const& range : ranges)
         {
@@ -331,7 +344,7 @@ TEST_F(PeerMgrWishlistTest, prefersNearlyCompletePieces)
     // those blocks should be next in line.
     for (int run = 0; run < num_runs; ++run)
     {
-        auto const ranges = Wishlist::next(mediator, 20);
+        auto const ranges = Wishlist{}.next(mediator, 20);
         auto requested = tr_bitfield(300);
         for (auto const& range : ranges)
         {
@@ -343,3 +356,128 @@ TEST_F(PeerMgrWishlistTest, prefersNearlyCompletePieces)
         EXPECT_EQ(0U, requested.count(200, 300));
     }
 }
+
+TEST_F(PeerMgrWishlistTest, prefersRarerPieces)
+{
+    auto mediator = MockMediator{};
+
+    // setup: three pieces, all missing
+    mediator.piece_count_ = 3;
+    mediator.missing_block_count_[0] = 100;
+    mediator.missing_block_count_[1] = 100;
+    mediator.missing_block_count_[2] = 100;
+    mediator.block_span_[0] = { 0, 100 };
+    mediator.block_span_[1] = { 100, 200 };
+    mediator.block_span_[2] = { 200, 300 };
+
+    // and we want everything
+    for (tr_piece_index_t i = 0; i < 3; ++i)
+    {
+        mediator.can_request_piece_.insert(i);
+    }
+    for (tr_block_index_t i = 0; i < 300; ++i)
+    {
+        mediator.can_request_block_.insert(i);
+    }
+
+    // but the third piece is rarer than the others
+    mediator.peers_with_piece_count_[0] = 10;
+    mediator.peers_with_piece_count_[1] = 10;
+    mediator.peers_with_piece_count_[2] = 1;
+
+    // NB: when all other things are equal in the wishlist, pieces are
+    // picked at random so this test -could- pass even if there's a bug.
+    // So test several times to shake out any randomness
+    auto const num_runs = 1000;
+    for (int run = 0; run < num_runs; ++run)
+    {
+        auto const ranges = Wishlist{}.next(mediator, 10);
+        auto requested = tr_bitfield(300);
+        for (auto const& range : ranges)
+        {
+            requested.setSpan(range.begin, range.end);
+        }
+        EXPECT_EQ(10U, requested.count());
+        EXPECT_EQ(10U, requested.count(200, 300));
+    }
+}
+
+TEST_F(PeerMgrWishlistTest, resortsChangedPieces)
+{
+    auto mediator = MockMediator{};
+
+    // setup: twenty pieces, all missing, and piece N has N+1 peers.
+    // That's enough pieces that a couple of changes get re-sorted one
+    // at a time instead of by rebuilding the whole wishlist.
+    auto constexpr NumPieces = tr_piece_index_t{ 20 };
+    auto constexpr BlocksPerPiece = tr_block_index_t{ 10 };
+    auto constexpr NumBlocks = NumPieces * BlocksPerPiece;
+    mediator.piece_count_ = NumPieces;
+    for (tr_piece_index_t i = 0; i < NumPieces; ++i)
+    {
+        mediator.missing_block_count_[i] = BlocksPerPiece;
+        mediator.block_span_[i] = { i * BlocksPerPiece, (i + 1) * BlocksPerPiece };
+        mediator.peers_with_piece_count_[i] = i + 1;
+        mediator.can_request_piece_.insert(i);
+    }
+
+    // and we want everything
+    for (tr_block_index_t i = 0; i < NumBlocks; ++i)
+    {
+        mediator.can_request_block_.insert(i);
+    }
+
+    auto const requested_pieces = [&mediator](std::vector<tr_block_span_t> const& spans)
+    {
+        auto requested = tr_bitfield(NumBlocks);
+        for (auto const& span : spans)
+        {
+            requested.setSpan(span.begin, span.end);
+        }
+
+        auto pieces = std::set<tr_piece_index_t>{};
+        for (tr_piece_index_t i = 0; i < NumPieces; ++i)
+        {
+            auto const [begin, end] = mediator.block_span_[i];
+            if (requested.count(begin, end) == BlocksPerPiece)
+            {
+                pieces.insert(i);
+            }
+        }
+        return pieces;
+    };
+
+    // the first pieces are the rarest, so they should be picked first
+    auto wishlist = Wishlist{};
+    EXPECT_EQ((std::set<tr_piece_index_t>{ 0, 1, 2 }), requested_pieces(wishlist.next(mediator, 30)));
+
+    // the wishlist doesn't notice changes until it's told about them...
+    mediator.peers_with_piece_count_[0] = 100;
+    mediator.peers_with_piece_count_[5] = 0;
+    mediator.peers_with_piece_count_[19] = 0;
+    EXPECT_EQ((std::set<tr_piece_index_t>{ 0, 1, 2 }), requested_pieces(wishlist.next(mediator, 30)));
+
+    // ...but re-sorts the ones it's told about. Piece 19 wasn't mentioned,
+    // so it keeps its old place, which shows that only the changed pieces
+    // were re-sorted and the wishlist wasn't rebuilt.
+    wishlist.pieceChanged(0);
+    wishlist.pieceChanged(5);
+    auto spans = wishlist.next(mediator, 10);
+    ASSERT_EQ(1U, std::size(spans));
+    EXPECT_EQ(mediator.block_span_[5].begin, spans[0].begin);
+    EXPECT_EQ((std::set<tr_piece_index_t>{ 1, 2, 5 }), requested_pieces(wishlist.next(mediator, 30)));
+    EXPECT_EQ((std::set<tr_piece_index_t>{ 1, 2, 3, 4, 5 }), requested_pieces(wishlist.next(mediator, 50)));
+
+    // once a quarter of the pieces have changed, it's cheaper to
+    // rebuild everything, which picks up piece 19 too
+    for (tr_piece_index_t i = 10; i < 16; ++i)
+    {
+        wishlist.pieceChanged(i);
+    }
+    EXPECT_EQ((std::set<tr_piece_index_t>{ 1, 5, 19 }), requested_pieces(wishlist.next(mediator, 30)));
+
+    // pieces that are no longer missing any blocks are dropped
+    mediator.missing_block_count_[5] = 0;
+    wishlist.pieceChanged(5);
+    EXPECT_EQ((std::set<tr_piece_index_t>{ 1, 2, 19 }), requested_pieces(wishlist.next(mediator, 30)));
+}
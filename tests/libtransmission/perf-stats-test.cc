@@ -0,0 +1,108 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <chrono>
+#include <string>
+#include <string_view>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/perf-stats.h>
+
+#include "gtest/gtest.h"
+
+using namespace std::literals;
+
+using PerfStatsTest = ::testing::Test;
+
+TEST_F(PerfStatsTest, histogramBuckets)
+{
+    auto histogram = tr_perf_stats::Histogram{};
+    histogram.add(0us);
+    histogram.add(1us);
+    histogram.add(5us);
+    histogram.add(8us);
+    histogram.add(1h);
+
+    EXPECT_EQ(5U, histogram.count());
+    EXPECT_EQ(1U, histogram.buckets()[0]);
+    EXPECT_EQ(1U, histogram.buckets()[1]);
+    EXPECT_EQ(1U, histogram.buckets()[3]);
+    EXPECT_EQ(1U, histogram.buckets()[4]);
+    EXPECT_EQ(1U, histogram.buckets().back());
+    EXPECT_EQ(uint64_t{ 3600000000U }, histogram.maxUsec());
+    EXPECT_EQ(uint64_t{ 3600000014U }, histogram.totalUsec());
+
+    EXPECT_EQ(1U, tr_perf_stats::Histogram::bucketLimitUsec(0));
+    EXPECT_EQ(8U, tr_perf_stats::Histogram::bucketLimitUsec(3));
+    EXPECT_EQ(0U, tr_perf_stats::Histogram::bucketLimitUsec(tr_perf_stats::Histogram::NumBuckets - 1U));
+}
+
+TEST_F(PerfStatsTest, histogramPercentiles)
+{
+    auto histogram = tr_perf_stats::Histogram{};
+    EXPECT_EQ(0U, histogram.percentileUsec(50.0));
+
+    for (int i = 0; i < 90; ++i)
+    {
+        histogram.add(100us);
+    }
+    for (int i = 0; i < 10; ++i)
+    {
+        histogram.add(5000us);
+    }
+
+    // 100us lands in the [64, 128) bucket
+    EXPECT_EQ(128U, histogram.percentileUsec(50.0));
+    EXPECT_EQ(128U, histogram.percentileUsec(90.0));
+
+    // never overstate the worst sample
+    EXPECT_EQ(5000U, histogram.percentileUsec(99.0));
+}
+
+TEST_F(PerfStatsTest, tasksAndQueue)
+{
+    auto stats = tr_perf_stats{};
+    stats.addTask("a"sv, 10ms);
+    stats.addTask("a"sv, 20ms);
+    stats.addTask("b"sv, 1ms);
+    {
+        auto const timer = stats.time("c"sv);
+    }
+    stats.addQueueWait(3ms);
+    stats.addLoopLag(2ms);
+    stats.setQueueDepth(7U);
+    stats.setQueueDepth(2U);
+
+    auto const snapshot = stats.snapshot();
+    ASSERT_EQ(3U, std::size(snapshot.tasks));
+    EXPECT_EQ(2U, snapshot.tasks.at("a").count());
+    EXPECT_EQ(30000U, snapshot.tasks.at("a").totalUsec());
+    EXPECT_EQ(1U, snapshot.tasks.at("b").count());
+    EXPECT_EQ(1U, snapshot.tasks.at("c").count());
+    EXPECT_EQ(1U, snapshot.queue_wait.count());
+    EXPECT_EQ(1U, snapshot.loop_lag.count());
+    EXPECT_EQ(2U, snapshot.queue_depth);
+    EXPECT_EQ(7U, snapshot.peak_queue_depth);
+}
+
+TEST_F(PerfStatsTest, prometheus)
+{
+    auto stats = tr_perf_stats{};
+    stats.addTask("peer-mgr.rechoke"sv, 3us);
+    stats.setQueueDepth(4U);
+
+    auto const text = stats.toPrometheus();
+    auto const contains = [&text](std::string_view needle)
+    {
+        return text.find(needle) != std::string::npos;
+    };
+    EXPECT_TRUE(contains("# TYPE transmission_task_duration_seconds histogram\n"sv));
+    EXPECT_TRUE(contains("transmission_task_duration_seconds_bucket{task=\"peer-mgr.rechoke\",le=\"4e-06\"} 1\n"sv));
+    EXPECT_TRUE(contains("transmission_task_duration_seconds_bucket{task=\"peer-mgr.rechoke\",le=\"+Inf\"} 1\n"sv));
+    EXPECT_TRUE(contains("transmission_task_duration_seconds_count{task=\"peer-mgr.rechoke\"} 1\n"sv));
+    EXPECT_TRUE(contains("transmission_session_thread_queue_depth 4\n"sv));
+    EXPECT_TRUE(contains("transmission_session_thread_loop_lag_seconds_count 0\n"sv));
+}
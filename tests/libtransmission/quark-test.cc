@@ -11,6 +11,8 @@
 #include <cstring>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <vector>
 
 class QuarkTest : public ::testing::Test
 {
@@ -40,3 +42,87 @@ TEST_F(QuarkTest, newQuarkByStringView)
     auto const q = tr_quark_new(UniqueString);
     EXPECT_EQ(UniqueString, tr_quark_get_string_view(q));
 }
+
+TEST_F(QuarkTest, newQuarkFromManyThreads)
+{
+    static auto constexpr NumThreads = 4;
+    static auto constexpr NumStrings = 500;
+
+    // every thread makes the same quarks, so they should all agree
+    auto results = std::vector<std::vector<tr_quark>>(NumThreads);
+    auto threads = std::vector<std::thread>{};
+    for (auto& result : results)
+    {
+        threads.emplace_back(
+            [&result]()
+            {
+                for (int i = 0; i < NumStrings; ++i)
+                {
+                    auto const str = "https://tracker" + std::to_string(i) + ".example/announce";
+                    auto const q = tr_quark_new(str);
+                    EXPECT_EQ(str, tr_quark_get_string_view(q));
+                    result.push_back(q);
+                }
+            });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (auto const& result : results)
+    {
+        EXPECT_EQ(results.front(), result);
+    }
+}
+
+TEST_F(QuarkTest, lookupWhileOtherThreadsAddQuarks)
+{
+    static auto constexpr NumWriters = 2;
+    static auto constexpr NumStrings = 20000;
+
+    auto constexpr Known = std::string_view{ "a runtime quark made before the others" };
+    auto const known = tr_quark_new(Known);
+
+    // enough new quarks to make the index grow a few times while readers use it
+    auto writers = std::vector<std::thread>{};
+    for (int writer = 0; writer < NumWriters; ++writer)
+    {
+        writers.emplace_back(
+            [writer]()
+            {
+                for (int i = 0; i < NumStrings; ++i)
+                {
+                    auto const str = "label-" + std::to_string(writer) + '-' + std::to_string(i);
+                    auto const q = tr_quark_new(str);
+                    EXPECT_EQ(str, tr_quark_get_string_view(q));
+                    EXPECT_EQ(q, tr_quark_lookup(str));
+                }
+            });
+    }
+
+    for (int i = 0; i < NumStrings; ++i)
+    {
+        EXPECT_EQ(known, tr_quark_lookup(Known));
+        EXPECT_EQ(Known, tr_quark_get_string_view(known));
+        EXPECT_FALSE(tr_quark_lookup("a string that nobody makes into a quark"));
+    }
+
+    for (auto& writer : writers)
+    {
+        writer.join();
+    }
+
+    for (int writer = 0; writer < NumWriters; ++writer)
+    {
+        for (int i = 0; i < NumStrings; ++i)
+        {
+            auto const str = "label-" + std::to_string(writer) + '-' + std::to_string(i);
+            auto const q = tr_quark_lookup(str);
+            ASSERT_TRUE(q);
+            EXPECT_EQ(str, tr_quark_get_string_view(*q));
+            EXPECT_EQ('\0', tr_quark_get_string_view(*q).data()[std::size(str)]);
+        }
+    }
+}
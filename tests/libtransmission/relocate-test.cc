@@ -0,0 +1,221 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/stat.h> // mkfifo()
+#endif
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/file.h>
+#include <libtransmission/relocate.h>
+#include <libtransmission/tr-strbuf.h>
+#include <libtransmission/utils.h>
+
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission::test
+{
+
+class RelocateTest : public SandboxedTest
+{
+protected:
+    static auto constexpr MaxWaitMsec = 5000;
+    static auto constexpr TorId = tr_torrent_id_t{ 1 };
+
+    // Pretend that the sandbox's `a` and `b` subdirectories are on different devices
+    static std::string fakeDeviceKey(std::string_view path)
+    {
+        return tr_strvContains(path, "/b/"sv) || tr_strvEndsWith(path, "/b"sv) ? "b" : "a";
+    }
+
+    void SetUp() override
+    {
+        SandboxedTest::SetUp();
+
+        worker_ = std::make_unique<tr_relocate_worker>(fakeDeviceKey);
+        worker_->addCallback([this](auto const& /*job*/) { ++n_callbacks_; });
+    }
+
+    void TearDown() override
+    {
+        worker_.reset();
+
+        SandboxedTest::TearDown();
+    }
+
+    [[nodiscard]] tr_pathbuf path(std::string_view subpath) const
+    {
+        return tr_pathbuf{ sandboxDir(), '/', subpath };
+    }
+
+    // A job that moves every file in `subpaths` from the `a` device to the `b` device
+    template<typename... Subpaths>
+    std::shared_ptr<tr_relocate_worker::Job> makeJob(Subpaths... subpaths)
+    {
+        auto job = std::make_shared<tr_relocate_worker::Job>();
+        job->tor_id = TorId;
+        job->old_dir = path("a"sv);
+        job->new_dir = path("b"sv);
+        job->setme_progress = &progress_;
+        job->setme_state = &state_;
+
+        for (auto const subpath : { std::string_view{ subpaths }... })
+        {
+            auto& file = job->files.emplace_back();
+            file.old_path = tr_pathbuf{ job->old_dir, '/', subpath };
+            file.new_path = tr_pathbuf{ job->new_dir, '/', subpath };
+            if (auto const info = tr_sys_path_get_info(file.old_path); info)
+            {
+                file.size = info->size;
+            }
+        }
+
+        return job;
+    }
+
+    [[nodiscard]] static std::string contents(std::string_view filename)
+    {
+        auto file = tr_mapped_file{};
+        return file.load(filename) ? std::string{ file.sv() } : std::string{};
+    }
+
+    std::unique_ptr<tr_relocate_worker> worker_;
+    std::atomic<int> n_callbacks_ = {};
+    double volatile progress_ = 0.0;
+    int volatile state_ = TR_LOC_MOVING;
+};
+
+TEST_F(RelocateTest, copiesOnlyFilesOnOtherDevices)
+{
+    createFileWithContents(path("a/one"sv), "one"sv);
+    createFileWithContents(path("a/dir/two"sv), "two"sv);
+    auto job = makeJob("one"sv, "dir/two"sv);
+
+    // this one's already on the new device, so it should just be renamed later
+    createFileWithContents(path("b/three-old"sv), "three"sv);
+    auto& renamed = job->files.emplace_back();
+    renamed.old_path = path("b/three-old"sv);
+    renamed.new_path = path("b/three"sv);
+
+    worker_->add(job);
+    EXPECT_TRUE(waitFor([this]() { return n_callbacks_ == 1; }, MaxWaitMsec));
+    EXPECT_TRUE(worker_->finish(*job));
+    EXPECT_FALSE(worker_->contains(TorId));
+
+    EXPECT_TRUE(std::empty(job->error_message));
+    EXPECT_EQ(1.0, progress_);
+    EXPECT_EQ("one"sv, contents(path("b/one"sv)));
+    EXPECT_EQ("two"sv, contents(path("b/dir/two"sv)));
+    EXPECT_TRUE(job->files[0].copied_mtime);
+    EXPECT_TRUE(job->files[1].copied_mtime);
+    EXPECT_FALSE(job->files[2].copied_mtime);
+    EXPECT_FALSE(tr_sys_path_exists(path("b/three"sv)));
+
+    // the worker doesn't touch the old copies
+    EXPECT_EQ("one"sv, contents(path("a/one"sv)));
+    EXPECT_EQ("two"sv, contents(path("a/dir/two"sv)));
+    EXPECT_EQ("three"sv, contents(path("b/three-old"sv)));
+}
+
+TEST_F(RelocateTest, removeOriginalsSkipsChangedFiles)
+{
+    createFileWithContents(path("a/one"sv), "one"sv);
+    createFileWithContents(path("a/two"sv), "two"sv);
+    auto job = makeJob("one"sv, "two"sv);
+
+    worker_->add(job);
+    EXPECT_TRUE(waitFor([this]() { return n_callbacks_ == 1; }, MaxWaitMsec));
+    EXPECT_TRUE(worker_->finish(*job));
+    ASSERT_TRUE(job->files[1].copied_mtime);
+
+    // pretend `two` was written to after it was copied
+    *job->files[1].copied_mtime -= 10;
+
+    tr_relocate_worker::removeOriginals(*job);
+    EXPECT_FALSE(tr_sys_path_exists(path("a/one"sv)));
+    EXPECT_TRUE(tr_sys_path_exists(path("a/two"sv)));
+    EXPECT_EQ("one"sv, contents(path("b/one"sv)));
+    EXPECT_EQ("two"sv, contents(path("b/two"sv)));
+}
+
+TEST_F(RelocateTest, failedCopyRemovesCopies)
+{
+    createFileWithContents(path("a/one"sv), "one"sv);
+    auto job = makeJob("one"sv, "missing"sv);
+
+    worker_->add(job);
+    EXPECT_TRUE(waitFor([this]() { return n_callbacks_ == 1; }, MaxWaitMsec));
+    EXPECT_TRUE(worker_->finish(*job));
+
+    EXPECT_FALSE(std::empty(job->error_message));
+    EXPECT_NE(0, job->error_code);
+    EXPECT_FALSE(tr_sys_path_exists(path("b/one"sv)));
+    EXPECT_FALSE(tr_sys_path_exists(path("b/missing"sv)));
+    EXPECT_TRUE(tr_sys_path_exists(path("a/one"sv)));
+}
+
+TEST_F(RelocateTest, removeAfterCopyRemovesCopies)
+{
+    createFileWithContents(path("a/one"sv), "one"sv);
+    auto job = makeJob("one"sv);
+
+    worker_->add(job);
+    EXPECT_TRUE(waitFor([this]() { return n_callbacks_ == 1; }, MaxWaitMsec));
+    EXPECT_TRUE(tr_sys_path_exists(path("b/one"sv)));
+
+    // cancel it before the caller finishes it
+    worker_->remove(TorId);
+    EXPECT_FALSE(worker_->finish(*job));
+    EXPECT_EQ(TR_LOC_ERROR, state_);
+    EXPECT_FALSE(tr_sys_path_exists(path("b/one"sv)));
+    EXPECT_TRUE(tr_sys_path_exists(path("a/one"sv)));
+}
+
+#ifndef _WIN32
+
+TEST_F(RelocateTest, removeDuringCopyRemovesCopies)
+{
+    // `two` is a pipe, so copying it blocks until the test opens it for writing.
+    // That gives a chance to cancel the job after `one` has been copied
+    // and while `two` is partway through.
+    createFileWithContents(path("a/one"sv), "one"sv);
+    auto const fifo = path("a/two"sv);
+    ASSERT_EQ(0, mkfifo(fifo.c_str(), 0600));
+    auto job = makeJob("one"sv, "two"sv);
+
+    worker_->add(job);
+    EXPECT_TRUE(waitFor([this]() { return contents(path("b/one"sv)) == "one"sv; }, MaxWaitMsec));
+
+    auto remover = std::thread([this]() { worker_->remove(TorId); });
+    EXPECT_TRUE(waitFor([&job]() { return job->stop.load(); }, MaxWaitMsec));
+    EXPECT_TRUE(worker_->contains(TorId));
+
+    // open the other end of the pipe so that the copy can go on
+    // and notice that it's been cancelled
+    auto const fd = tr_sys_file_open(fifo, TR_SYS_FILE_WRITE, 0);
+    EXPECT_NE(TR_BAD_SYS_FILE, fd);
+    remover.join();
+    tr_sys_file_close(fd);
+
+    EXPECT_EQ(0, n_callbacks_);
+    EXPECT_FALSE(worker_->contains(TorId));
+    EXPECT_EQ(TR_LOC_ERROR, state_);
+    EXPECT_FALSE(tr_sys_path_exists(path("b/one"sv)));
+    EXPECT_FALSE(tr_sys_path_exists(path("b/two"sv)));
+    EXPECT_TRUE(tr_sys_path_exists(path("a/one"sv)));
+}
+
+#endif
+
+} // namespace libtransmission::test
@@ -0,0 +1,209 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cstddef> // std::byte
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/error.h>
+#include <libtransmission/file.h>
+#include <libtransmission/resume-store.h>
+#include <libtransmission/tr-strbuf.h>
+#include <libtransmission/utils.h>
+
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission::test
+{
+
+class ResumeStoreTest : public SandboxedTest
+{
+protected:
+    [[nodiscard]] std::string storeFilename() const
+    {
+        return tr_pathbuf{ sandboxDir(), "/resume.snapshot"sv }.c_str();
+    }
+
+    [[nodiscard]] static tr_sha1_digest_t makeHash(int n)
+    {
+        auto hash = tr_sha1_digest_t{};
+        hash.fill(static_cast<std::byte>(n));
+        return hash;
+    }
+};
+
+TEST_F(ResumeStoreTest, roundTrip)
+{
+    auto const filename = storeFilename();
+    auto const hash1 = makeHash(1);
+    auto const hash2 = makeHash(2);
+
+    {
+        auto store = tr_resume_store{ filename };
+        EXPECT_TRUE(store.load());
+        EXPECT_TRUE(store.empty());
+
+        store.put(hash1, "d4:name3:onee"sv);
+        store.put(hash2, "d4:name3:twoe"sv);
+        EXPECT_TRUE(store.isDirty());
+        EXPECT_EQ("d4:name3:onee"sv, store.get(hash1));
+        EXPECT_TRUE(store.flush());
+        EXPECT_FALSE(store.isDirty());
+    }
+
+    auto store = tr_resume_store{ filename };
+    EXPECT_TRUE(store.load());
+    EXPECT_EQ(2U, store.size());
+    EXPECT_EQ("d4:name3:onee"sv, store.get(hash1));
+    EXPECT_EQ("d4:name3:twoe"sv, store.get(hash2));
+    EXPECT_FALSE(store.get(makeHash(3)));
+
+    // newer records win, and erased ones stay gone
+    store.put(hash1, "d4:name5:onetwoe"sv);
+    store.erase(hash2);
+    EXPECT_TRUE(store.flush());
+    EXPECT_TRUE(store.load());
+    EXPECT_EQ(1U, store.size());
+    EXPECT_EQ("d4:name5:onetwoe"sv, store.get(hash1));
+    EXPECT_FALSE(store.get(hash2));
+    EXPECT_LT(0U, store.deadBytes());
+
+    store.remove();
+    EXPECT_TRUE(store.empty());
+    EXPECT_FALSE(tr_sys_path_exists(filename));
+}
+
+TEST_F(ResumeStoreTest, discardsDamagedTail)
+{
+    auto const filename = storeFilename();
+
+    auto store = tr_resume_store{ filename };
+    EXPECT_TRUE(store.load());
+    store.put(makeHash(1), "d4:name3:onee"sv);
+    EXPECT_TRUE(store.flush());
+    auto const good_size = store.fileSize();
+    store.put(makeHash(2), "d4:name3:twoe"sv);
+    EXPECT_TRUE(store.flush());
+
+    // simulate a crash in the middle of writing the second record
+    auto contents = std::string{};
+    {
+        auto file = tr_mapped_file{};
+        EXPECT_TRUE(file.load(filename));
+        contents = file.sv();
+    }
+    contents.resize(contents.size() - 4U);
+    EXPECT_TRUE(tr_saveFile(filename, contents));
+
+    EXPECT_TRUE(store.load());
+    EXPECT_EQ(1U, store.size());
+    EXPECT_EQ("d4:name3:onee"sv, store.get(makeHash(1)));
+    EXPECT_EQ(std::size(contents), store.fileSize());
+
+    // the next flush overwrites the damage
+    store.put(makeHash(3), "d4:name5:threee"sv);
+    EXPECT_TRUE(store.flush());
+    EXPECT_TRUE(store.load());
+    EXPECT_EQ(2U, store.size());
+    EXPECT_EQ("d4:name5:threee"sv, store.get(makeHash(3)));
+    EXPECT_LT(good_size, store.fileSize());
+    auto const info = tr_sys_path_get_info(filename);
+    ASSERT_TRUE(info);
+    EXPECT_EQ(info->size, store.fileSize());
+
+    // flip a bit in the payload so the checksum fails
+    {
+        auto file = tr_mapped_file{};
+        EXPECT_TRUE(file.load(filename));
+        contents = file.sv();
+    }
+    contents[contents.find("three")] = 'T';
+    EXPECT_TRUE(tr_saveFile(filename, contents));
+    EXPECT_TRUE(store.load());
+    EXPECT_EQ(1U, store.size());
+    EXPECT_FALSE(store.get(makeHash(3)));
+}
+
+TEST_F(ResumeStoreTest, rejectsBadHeader)
+{
+    auto const filename = storeFilename();
+    auto const bad_contents = "this is not a resume store"sv;
+    EXPECT_TRUE(tr_saveFile(filename, bad_contents));
+
+    auto store = tr_resume_store{ filename };
+    tr_error* error = nullptr;
+    EXPECT_FALSE(store.load(&error));
+    ASSERT_NE(nullptr, error);
+    tr_error_clear(&error);
+    EXPECT_TRUE(store.empty());
+
+    // the unknown file is kept
+    auto const backup = tr_pathbuf{ filename, ".bad"sv };
+    EXPECT_FALSE(tr_sys_path_exists(filename));
+    auto file = tr_mapped_file{};
+    EXPECT_TRUE(file.load(backup));
+    EXPECT_EQ(bad_contents, file.sv());
+
+    // the next flush starts a new file
+    store.put(makeHash(1), "d4:name3:onee"sv);
+    EXPECT_TRUE(store.flush());
+    EXPECT_TRUE(store.load());
+    EXPECT_EQ("d4:name3:onee"sv, store.get(makeHash(1)));
+    EXPECT_TRUE(tr_sys_path_exists(backup));
+}
+
+TEST_F(ResumeStoreTest, removesFilesAfterFlush)
+{
+    auto const filename = storeFilename();
+    auto const resume_file = tr_pathbuf{ sandboxDir(), "/one.resume"sv };
+    EXPECT_TRUE(tr_saveFile(resume_file, "d4:name3:onee"sv));
+
+    auto store = tr_resume_store{ filename };
+    EXPECT_TRUE(store.load());
+    store.put(makeHash(1), "d4:name3:onee"sv);
+    store.removeAfterFlush(std::string{ resume_file.sv() });
+    EXPECT_TRUE(tr_sys_path_exists(resume_file));
+
+    EXPECT_TRUE(store.flush());
+    EXPECT_FALSE(tr_sys_path_exists(resume_file));
+    EXPECT_FALSE(store.isDirty());
+}
+
+TEST_F(ResumeStoreTest, compacts)
+{
+    auto const filename = storeFilename();
+    auto const payload = std::string(4096U, 'x');
+
+    auto store = tr_resume_store{ filename };
+    EXPECT_TRUE(store.load());
+    store.put(makeHash(1), "d4:name3:onee"sv);
+    EXPECT_TRUE(store.flush());
+
+    // keep rewriting one torrent until its old records
+    // outweigh the live ones and the file gets compacted
+    auto max_size = uint64_t{};
+    for (int i = 0; i < 200; ++i)
+    {
+        store.put(makeHash(2), payload);
+        EXPECT_TRUE(store.flush());
+        max_size = std::max(max_size, store.fileSize());
+    }
+
+    EXPECT_GT(max_size, store.fileSize());
+    EXPECT_GT(payload.size() * 200U, max_size);
+
+    EXPECT_TRUE(store.load());
+    EXPECT_EQ(2U, store.size());
+    EXPECT_EQ("d4:name3:onee"sv, store.get(makeHash(1)));
+    EXPECT_EQ(payload, store.get(makeHash(2)));
+}
+
+} // namespace libtransmission::test
@@ -12,6 +12,7 @@
 #include <algorithm>
 #include <array>
 #include <set>
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -90,7 +91,7 @@ TEST_F(RpcTest, sessionGet)
     EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &args));
 
     // what we expected
-    auto const expected_keys = std::array<tr_quark, 59>{
+    auto const expected_keys = std::array<tr_quark, 60>{
         TR_KEY_alt_speed_down,
         TR_KEY_alt_speed_enabled,
         TR_KEY_alt_speed_time_begin,
@@ -125,6 +126,7 @@ TEST_F(RpcTest, sessionGet)
         TR_KEY_port_forwarding_enabled,
         TR_KEY_queue_stalled_enabled,
         TR_KEY_queue_stalled_minutes,
+        TR_KEY_read_cache_size_mb,
         TR_KEY_rename_partial_files,
         TR_KEY_rpc_version,
         TR_KEY_rpc_version_minimum,
@@ -185,4 +187,177 @@ TEST_F(RpcTest, sessionGet)
     tr_torrentRemove(tor, false, nullptr, nullptr);
 }
 
+TEST_F(RpcTest, serializedResponseMatchesVariant)
+{
+    auto const variant_response_func = [](tr_session* /*session*/, tr_variant* response, void* setme)
+    {
+        *static_cast<std::string*>(setme) = tr_variantToStr(response, TR_VARIANT_FMT_JSON);
+    };
+
+    auto const serialized_response_func = [](tr_session* /*session*/, std::string_view json, void* setme)
+    {
+        // round-trip it through tr_variant so that the dict keys get sorted
+        auto response = tr_variant{};
+        EXPECT_TRUE(tr_variantFromBuf(&response, TR_VARIANT_PARSE_JSON, json));
+        *static_cast<std::string*>(setme) = tr_variantToStr(&response, TR_VARIANT_FMT_JSON);
+        tr_variantClear(&response);
+    };
+
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Partial);
+    EXPECT_NE(nullptr, tor);
+
+    for (auto const format : { "objects"sv, "table"sv })
+    {
+        auto request = tr_variant{};
+        tr_variantInitDict(&request, 3);
+        tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-get");
+        tr_variantDictAddInt(&request, TR_KEY_tag, 12345);
+        auto* const args = tr_variantDictAddDict(&request, TR_KEY_arguments, 2);
+        tr_variantDictAddStrView(args, TR_KEY_format, format);
+        auto* const fields = tr_variantDictAddList(args, TR_KEY_fields, 8);
+        for (auto const key : { "files"sv,
+                                "fileStats"sv,
+                                "hashString"sv,
+                                "id"sv,
+                                "name"sv,
+                                "peersFrom"sv,
+                                "percentDone"sv,
+                                "trackerStats"sv })
+        {
+            tr_variantListAddStrView(fields, key);
+        }
+
+        auto expected = std::string{};
+        tr_rpc_request_exec_json(session_, &request, variant_response_func, &expected);
+        auto actual = std::string{};
+        tr_rpc_request_exec_serialized(session_, &request, serialized_response_func, &actual);
+        tr_variantClear(&request);
+
+        EXPECT_FALSE(std::empty(expected));
+        EXPECT_EQ(expected, actual);
+    }
+
+    // methods that don't have a serializer of their own should still work
+    auto request = tr_variant{};
+    tr_variantInitDict(&request, 1);
+    tr_variantDictAddStrView(&request, TR_KEY_method, "free-space");
+    auto expected = std::string{};
+    tr_rpc_request_exec_json(session_, &request, variant_response_func, &expected);
+    auto actual = std::string{};
+    tr_rpc_request_exec_serialized(session_, &request, serialized_response_func, &actual);
+    tr_variantClear(&request);
+    EXPECT_FALSE(std::empty(expected));
+    EXPECT_EQ(expected, actual);
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_F(RpcTest, torrentGetSince)
+{
+    auto const rpc_response_func = [](tr_session* /*session*/, tr_variant* response, void* setme) noexcept
+    {
+        *static_cast<tr_variant*>(setme) = *response;
+        tr_variantInitBool(response, false);
+    };
+
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    EXPECT_NE(nullptr, tor);
+    auto const tor_id = tr_torrentId(tor);
+
+    // sends a delta torrent-get and returns its response arguments
+    auto response = tr_variant{};
+    auto const torrent_get_since = [&](int64_t since)
+    {
+        tr_variantClear(&response);
+        auto request = tr_variant{};
+        tr_variantInitDict(&request, 2);
+        tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-get");
+        auto* const args = tr_variantDictAddDict(&request, TR_KEY_arguments, 2);
+        tr_variantDictAddInt(args, TR_KEY_since, since);
+        auto* const fields = tr_variantDictAddList(args, TR_KEY_fields, 3);
+        tr_variantListAddStrView(fields, "id"sv);
+        tr_variantListAddStrView(fields, "name"sv);
+        tr_variantListAddStrView(fields, "peer-limit"sv);
+        tr_rpc_request_exec_json(session_, &request, rpc_response_func, &response);
+        tr_variantClear(&request);
+
+        tr_variant* args_out = nullptr;
+        EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &args_out));
+        return args_out;
+    };
+
+    auto const get_revision = [](tr_variant* args)
+    {
+        auto revision = int64_t{};
+        EXPECT_TRUE(tr_variantDictFindInt(args, TR_KEY_revision, &revision));
+        return revision;
+    };
+
+    auto const get_torrents = [](tr_variant* args)
+    {
+        tr_variant* torrents = nullptr;
+        EXPECT_TRUE(tr_variantDictFindList(args, TR_KEY_torrents, &torrents));
+        return torrents;
+    };
+
+    // since 0, everything is new
+    auto* args = torrent_get_since(0);
+    auto revision = get_revision(args);
+    EXPECT_GT(revision, 0);
+    auto* torrents = get_torrents(args);
+    EXPECT_EQ(1U, tr_variantListSize(torrents));
+    auto* tor_dict = tr_variantListChild(torrents, 0);
+    auto name = std::string_view{};
+    EXPECT_TRUE(tr_variantDictFindStrView(tor_dict, TR_KEY_name, &name));
+    EXPECT_TRUE(tr_variantDictFind(tor_dict, TR_KEY_peer_limit) != nullptr);
+
+    // nothing has changed
+    args = torrent_get_since(revision);
+    auto const prev_revision = revision;
+    revision = get_revision(args);
+    EXPECT_GT(revision, prev_revision);
+    EXPECT_EQ(0U, tr_variantListSize(get_torrents(args)));
+
+    // one field has changed; expect it and the id
+    tr_torrentSetPeerLimit(tor, tr_torrentGetPeerLimit(tor) + 1);
+    args = torrent_get_since(revision);
+    revision = get_revision(args);
+    torrents = get_torrents(args);
+    EXPECT_EQ(1U, tr_variantListSize(torrents));
+    tor_dict = tr_variantListChild(torrents, 0);
+    EXPECT_FALSE(tr_variantDictFindStrView(tor_dict, TR_KEY_name, &name));
+    auto i = int64_t{};
+    EXPECT_TRUE(tr_variantDictFindInt(tor_dict, TR_KEY_id, &i));
+    EXPECT_EQ(tor_id, i);
+    EXPECT_TRUE(tr_variantDictFindInt(tor_dict, TR_KEY_peer_limit, &i));
+    EXPECT_EQ(tr_torrentGetPeerLimit(tor), i);
+
+    // a revision from some other session, e.g. from before a restart,
+    // gets everything, the same as `since` 0
+    for (auto const stale : { revision + 1000, int64_t{ 1 } })
+    {
+        args = torrent_get_since(stale);
+        EXPECT_GT(get_revision(args), revision);
+        torrents = get_torrents(args);
+        EXPECT_EQ(1U, tr_variantListSize(torrents));
+        tor_dict = tr_variantListChild(torrents, 0);
+        EXPECT_TRUE(tr_variantDictFindStrView(tor_dict, TR_KEY_name, &name));
+        EXPECT_TRUE(tr_variantDictFind(tor_dict, TR_KEY_peer_limit) != nullptr);
+        revision = get_revision(args);
+    }
+
+    // the torrent has been removed
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+    EXPECT_TRUE(waitFor([this, tor_id]() { return session_->torrents().get(tor_id) == nullptr; }, 5000));
+    args = torrent_get_since(revision);
+    EXPECT_EQ(0U, tr_variantListSize(get_torrents(args)));
+    tr_variant* removed = nullptr;
+    EXPECT_TRUE(tr_variantDictFindList(args, TR_KEY_removed, &removed));
+    EXPECT_EQ(1U, tr_variantListSize(removed));
+    EXPECT_TRUE(tr_variantGetInt(tr_variantListChild(removed, 0), &i));
+    EXPECT_EQ(tor_id, i);
+
+    tr_variantClear(&response);
+}
+
 } // namespace libtransmission::test
@@ -341,6 +341,38 @@ TEST_F(UtilsTest, saveFile)
     tr_error_clear(&error);
 }
 
+TEST_F(UtilsTest, mappedFile)
+{
+    auto const filename = tr_pathbuf{ ::testing::TempDir(), "mapped.txt"sv };
+    auto const contents = "these are the contents"sv;
+    tr_error* error = nullptr;
+    EXPECT_TRUE(tr_saveFile(filename.sv(), contents, &error));
+    EXPECT_EQ(nullptr, error) << *error;
+
+    auto file = tr_mapped_file{};
+    EXPECT_TRUE(file.load(filename.sv(), &error));
+    EXPECT_EQ(nullptr, error) << *error;
+    EXPECT_EQ(contents, file.sv());
+
+    // the mapping moves with the object
+    auto const moved = std::move(file);
+    EXPECT_EQ(contents, moved.sv());
+    EXPECT_TRUE(std::empty(file.sv())); // NOLINT(bugprone-use-after-move)
+
+    // an empty file has nothing to map, but isn't an error
+    EXPECT_TRUE(tr_saveFile(filename.sv(), ""sv, &error));
+    EXPECT_TRUE(file.load(filename.sv(), &error));
+    EXPECT_EQ(nullptr, error) << *error;
+    EXPECT_TRUE(std::empty(file.sv()));
+
+    EXPECT_TRUE(tr_sys_path_remove(filename, &error));
+    EXPECT_EQ(nullptr, error) << *error;
+
+    EXPECT_FALSE(file.load(filename.sv(), &error));
+    ASSERT_NE(nullptr, error);
+    tr_error_clear(&error);
+}
+
 TEST_F(UtilsTest, ratioToString)
 {
     // Testpairs contain ratio as a double and a string
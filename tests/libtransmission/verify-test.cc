@@ -0,0 +1,204 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef> // size_t
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/crypto-utils.h>
+#include <libtransmission/makemeta.h>
+#include <libtransmission/torrent.h>
+#include <libtransmission/tr-strbuf.h>
+#include <libtransmission/utils.h>
+#include <libtransmission/verify.h>
+
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission::test
+{
+
+class VerifyTest : public SessionTest
+{
+protected:
+    static auto constexpr MaxWaitMsec = 20000;
+    static auto constexpr PayloadSize = size_t{ 1024U * 1024U };
+
+    // Pretend that the sandbox's `a` and `b` subdirectories are on different devices
+    static std::string fakeDeviceKey(std::string_view path)
+    {
+        return tr_strvContains(path, "/b/"sv) || tr_strvEndsWith(path, "/b"sv) ? "b" : "a";
+    }
+
+    // Pretend that everything is on one device
+    static std::string oneDeviceKey(std::string_view /*path*/)
+    {
+        return "a";
+    }
+
+    // A complete single-file torrent of random data, downloaded into the sandbox's `dirname` subdirectory
+    tr_torrent* makeTorrent(std::string_view dirname, std::string_view filename)
+    {
+        auto const dir = tr_pathbuf{ sandboxDir(), '/', dirname };
+        auto const path = tr_pathbuf{ dir, '/', filename };
+        auto payload = std::vector<std::byte>(PayloadSize);
+        tr_rand_buffer(std::data(payload), std::size(payload));
+        createFileWithContents(path, std::data(payload), std::size(payload));
+
+        auto builder = tr_metainfo_builder{ path };
+        tr_error* error = builder.makeChecksums().get();
+        EXPECT_EQ(nullptr, error) << *error;
+        auto const benc = builder.benc();
+
+        auto* const ctor = tr_ctorNew(session_);
+        EXPECT_TRUE(tr_ctorSetMetainfo(ctor, std::data(benc), std::size(benc), &error));
+        EXPECT_EQ(nullptr, error) << *error;
+        tr_ctorSetPaused(ctor, TR_FORCE, true);
+        tr_ctorSetDownloadDir(ctor, TR_FORCE, dir.c_str());
+        auto* const tor = createTorrentAndWaitForVerifyDone(ctor);
+        tr_ctorFree(ctor);
+
+        EXPECT_NE(nullptr, tor);
+        EXPECT_TRUE(tor->isDone());
+        return tor;
+    }
+
+    void addCallbacks(tr_verify_worker& worker)
+    {
+        worker.addCallback(
+            [this](tr_torrent* tor, bool aborted)
+            {
+                auto const lock = std::lock_guard{ done_mutex_ };
+                done_.emplace_back(tor, aborted);
+            });
+    }
+
+    [[nodiscard]] auto done()
+    {
+        auto const lock = std::lock_guard{ done_mutex_ };
+        return done_;
+    }
+
+    // @return the most torrents that were being verified at once
+    // until `n_done` torrents were done
+    [[nodiscard]] size_t watchVerify(std::vector<tr_torrent*> const& torrents, size_t n_done)
+    {
+        auto max_active = size_t{};
+        auto const is_done = [&]()
+        {
+            auto const n_active = std::count_if(
+                std::begin(torrents),
+                std::end(torrents),
+                [](auto const* tor) { return tor->verifyState() == TR_VERIFY_NOW; });
+            max_active = std::max(max_active, static_cast<size_t>(n_active));
+            return std::size(done()) >= n_done;
+        };
+
+        auto const deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds{ MaxWaitMsec };
+        while (!is_done() && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(1ms);
+        }
+
+        return max_active;
+    }
+
+private:
+    std::mutex done_mutex_;
+    std::vector<std::pair<tr_torrent*, bool /*aborted*/>> done_;
+};
+
+TEST_F(VerifyTest, verifiesOneTorrentAtATimePerDevice)
+{
+    auto* const tor1 = makeTorrent("a"sv, "one"sv);
+    auto* const tor2 = makeTorrent("a"sv, "two"sv);
+
+    auto worker = tr_verify_worker{ oneDeviceKey };
+    addCallbacks(worker);
+    worker.setMaxThreads(4U);
+    worker.setMaxThreadsPerDevice(1U);
+    // slow enough that the verifies would overlap if they could
+    worker.setSpeedLimitBytesPerSecond(PayloadSize * 2U);
+
+    worker.add(tor1);
+    worker.add(tor2);
+
+    EXPECT_EQ(1U, watchVerify({ tor1, tor2 }, 2U));
+    EXPECT_EQ(2U, std::size(done()));
+    EXPECT_TRUE(tor1->isDone());
+    EXPECT_TRUE(tor2->isDone());
+}
+
+TEST_F(VerifyTest, verifiesTorrentsOnDifferentDevicesAtOnce)
+{
+    auto* const tor1 = makeTorrent("a"sv, "one"sv);
+    auto* const tor2 = makeTorrent("b"sv, "two"sv);
+
+    auto worker = tr_verify_worker{ fakeDeviceKey };
+    addCallbacks(worker);
+    worker.setMaxThreads(4U);
+    worker.setMaxThreadsPerDevice(1U);
+    worker.setSpeedLimitBytesPerSecond(PayloadSize * 2U);
+
+    worker.add(tor1);
+    worker.add(tor2);
+
+    EXPECT_EQ(2U, watchVerify({ tor1, tor2 }, 2U));
+    EXPECT_EQ(2U, std::size(done()));
+    EXPECT_TRUE(tor1->isDone());
+    EXPECT_TRUE(tor2->isDone());
+}
+
+TEST_F(VerifyTest, removeStopsAnActiveVerify)
+{
+    auto* const tor = makeTorrent("a"sv, "one"sv);
+
+    auto worker = tr_verify_worker{ oneDeviceKey };
+    addCallbacks(worker);
+    // about four seconds' worth of reading
+    worker.setSpeedLimitBytesPerSecond(PayloadSize / 4U);
+
+    worker.add(tor);
+    EXPECT_TRUE(waitFor([tor]() { return tor->verifyState() == TR_VERIFY_NOW; }, MaxWaitMsec));
+
+    // remove() returns once the verify has stopped,
+    // so the callback must already have been called
+    worker.remove(tor);
+    auto const results = done();
+    ASSERT_EQ(1U, std::size(results));
+    EXPECT_EQ(tor, results.front().first);
+    EXPECT_TRUE(results.front().second);
+    EXPECT_EQ(TR_VERIFY_NONE, tor->verifyState());
+}
+
+TEST_F(VerifyTest, speedLimitSlowsVerifyDown)
+{
+    auto* const tor = makeTorrent("a"sv, "one"sv);
+
+    auto worker = tr_verify_worker{ oneDeviceKey };
+    addCallbacks(worker);
+    // reads are at most 256 KiB, so the last one can't start until 750 msec in
+    worker.setSpeedLimitBytesPerSecond(PayloadSize);
+
+    auto const begin = std::chrono::steady_clock::now();
+    worker.add(tor);
+    EXPECT_TRUE(waitFor([this]() { return !std::empty(done()); }, MaxWaitMsec));
+    auto const elapsed = std::chrono::steady_clock::now() - begin;
+
+    EXPECT_GE(elapsed, 700ms);
+    EXPECT_FALSE(done().front().second);
+    EXPECT_TRUE(tor->isDone());
+}
+
+} // namespace libtransmission::test
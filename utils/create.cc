@@ -4,6 +4,7 @@
 // License text can be found in the licenses/ folder.
 
 #include <array>
+#include <cstddef> // for size_t
 #include <cstdlib> // for strtoul()
 #include <chrono>
 #include <cstdint> // for uint32_t
@@ -35,7 +36,10 @@ char constexpr Usage[] = "Usage: transmission-create [options] <file|directory>"
 
 uint32_t constexpr KiB = 1024;
 
-auto constexpr Options = std::array<tr_option, 10>{
+// more than enough for any machine; mostly here to catch typos
+size_t constexpr MaxThreads = 1024;
+
+auto constexpr Options = std::array<tr_option, 11>{
     { { 'p', "private", "Allow this torrent to only be used with the specified tracker(s)", "p", false, nullptr },
       { 'r', "source", "Set the source for private trackers", "r", true, "<source>" },
       { 'o', "outfile", "Save the generated .torrent to this filename", "o", true, "<file>" },
@@ -43,6 +47,7 @@ auto constexpr Options = std::array<tr_option, 10>{
       { 'c', "comment", "Add a comment", "c", true, "<comment>" },
       { 't', "tracker", "Add a tracker's announce URL", "t", true, "<url>" },
       { 'w', "webseed", "Add a webseed URL", "w", true, "<url>" },
+      { 'j', "threads", "Hash pieces with this many threads (default: one per CPU core)", "j", true, "<count>" },
       { 'x', "anonymize", "Omit \"Creation date\" and \"Created by\" info", nullptr, false, nullptr },
       { 'V', "version", "Show version number and exit", "V", false, nullptr },
       { 0, nullptr, nullptr, nullptr, false, nullptr } }
@@ -57,6 +62,7 @@ struct app_options
     std::string_view infile;
     std::string_view source;
     uint32_t piece_size = 0;
+    size_t threads = 0;
     bool anonymize = false;
     bool is_private = false;
     bool show_version = false;
@@ -107,6 +113,20 @@ int parseCommandLine(app_options& options, int argc, char const* const* argv)
             }
             break;
 
+        case 'j':
+            {
+                auto remainder = std::string_view{};
+                auto const n = tr_parseNum<size_t>(optarg, &remainder);
+                if (!n || !std::empty(remainder) || *n < 1U || *n > MaxThreads)
+                {
+                    fprintf(stderr, "ERROR: Thread count must be a number from 1 to %zu\n", MaxThreads);
+                    return 1;
+                }
+
+                options.threads = *n;
+            }
+            break;
+
         case 'r':
             options.source = optarg;
             break;
@@ -247,6 +267,7 @@ int tr_main(int argc, char* argv[])
 
     builder.setPrivate(options.is_private);
     builder.setAnonymize(options.anonymize);
+    builder.setChecksumThreads(options.threads);
     builder.setWebseeds(std::move(options.webseeds));
     builder.setAnnounceList(std::move(options.trackers));
 